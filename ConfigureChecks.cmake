@@ -14,10 +14,19 @@ CHECK_INCLUDE_FILE(libgen.h HAVE_LIBGEN_H)
 CHECK_INCLUDE_FILE(unistd.h HAVE_UNISTD_H)
 CHECK_INCLUDE_FILE(direct.h HAVE_DIRECT_H)
 CHECK_INCLUDE_FILE(stdint.h HAVE_STDINT_H)
+CHECK_INCLUDE_FILE(sys/stat.h HAVE_SYS_STAT_H)
+CHECK_INCLUDE_FILE(sys/mman.h HAVE_SYS_MMAN_H)
+CHECK_INCLUDE_FILE(pthread.h HAVE_PTHREAD_H)
 
 CHECK_SYMBOL_EXISTS(abort "stdlib.h" HAVE_ABORT)
 
+CHECK_FUNCTION_EXISTS(fileno HAVE_FILENO)
+CHECK_FUNCTION_EXISTS(fopencookie HAVE_FOPENCOOKIE)
+CHECK_FUNCTION_EXISTS(fseeko HAVE_FSEEKO)
 CHECK_FUNCTION_EXISTS(getcwd HAVE_GETCWD)
+CHECK_FUNCTION_EXISTS(gettimeofday HAVE_GETTIMEOFDAY)
+CHECK_FUNCTION_EXISTS(mmap HAVE_MMAP)
+CHECK_FUNCTION_EXISTS(open_memstream HAVE_OPEN_MEMSTREAM)
 CHECK_FUNCTION_EXISTS(toascii HAVE_TOASCII)
 
 CHECK_LIBRARY_EXISTS(dl dlopen "" HAVE_LIBDL)
@@ -28,6 +37,14 @@ ELSE (HAVE_LIBDL)
     SET(LIBDL "")
 ENDIF (HAVE_LIBDL)
 
+# Thread support (used for parallel output)
+FIND_PACKAGE(Threads)
+IF (CMAKE_USE_PTHREADS_INIT AND HAVE_PTHREAD_H)
+    SET(HAVE_PTHREAD 1)
+ENDIF (CMAKE_USE_PTHREADS_INIT AND HAVE_PTHREAD_H)
+CHECK_C_SOURCE_COMPILES("__thread int x; int main(void) { return x; }"
+                        HAVE___THREAD)
+
 CONFIGURE_FILE(libyasm-stdint.h.cmake
                ${CMAKE_CURRENT_BINARY_DIR}/libyasm-stdint.h)
 CONFIGURE_FILE(config.h.cmake ${CMAKE_CURRENT_BINARY_DIR}/config.h)
@@ -31,6 +31,9 @@ call :update %1 x86insn_nasm.gperf x86insn_nasm.c
 call :update %1 x86insn_gas.gperf x86insn_gas.c
 call :update %1 modules\arch\x86\x86cpu.gperf x86cpu.c
 call :update %1 modules\arch\x86\x86regtmod.gperf x86regtmod.c
+call :update %1 libyasm\objdirs.gperf objdirs.c
+call :update %1 modules\parsers\gas\gas-dirs.gperf gas-dirs.c
+call :update %1 modules\preprocs\nasm\nasm-ppdir.gperf nasm-ppdir.c
 goto :eof
 
 :update
@@ -20,3 +20,6 @@ call %_python_% modules\arch\x86\gen_x86_insn.py
 %1 x86insn_gas.gperf x86insn_gas.c
 %1 modules\arch\x86\x86cpu.gperf x86cpu.c
 %1 modules\arch\x86\x86regtmod.gperf x86regtmod.c
+%1 libyasm\objdirs.gperf objdirs.c
+%1 modules\parsers\gas\gas-dirs.gperf gas-dirs.c
+%1 modules\preprocs\nasm\nasm-ppdir.gperf nasm-ppdir.c
@@ -2,6 +2,32 @@
 
 #define CMAKE_BUILD 1
 
+/* Enable POSIX and platform extensions (as AC_USE_SYSTEM_EXTENSIONS does);
+ * the compiler may be run in strict ANSI mode.
+ */
+#ifndef _ALL_SOURCE
+# define _ALL_SOURCE 1
+#endif
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE 1
+#endif
+#ifndef _POSIX_PTHREAD_SEMANTICS
+# define _POSIX_PTHREAD_SEMANTICS 1
+#endif
+#ifndef _TANDEM_SOURCE
+# define _TANDEM_SOURCE 1
+#endif
+#ifndef __EXTENSIONS__
+# define __EXTENSIONS__ 1
+#endif
+
+/* Use 64-bit file offsets (off_t, fseeko) on hosts where they are optional,
+ * as AC_SYS_LARGEFILE does.
+ */
+#ifndef _FILE_OFFSET_BITS
+# define _FILE_OFFSET_BITS 64
+#endif
+
 /* Define if shared libs are being built */
 #cmakedefine BUILD_SHARED_LIBS 1
 
@@ -20,9 +46,39 @@
 /* Define to 1 if you have the <direct.h> header file. */
 #cmakedefine HAVE_DIRECT_H 1
 
+/* Define to 1 if you have the <sys/stat.h> header file. */
+#cmakedefine HAVE_SYS_STAT_H 1
+
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
+/* Define to 1 if you have POSIX threads (and <pthread.h>). */
+#cmakedefine HAVE_PTHREAD 1
+
+/* Define to 1 if the compiler supports __thread thread-local storage. */
+#cmakedefine HAVE___THREAD 1
+
+/* Define to 1 if you have the `fileno' function. */
+#cmakedefine HAVE_FILENO 1
+
+/* Define to 1 if you have the `fopencookie' function. */
+#cmakedefine HAVE_FOPENCOOKIE 1
+
+/* Define to 1 if fseeko (and presumably ftello) exists and is declared. */
+#cmakedefine HAVE_FSEEKO 1
+
 /* Define to 1 if you have the `getcwd' function. */
 #cmakedefine HAVE_GETCWD 1
 
+/* Define to 1 if you have the `gettimeofday' function. */
+#cmakedefine HAVE_GETTIMEOFDAY 1
+
+/* Define to 1 if you have the `mmap' function. */
+#cmakedefine HAVE_MMAP 1
+
+/* Define to 1 if you have the `open_memstream' function. */
+#cmakedefine HAVE_OPEN_MEMSTREAM 1
+
 /* Define to 1 if you have the `toascii' function. */
 #cmakedefine HAVE_TOASCII 1
 
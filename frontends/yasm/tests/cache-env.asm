@@ -0,0 +1 @@
+db %!YASM_CACHE_TEST
@@ -0,0 +1,95 @@
+#! /bin/sh
+# Check that --cache-dir never returns stale outputs when something besides
+# the files read changes: a file appearing earlier in the include path, or
+# an environment variable the source looks up with %!.
+
+case `echo "testing\c"; echo 1,2,3`,`echo -n testing; echo 1,2,3` in
+  *c*,-n*) ECHO_N= ECHO_C='
+' ECHO_T='	' ;;
+  *c*,*  ) ECHO_N=-n ECHO_C= ECHO_T= ;;
+  *)       ECHO_N= ECHO_C='\c' ECHO_T= ;;
+esac
+
+mkdir results >/dev/null 2>&1
+rm -rf results/cache
+mkdir results/cache results/cache/d1 results/cache/d2
+
+passedct=0
+failedct=0
+
+pass() {
+    echo $ECHO_N ".$ECHO_C"
+    passedct=`expr $passedct + 1`
+}
+
+fail() {
+    echo $ECHO_N "F$ECHO_C"
+    eval "failed$failedct='$1'"
+    failedct=`expr $failedct + 1`
+}
+
+# Assemble with and without the cache; the outputs must match.  The
+# output name is part of the cache key, so it is the same for every run.
+check() {
+    name=$1
+    shift
+    ./yasm -f elf32 --cache-dir=results/cache/entries \
+        -o results/cache/cached.o "$@" 2>/dev/null
+    ./yasm -f elf32 -o results/cache/nocache.o "$@" 2>/dev/null
+    if cmp results/cache/cached.o results/cache/nocache.o \
+        >/dev/null 2>&1; then
+        pass
+    else
+        fail "${name}: cached output is stale"
+    fi
+}
+
+dir=${srcdir}/frontends/yasm/tests
+inc="-I results/cache/d1/ -I results/cache/d2/"
+
+echo $ECHO_N "Test cache_test: $ECHO_C"
+
+echo "db 2" > results/cache/d2/cache-inc.inc
+check inc-d2 $inc ${dir}/cache-inc.asm
+if ls results/cache/entries/*/*.manifest >/dev/null 2>&1; then
+    pass
+else
+    fail "inc-d2: no cache entry stored"
+fi
+check inc-d2-again $inc ${dir}/cache-inc.asm
+
+# A file earlier in the include path now shadows the one used before
+echo "db 1" > results/cache/d1/cache-inc.inc
+check inc-d1 $inc ${dir}/cache-inc.asm
+
+YASM_CACHE_TEST=1
+export YASM_CACHE_TEST
+check env-1 ${dir}/cache-env.asm
+YASM_CACHE_TEST=2
+check env-2 ${dir}/cache-env.asm
+
+# Options that only affect reporting must share one cache entry, whether
+# their values are attached or given as the next argument
+for threads in --threads=2 "--threads 4" "--threads 8"; do
+    ./yasm -f elf32 --cache-dir=results/cache/threads $threads \
+        -o results/cache/cached.o ${dir}/cache-env.asm 2>/dev/null
+done
+if test `ls results/cache/threads/*/*.manifest 2>/dev/null | wc -l` -eq 1
+then
+    pass
+else
+    fail "threads: values of --threads split the cache"
+fi
+
+ct=`expr $failedct + $passedct`
+per=`expr 100 \* $passedct / $ct`
+
+echo " +$passedct-$failedct/$ct $per%"
+i=0
+while test $i -lt $failedct; do
+    eval "failure=\$failed$i"
+    echo " ** $failure"
+    i=`expr $i + 1`
+done
+
+exit $failedct
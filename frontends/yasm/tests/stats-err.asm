@@ -0,0 +1 @@
+dd undefined_symbol
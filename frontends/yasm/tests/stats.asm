@@ -0,0 +1,2 @@
+db 1, 2, 3
+label: dd label
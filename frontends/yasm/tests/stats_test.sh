@@ -0,0 +1,74 @@
+#! /bin/sh
+# Check that --stats reports the phase table and does not change the exit
+# status of an assembly, either when it succeeds or when it fails.
+
+case `echo "testing\c"; echo 1,2,3`,`echo -n testing; echo 1,2,3` in
+  *c*,-n*) ECHO_N= ECHO_C='
+' ECHO_T='	' ;;
+  *c*,*  ) ECHO_N=-n ECHO_C= ECHO_T= ;;
+  *)       ECHO_N= ECHO_C='\c' ECHO_T= ;;
+esac
+
+mkdir results >/dev/null 2>&1
+
+passedct=0
+failedct=0
+
+pass() {
+    echo $ECHO_N ".$ECHO_C"
+    passedct=`expr $passedct + 1`
+}
+
+fail() {
+    echo $ECHO_N "F$ECHO_C"
+    eval "failed$failedct='$1'"
+    failedct=`expr $failedct + 1`
+}
+
+header='^phase  *time (s)  *allocs  *alloc bytes$'
+
+echo $ECHO_N "Test stats_test: $ECHO_C"
+for a in stats stats-err
+do
+    asm=${srcdir}/frontends/yasm/tests/${a}.asm
+
+    ./yasm -f bin -o results/${a}.bin ${asm} 2>/dev/null
+    status=$?
+    ./yasm --stats -f bin -o results/${a}-stats.bin ${asm} \
+        2>results/${a}.stats
+    stats_status=$?
+
+    if test $status -eq $stats_status; then
+        pass
+    else
+        fail "${a}: exit status $stats_status with --stats, $status without"
+    fi
+
+    if grep "$header" results/${a}.stats >/dev/null \
+        && grep '^total ' results/${a}.stats >/dev/null \
+        && grep '^bytecodes ' results/${a}.stats >/dev/null; then
+        pass
+    else
+        fail "${a}: --stats table missing"
+    fi
+done
+
+# Output must not depend on --stats
+if cmp results/stats.bin results/stats-stats.bin >/dev/null 2>&1; then
+    pass
+else
+    fail "stats: output differs with --stats"
+fi
+
+ct=`expr $failedct + $passedct`
+per=`expr 100 \* $passedct / $ct`
+
+echo " +$passedct-$failedct/$ct $per%"
+i=0
+while test $i -lt $failedct; do
+    eval "failure=\$failed$i"
+    echo " ** $failure"
+    i=`expr $i + 1`
+done
+
+exit $failedct
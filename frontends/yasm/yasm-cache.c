@@ -0,0 +1,504 @@
+/*
+ * Object cache
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <util.h>
+
+#include <libyasm/compat-queue.h>
+#include <libyasm.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "yasm-cache.h"
+
+/* An entry is stored as <dir>/<first 2 hex digits of key>/<rest of key>
+ * with the extensions below.  The manifest is written last, so an entry
+ * without one (or with an out-of-date one) is never used.  The manifest
+ * lists the digest of each output, then each dependency as one of:
+ *   dep <digest> <filename>    file with the given contents
+ *   absent <filename>          file that must not exist
+ *   env <digest> <name>        environment variable with the given value
+ */
+#define MANIFEST_MAGIC  "yasm-objcache 2"
+#define EXT_MANIFEST    ".manifest"
+#define EXT_OBJ         ".obj"
+#define EXT_LIST        ".lst"
+
+#define COPY_BUF_SIZE   16384
+
+typedef enum objcache_dep_kind {
+    DEP_FILE = 0,
+    DEP_ABSENT,
+    DEP_ENV
+} objcache_dep_kind;
+
+typedef struct objcache_dep {
+    STAILQ_ENTRY(objcache_dep) link;
+    objcache_dep_kind kind;
+    unsigned char digest[16];   /* unused for DEP_ABSENT */
+    /*@only@*/ char *filename;  /* variable name for DEP_ENV */
+} objcache_dep;
+
+struct objcache {
+    /*@only@*/ char *base;      /* entry pathname, without extension */
+    STAILQ_HEAD(objcache_deps, objcache_dep) deps;
+};
+
+/* Digest the contents of an open file.  Returns 0 on read error. */
+static int
+md5_stream(FILE *f, unsigned char digest[16])
+{
+    yasm_md5_context ctx;
+    unsigned char *buf = yasm_xmalloc(COPY_BUF_SIZE);
+    size_t got;
+
+    yasm_md5_init(&ctx);
+    while ((got = fread(buf, 1, COPY_BUF_SIZE, f)) > 0)
+        yasm_md5_update(&ctx, buf, (unsigned long)got);
+    yasm_md5_final(digest, &ctx);
+    yasm_xfree(buf);
+    return !ferror(f);
+}
+
+static int
+md5_file(const char *filename, unsigned char digest[16])
+{
+    FILE *f = fopen(filename, "rb");
+    int ok;
+
+    if (!f)
+        return 0;
+    ok = md5_stream(f, digest);
+    fclose(f);
+    return ok;
+}
+
+/* Digest the value of an environment variable.  An unset variable gets a
+ * digest no value will have.
+ */
+static void
+md5_env(const char *name, unsigned char digest[16])
+{
+    yasm_md5_context ctx;
+    const char *val = getenv(name);
+
+    if (!val) {
+        memset(digest, 0, 16);
+        return;
+    }
+    yasm_md5_init(&ctx);
+    yasm_md5_update(&ctx, (const unsigned char *)val,
+                    (unsigned long)strlen(val)+1);
+    yasm_md5_final(digest, &ctx);
+}
+
+/* Copy a file, digesting the contents on the way.  A partially written
+ * destination is removed.  Returns 0 on failure.
+ */
+static int
+copy_file(const char *from, const char *to, unsigned char digest[16])
+{
+    yasm_md5_context ctx;
+    unsigned char *buf;
+    FILE *in, *out;
+    size_t got;
+    int ok = 1;
+
+    in = fopen(from, "rb");
+    if (!in)
+        return 0;
+    out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return 0;
+    }
+
+    buf = yasm_xmalloc(COPY_BUF_SIZE);
+    yasm_md5_init(&ctx);
+    while ((got = fread(buf, 1, COPY_BUF_SIZE, in)) > 0) {
+        yasm_md5_update(&ctx, buf, (unsigned long)got);
+        if (fwrite(buf, 1, got, out) != got) {
+            ok = 0;
+            break;
+        }
+    }
+    yasm_md5_final(digest, &ctx);
+    yasm_xfree(buf);
+
+    if (ferror(in))
+        ok = 0;
+    fclose(in);
+    if (fclose(out) != 0)
+        ok = 0;
+    if (!ok)
+        remove(to);
+    return ok;
+}
+
+static void
+digest_to_hex(const unsigned char digest[16], /*@out@*/ char hex[33])
+{
+    static const char digits[] = "0123456789abcdef";
+    int i;
+
+    for (i=0; i<16; i++) {
+        hex[i*2] = digits[digest[i] >> 4];
+        hex[i*2+1] = digits[digest[i] & 0xf];
+    }
+    hex[32] = '\0';
+}
+
+/* Compare a hex string (as written by digest_to_hex) against a digest. */
+static int
+hex_matches(const char *hex, const unsigned char digest[16])
+{
+    char expect[33];
+
+    digest_to_hex(digest, expect);
+    return strncmp(hex, expect, 32) == 0;
+}
+
+static /*@only@*/ char *
+entry_path(const objcache *cache, const char *ext)
+{
+    char *path = yasm_xmalloc(strlen(cache->base)+strlen(ext)+1);
+    strcpy(path, cache->base);
+    strcat(path, ext);
+    return path;
+}
+
+/* Name of a private temporary file next to path. */
+static /*@only@*/ char *
+temp_path(const char *path)
+{
+    char *tmp = yasm_xmalloc(strlen(path)+32);
+#ifdef HAVE_UNISTD_H
+    sprintf(tmp, "%s.tmp%lu", path, (unsigned long)getpid());
+#else
+    sprintf(tmp, "%s.tmp", path);
+#endif
+    return tmp;
+}
+
+/* Move tmp over path, replacing any existing file. */
+static int
+replace_file(const char *tmp, const char *path)
+{
+    if (rename(tmp, path) == 0)
+        return 1;
+    /* Windows rename() does not replace an existing file */
+    remove(path);
+    if (rename(tmp, path) == 0)
+        return 1;
+    remove(tmp);
+    return 0;
+}
+
+/* Read a whole line (without the newline) into a growing buffer.  Returns
+ * 0 at end of file.
+ */
+static int
+read_line(FILE *f, char **buf, size_t *size)
+{
+    size_t len = 0;
+
+    for (;;) {
+        if (!fgets(*buf+len, (int)(*size-len), f))
+            return len > 0;
+        len += strlen(*buf+len);
+        if (len > 0 && (*buf)[len-1] == '\n') {
+            (*buf)[len-1] = '\0';
+            return 1;
+        }
+        if (len+1 < *size)
+            return 1;   /* last line without newline */
+        *size *= 2;
+        *buf = yasm_xrealloc(*buf, *size);
+    }
+}
+
+objcache *
+objcache_create(const char *dir, const yasm_md5_context *key,
+                const char *in_filename)
+{
+    yasm_md5_context ctx = *key;
+    unsigned char digest[16];
+    char hex[33];
+    objcache *cache;
+    FILE *f;
+    int ok;
+    size_t dirlen = strlen(dir);
+
+    f = fopen(in_filename, "rb");
+    if (!f)
+        return NULL;
+    ok = md5_stream(f, digest);
+    fclose(f);
+    if (!ok)
+        return NULL;
+
+    /* The key proper is the option digest followed by the input digest */
+    yasm_md5_update(&ctx, digest, 16);
+    yasm_md5_final(digest, &ctx);
+    digest_to_hex(digest, hex);
+
+    cache = yasm_xmalloc(sizeof(objcache));
+    cache->base = yasm_xmalloc(dirlen+1+2+1+30+1);
+    strcpy(cache->base, dir);
+    if (dirlen > 0 && dir[dirlen-1] != '/' && dir[dirlen-1] != '\\')
+        strcat(cache->base, "/");
+    strncat(cache->base, hex, 2);
+    strcat(cache->base, "/");
+    strcat(cache->base, hex+2);
+    STAILQ_INIT(&cache->deps);
+    return cache;
+}
+
+void
+objcache_destroy(objcache *cache)
+{
+    objcache_dep *dep, *next;
+
+    dep = STAILQ_FIRST(&cache->deps);
+    while (dep) {
+        next = STAILQ_NEXT(dep, link);
+        yasm_xfree(dep->filename);
+        yasm_xfree(dep);
+        dep = next;
+    }
+    yasm_xfree(cache->base);
+    yasm_xfree(cache);
+}
+
+int
+objcache_lookup(objcache *cache, const char *obj_filename,
+                const char *list_filename)
+{
+    char obj_hex[33] = "", list_hex[33] = "";
+    unsigned char digest[16];
+    char *path, *line;
+    size_t size = 256;
+    FILE *f;
+    int hit = 1;
+
+    path = entry_path(cache, EXT_MANIFEST);
+    f = fopen(path, "rt");
+    yasm_xfree(path);
+    if (!f)
+        return 0;
+
+    line = yasm_xmalloc(size);
+    if (!read_line(f, &line, &size) || strcmp(line, MANIFEST_MAGIC) != 0)
+        hit = 0;
+    while (hit && read_line(f, &line, &size)) {
+        if (strlen(line) < 4+32)
+            hit = 0;
+        else if (strncmp(line, "obj ", 4) == 0)
+            strncpy(obj_hex, line+4, 32);
+        else if (strncmp(line, "lst ", 4) == 0)
+            strncpy(list_hex, line+4, 32);
+        else if (strncmp(line, "dep ", 4) == 0 && line[4+32] == ' ') {
+            if (!md5_file(line+4+32+1, digest) || !hex_matches(line+4, digest))
+                hit = 0;
+        } else if (strncmp(line, "env ", 4) == 0 && line[4+32] == ' ') {
+            md5_env(line+4+32+1, digest);
+            if (!hex_matches(line+4, digest))
+                hit = 0;
+        } else if (strncmp(line, "absent ", 7) == 0) {
+            FILE *dep = fopen(line+7, "rb");
+            if (dep) {
+                fclose(dep);
+                hit = 0;
+            }
+        } else
+            hit = 0;
+    }
+    yasm_xfree(line);
+    fclose(f);
+
+    if (!hit || obj_hex[0] == '\0' || (list_hex[0] != '\0') !=
+        (list_filename != NULL))
+        return 0;
+
+    /* Dependencies are unchanged; copy out the outputs, checking them
+     * against the manifest in case the entry was overwritten partway.
+     */
+    path = entry_path(cache, EXT_OBJ);
+    hit = copy_file(path, obj_filename, digest) && hex_matches(obj_hex, digest);
+    yasm_xfree(path);
+    if (hit && list_filename) {
+        path = entry_path(cache, EXT_LIST);
+        hit = copy_file(path, list_filename, digest) &&
+            hex_matches(list_hex, digest);
+        yasm_xfree(path);
+    }
+    if (!hit) {
+        remove(obj_filename);
+        if (list_filename)
+            remove(list_filename);
+    }
+    return hit;
+}
+
+static void
+add_dep(objcache *cache, objcache_dep_kind kind, const char *filename,
+        const unsigned char digest[16])
+{
+    objcache_dep *dep;
+
+    /* Probes and lookups tend to repeat; one record of each is enough */
+    if (kind != DEP_FILE) {
+        STAILQ_FOREACH(dep, &cache->deps, link) {
+            if (dep->kind == kind && strcmp(dep->filename, filename) == 0)
+                return;
+        }
+    }
+
+    dep = yasm_xmalloc(sizeof(objcache_dep));
+    dep->kind = kind;
+    memcpy(dep->digest, digest, 16);
+    dep->filename = yasm__xstrdup(filename);
+    STAILQ_INSERT_TAIL(&cache->deps, dep, link);
+}
+
+void
+objcache_add_dep(objcache *cache, const char *filename)
+{
+    unsigned char digest[16];
+
+    /* An unreadable dependency can't be validated later; make sure the
+     * entry never matches by recording a digest no file will have.
+     */
+    if (!md5_file(filename, digest))
+        memset(digest, 0, 16);
+    add_dep(cache, DEP_FILE, filename, digest);
+}
+
+void
+objcache_add_dep_data(objcache *cache, const char *filename,
+                      const unsigned char *data, unsigned long len)
+{
+    yasm_md5_context ctx;
+    unsigned char digest[16];
+
+    yasm_md5_init(&ctx);
+    yasm_md5_update(&ctx, data, len);
+    yasm_md5_final(digest, &ctx);
+    add_dep(cache, DEP_FILE, filename, digest);
+}
+
+void
+objcache_add_absent(objcache *cache, const char *filename)
+{
+    static const unsigned char none[16] = {0};
+    add_dep(cache, DEP_ABSENT, filename, none);
+}
+
+void
+objcache_add_env(objcache *cache, const char *name)
+{
+    unsigned char digest[16];
+
+    md5_env(name, digest);
+    add_dep(cache, DEP_ENV, name, digest);
+}
+
+/* Copy an output into the entry.  Returns 0 on failure. */
+static int
+store_output(objcache *cache, const char *filename, const char *ext,
+             /*@out@*/ char hex[33])
+{
+    unsigned char digest[16];
+    char *path = entry_path(cache, ext);
+    char *tmp = temp_path(path);
+    int ok;
+
+    ok = copy_file(filename, tmp, digest) && replace_file(tmp, path);
+    digest_to_hex(digest, hex);
+    yasm_xfree(tmp);
+    yasm_xfree(path);
+    return ok;
+}
+
+void
+objcache_store(objcache *cache, const char *obj_filename,
+               const char *list_filename)
+{
+    char obj_hex[33], list_hex[33], hex[33];
+    objcache_dep *dep;
+    char *path, *tmp;
+    FILE *f;
+    int ok;
+
+    path = entry_path(cache, EXT_MANIFEST);
+    if (yasm__createpath(path) == (size_t)-1) {
+        yasm_xfree(path);
+        return;
+    }
+
+    if (!store_output(cache, obj_filename, EXT_OBJ, obj_hex) ||
+        (list_filename &&
+         !store_output(cache, list_filename, EXT_LIST, list_hex))) {
+        yasm_xfree(path);
+        return;
+    }
+
+    tmp = temp_path(path);
+    f = fopen(tmp, "wt");
+    if (!f) {
+        yasm_xfree(tmp);
+        yasm_xfree(path);
+        return;
+    }
+    fprintf(f, "%s\n", MANIFEST_MAGIC);
+    fprintf(f, "obj %s\n", obj_hex);
+    if (list_filename)
+        fprintf(f, "lst %s\n", list_hex);
+    STAILQ_FOREACH(dep, &cache->deps, link) {
+        digest_to_hex(dep->digest, hex);
+        switch (dep->kind) {
+            case DEP_FILE:
+                fprintf(f, "dep %s %s\n", hex, dep->filename);
+                break;
+            case DEP_ABSENT:
+                fprintf(f, "absent %s\n", dep->filename);
+                break;
+            case DEP_ENV:
+                fprintf(f, "env %s %s\n", hex, dep->filename);
+                break;
+        }
+    }
+    ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = 0;
+    if (ok)
+        replace_file(tmp, path);
+    else
+        remove(tmp);
+    yasm_xfree(tmp);
+    yasm_xfree(path);
+}
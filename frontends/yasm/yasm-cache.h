@@ -0,0 +1,74 @@
+/*
+ * Object cache
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef YASM_CACHE_H
+#define YASM_CACHE_H
+
+/* A directory of previously generated outputs (object and list files).
+ * Entries are keyed by the MD5 of the options in effect together with the
+ * contents of the input file; each entry also records the MD5 of every
+ * other file the output depended on (included and incbin'ed files), the
+ * paths searched for such files without finding one, and the values of
+ * environment variables the source looked up, and is only used while all
+ * of them are unchanged.
+ */
+typedef struct objcache objcache;
+
+/* Open the cache entry for assembling in_filename.  key has already been
+ * fed everything besides the input contents that affects the output.
+ * Returns NULL if the input cannot be read.
+ */
+/*@null@*/ objcache *objcache_create(const char *dir,
+                                     const yasm_md5_context *key,
+                                     const char *in_filename);
+void objcache_destroy(/*@only@*/ objcache *cache);
+
+/* Look up the entry.  On a hit, the stored outputs are copied to
+ * obj_filename and list_filename and 1 is returned; otherwise returns 0.
+ */
+int objcache_lookup(objcache *cache, const char *obj_filename,
+                    /*@null@*/ const char *list_filename);
+
+/* Record a file (read from disk, or already in memory) the output depends
+ * on.
+ */
+void objcache_add_dep(objcache *cache, const char *filename);
+void objcache_add_dep_data(objcache *cache, const char *filename,
+                           const unsigned char *data, unsigned long len);
+
+/* Record a path that was looked for but not found, and an environment
+ * variable that was looked up; both may be recorded more than once.
+ */
+void objcache_add_absent(objcache *cache, const char *filename);
+void objcache_add_env(objcache *cache, const char *name);
+
+/* Store the outputs and recorded dependencies as the entry.  As the cache
+ * is only an optimization, failures are silently ignored.
+ */
+void objcache_store(objcache *cache, const char *obj_filename,
+                    /*@null@*/ const char *list_filename);
+
+#endif
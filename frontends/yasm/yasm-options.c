@@ -73,6 +73,7 @@ parse_cmdline(int argc, char **argv, opt_option *options, size_t nopts,
                     if (options[i].lopt &&
                         strncmp(&argv[0][2], options[i].lopt,
                                 (optlen = strlen(options[i].lopt))) == 0) {
+                        char *cmd = &argv[0][2];
                         char *param;
                         char c = argv[0][2 + optlen];
 
@@ -80,22 +81,26 @@ parse_cmdline(int argc, char **argv, opt_option *options, size_t nopts,
                             continue;
 
                         if (options[i].takes_param) {
-                            param = strchr(&argv[0][2], '=');
-                            if (!param) {
+                            /* --opt=value or --opt value */
+                            param = strchr(cmd, '=');
+                            if (param) {
+                                *param = '\0';
+                                param++;
+                            } else if (argv[1] == NULL || argv[1][0] == '-') {
                                 print_error(
                                     _("option `--%s' needs an argument!"),
                                     options[i].lopt);
                                 errors++;
                                 goto fail;
                             } else {
-                                *param = '\0';
-                                param++;
+                                param = argv[1];
+                                argc--;
+                                argv++;
                             }
                         } else
                             param = NULL;
 
-                        if (!options[i].
-                            handler(&argv[0][2], param, options[i].extra))
+                        if (!options[i].handler(cmd, param, options[i].extra))
                             got_it = 1;
                         break;
                     }
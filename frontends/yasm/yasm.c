@@ -36,6 +36,7 @@
 #endif
 
 #include "yasm-options.h"
+#include "yasm-cache.h"
 
 #if defined(CMAKE_BUILD) && defined(BUILD_SHARED_LIBS)
 #include "yasm-plugin.h"
@@ -77,6 +78,16 @@ static enum {
     EWSTYLE_GNU = 0,
     EWSTYLE_VC
 } ewmsg_style = EWSTYLE_GNU;
+static enum {
+    STATS_NONE = 0,
+    STATS_TEXT,
+    STATS_JSON
+} stats_style = STATS_NONE;
+/*@null@*/ /*@only@*/ static char *stats_filename = NULL;
+static unsigned int num_threads = 1;
+/*@null@*/ /*@only@*/ static char *cache_dir = NULL;
+static yasm_md5_context cache_key;
+/*@null@*/ /*@only@*/ static objcache *cur_objcache = NULL;
 
 /*@null@*/ /*@dependent@*/ static FILE *open_file(const char *filename,
                                                   const char *mode);
@@ -84,6 +95,7 @@ static void check_errors(/*@only@*/ yasm_errwarns *errwarns,
                          /*@only@*/ yasm_object *object,
                          /*@only@*/ yasm_linemap *linemap);
 static void cleanup(/*@null@*/ /*@only@*/ yasm_object *object);
+static void output_stats(void);
 
 /* Forward declarations: cmd line parser handlers */
 static int opt_special_handler(char *cmd, /*@null@*/ char *param, int extra);
@@ -108,6 +120,12 @@ static int opt_ewmsg_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_makedep_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_prefix_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_suffix_handler(char *cmd, /*@null@*/ char *param, int extra);
+static int opt_stats_handler(char *cmd, /*@null@*/ char *param, int extra);
+static int opt_threads_handler(char *cmd, /*@null@*/ char *param, int extra);
+static int opt_cache_dir_handler(char *cmd, /*@null@*/ char *param,
+                                 int extra);
+static int opt_statsfile_handler(char *cmd, /*@null@*/ char *param,
+                                 int extra);
 #if defined(CMAKE_BUILD) && defined(BUILD_SHARED_LIBS)
 static int opt_plugin_handler(char *cmd, /*@null@*/ char *param, int extra);
 #endif
@@ -136,6 +154,11 @@ static void apply_preproc_builtins(void);
 static void apply_preproc_standard_macros(const yasm_stdmac *stdmacs);
 static void apply_preproc_saved_options(void);
 static void print_list_keyword_desc(const char *name, const char *keyword);
+static void cache_key_init(int argc, char *argv[]);
+static int cache_usable(void);
+static void cache_add_absent(const char *path, void *d);
+static void cache_add_env(const char *name, void *d);
+static void cache_store(yasm_object *object);
 
 /* values for special_options */
 #define SPECIAL_SHOW_HELP 0x01
@@ -202,6 +225,9 @@ static opt_option options[] =
       N_("undefine a macro"), N_("macro") },
     { 'U', NULL, 1, opt_preproc_option, 2,
       N_("undefine a macro"), N_("macro") },
+    { 0, "pp-snapshot", 1, opt_preproc_option, 3,
+      N_("save or reuse macro state after pre-included files"),
+      N_("filename") },
     { 'X', NULL, 1, opt_ewmsg_handler, 0,
       N_("select error/warning message style (`gnu' or `vc')"), N_("style") },
     { 0, "prefix", 1, opt_prefix_handler, 0,
@@ -210,6 +236,17 @@ static opt_option options[] =
       N_("append argument to name of all external symbols"), N_("suffix") },
     { 0, "postfix", 1, opt_suffix_handler, 0,
       N_("append argument to name of all external symbols"), N_("suffix") },
+    { 0, "stats", 0, opt_stats_handler, STATS_TEXT,
+      N_("report per-phase timings and counters"), NULL },
+    { 0, "stats-json", 0, opt_stats_handler, STATS_JSON,
+      N_("report per-phase timings and counters as JSON"), NULL },
+    { 0, "stats-file", 1, opt_statsfile_handler, 0,
+      N_("name of statistics output (default stderr)"), N_("filename") },
+    { 0, "threads", 1, opt_threads_handler, 0,
+      N_("number of threads to use for object output"), N_("n") },
+    { 0, "cache-dir", 1, opt_cache_dir_handler, 0,
+      N_("reuse outputs of identical assemblies cached in directory"),
+      N_("dir") },
 #if defined(CMAKE_BUILD) && defined(BUILD_SHARED_LIBS)
     { 'N', "plugin", 1, opt_plugin_handler, 0,
       N_("load plugin module"), N_("plugin") },
@@ -322,10 +359,10 @@ do_preproc_only(void)
         fputc('\n', stdout);
         yasm_xfree(preproc_buf);
     } else {
-        while ((preproc_buf = yasm_preproc_get_line(cur_preproc)) != NULL) {
-            fputs(preproc_buf, out);
+        yasm_preproc_line line;
+        while (yasm_preproc_get_line_ref(cur_preproc, &line)) {
+            fputs(line.text, out);
             fputc('\n', out);
-            yasm_xfree(preproc_buf);
         }
     }
 
@@ -363,6 +400,9 @@ do_assemble(void)
     int i, matched;
     const char *machine;
 
+    if (stats_style != STATS_NONE)
+        yasm_stats_enable();
+
     /* Initialize line map */
     linemap = yasm_linemap_create();
     yasm_linemap_set(linemap, in_filename, 0, 1, 1);
@@ -384,6 +424,25 @@ do_assemble(void)
         }
     }
 
+    /* Reuse the outputs of an identical earlier assembly if possible */
+    if (cache_dir && cache_usable()) {
+        cur_objcache = objcache_create(cache_dir, &cache_key, in_filename);
+        if (cur_objcache &&
+            objcache_lookup(cur_objcache, obj_filename, list_filename)) {
+            output_stats();
+            yasm_linemap_destroy(linemap);
+            yasm_errwarns_destroy(errwarns);
+            cleanup(NULL);
+            return EXIT_SUCCESS;
+        }
+        /* Include paths probed and environment variables looked up also
+         * determine the outputs; record them for the entry.
+         */
+        if (cur_objcache)
+            yasm_set_dependency_funcs(cache_add_absent, cache_add_env,
+                                      cur_objcache);
+    }
+
     /* Set up architecture using machine and parser. */
     if (!machine_name) {
         /* If we're using x86 and the default objfmt bits is 64, default the
@@ -446,9 +505,19 @@ do_assemble(void)
         return EXIT_FAILURE;
     }
 
+    object->threads = num_threads;
+
     /* Get a fresh copy of objfmt_module as it may have changed. */
     cur_objfmt_module = ((yasm_objfmt_base *)object->objfmt)->module;
 
+    /* Merge constant data into fewer bytecodes while parsing.  Debugging
+     * formats and the dbg object format describe individual bytecodes, so
+     * don't merge if either is in use.
+     */
+    object->coalesce_data =
+        yasm__strcasecmp(cur_dbgfmt_module->keyword, "null") == 0 &&
+        yasm__strcasecmp(cur_objfmt_module->keyword, "dbg") != 0;
+
     /* Check to see if the requested preprocessor is in the allowed list
      * for the active parser.
      */
@@ -518,21 +587,29 @@ do_assemble(void)
     }
 
     /* Parse! */
+    yasm_stats_phase_begin(YASM_STATS_PHASE_PARSE);
     cur_parser_module->do_parse(object, cur_preproc, list_filename != NULL,
                                 linemap, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_PARSE);
 
     check_errors(errwarns, object, linemap);
 
     /* Finalize parse */
+    yasm_stats_phase_begin(YASM_STATS_PHASE_FINALIZE);
     yasm_object_finalize(object, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_FINALIZE);
     check_errors(errwarns, object, linemap);
 
     /* Optimize */
+    yasm_stats_phase_begin(YASM_STATS_PHASE_OPTIMIZE);
     yasm_object_optimize(object, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_OPTIMIZE);
     check_errors(errwarns, object, linemap);
 
     /* generate any debugging information */
+    yasm_stats_phase_begin(YASM_STATS_PHASE_DBGFMT);
     yasm_dbgfmt_generate(object, linemap, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_DBGFMT);
     check_errors(errwarns, object, linemap);
 
     /* open the object file for output (if not already opened by dbg objfmt) */
@@ -545,6 +622,7 @@ do_assemble(void)
     }
 
     /* Write the object file */
+    yasm_stats_phase_begin(YASM_STATS_PHASE_OUTPUT);
     yasm_objfmt_output(object, obj?obj:stderr,
                        yasm__strcasecmp(cur_dbgfmt_module->keyword, "null"),
                        errwarns);
@@ -552,6 +630,7 @@ do_assemble(void)
     /* Close object file */
     if (obj)
         fclose(obj);
+    yasm_stats_phase_end(YASM_STATS_PHASE_OUTPUT);
 
     /* If we had an error at this point, we also need to delete the output
      * object file (to make sure it's not left newer than the source).
@@ -568,14 +647,21 @@ do_assemble(void)
             return EXIT_FAILURE;
         }
         /* Initialize the list format */
+        yasm_stats_phase_begin(YASM_STATS_PHASE_LIST);
         cur_listfmt = yasm_listfmt_create(cur_listfmt_module, in_filename,
                                           obj_filename);
         yasm_listfmt_output(cur_listfmt, list, linemap, cur_arch);
         fclose(list);
+        yasm_stats_phase_end(YASM_STATS_PHASE_LIST);
     }
 
+    /* Only cache clean results, so warnings aren't lost on a later hit */
+    if (cur_objcache && yasm_errwarns_num_errors(errwarns, 1) == 0)
+        cache_store(object);
+
     yasm_errwarns_output_all(errwarns, linemap, warning_error,
                              print_yasm_error, print_yasm_warning);
+    output_stats();
 
     yasm_linemap_destroy(linemap);
     yasm_errwarns_destroy(errwarns);
@@ -631,6 +717,9 @@ main(int argc, char *argv[])
     /* Initialize parameter storage */
     STAILQ_INIT(&preproc_options);
 
+    /* Must be done before parse_cmdline() modifies argv */
+    cache_key_init(argc, argv);
+
     if (parse_cmdline(argc, argv, options, NELEMS(options), print_error))
         return EXIT_FAILURE;
 
@@ -772,6 +861,7 @@ check_errors(yasm_errwarns *errwarns, yasm_object *object,
     if (yasm_errwarns_num_errors(errwarns, warning_error) > 0) {
         yasm_errwarns_output_all(errwarns, linemap, warning_error,
                                  print_yasm_error, print_yasm_warning);
+        output_stats();
         yasm_linemap_destroy(linemap);
         yasm_errwarns_destroy(errwarns);
         cleanup(object);
@@ -779,6 +869,170 @@ check_errors(yasm_errwarns *errwarns, yasm_object *object,
     }
 }
 
+/* Output assembly statistics (if enabled). */
+static void
+output_stats(void)
+{
+    FILE *f = errfile;
+
+    if (stats_style == STATS_NONE)
+        return;
+
+    if (stats_filename) {
+        f = open_file(stats_filename, "wt");
+        if (!f)
+            return;
+    }
+    yasm_stats_output(f, stats_style == STATS_JSON);
+    if (f != errfile)
+        fclose(f);
+}
+
+/* If arg is one of the long options that only affect reporting, return its
+ * entry in the options table; otherwise return NULL.
+ */
+static const opt_option *
+uncached_option(const char *arg)
+{
+    static const char *uncached[] = {
+        "cache-dir", "stats", "stats-json", "stats-file", "threads"
+    };
+    size_t i, j, len;
+
+    if (strncmp(arg, "--", 2) != 0)
+        return NULL;
+    arg += 2;
+    for (i=0; i<NELEMS(uncached); i++) {
+        len = strlen(uncached[i]);
+        if (strncmp(arg, uncached[i], len) == 0 &&
+            (arg[len] == '\0' || arg[len] == '='))
+            break;
+    }
+    if (i == NELEMS(uncached))
+        return NULL;
+    for (j=0; j<NELEMS(options); j++) {
+        if (options[j].lopt && strcmp(options[j].lopt, uncached[i]) == 0)
+            return &options[j];
+    }
+    return NULL;
+}
+
+/* Digest everything other than the input contents that can affect the
+ * outputs: the version, command line, environment, and working directory
+ * (debug formats record it).  Options that only affect reporting are left
+ * out.
+ */
+static void
+cache_key_init(int argc, char *argv[])
+{
+    static const char *env_vars[] = { "YASM_TEST_SUITE", "YASM_CPP" };
+    const char *val;
+    char *cwd;
+    size_t j;
+    int i;
+
+    yasm_md5_init(&cache_key);
+    yasm_md5_update(&cache_key, (const unsigned char *)PACKAGE_STRING,
+                    (unsigned long)strlen(PACKAGE_STRING)+1);
+
+    for (j=0; j<NELEMS(env_vars); j++) {
+        val = getenv(env_vars[j]);
+        if (!val)
+            val = "";
+        yasm_md5_update(&cache_key, (const unsigned char *)env_vars[j],
+                        (unsigned long)strlen(env_vars[j])+1);
+        yasm_md5_update(&cache_key, (const unsigned char *)val,
+                        (unsigned long)strlen(val)+1);
+    }
+
+    cwd = yasm__getcwd();
+    yasm_md5_update(&cache_key, (const unsigned char *)cwd,
+                    (unsigned long)strlen(cwd)+1);
+    yasm_xfree(cwd);
+
+    for (i=1; i<argc; i++) {
+        const opt_option *opt = uncached_option(argv[i]);
+
+        if (opt) {
+            /* Also skip a value given as the next argument */
+            if (opt->takes_param && !strchr(argv[i], '=') && i+1 < argc &&
+                argv[i+1][0] != '-')
+                i++;
+            continue;
+        }
+        yasm_md5_update(&cache_key, (const unsigned char *)argv[i],
+                        (unsigned long)strlen(argv[i])+1);
+        if (strcmp(argv[i], "--") == 0)
+            break;
+    }
+    /* Everything after "--" is an input file */
+    for (i++; i<argc; i++)
+        yasm_md5_update(&cache_key, (const unsigned char *)argv[i],
+                        (unsigned long)strlen(argv[i])+1);
+}
+
+/* Whether every file the outputs depend on can be determined, so a cache
+ * entry can be validated.  The gas preprocessor doesn't report its
+ * includes, and map files (which bin-style formats can write at the
+ * request of a directive) aren't tracked.
+ */
+static int
+cache_usable(void)
+{
+    const yasm_directive *dir = cur_objfmt_module->directives;
+
+    if (strcmp(in_filename, "-") == 0)
+        return 0;
+    if (yasm__strcasecmp(cur_preproc_module->keyword, "gas") == 0)
+        return 0;
+    if (yasm__strcasecmp(cur_objfmt_module->keyword, "dbg") == 0)
+        return 0;
+    for (; dir && dir->name; dir++) {
+        if (yasm__strcasecmp(dir->name, "map") == 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void
+cache_add_absent(const char *path, void *d)
+{
+    objcache_add_absent((objcache *)d, path);
+}
+
+static void
+cache_add_env(const char *name, void *d)
+{
+    objcache_add_env((objcache *)d, name);
+}
+
+static int
+cache_add_incbin(const char *path, const unsigned char *data,
+                 unsigned long len, void *d)
+{
+    objcache_add_dep_data((objcache *)d, path, data, len);
+    return 0;
+}
+
+/* Record the dependencies of a successful assembly and store its outputs. */
+static void
+cache_store(yasm_object *object)
+{
+    char *buf = yasm_xmalloc(PREPROC_BUF_SIZE+1);
+    size_t got;
+
+    while ((got = yasm_preproc_get_included_file(cur_preproc, buf,
+                                                 PREPROC_BUF_SIZE)) != 0) {
+        buf[got] = '\0';
+        objcache_add_dep(cur_objcache, buf);
+    }
+    yasm_xfree(buf);
+
+    yasm_filecache_traverse(object->filecache, cur_objcache,
+                            cache_add_incbin);
+    objcache_store(cur_objcache, obj_filename, list_filename);
+}
+
 /* Define DO_FREE to 1 to enable deallocation of all data structures.
  * Useful for detecting memory leaks, but slows down execution unnecessarily
  * (as the OS will free everything we miss here).
@@ -794,6 +1048,10 @@ cleanup(yasm_object *object)
             yasm_listfmt_destroy(cur_listfmt);
         if (cur_preproc)
             yasm_preproc_destroy(cur_preproc);
+        if (cur_objcache) {
+            yasm_set_dependency_funcs(NULL, NULL, NULL);
+            objcache_destroy(cur_objcache);
+        }
         if (object)
             yasm_object_destroy(object);
 
@@ -818,6 +1076,10 @@ cleanup(yasm_object *object)
             yasm_xfree(machine_name);
         if (objfmt_keyword)
             yasm_xfree(objfmt_keyword);
+        if (stats_filename)
+            yasm_xfree(stats_filename);
+        if (cache_dir)
+            yasm_xfree(cache_dir);
     }
 
     if (errfile != stderr && errfile != stdout)
@@ -1205,6 +1467,67 @@ opt_suffix_handler(/*@unused@*/ char *cmd, char *param, /*@unused@*/ int extra)
     return 0;
 }
 
+static int
+opt_stats_handler(/*@unused@*/ char *cmd, /*@unused@*/ char *param,
+                  int extra)
+{
+    stats_style = extra;
+    return 0;
+}
+
+static int
+opt_statsfile_handler(/*@unused@*/ char *cmd, char *param,
+                      /*@unused@*/ int extra)
+{
+    if (stats_filename) {
+        print_error(
+            _("warning: can output to only one statistics file, last specified used"));
+        yasm_xfree(stats_filename);
+    }
+
+    assert(param != NULL);
+    stats_filename = yasm__xstrdup(param);
+
+    /* Default to text style if only the file is given */
+    if (stats_style == STATS_NONE)
+        stats_style = STATS_TEXT;
+
+    return 0;
+}
+
+static int
+opt_threads_handler(/*@unused@*/ char *cmd, char *param,
+                    /*@unused@*/ int extra)
+{
+    char *end;
+    unsigned long n;
+
+    assert(param != NULL);
+    n = strtoul(param, &end, 10);
+    if (*param == '\0' || *end != '\0' || n == 0 || n > 256) {
+        print_error(_("warning: invalid thread count `%s', using 1"), param);
+        n = 1;
+    }
+#ifndef YASM_THREADS
+    else if (n > 1)
+        print_error(_("warning: threads not supported on this platform"));
+#endif
+    num_threads = (unsigned int)n;
+    return 0;
+}
+
+static int
+opt_cache_dir_handler(/*@unused@*/ char *cmd, char *param,
+                      /*@unused@*/ int extra)
+{
+    if (cache_dir)
+        yasm_xfree(cache_dir);
+
+    assert(param != NULL);
+    cache_dir = yasm__xstrdup(param);
+    return 0;
+}
+
 #if defined(CMAKE_BUILD) && defined(BUILD_SHARED_LIBS)
 static int
 opt_plugin_handler(/*@unused@*/ char *cmd, char *param,
@@ -1254,13 +1577,14 @@ apply_preproc_saved_options()
 {
     constcharparam *cp, *cpnext;
 
-    void (*funcs[3])(yasm_preproc *, const char *);
+    void (*funcs[4])(yasm_preproc *, const char *);
     funcs[0] = cur_preproc_module->add_include_file;
     funcs[1] = cur_preproc_module->predefine_macro;
     funcs[2] = cur_preproc_module->undefine_macro;
+    funcs[3] = cur_preproc_module->use_snapshot;
 
     STAILQ_FOREACH(cp, &preproc_options, link) {
-        if (0 <= cp->id && cp->id < 3 && funcs[cp->id])
+        if (0 <= cp->id && cp->id < 4 && funcs[cp->id])
             funcs[cp->id](cur_preproc, cp->param);
     }
 
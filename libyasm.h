@@ -49,6 +49,7 @@ typedef unsigned long uintptr_t;
 #include <libyasm/linemap.h>
 
 #include <libyasm/errwarn.h>
+#include <libyasm/stats.h>
 #include <libyasm/intnum.h>
 #include <libyasm/floatnum.h>
 #include <libyasm/expr.h>
@@ -67,7 +68,9 @@ typedef unsigned long uintptr_t;
 #include <libyasm/preproc.h>
 
 #include <libyasm/file.h>
+#include <libyasm/filecache.h>
 #include <libyasm/module.h>
+#include <libyasm/assemble.h>
 
 #include <libyasm/hamt.h>
 #include <libyasm/md5.h>
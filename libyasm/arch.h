@@ -55,6 +55,15 @@ typedef enum yasm_arch_regtmod {
     YASM_ARCH_TARGETMOD                 /**< A target modifier (for jumps) */
 } yasm_arch_regtmod;
 
+/** One register term of an effective address handed to
+ * yasm_arch_ea_create_regs(): reg, or reg*mult if explicit_mult is set.
+ */
+typedef struct yasm_arch_ea_reg {
+    uintptr_t reg;                      /**< Register */
+    long mult;                          /**< Multiplier (1 if implicit) */
+    int explicit_mult;                  /**< Nonzero if written as reg*mult */
+} yasm_arch_ea_reg;
+
 #ifndef YASM_DOXYGEN
 /** Base #yasm_arch structure.  Must be present as the first element in any
  * #yasm_arch implementation.
@@ -186,6 +195,14 @@ typedef struct yasm_arch_module {
      */
     yasm_effaddr * (*ea_create) (yasm_arch *arch, /*@keep@*/ yasm_expr *e);
 
+    /** Module-level implementation of yasm_arch_ea_create_regs().
+     * Call yasm_arch_ea_create_regs() instead of calling this function.
+     * May be NULL if the architecture only accepts expressions.
+     */
+    /*@null@*/ yasm_effaddr * (*ea_create_regs)
+        (yasm_arch *arch, const yasm_arch_ea_reg *regs, size_t nregs,
+         /*@null@*/ /*@keep@*/ yasm_expr *disp);
+
     /** Module-level implementation of yasm_arch_ea_destroy().
      * Call yasm_arch_ea_destroy() instead of calling this function.
      */
@@ -409,6 +426,22 @@ void yasm_arch_segreg_print(yasm_arch *arch, uintptr_t segreg, FILE *f);
  */
 yasm_effaddr *yasm_arch_ea_create(yasm_arch *arch, /*@keep@*/ yasm_expr *e);
 
+/** Create an effective address from registers already separated out by the
+ * parser plus a register-free displacement.  This avoids building and later
+ * re-walking a register expression for the common base+index*scale+disp
+ * forms.  Callers must be prepared to fall back to yasm_arch_ea_create() for
+ * anything the architecture declines.
+ * \param arch     architecture
+ * \param regs     register terms, in source order
+ * \param nregs    number of register terms
+ * \param disp     displacement (kept if an address is returned, NULL if none)
+ * \return Newly allocated effective address, or NULL if the form is not
+ *         supported (disp is then not kept).
+ */
+/*@null@*/ yasm_effaddr *yasm_arch_ea_create_regs
+    (yasm_arch *arch, const yasm_arch_ea_reg *regs, size_t nregs,
+     /*@null@*/ /*@keep@*/ yasm_expr *disp);
+
 /** Delete (free allocated memory for) an effective address.
  * \param arch  architecture
  * \param ea    effective address (only pointer to it).
@@ -483,6 +516,11 @@ void yasm_arch_ea_print(const yasm_arch *arch, const yasm_effaddr *ea,
     ((yasm_arch_base *)arch)->module->segreg_print(arch, segreg, f)
 #define yasm_arch_ea_create(arch, e) \
     ((yasm_arch_base *)arch)->module->ea_create(arch, e)
+#define yasm_arch_ea_create_regs(arch, regs, nregs, disp) \
+    (((yasm_arch_base *)arch)->module->ea_create_regs ? \
+     ((yasm_arch_base *)arch)->module->ea_create_regs(arch, regs, nregs, \
+                                                      disp) : \
+     (yasm_effaddr *)NULL)
 #define yasm_arch_ea_destroy(arch, ea) \
     ((yasm_arch_base *)arch)->module->ea_destroy(ea)
 #define yasm_arch_ea_print(arch, ea, f, i) \
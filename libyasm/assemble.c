@@ -0,0 +1,936 @@
+/*
+ * In-memory assembly
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "util.h"
+
+#ifdef YASM_THREADS
+#include <pthread.h>
+#endif
+
+#include "libyasm-stdint.h"
+#include "coretype.h"
+
+#include "linemap.h"
+#include "errwarn.h"
+#include "intnum.h"
+#include "expr.h"
+#include "symrec.h"
+#include "bytecode.h"
+#include "section.h"
+#include "arch.h"
+#include "dbgfmt.h"
+#include "objfmt.h"
+#include "parser.h"
+#include "preproc.h"
+#include "module.h"
+#include "stats.h"
+#include "assemble.h"
+
+
+/* Source text, read either from a single buffer or a line at a time from a
+ * callback (which appends a newline to each line).
+ */
+typedef struct asm_input {
+    /*@dependent@*/ const char *buf;    /* unread part of current text */
+    size_t len;
+    /*@null@*/ yasm_assemble_line_func get_line;
+    void *d;
+    int need_newline;       /* newline pending after current line */
+} asm_input;
+
+/* Output position within the caller's buffer.  As object formats seek back
+ * to patch headers, writes may land anywhere; the length is the highest
+ * position ever written.
+ */
+typedef struct asm_output {
+    yasm_assemble_output *out;
+    size_t pos;
+} asm_output;
+
+static size_t
+input_read(asm_input *in, char *dest, size_t size)
+{
+    size_t n = 0;
+
+    while (n < size) {
+        size_t chunk;
+
+        if (in->len == 0) {
+            if (in->need_newline) {
+                dest[n++] = '\n';
+                in->need_newline = 0;
+                continue;
+            }
+            if (!in->get_line)
+                break;
+            in->buf = in->get_line(in->d, &in->len);
+            if (!in->buf) {
+                in->get_line = NULL;
+                in->len = 0;
+                break;
+            }
+            in->need_newline = 1;
+            continue;
+        }
+
+        chunk = size - n;
+        if (chunk > in->len)
+            chunk = in->len;
+        memcpy(dest+n, in->buf, chunk);
+        in->buf += chunk;
+        in->len -= chunk;
+        n += chunk;
+    }
+    return n;
+}
+
+static void
+output_write(asm_output *o, const char *data, size_t size)
+{
+    yasm_assemble_output *out = o->out;
+    size_t end = o->pos + size;
+
+    if (end > out->size) {
+        size_t newsize = out->size ? out->size : 4096;
+        while (newsize < end)
+            newsize *= 2;
+        out->data = yasm_xrealloc(out->data, newsize);
+        out->size = newsize;
+    }
+    /* Zero any gap left by seeking past the end */
+    if (o->pos > out->len)
+        memset(out->data + out->len, 0, o->pos - out->len);
+    memcpy(out->data + o->pos, data, size);
+    o->pos = end;
+    if (end > out->len)
+        out->len = end;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t
+cookie_read(void *cookie, char *buf, size_t size)
+{
+    return (ssize_t)input_read((asm_input *)cookie, buf, size);
+}
+
+static ssize_t
+cookie_write(void *cookie, const char *buf, size_t size)
+{
+    output_write((asm_output *)cookie, buf, size);
+    return (ssize_t)size;
+}
+
+static int
+cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+    asm_output *o = (asm_output *)cookie;
+    off64_t base;
+
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (off64_t)o->pos;
+            break;
+        case SEEK_END:
+            base = (off64_t)o->out->len;
+            break;
+        default:
+            return -1;
+    }
+    if (base + *offset < 0)
+        return -1;
+    o->pos = (size_t)(base + *offset);
+    *offset = (off64_t)o->pos;
+    return 0;
+}
+
+static /*@null@*/ FILE *
+open_input(asm_input *in)
+{
+    cookie_io_functions_t funcs = {cookie_read, NULL, NULL, NULL};
+    return fopencookie(in, "r", funcs);
+}
+
+static /*@null@*/ FILE *
+open_output(asm_output *o)
+{
+    cookie_io_functions_t funcs = {NULL, cookie_write, cookie_seek, NULL};
+    return fopencookie(o, "wb", funcs);
+}
+
+static int
+close_output(FILE *f, asm_output *o)
+{
+    return fclose(f);
+}
+#else
+/* Without custom streams, go through anonymous temporary files. */
+static /*@null@*/ FILE *
+open_input(asm_input *in)
+{
+    char buf[4096];
+    size_t n;
+    FILE *f = tmpfile();
+
+    if (!f)
+        return NULL;
+    while ((n = input_read(in, buf, sizeof(buf))) > 0)
+        fwrite(buf, 1, n, f);
+    if (ferror(f) || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+static /*@null@*/ FILE *
+open_output(asm_output *o)
+{
+    return tmpfile();
+}
+
+static int
+close_output(FILE *f, asm_output *o)
+{
+    char buf[4096];
+    size_t n;
+    int err;
+
+    err = fflush(f) != 0 || fseek(f, 0, SEEK_SET) != 0;
+    while (!err && (n = fread(buf, 1, sizeof(buf), f)) > 0)
+        output_write(o, buf, n);
+    err |= ferror(f);
+    return fclose(f) != 0 || err;
+}
+#endif
+
+#ifdef YASM_THREADS
+/* Held while assembling with modules that keep global state. */
+static pthread_mutex_t assemble_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Modules known to keep all their state in their own objects, so that
+ * assemblies using only these may run concurrently.
+ */
+static const char *reentrant_preprocs[] = {"raw", "nasm", "tasm", NULL};
+static const char *reentrant_parsers[] = {"nasm", "tasm", "gas", "gnu", NULL};
+static const char *reentrant_archs[] = {"x86", NULL};
+static const char *reentrant_objfmts[] = {
+    "bin", "coff", "win32", "win64", "x64", "macho", "macho32", "macho64",
+    "elf", "elf32", "elf64", "elfx32", "rdf", "xdf", NULL
+};
+static const char *reentrant_dbgfmts[] = {"null", NULL};
+
+static int
+keyword_listed(const char *keyword, const char **list)
+{
+    for (; *list; list++)
+        if (yasm__strcasecmp(keyword, *list) == 0)
+            return 1;
+    return 0;
+}
+
+static void
+null_print_error(const char *fn, unsigned long line, const char *msg,
+                 const char *xref_fn, unsigned long xref_line,
+                 const char *xref_msg)
+{
+}
+
+static void
+null_print_warning(const char *fn, unsigned long line, const char *msg)
+{
+}
+
+/* Print an error not associated with a source line.  fmt is untranslated
+ * and uses up to three string arguments; pass "" for any unused ones.
+ */
+static void
+setup_error(yasm_print_error_func print_error, const char *fmt,
+            const char *a1, const char *a2, const char *a3)
+{
+    char *msg;
+
+    fmt = yasm_gettext_hook(fmt);
+    msg = yasm_xmalloc(strlen(fmt)+strlen(a1)+strlen(a2)+strlen(a3)+1);
+    sprintf(msg, fmt, a1, a2, a3);
+    print_error("", 0, msg, NULL, 0, NULL);
+    yasm_xfree(msg);
+}
+
+static void
+apply_standard_macros(yasm_preproc *preproc, const yasm_stdmac *stdmacs,
+                      const char *parser, const char *preproc_keyword)
+{
+    int i, matched;
+
+    if (!stdmacs)
+        return;
+
+    matched = -1;
+    for (i=0; stdmacs[i].parser; i++)
+        if (yasm__strcasecmp(stdmacs[i].parser, parser) == 0 &&
+            yasm__strcasecmp(stdmacs[i].preproc, preproc_keyword) == 0)
+            matched = i;
+    if (matched >= 0 && stdmacs[matched].macros)
+        yasm_preproc_add_standard(preproc, stdmacs[matched].macros);
+}
+
+/* Maps an object pointer to its index in the result arrays. */
+typedef struct ptr_index {
+    /*@dependent@*/ const void *ptr;
+    unsigned long index;
+} ptr_index;
+
+typedef struct collect_info {
+    yasm_assembly *result;
+    /*@only@*/ yasm_section **sects;    /* sections in object order */
+    unsigned long num_sects;
+    /*@only@*/ ptr_index *sect_map;     /* sorted by pointer */
+    /*@only@*/ ptr_index *sym_map;      /* sorted by pointer */
+} collect_info;
+
+static int
+ptr_index_compare(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)((const ptr_index *)a)->ptr;
+    uintptr_t pb = (uintptr_t)((const ptr_index *)b)->ptr;
+    return (pa > pb) - (pa < pb);
+}
+
+/* Returns the index of ptr in a map sorted by ptr_index_compare(), or -1. */
+static long
+ptr_index_find(const ptr_index *map, unsigned long n, const void *ptr)
+{
+    ptr_index key;
+    const ptr_index *found;
+
+    if (n == 0)
+        return -1;
+    key.ptr = ptr;
+    found = bsearch(&key, map, n, sizeof(ptr_index), ptr_index_compare);
+    return found ? (long)found->index : -1;
+}
+
+static unsigned long
+collect_name(yasm_assembly *result, const char *name)
+{
+    size_t len = strlen(name)+1;
+    unsigned long offset = (unsigned long)result->names_len;
+
+    if (result->names_len + len > result->names_size) {
+        size_t newsize = result->names_size ? result->names_size : 256;
+        while (newsize < result->names_len + len)
+            newsize *= 2;
+        result->names = yasm_xrealloc(result->names, newsize);
+        result->names_size = newsize;
+    }
+    memcpy(result->names + result->names_len, name, len);
+    result->names_len += len;
+    return offset;
+}
+
+static int
+collect_count_section(yasm_section *sect, void *d)
+{
+    collect_info *info = (collect_info *)d;
+    info->num_sects++;
+    info->result->num_relocs += yasm_section_num_relocs(sect);
+    return 0;
+}
+
+static int
+collect_section(yasm_section *sect, void *d)
+{
+    collect_info *info = (collect_info *)d;
+    yasm_assembly *result = info->result;
+    yasm_assembly_section *asect = &result->sections[result->num_sections];
+    unsigned long pos, len;
+
+    asect->name = collect_name(result, yasm_section_get_name(sect));
+    if (yasm_section_get_output_range(sect, &pos, &len) &&
+        pos <= result->output.len) {
+        /* Clamp to what actually reached the output */
+        if (len > result->output.len - pos)
+            len = (unsigned long)(result->output.len - pos);
+        asect->offset = pos;
+        asect->len = len;
+    } else {
+        asect->offset = 0;
+        asect->len = 0;
+    }
+    asect->size = yasm_bc_next_offset(yasm_section_bcs_last(sect));
+    asect->first_reloc = 0;
+    asect->num_relocs = 0;
+
+    info->sects[result->num_sections] = sect;
+    info->sect_map[result->num_sections].ptr = sect;
+    info->sect_map[result->num_sections].index = result->num_sections;
+    result->num_sections++;
+    return 0;
+}
+
+static int
+collect_count_symbol(yasm_symrec *sym, void *d)
+{
+    ((collect_info *)d)->result->num_symbols++;
+    return 0;
+}
+
+static int
+collect_symbol(yasm_symrec *sym, void *d)
+{
+    collect_info *info = (collect_info *)d;
+    yasm_assembly *result = info->result;
+    yasm_assembly_symbol *asym = &result->symbols[result->num_symbols];
+    yasm_symrec_get_label_bytecodep precbc;
+    const yasm_expr *equ;
+
+    asym->name = collect_name(result, yasm_symrec_get_name(sym));
+    asym->value = 0;
+    asym->section = -1;
+    asym->visibility = (unsigned long)yasm_symrec_get_visibility(sym);
+    asym->kind = YASM_ASSEMBLY_SYM_UNDEF;
+
+    if (yasm_symrec_get_label(sym, &precbc)) {
+        asym->kind = YASM_ASSEMBLY_SYM_LABEL;
+        asym->value = yasm_bc_next_offset(precbc);
+        asym->section = ptr_index_find(info->sect_map, info->num_sects,
+                                       yasm_bc_get_section(precbc));
+    } else if ((equ = yasm_symrec_get_equ(sym)) != NULL) {
+        yasm_expr *e = yasm_expr_copy(equ);
+        /*@dependent@*/ /*@null@*/ const yasm_intnum *intn;
+
+        asym->kind = YASM_ASSEMBLY_SYM_EQU;
+        intn = yasm_expr_get_intnum(&e, 1);
+        if (intn) {
+            if (yasm_intnum_sign(intn) < 0)
+                asym->value = (unsigned long)yasm_intnum_get_int(intn);
+            else
+                asym->value = yasm_intnum_get_uint(intn);
+        }
+        yasm_expr_destroy(e);
+    }
+
+    info->sym_map[result->num_symbols].ptr = sym;
+    info->sym_map[result->num_symbols].index = result->num_symbols;
+    result->num_symbols++;
+    return 0;
+}
+
+/* Fill in result from an object that has been output. */
+static void
+collect_object(yasm_object *object, yasm_assembly *result)
+{
+    collect_info info;
+    unsigned long i;
+
+    info.result = result;
+    info.num_sects = 0;
+    result->num_relocs = 0;
+    yasm_object_sections_traverse(object, &info, collect_count_section);
+    yasm_symtab_traverse(object->symtab, &info, collect_count_symbol);
+
+    info.sects = yasm_xmalloc((info.num_sects+1)*sizeof(yasm_section *));
+    info.sect_map = yasm_xmalloc((info.num_sects+1)*sizeof(ptr_index));
+    info.sym_map = yasm_xmalloc((result->num_symbols+1)*sizeof(ptr_index));
+    result->sections = yasm_xmalloc((info.num_sects+1) *
+                                    sizeof(yasm_assembly_section));
+    result->symbols = yasm_xmalloc((result->num_symbols+1) *
+                                   sizeof(yasm_assembly_symbol));
+    result->relocs = yasm_xmalloc((result->num_relocs+1) *
+                                  sizeof(yasm_assembly_reloc));
+
+    result->num_sections = 0;
+    yasm_object_sections_traverse(object, &info, collect_section);
+    qsort(info.sect_map, info.num_sects, sizeof(ptr_index),
+          ptr_index_compare);
+
+    result->num_symbols = 0;
+    yasm_symtab_traverse(object->symtab, &info, collect_symbol);
+    qsort(info.sym_map, result->num_symbols, sizeof(ptr_index),
+          ptr_index_compare);
+
+    result->num_relocs = 0;
+    for (i=0; i<info.num_sects; i++) {
+        yasm_assembly_section *asect = &result->sections[i];
+        yasm_reloc *reloc;
+
+        asect->first_reloc = result->num_relocs;
+        for (reloc = yasm_section_relocs_first(info.sects[i]); reloc;
+             reloc = yasm_section_reloc_next(info.sects[i], reloc)) {
+            yasm_assembly_reloc *areloc = &result->relocs[result->num_relocs];
+            unsigned long addr;
+            yasm_symrec *sym;
+
+            yasm_reloc_get(reloc, &addr, &sym);
+            areloc->offset = addr;
+            areloc->symbol = ptr_index_find(info.sym_map,
+                                            result->num_symbols, sym);
+            result->num_relocs++;
+        }
+        asect->num_relocs = result->num_relocs - asect->first_reloc;
+    }
+
+    yasm_xfree(info.sects);
+    yasm_xfree(info.sect_map);
+    yasm_xfree(info.sym_map);
+}
+
+/* Assembly collecting messages on this thread, for collect_print_error()
+ * and collect_print_warning().
+ */
+static YASM_THREAD_LOCAL /*@null@*/ yasm_assembly *collect_result;
+
+static void
+collect_message(const char *fn, unsigned long line, const char *kind,
+                const char *msg)
+{
+    yasm_assembly *result = collect_result;
+    size_t len = strlen(fn) + strlen(kind) + strlen(msg) + 32;
+
+    if (!result)
+        return;
+    if (result->messages_len + len > result->messages_size) {
+        size_t newsize = result->messages_size ? result->messages_size : 256;
+        while (newsize < result->messages_len + len)
+            newsize *= 2;
+        result->messages = yasm_xrealloc(result->messages, newsize);
+        result->messages_size = newsize;
+    }
+    if (line)
+        result->messages_len += sprintf(result->messages +
+                                        result->messages_len, "%s:%lu: %s%s\n",
+                                        fn, line, kind, msg);
+    else
+        result->messages_len += sprintf(result->messages +
+                                        result->messages_len, "%s: %s%s\n",
+                                        fn, kind, msg);
+}
+
+static void
+collect_print_error(const char *fn, unsigned long line, const char *msg,
+                    const char *xref_fn, unsigned long xref_line,
+                    const char *xref_msg)
+{
+    collect_message(fn, line, yasm_gettext_hook(N_("error: ")), msg);
+    if (xref_fn && xref_msg)
+        collect_message(xref_fn, xref_line, yasm_gettext_hook(N_("error: ")),
+                        xref_msg);
+}
+
+static void
+collect_print_warning(const char *fn, unsigned long line, const char *msg)
+{
+    collect_message(fn, line, yasm_gettext_hook(N_("warning: ")), msg);
+}
+
+/* Release the collected arrays, keeping the output buffer. */
+static void
+collect_reset(yasm_assembly *result)
+{
+    if (result->sections)
+        yasm_xfree(result->sections);
+    if (result->symbols)
+        yasm_xfree(result->symbols);
+    if (result->relocs)
+        yasm_xfree(result->relocs);
+    result->sections = NULL;
+    result->num_sections = 0;
+    result->symbols = NULL;
+    result->num_symbols = 0;
+    result->relocs = NULL;
+    result->num_relocs = 0;
+    result->names_len = 0;
+    result->messages_len = 0;
+}
+
+void
+yasm_assemble_options_init(yasm_assemble_options *opts)
+{
+    opts->arch = "x86";
+    opts->machine = NULL;
+    opts->parser = "nasm";
+    opts->preproc = NULL;
+    opts->objfmt = "bin";
+    opts->dbgfmt = "null";
+    opts->src_filename = "-";
+    opts->obj_filename = "yasm.out";
+    opts->warning_error = 0;
+    opts->print_error = NULL;
+    opts->print_warning = NULL;
+}
+
+/* Mirrors the pipeline of the yasm frontend, with the input and output
+ * streams backed by memory.  If result is non-NULL, its output is used as
+ * the output buffer and the rest of it is filled in from the object.
+ */
+static int
+assemble(const yasm_assemble_options *opts, asm_input *in,
+         yasm_assemble_output *out, /*@null@*/ yasm_assembly *result)
+{
+    yasm_assemble_options defaults;
+    yasm_print_error_func print_error;
+    yasm_print_warning_func print_warning;
+    yasm_arch_module *arch_module;
+    yasm_parser_module *parser_module;
+    yasm_preproc_module *preproc_module;
+    const yasm_objfmt_module *objfmt_module;
+    const yasm_dbgfmt_module *dbgfmt_module;
+    const char *preproc_keyword, *machine;
+    yasm_arch_create_error arch_error;
+    yasm_arch *arch;
+    yasm_object *object;
+    yasm_linemap *linemap;
+    yasm_errwarns *errwarns;
+    /*@null@*/ yasm_preproc *preproc = NULL;
+    asm_output o;
+    FILE *f;
+    char *predef;
+    int i, matched, retval = 1;
+#ifdef YASM_THREADS
+    int locked;
+#endif
+
+    if (!opts) {
+        yasm_assemble_options_init(&defaults);
+        opts = &defaults;
+    }
+    print_error = opts->print_error ? opts->print_error : null_print_error;
+    print_warning =
+        opts->print_warning ? opts->print_warning : null_print_warning;
+
+    /* Look up modules */
+    arch_module = yasm_load_arch(opts->arch);
+    if (!arch_module) {
+        setup_error(print_error, N_("unrecognized %s `%s'"),
+                    "architecture", opts->arch, "");
+        return 1;
+    }
+    parser_module = yasm_load_parser(opts->parser);
+    if (!parser_module) {
+        setup_error(print_error, N_("unrecognized %s `%s'"), "parser",
+                    opts->parser, "");
+        return 1;
+    }
+    preproc_keyword = opts->preproc ? opts->preproc :
+        parser_module->default_preproc_keyword;
+    preproc_module = yasm_load_preproc(preproc_keyword);
+    if (!preproc_module) {
+        setup_error(print_error, N_("unrecognized %s `%s'"),
+                    "preprocessor", preproc_keyword, "");
+        return 1;
+    }
+    objfmt_module = yasm_load_objfmt(opts->objfmt);
+    if (!objfmt_module) {
+        setup_error(print_error, N_("unrecognized %s `%s'"),
+                    "object format", opts->objfmt, "");
+        return 1;
+    }
+    dbgfmt_module = yasm_load_dbgfmt(opts->dbgfmt);
+    if (!dbgfmt_module) {
+        setup_error(print_error, N_("unrecognized %s `%s'"),
+                    "debug format", opts->dbgfmt, "");
+        return 1;
+    }
+
+    matched = 0;
+    for (i=0; parser_module->preproc_keywords[i]; i++) {
+        if (yasm__strcasecmp(parser_module->preproc_keywords[i],
+                             preproc_module->keyword) == 0) {
+            matched = 1;
+            break;
+        }
+    }
+    if (!matched) {
+        setup_error(print_error, N_("`%s' is not a valid %s for %s"),
+                    preproc_module->keyword, "preprocessor",
+                    parser_module->keyword);
+        return 1;
+    }
+    if (!preproc_module->create_stream) {
+        setup_error(print_error, N_("%s `%s' cannot read from memory"),
+                    "preprocessor", preproc_module->keyword, "");
+        return 1;
+    }
+    if (yasm__strcasecmp(objfmt_module->keyword, "dbg") == 0) {
+        setup_error(print_error, N_("%s `%s' cannot write to memory"),
+                    "object format", objfmt_module->keyword, "");
+        return 1;
+    }
+
+#ifdef YASM_THREADS
+    locked = !keyword_listed(preproc_module->keyword, reentrant_preprocs) ||
+        !keyword_listed(parser_module->keyword, reentrant_parsers) ||
+        !keyword_listed(arch_module->keyword, reentrant_archs) ||
+        !keyword_listed(objfmt_module->keyword, reentrant_objfmts) ||
+        !keyword_listed(dbgfmt_module->keyword, reentrant_dbgfmts);
+    if (locked)
+        pthread_mutex_lock(&assemble_lock);
+#endif
+
+    /* Set up architecture, defaulting the machine as the frontend does */
+    if (opts->machine)
+        machine = opts->machine;
+    else if (yasm__strcasecmp(arch_module->keyword, "x86") == 0 &&
+             objfmt_module->default_x86_mode_bits == 64)
+        machine = "amd64";
+    else
+        machine = arch_module->default_machine_keyword;
+    if (yasm__strcasecmp(machine, "amd64") == 0 &&
+        yasm__strcasecmp(objfmt_module->keyword, "elfx32") == 0)
+        machine = "x32";
+
+    arch = yasm_arch_create(arch_module, machine, parser_module->keyword,
+                            &arch_error);
+    if (!arch) {
+        if (arch_error == YASM_ARCH_CREATE_BAD_PARSER)
+            setup_error(print_error, N_("`%s' is not a valid %s for %s"),
+                        parser_module->keyword, "parser",
+                        arch_module->keyword);
+        else
+            setup_error(print_error, N_("`%s' is not a valid %s for %s"),
+                        machine, "machine", arch_module->keyword);
+        goto unlock;
+    }
+
+    object = yasm_object_create(opts->src_filename, opts->obj_filename, arch,
+                                objfmt_module, dbgfmt_module);
+    if (!object) {
+        yasm_error_class eclass;
+        unsigned long xrefline;
+        /*@only@*/ /*@null@*/ char *estr, *xrefstr;
+
+        yasm_error_fetch(&eclass, &estr, &xrefline, &xrefstr);
+        print_error("", 0, estr, NULL, 0, NULL);
+        yasm_xfree(estr);
+        yasm_xfree(xrefstr);
+        goto unlock;
+    }
+    objfmt_module = ((yasm_objfmt_base *)object->objfmt)->module;
+    object->coalesce_data =
+        yasm__strcasecmp(dbgfmt_module->keyword, "null") == 0;
+
+    linemap = yasm_linemap_create();
+    yasm_linemap_set(linemap, opts->src_filename, 0, 1, 1);
+    errwarns = yasm_errwarns_create();
+
+    f = open_input(in);
+    if (!f) {
+        setup_error(print_error, N_("could not open %s stream"), "input",
+                    "", "");
+        goto done;
+    }
+    preproc = yasm_preproc_create_stream(preproc_module, f,
+                                         opts->src_filename, object->symtab,
+                                         linemap, errwarns);
+
+    predef = yasm_xmalloc(strlen("__YASM_OBJFMT__=")
+                          + strlen(opts->objfmt) + 1);
+    strcpy(predef, "__YASM_OBJFMT__=");
+    strcat(predef, opts->objfmt);
+    yasm_preproc_define_builtin(preproc, predef);
+    yasm_xfree(predef);
+    apply_standard_macros(preproc, parser_module->stdmacs,
+                          parser_module->keyword, preproc_module->keyword);
+    apply_standard_macros(preproc, objfmt_module->stdmacs,
+                          parser_module->keyword, preproc_module->keyword);
+
+    if (yasm__strcasecmp(arch_module->keyword, "x86") == 0)
+        yasm_arch_set_var(arch, "mode_bits",
+                          objfmt_module->default_x86_mode_bits);
+
+    yasm_stats_phase_begin(YASM_STATS_PHASE_PARSE);
+    parser_module->do_parse(object, preproc, 0, linemap, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_PARSE);
+    if (yasm_errwarns_num_errors(errwarns, opts->warning_error) > 0)
+        goto done;
+
+    yasm_stats_phase_begin(YASM_STATS_PHASE_FINALIZE);
+    yasm_object_finalize(object, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_FINALIZE);
+    if (yasm_errwarns_num_errors(errwarns, opts->warning_error) > 0)
+        goto done;
+
+    yasm_stats_phase_begin(YASM_STATS_PHASE_OPTIMIZE);
+    yasm_object_optimize(object, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_OPTIMIZE);
+    if (yasm_errwarns_num_errors(errwarns, opts->warning_error) > 0)
+        goto done;
+
+    yasm_stats_phase_begin(YASM_STATS_PHASE_DBGFMT);
+    yasm_dbgfmt_generate(object, linemap, errwarns);
+    yasm_stats_phase_end(YASM_STATS_PHASE_DBGFMT);
+    if (yasm_errwarns_num_errors(errwarns, opts->warning_error) > 0)
+        goto done;
+
+    /* Output replaces any previous contents of the buffer */
+    out->len = 0;
+    o.out = out;
+    o.pos = 0;
+    f = open_output(&o);
+    if (!f) {
+        setup_error(print_error, N_("could not open %s stream"), "output",
+                    "", "");
+        goto done;
+    }
+    yasm_stats_phase_begin(YASM_STATS_PHASE_OUTPUT);
+    yasm_objfmt_output(object, f,
+                       yasm__strcasecmp(dbgfmt_module->keyword, "null"),
+                       errwarns);
+    if (close_output(f, &o) != 0) {
+        setup_error(print_error, N_("error writing %s stream"), "output",
+                    "", "");
+        yasm_stats_phase_end(YASM_STATS_PHASE_OUTPUT);
+        goto done;
+    }
+    yasm_stats_phase_end(YASM_STATS_PHASE_OUTPUT);
+
+    if (yasm_errwarns_num_errors(errwarns, opts->warning_error) == 0) {
+        retval = 0;
+        if (result)
+            collect_object(object, result);
+    }
+
+done:
+    yasm_errwarns_output_all(errwarns, linemap, opts->warning_error,
+                             print_error, print_warning);
+    if (preproc)
+        yasm_preproc_destroy(preproc);
+    yasm_object_destroy(object);
+    yasm_linemap_destroy(linemap);
+    yasm_errwarns_destroy(errwarns);
+unlock:
+#ifdef YASM_THREADS
+    if (locked)
+        pthread_mutex_unlock(&assemble_lock);
+#endif
+    return retval;
+}
+
+int
+yasm_assemble_buffer(const yasm_assemble_options *opts, const char *src,
+                     size_t len, yasm_assemble_output *out)
+{
+    asm_input in;
+    int retval;
+
+    in.buf = src;
+    in.len = len;
+    in.get_line = NULL;
+    in.d = NULL;
+    in.need_newline = 0;
+    yasm_intnum_initialize();
+    retval = assemble(opts, &in, out, NULL);
+    yasm_intnum_cleanup();
+    return retval;
+}
+
+int
+yasm_assemble_lines(const yasm_assemble_options *opts,
+                    yasm_assemble_line_func get_line, void *d,
+                    yasm_assemble_output *out)
+{
+    asm_input in;
+    int retval;
+
+    in.buf = NULL;
+    in.len = 0;
+    in.get_line = get_line;
+    in.d = d;
+    in.need_newline = 0;
+    yasm_intnum_initialize();
+    retval = assemble(opts, &in, out, NULL);
+    yasm_intnum_cleanup();
+    return retval;
+}
+
+void
+yasm_assembly_init(yasm_assembly *result)
+{
+    result->output.data = NULL;
+    result->output.len = 0;
+    result->output.size = 0;
+    result->names = NULL;
+    result->names_len = 0;
+    result->names_size = 0;
+    result->sections = NULL;
+    result->num_sections = 0;
+    result->symbols = NULL;
+    result->num_symbols = 0;
+    result->relocs = NULL;
+    result->num_relocs = 0;
+    result->messages = NULL;
+    result->messages_len = 0;
+    result->messages_size = 0;
+}
+
+void
+yasm_assembly_free(yasm_assembly *result)
+{
+    collect_reset(result);
+    if (result->output.data)
+        yasm_xfree(result->output.data);
+    if (result->names)
+        yasm_xfree(result->names);
+    if (result->messages)
+        yasm_xfree(result->messages);
+    yasm_assembly_init(result);
+}
+
+int
+yasm_assemble_collect(const yasm_assemble_options *opts, const char *src,
+                      size_t len, yasm_assembly *result)
+{
+    yasm_assemble_options o;
+    asm_input in;
+    int retval;
+
+    /* Messages not handled by the caller are collected into result */
+    if (opts)
+        o = *opts;
+    else
+        yasm_assemble_options_init(&o);
+    if (!o.print_error)
+        o.print_error = collect_print_error;
+    if (!o.print_warning)
+        o.print_warning = collect_print_warning;
+
+    in.buf = src;
+    in.len = len;
+    in.get_line = NULL;
+    in.d = NULL;
+    in.need_newline = 0;
+    collect_reset(result);
+    collect_result = result;
+    yasm_intnum_initialize();
+    retval = assemble(&o, &in, &result->output, result);
+    yasm_intnum_cleanup();
+    collect_result = NULL;
+    return retval;
+}
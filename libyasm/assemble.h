@@ -0,0 +1,285 @@
+/**
+ * \file libyasm/assemble.h
+ * \brief YASM in-memory assembly interface.
+ *
+ * \license
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * \endlicense
+ */
+#ifndef YASM_ASSEMBLE_H
+#define YASM_ASSEMBLE_H
+
+#ifndef YASM_LIB_DECL
+#define YASM_LIB_DECL
+#endif
+
+/** Options for yasm_assemble_buffer() and yasm_assemble_lines().  Module
+ * options are keywords of already loaded or registered modules, as accepted
+ * by yasm_load_module().
+ */
+typedef struct yasm_assemble_options {
+    /** Architecture keyword (default "x86"). */
+    const char *arch;
+
+    /** Machine keyword, or NULL (the default) to choose it as the yasm
+     * frontend does: "amd64" for x86 with 64-bit object formats, otherwise
+     * the architecture's default machine.
+     */
+    /*@null@*/ const char *machine;
+
+    /** Parser keyword (default "nasm"). */
+    const char *parser;
+
+    /** Preprocessor keyword, or NULL (the default) for the parser's default
+     * preprocessor.  The preprocessor must support reading from a stream;
+     * see yasm_preproc_create_stream().  For generated code that needs no
+     * macros, "raw" is much faster, as the NASM preprocessor's standard
+     * macros are processed again on every call.
+     */
+    /*@null@*/ const char *preproc;
+
+    /** Object format keyword (default "bin").  The "dbg" object format
+     * writes to its own file and is not supported.
+     */
+    const char *objfmt;
+
+    /** Debug format keyword (default "null"). */
+    const char *dbgfmt;
+
+    /** Source filename used in messages and debug information
+     * (default "-").
+     */
+    const char *src_filename;
+
+    /** Object filename recorded by object formats that mention it, e.g. in
+     * bin map files (default "yasm.out").  Nothing is written to it.
+     */
+    const char *obj_filename;
+
+    /** Nonzero to treat warnings as errors (default 0). */
+    int warning_error;
+
+    /** Function called to print out errors, or NULL (the default) to
+     * discard them.
+     */
+    /*@null@*/ yasm_print_error_func print_error;
+
+    /** Function called to print out warnings, or NULL (the default) to
+     * discard them.
+     */
+    /*@null@*/ yasm_print_warning_func print_warning;
+} yasm_assemble_options;
+
+/** Growable output buffer for yasm_assemble_buffer() and
+ * yasm_assemble_lines().  The same buffer may be reused for many calls to
+ * avoid reallocation.
+ */
+typedef struct yasm_assemble_output {
+    /** Output bytes.  May be NULL if size is 0.  Allocated and grown with
+     * #yasm_xrealloc; the caller frees it with #yasm_xfree.
+     */
+    /*@null@*/ /*@owned@*/ unsigned char *data;
+
+    /** Number of valid bytes in data. */
+    size_t len;
+
+    /** Allocated size of data. */
+    size_t size;
+} yasm_assemble_output;
+
+/** Kind of a symbol in #yasm_assembly_symbol. */
+typedef enum yasm_assembly_sym_kind {
+    YASM_ASSEMBLY_SYM_UNDEF = 0,    /**< Not defined in the source (e.g.
+                                     *   EXTERN or COMMON) */
+    YASM_ASSEMBLY_SYM_LABEL = 1,    /**< Label; value is the offset within
+                                     *   its section */
+    YASM_ASSEMBLY_SYM_EQU = 2       /**< EQU; value is its integer value if
+                                     *   constant, otherwise 0 */
+} yasm_assembly_sym_kind;
+
+/** Section of an assembled object.  All fields are unsigned long so that
+ * arrays of these can be handed out as flat buffers (format "LLLLLL").
+ */
+typedef struct yasm_assembly_section {
+    unsigned long name;         /**< Offset of name in yasm_assembly.names */
+    unsigned long offset;       /**< Offset of contents in the output */
+    unsigned long len;          /**< Length of contents in the output (0 if
+                                 *   not written out, e.g. for BSS) */
+    unsigned long size;         /**< Size of the section in memory */
+    unsigned long first_reloc;  /**< Index of first relocation in
+                                 *   yasm_assembly.relocs */
+    unsigned long num_relocs;   /**< Number of relocations */
+} yasm_assembly_section;
+
+/** Symbol of an assembled object (buffer format "LLlLL"). */
+typedef struct yasm_assembly_symbol {
+    unsigned long name;         /**< Offset of name in yasm_assembly.names */
+    unsigned long value;        /**< Value; see #yasm_assembly_sym_kind */
+    long section;               /**< Index of section for labels, else -1 */
+    unsigned long visibility;   /**< Visibility (#yasm_sym_vis flags) */
+    unsigned long kind;         /**< Kind (#yasm_assembly_sym_kind) */
+} yasm_assembly_symbol;
+
+/** Relocation of an assembled object (buffer format "Ll").  Only the
+ * address and symbol are recorded; the type of relocation is specific to
+ * the object format.
+ */
+typedef struct yasm_assembly_reloc {
+    unsigned long offset;       /**< Offset within the section */
+    long symbol;                /**< Index of relocated symbol in
+                                 *   yasm_assembly.symbols, or -1 */
+} yasm_assembly_reloc;
+
+/** Complete results of yasm_assemble_collect(): the output bytes plus the
+ * sections, symbols and relocations of the object, held in flat arrays so
+ * that callers (such as language bindings) can use them without copying.
+ * Initialize with yasm_assembly_init() and release with yasm_assembly_free();
+ * the same structure may be reused for many calls.
+ */
+typedef struct yasm_assembly {
+    /** Object or flat binary output. */
+    yasm_assemble_output output;
+
+    /** NUL-terminated names, referred to by offset. */
+    /*@null@*/ /*@owned@*/ char *names;
+    size_t names_len;           /**< Length of names (including NULs) */
+    size_t names_size;          /**< Allocated size of names */
+
+    /** Sections, in object order. */
+    /*@null@*/ /*@owned@*/ yasm_assembly_section *sections;
+    unsigned long num_sections; /**< Number of sections */
+
+    /** Symbols, in symbol table order. */
+    /*@null@*/ /*@owned@*/ yasm_assembly_symbol *symbols;
+    unsigned long num_symbols;  /**< Number of symbols */
+
+    /** Relocations of all sections, grouped by section. */
+    /*@null@*/ /*@owned@*/ yasm_assembly_reloc *relocs;
+    unsigned long num_relocs;   /**< Number of relocations */
+
+    /** Errors and warnings not handled by the print_error and print_warning
+     * options, one per line as "file:line: error: message".  NUL-terminated
+     * if messages_len is nonzero.
+     */
+    /*@null@*/ /*@owned@*/ char *messages;
+    size_t messages_len;        /**< Length of messages (excluding NUL) */
+    size_t messages_size;       /**< Allocated size of messages */
+} yasm_assembly;
+
+/** Source line callback for yasm_assemble_lines().
+ * \param d         caller data
+ * \param len       length of the returned line (output)
+ * \return Next line of source, without the trailing newline, or NULL at end
+ *         of input.  The line need not be NUL-terminated, and only needs to
+ *         remain valid until the next call.
+ */
+typedef /*@null@*/ const char * (*yasm_assemble_line_func)
+    (void *d, /*@out@*/ size_t *len);
+
+/** Initialize assembly options to their defaults.
+ * \param opts      options (output)
+ */
+YASM_LIB_DECL
+void yasm_assemble_options_init(/*@out@*/ yasm_assemble_options *opts);
+
+/** Assemble source held in memory into an output buffer, without any
+ * intermediate files where the C library supports custom streams
+ * (fopencookie()).  Elsewhere the source and output are passed through
+ * anonymous temporary files from tmpfile(), which is slower and may fail
+ * if no temporary directory is writable.
+ *
+ * libyasm must have been initialized (see yasm_errwarn_initialize(),
+ * BitVector_Boot() and yasm_floatnum_initialize()) and the modules named
+ * by opts registered; the intnum state of the calling thread is set up as
+ * needed.
+ *
+ * Several threads may assemble at once.  Assemblies run concurrently only
+ * if all their modules keep no global state; at present these are the
+ * "raw", "nasm" and "tasm" preprocessors, the "nasm", "tasm", "gas" and
+ * "gnu" parsers, the "x86" architecture, the bin, coff, win32, win64, x64,
+ * macho, macho32, macho64, elf, elf32, elf64, elfx32, rdf and xdf object
+ * formats, and the "null" debug format.  Assemblies using any other module
+ * (such as the "lc3b" architecture or a debug format other than "null")
+ * are run one at a time.  If yasm was built without thread support,
+ * callers must not assemble from several threads at once.
+ * \param opts      options (may be NULL for defaults)
+ * \param src       source text
+ * \param len       length of src
+ * \param out       output buffer; on success, out->len is the size of the
+ *                  object or flat binary
+ * \return Zero on success, nonzero if there were errors (or warnings, if
+ *         opts->warning_error is set).
+ */
+YASM_LIB_DECL
+int yasm_assemble_buffer(/*@null@*/ const yasm_assemble_options *opts,
+                         const char *src, size_t len,
+                         yasm_assemble_output *out);
+
+/** Assemble source provided a line at a time by a callback into an output
+ * buffer.  Requirements and the use of intermediate files are the same as
+ * for yasm_assemble_buffer().
+ * \param opts      options (may be NULL for defaults)
+ * \param get_line  line callback
+ * \param d         caller data passed to get_line
+ * \param out       output buffer
+ * \return Zero on success, nonzero if there were errors.
+ */
+YASM_LIB_DECL
+int yasm_assemble_lines(/*@null@*/ const yasm_assemble_options *opts,
+                        yasm_assemble_line_func get_line, void *d,
+                        yasm_assemble_output *out);
+
+/** Initialize an assembly result structure to empty.
+ * \param result    assembly results (output)
+ */
+YASM_LIB_DECL
+void yasm_assembly_init(/*@out@*/ yasm_assembly *result);
+
+/** Free everything held by an assembly result structure, leaving it empty.
+ * \param result    assembly results
+ */
+YASM_LIB_DECL
+void yasm_assembly_free(yasm_assembly *result);
+
+/** Assemble source held in memory as yasm_assemble_buffer() does, and also
+ * collect the sections, symbols and relocations of the object.
+ * Requirements are the same as for yasm_assemble_buffer().  Relocations
+ * are only available from object formats that record them in their
+ * sections (all but bin).  Errors and warnings are collected into
+ * result->messages, unless opts->print_error or opts->print_warning are
+ * set.
+ * \param opts      options (may be NULL for defaults)
+ * \param src       source text
+ * \param len       length of src
+ * \param result    assembly results; previous contents are replaced.  If
+ *                  there were errors, only the output is meaningful, and
+ *                  the section, symbol and relocation arrays are empty.
+ * \return Zero on success, nonzero if there were errors.
+ */
+YASM_LIB_DECL
+int yasm_assemble_collect(/*@null@*/ const yasm_assemble_options *opts,
+                          const char *src, size_t len,
+                          yasm_assembly *result);
+
+#endif
@@ -84,7 +84,6 @@ bc_align_destroy(void *contents)
         yasm_expr_destroy(align->fill);
     if (align->maxskip)
         yasm_expr_destroy(align->maxskip);
-    yasm_xfree(contents);
 }
 
 static void
@@ -234,12 +233,14 @@ yasm_bc_create_align(yasm_expr *boundary, yasm_expr *fill,
                      yasm_expr *maxskip, const unsigned char **code_fill,
                      unsigned long line)
 {
-    bytecode_align *align = yasm_xmalloc(sizeof(bytecode_align));
+    yasm_bytecode *bc = yasm_bc_create_inline(&bc_align_callback,
+                                              sizeof(bytecode_align), line);
+    bytecode_align *align = (bytecode_align *)bc->contents;
 
     align->boundary = boundary;
     align->fill = fill;
     align->maxskip = maxskip;
     align->code_fill = code_fill;
 
-    return yasm_bc_create_common(&bc_align_callback, align, line);
+    return bc;
 }
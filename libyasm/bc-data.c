@@ -26,6 +26,8 @@
  */
 #include "util.h"
 
+#include <limits.h>
+
 #include "libyasm-stdint.h"
 #include "coretype.h"
 
@@ -36,6 +38,27 @@
 
 #include "bytecode.h"
 #include "arch.h"
+#include "section.h"
+
+/* Appended data is moved to the data spool in blocks of at least this size */
+#define DATA_SPOOL_BLOCK        65536UL
+
+/* Offsets within the data spool, which may grow past 2 GB.  Without 64-bit
+ * file positioning, spooling stops once the spool reaches that size.
+ */
+#if defined(_MSC_VER)
+typedef __int64 spool_off;
+# define spool_seek(f, off, whence)     _fseeki64(f, off, whence)
+# define spool_tell(f)                  _ftelli64(f)
+#elif defined(HAVE_FSEEKO)
+typedef off_t spool_off;
+# define spool_seek(f, off, whence)     fseeko(f, off, whence)
+# define spool_tell(f)                  ftello(f)
+#else
+typedef long spool_off;
+# define spool_seek(f, off, whence)     fseek(f, off, whence)
+# define spool_tell(f)                  ftell(f)
+#endif
 
 
 struct yasm_dataval {
@@ -56,11 +79,46 @@ struct yasm_dataval {
     /*@only@*/ /*@null@*/ yasm_expr *multiple;
 };
 
+/* Part of a data bytecode generated by a single line */
+typedef struct data_line {
+    unsigned long line;         /* virtual line */
+    unsigned long start;        /* offset from start of bytecode */
+} data_line;
+
+/* Piece of a data bytecode stored in the object's data spool */
+typedef struct data_spool_piece {
+    spool_off pos;              /* position in spool file */
+    unsigned long len;
+} data_spool_piece;
+
+/* Leading part of a data bytecode that has been moved to the data spool */
+typedef struct data_spooled {
+    unsigned long len;          /* total length of the pieces */
+    /*@only@*/ data_spool_piece *pieces;
+    unsigned long num_pieces, pieces_alloc;
+} data_spooled;
+
+#define SPOOL_LEN(bc_data)  ((bc_data)->spooled ? (bc_data)->spooled->len : 0)
+
 typedef struct bytecode_data {
     /* converted data (linked list) */
     yasm_datavalhead datahead;
 
     int item_size;
+
+    /* Nonzero if data has been appended by yasm_bc_data_append(): the data
+     * is then a single raw value with raw_alloc bytes allocated.
+     */
+    unsigned long raw_alloc;
+
+    /* Lines of the appended data, in increasing order; NULL if not kept */
+    /*@null@*/ /*@only@*/ data_line *lines;
+    unsigned long num_lines, lines_alloc;
+
+    /* Leading part of the appended data that has been moved to the data
+     * spool; the raw value holds the rest.  NULL if none.
+     */
+    /*@null@*/ /*@only@*/ data_spooled *spooled;
 } bytecode_data;
 
 static void bc_data_destroy(void *contents);
@@ -91,7 +149,12 @@ bc_data_destroy(void *contents)
 {
     bytecode_data *bc_data = (bytecode_data *)contents;
     yasm_dvs_delete(&bc_data->datahead);
-    yasm_xfree(contents);
+    if (bc_data->lines)
+        yasm_xfree(bc_data->lines);
+    if (bc_data->spooled) {
+        yasm_xfree(bc_data->spooled->pieces);
+        yasm_xfree(bc_data->spooled);
+    }
 }
 
 static void
@@ -99,6 +162,12 @@ bc_data_print(const void *contents, FILE *f, int indent_level)
 {
     const bytecode_data *bc_data = (const bytecode_data *)contents;
     fprintf(f, "%*s_Data_\n", indent_level, "");
+    if (bc_data->lines)
+        fprintf(f, "%*sLines=%lu\n", indent_level+1, "",
+                bc_data->num_lines);
+    if (bc_data->spooled)
+        fprintf(f, "%*sSpooled=%lu\n", indent_level+1, "",
+                bc_data->spooled->len);
     fprintf(f, "%*sElements:\n", indent_level+1, "");
     yasm_dvs_print(&bc_data->datahead, f, indent_level+2);
 }
@@ -169,6 +238,16 @@ bc_data_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
     unsigned long len = 0;
     unsigned long multiple;
 
+    /* Release space left over from appending. */
+    if (bc_data->raw_alloc) {
+        dv = STAILQ_FIRST(&bc_data->datahead);
+        if (bc_data->raw_alloc > dv->data.raw.len) {
+            dv->data.raw.contents = yasm_xrealloc(dv->data.raw.contents,
+                                                  dv->data.raw.len);
+            bc_data->raw_alloc = dv->data.raw.len;
+        }
+    }
+
     /* Count up element sizes, rounding up string length. */
     STAILQ_FOREACH(dv, &bc_data->datahead, link) {
         switch (dv->type) {
@@ -198,10 +277,50 @@ bc_data_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
 
         bc->len += len;
     }
+    bc->len += SPOOL_LEN(bc_data);
 
     return 0;
 }
 
+/* Copy the spooled part of a data bytecode to buf, or (if buf is NULL) to
+ * the file f.
+ */
+static void
+bc_data_read_spooled(yasm_bytecode *bc, /*@null@*/ unsigned char *buf,
+                     /*@null@*/ FILE *f)
+{
+    data_spooled *spooled = ((bytecode_data *)bc->contents)->spooled;
+    FILE *spool = yasm_section_get_object(bc->section)->data_spool;
+    unsigned char *copybuf = NULL;
+    unsigned long i;
+
+    if (!buf)
+        copybuf = yasm_xmalloc(DATA_SPOOL_BLOCK);
+
+    yasm__object_lock();
+    for (i=0; i<spooled->num_pieces; i++) {
+        unsigned long left = spooled->pieces[i].len;
+
+        if (spool_seek(spool, spooled->pieces[i].pos, SEEK_SET) != 0)
+            yasm__fatal(N_("could not read data spool"));
+        while (left > 0) {
+            size_t n = left < DATA_SPOOL_BLOCK ? (size_t)left :
+                (size_t)DATA_SPOOL_BLOCK;
+            if (fread(buf ? buf : copybuf, n, 1, spool) != 1)
+                yasm__fatal(N_("could not read data spool"));
+            if (buf)
+                buf += n;
+            else
+                fwrite(copybuf, n, 1, f);
+            left -= n;
+        }
+    }
+    yasm__object_unlock();
+
+    if (copybuf)
+        yasm_xfree(copybuf);
+}
+
 static int
 bc_data_tobytes(yasm_bytecode *bc, unsigned char **bufp,
                 unsigned char *bufstart, void *d,
@@ -214,6 +333,11 @@ bc_data_tobytes(yasm_bytecode *bc, unsigned char **bufp,
     unsigned int val_len;
     unsigned long multiple, i;
 
+    if (bc_data->spooled) {
+        bc_data_read_spooled(bc, *bufp, NULL);
+        *bufp += bc_data->spooled->len;
+    }
+
     STAILQ_FOREACH(dv, &bc_data->datahead, link) {
         if (yasm_dv_get_multiple(dv, &multiple) || multiple == 0)
             continue;
@@ -263,8 +387,9 @@ yasm_bytecode *
 yasm_bc_create_data(yasm_datavalhead *datahead, unsigned int size,
                     int append_zero, yasm_arch *arch, unsigned long line)
 {
-    bytecode_data *data = yasm_xmalloc(sizeof(bytecode_data));
-    yasm_bytecode *bc = yasm_bc_create_common(&bc_data_callback, data, line);
+    yasm_bytecode *bc = yasm_bc_create_inline(&bc_data_callback,
+                                              sizeof(bytecode_data), line);
+    bytecode_data *data = (bytecode_data *)bc->contents;
     yasm_dataval *dv, *dv2, *dvo;
     yasm_intnum *intn;
     unsigned long len = 0, rlen, i;
@@ -272,6 +397,11 @@ yasm_bc_create_data(yasm_datavalhead *datahead, unsigned int size,
 
     yasm_dvs_initialize(&data->datahead);
     data->item_size = size;
+    data->lines = NULL;
+    data->num_lines = 0;
+    data->lines_alloc = 0;
+    data->raw_alloc = 0;
+    data->spooled = NULL;
 
     /* Prescan input data for length, etc.  Careful: this needs to be
      * precisely paired with the second loop.
@@ -444,6 +574,229 @@ yasm_bc_create_leb128(yasm_datavalhead *datahead, int sign, unsigned long line)
     return yasm_bc_create_data(datahead, 0, 0, 0, line);
 }
 
+unsigned long
+yasm_bc_data_const_len(const yasm_bytecode *bc)
+{
+    const bytecode_data *bc_data;
+    const yasm_dataval *dv;
+    unsigned long len;
+
+    if (bc->callback != &bc_data_callback || bc->multiple)
+        return 0;
+    bc_data = (const bytecode_data *)bc->contents;
+    len = SPOOL_LEN(bc_data);
+    STAILQ_FOREACH(dv, &bc_data->datahead, link) {
+        if (dv->type != DV_RAW || dv->multiple)
+            return 0;
+        len += dv->data.raw.len;
+    }
+    return len;
+}
+
+/* Prepare a constant data bytecode for having data appended: combine its
+ * contents into a single raw value and (optionally) give it a line table.
+ */
+static yasm_dataval *
+bc_data_gather(yasm_bytecode *bc, int keep_lines)
+{
+    bytecode_data *bc_data = (bytecode_data *)bc->contents;
+    yasm_dataval *dv = STAILQ_FIRST(&bc_data->datahead);
+
+    if (bc_data->raw_alloc)
+        return dv;
+
+    if (STAILQ_NEXT(dv, link)) {
+        unsigned long len = yasm_bc_data_const_len(bc), pos = 0;
+        unsigned char *contents = yasm_xmalloc(len);
+        STAILQ_FOREACH(dv, &bc_data->datahead, link) {
+            memcpy(&contents[pos], dv->data.raw.contents, dv->data.raw.len);
+            pos += dv->data.raw.len;
+        }
+        yasm_dvs_delete(&bc_data->datahead);
+        dv = yasm_dvs_append(&bc_data->datahead,
+                             yasm_dv_create_raw(contents, len));
+    }
+    bc_data->raw_alloc = dv->data.raw.len;
+
+    if (!keep_lines)
+        return dv;
+    bc_data->lines = yasm_xmalloc(sizeof(data_line));
+    bc_data->lines[0].line = bc->line;
+    bc_data->lines[0].start = 0;
+    bc_data->num_lines = 1;
+    bc_data->lines_alloc = 1;
+    return dv;
+}
+
+/* Stop spooling data for object after the spool couldn't be written. */
+static void
+bc_data_spool_failed(yasm_object *object)
+{
+    object->spool_data = 0;
+    yasm_warn_set(YASM_WARN_GENERAL,
+                  N_("could not write data spool; keeping data in memory"));
+}
+
+/* Move the in-memory part of appended data to the object's data spool.
+ * If the spool can't be written, the data is simply kept in memory.
+ */
+static void
+bc_data_spool(yasm_bytecode *bc, yasm_dataval *acc)
+{
+    bytecode_data *bc_data = (bytecode_data *)bc->contents;
+    yasm_object *object = yasm_section_get_object(bc->section);
+    data_spooled *spooled;
+    data_spool_piece *last;
+    spool_off pos;
+
+    if (!object->data_spool) {
+        object->data_spool = tmpfile();
+        if (!object->data_spool) {
+            bc_data_spool_failed(object);
+            return;
+        }
+    }
+
+    if (spool_seek(object->data_spool, 0, SEEK_END) != 0 ||
+        (pos = spool_tell(object->data_spool)) < 0 ||
+        fwrite(acc->data.raw.contents, acc->data.raw.len, 1,
+               object->data_spool) != 1) {
+        bc_data_spool_failed(object);
+        return;
+    }
+
+    spooled = bc_data->spooled;
+    if (!spooled) {
+        spooled = yasm_xmalloc(sizeof(data_spooled));
+        spooled->len = 0;
+        spooled->pieces = yasm_xmalloc(sizeof(data_spool_piece));
+        spooled->num_pieces = 0;
+        spooled->pieces_alloc = 1;
+        bc_data->spooled = spooled;
+    }
+
+    /* Extend the last piece if this directly follows it and the combined
+     * length still fits.  Compare by difference so nothing can overflow.
+     */
+    last = spooled->num_pieces > 0 ?
+        &spooled->pieces[spooled->num_pieces-1] : NULL;
+    if (last && pos > last->pos && pos - last->pos == (spool_off)last->len &&
+        acc->data.raw.len <= ULONG_MAX - last->len)
+        last->len += acc->data.raw.len;
+    else {
+        if (spooled->num_pieces == spooled->pieces_alloc) {
+            spooled->pieces_alloc *= 2;
+            spooled->pieces = yasm_xrealloc(spooled->pieces,
+                spooled->pieces_alloc*sizeof(data_spool_piece));
+        }
+        spooled->pieces[spooled->num_pieces].pos = pos;
+        spooled->pieces[spooled->num_pieces].len = acc->data.raw.len;
+        spooled->num_pieces++;
+    }
+    spooled->len += acc->data.raw.len;
+
+    /* Start over with a small buffer, so that a run ending soon after this
+     * doesn't keep a large allocation.
+     */
+    acc->data.raw.len = 0;
+    acc->data.raw.contents = yasm_xrealloc(acc->data.raw.contents, 1);
+    bc_data->raw_alloc = 1;
+}
+
+void
+yasm_bc_data_append(yasm_bytecode *bc, const yasm_bytecode *src,
+                    int keep_lines)
+{
+    bytecode_data *bc_data = (bytecode_data *)bc->contents;
+    const bytecode_data *src_data = (const bytecode_data *)src->contents;
+    yasm_dataval *acc = bc_data_gather(bc, keep_lines);
+    const yasm_dataval *dv;
+    unsigned long base = SPOOL_LEN(bc_data) + acc->data.raw.len;
+    unsigned long len = acc->data.raw.len + yasm_bc_data_const_len(src);
+
+    /* Append the bytes, growing geometrically (the excess is released by
+     * calc_len)
+     */
+    if (len > bc_data->raw_alloc) {
+        bc_data->raw_alloc = len > 2*bc_data->raw_alloc ? len :
+            2*bc_data->raw_alloc;
+        acc->data.raw.contents = yasm_xrealloc(acc->data.raw.contents,
+                                               bc_data->raw_alloc);
+    }
+    STAILQ_FOREACH(dv, &src_data->datahead, link) {
+        memcpy(&acc->data.raw.contents[acc->data.raw.len],
+               dv->data.raw.contents, dv->data.raw.len);
+        acc->data.raw.len += dv->data.raw.len;
+    }
+
+    /* Start a new part unless src is on the same line as the last one */
+    if (bc_data->lines &&
+        bc_data->lines[bc_data->num_lines-1].line != src->line) {
+        if (bc_data->num_lines == bc_data->lines_alloc) {
+            bc_data->lines_alloc *= 2;
+            bc_data->lines = yasm_xrealloc(bc_data->lines,
+                bc_data->lines_alloc*sizeof(data_line));
+        }
+        bc_data->lines[bc_data->num_lines].line = src->line;
+        bc_data->lines[bc_data->num_lines].start = base;
+        bc_data->num_lines++;
+    }
+
+    if (acc->data.raw.len >= DATA_SPOOL_BLOCK &&
+        yasm_section_get_object(bc->section)->spool_data)
+        bc_data_spool(bc, acc);
+}
+
+int
+yasm_bc_data_write_spooled(yasm_bytecode *bc, FILE *f)
+{
+    bytecode_data *bc_data = (bytecode_data *)bc->contents;
+    yasm_dataval *dv;
+
+    if (bc->callback != &bc_data_callback || !bc_data->spooled)
+        return 0;
+
+    bc_data_read_spooled(bc, NULL, f);
+    dv = STAILQ_FIRST(&bc_data->datahead);
+    if (dv->data.raw.len > 0)
+        fwrite(dv->data.raw.contents, dv->data.raw.len, 1, f);
+    return 1;
+}
+
+int
+yasm_bc_get_line_span(const yasm_bytecode *bc, unsigned long line,
+                      unsigned long *startp, unsigned long *lenp)
+{
+    const bytecode_data *bc_data = (const bytecode_data *)bc->contents;
+    unsigned long lo, hi;
+
+    if (bc->callback != &bc_data_callback || !bc_data->lines) {
+        *startp = 0;
+        *lenp = bc->len;
+        return bc->line == line;
+    }
+
+    /* Binary search for the line */
+    lo = 0;
+    hi = bc_data->num_lines;
+    while (lo < hi) {
+        unsigned long mid = lo + (hi-lo)/2;
+        if (bc_data->lines[mid].line < line)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    if (lo == bc_data->num_lines || bc_data->lines[lo].line != line)
+        return 0;
+
+    *startp = bc_data->lines[lo].start;
+    if (lo+1 < bc_data->num_lines)
+        *lenp = bc_data->lines[lo+1].start - *startp;
+    else
+        *lenp = bc->len - *startp;
+    return 1;
+}
+
 yasm_dataval *
 yasm_dv_create_expr(yasm_expr *e)
 {
@@ -37,8 +37,9 @@
 #include "value.h"
 
 #include "bytecode.h"
+#include "section.h"
 
-#include "file.h"
+#include "filecache.h"
 
 
 typedef struct bytecode_incbin {
@@ -81,7 +82,6 @@ bc_incbin_destroy(void *contents)
     yasm_xfree(incbin->filename);
     yasm_expr_destroy(incbin->start);
     yasm_expr_destroy(incbin->maxlen);
-    yasm_xfree(contents);
 }
 
 static void
@@ -127,12 +127,30 @@ bc_incbin_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
     incbin->maxlen = val.abs;
 }
 
+/* Get the (cached) contents of the included file. */
+static /*@null@*/ const unsigned char *
+bc_incbin_get_data(yasm_bytecode *bc, /*@out@*/ unsigned long *flen)
+{
+    bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
+    yasm_object *object = yasm_section_get_object(bc->section);
+    const unsigned char *data;
+
+    yasm__object_lock();
+    data = yasm_filecache_get(object->filecache, incbin->filename,
+                              incbin->from, flen);
+    yasm__object_unlock();
+    if (!data)
+        yasm_error_set(YASM_ERROR_IO,
+                       N_("`incbin': unable to open file `%s'"),
+                       incbin->filename);
+    return data;
+}
+
 static int
 bc_incbin_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
                    void *add_span_data)
 {
     bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
-    FILE *f;
     /*@dependent@*/ /*@null@*/ const yasm_intnum *num;
     unsigned long start = 0, maxlen = 0xFFFFFFFFUL, flen;
 
@@ -162,22 +180,9 @@ bc_incbin_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
         }
     }
 
-    /* Open file and determine its length */
-    f = yasm_fopen_include(incbin->filename, incbin->from, "rb", NULL);
-    if (!f) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to open file `%s'"),
-                       incbin->filename);
-        return -1;
-    }
-    if (fseek(f, 0L, SEEK_END) < 0) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to seek on file `%s'"),
-                       incbin->filename);
+    /* Load file (or find it in the cache) and determine its length */
+    if (!bc_incbin_get_data(bc, &flen))
         return -1;
-    }
-    flen = (unsigned long)ftell(f);
-    fclose(f);
 
     /* Compute length of incbin from start, maxlen, and len */
     if (start > flen) {
@@ -201,9 +206,9 @@ bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
                   /*@unused@*/ yasm_output_reloc_func output_reloc)
 {
     bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
-    FILE *f;
     /*@dependent@*/ /*@null@*/ const yasm_intnum *num;
-    unsigned long start = 0;
+    const unsigned char *data;
+    unsigned long start = 0, flen;
 
     /* Convert start to integer value */
     if (incbin->start) {
@@ -214,34 +219,19 @@ bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
         start = yasm_intnum_get_uint(num);
     }
 
-    /* Open file */
-    f = yasm_fopen_include(incbin->filename, incbin->from, "rb", NULL);
-    if (!f) {
-        yasm_error_set(YASM_ERROR_IO, N_("`incbin': unable to open file `%s'"),
-                       incbin->filename);
+    /* Get file contents; normally already cached by calc_len */
+    data = bc_incbin_get_data(bc, &flen);
+    if (!data)
         return 1;
-    }
 
-    /* Seek to start of data */
-    if (fseek(f, (long)start, SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to seek on file `%s'"),
-                       incbin->filename);
-        fclose(f);
-        return 1;
-    }
-
-    /* Read len bytes */
-    if (fread(*bufp, 1, (size_t)bc->len, f) < (size_t)bc->len) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to read %lu bytes from file `%s'"),
-                       bc->len, incbin->filename);
-        fclose(f);
-        return 1;
-    }
+    if (start > flen)
+        start = flen;
+    if (bc->len > flen - start)
+        yasm_internal_error(N_("incbin length exceeds file length"));
 
+    /* Copy len bytes from start of data */
+    memcpy(*bufp, data + start, (size_t)bc->len);
     *bufp += bc->len;
-    fclose(f);
     return 0;
 }
 
@@ -249,7 +239,9 @@ yasm_bytecode *
 yasm_bc_create_incbin(char *filename, yasm_expr *start, yasm_expr *maxlen,
                       yasm_linemap *linemap, unsigned long line)
 {
-    bytecode_incbin *incbin = yasm_xmalloc(sizeof(bytecode_incbin));
+    yasm_bytecode *bc = yasm_bc_create_inline(&bc_incbin_callback,
+                                              sizeof(bytecode_incbin), line);
+    bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
     unsigned long xline;
 
     /* Find from filename based on line number */
@@ -261,5 +253,5 @@ yasm_bc_create_incbin(char *filename, yasm_expr *start, yasm_expr *maxlen,
     incbin->maxlen = maxlen;
     /*@=mustfree@*/
 
-    return yasm_bc_create_common(&bc_incbin_callback, incbin, line);
+    return bc;
 }
@@ -71,7 +71,6 @@ static const yasm_bytecode_callback bc_org_callback = {
 static void
 bc_org_destroy(void *contents)
 {
-    yasm_xfree(contents);
 }
 
 static void
@@ -143,10 +142,12 @@ bc_org_tobytes(yasm_bytecode *bc, unsigned char **bufp,
 yasm_bytecode *
 yasm_bc_create_org(unsigned long start, unsigned long fill, unsigned long line)
 {
-    bytecode_org *org = yasm_xmalloc(sizeof(bytecode_org));
+    yasm_bytecode *bc = yasm_bc_create_inline(&bc_org_callback,
+                                              sizeof(bytecode_org), line);
+    bytecode_org *org = (bytecode_org *)bc->contents;
 
     org->start = start;
     org->fill = fill;
 
-    return yasm_bc_create_common(&bc_org_callback, org, line);
+    return bc;
 }
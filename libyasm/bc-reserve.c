@@ -71,7 +71,6 @@ bc_reserve_destroy(void *contents)
 {
     bytecode_reserve *reserve = (bytecode_reserve *)contents;
     yasm_expr_destroy(reserve->numitems);
-    yasm_xfree(contents);
 }
 
 static void
@@ -128,14 +127,16 @@ yasm_bytecode *
 yasm_bc_create_reserve(yasm_expr *numitems, unsigned int itemsize,
                        unsigned long line)
 {
-    bytecode_reserve *reserve = yasm_xmalloc(sizeof(bytecode_reserve));
+    yasm_bytecode *bc = yasm_bc_create_inline(&bc_reserve_callback,
+                                              sizeof(bytecode_reserve), line);
+    bytecode_reserve *reserve = (bytecode_reserve *)bc->contents;
 
     /*@-mustfree@*/
     reserve->numitems = numitems;
     /*@=mustfree@*/
     reserve->itemsize = itemsize;
 
-    return yasm_bc_create_common(&bc_reserve_callback, reserve, line);
+    return bc;
 }
 
 const yasm_expr *
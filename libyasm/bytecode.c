@@ -34,10 +34,73 @@
 #include "expr.h"
 #include "value.h"
 #include "symrec.h"
+#include "stats.h"
 
 #include "bytecode.h"
 
 
+/* Bytecodes are allocated from chunks of BC_CHUNK_COUNT, so that those
+ * created together (and thus usually adjacent in a section) are adjacent in
+ * memory.  Destroyed bytecodes are reused, and the chunks are freed once no
+ * bytecodes remain.  The pool is per-thread so that separate objects may be
+ * assembled concurrently; bytecodes must be destroyed by the thread that
+ * created them.
+ */
+#define BC_CHUNK_COUNT  512
+
+typedef struct bc_chunk {
+    /*@null@*/ /*@owned@*/ struct bc_chunk *next;
+    yasm_bytecode bcs[BC_CHUNK_COUNT];
+} bc_chunk;
+
+static YASM_THREAD_LOCAL /*@null@*/ /*@owned@*/ bc_chunk *bc_chunks = NULL;
+/* bytecodes used in first chunk */
+static YASM_THREAD_LOCAL unsigned long bc_chunk_used = BC_CHUNK_COUNT;
+/* free list, linked through link */
+static YASM_THREAD_LOCAL /*@null@*/ yasm_bytecode *bc_free = NULL;
+/* bytecodes in use */
+static YASM_THREAD_LOCAL unsigned long bc_count = 0;
+
+static /*@only@*/ yasm_bytecode *
+bc_alloc(void)
+{
+    yasm_bytecode *bc;
+
+    if (bc_free) {
+        bc = bc_free;
+        bc_free = STAILQ_NEXT(bc, link);
+    } else {
+        if (bc_chunk_used == BC_CHUNK_COUNT) {
+            bc_chunk *chunk = yasm_xmalloc(sizeof(bc_chunk));
+            chunk->next = bc_chunks;
+            bc_chunks = chunk;
+            bc_chunk_used = 0;
+        }
+        bc = &bc_chunks->bcs[bc_chunk_used++];
+    }
+    bc_count++;
+    return bc;
+}
+
+static void
+bc_free_node(/*@only@*/ yasm_bytecode *bc)
+{
+    STAILQ_NEXT(bc, link) = bc_free;
+    bc_free = bc;
+    if (--bc_count > 0)
+        return;
+
+    /* Last bytecode gone; release everything */
+    while (bc_chunks) {
+        bc_chunk *chunk = bc_chunks;
+        bc_chunks = chunk->next;
+        yasm_xfree(chunk);
+    }
+    bc_chunk_used = BC_CHUNK_COUNT;
+    bc_free = NULL;
+}
+
+
 void
 yasm_bc_set_multiple(yasm_bytecode *bc, yasm_expr *e)
 {
@@ -92,12 +155,27 @@ yasm_bc_transform(yasm_bytecode *bc, const yasm_bytecode_callback *callback,
     bc->contents = contents;
 }
 
+void
+yasm_bc_transform_inline(yasm_bytecode *bc,
+                         const yasm_bytecode_callback *callback,
+                         const void *contents, size_t size)
+{
+    if (size > YASM_BC_INLINE_SIZE)
+        yasm_internal_error(N_("bytecode contents too large to hold inline"));
+    if (bc->callback)
+        bc->callback->destroy(bc->contents);
+    memcpy(bc->inline_contents.data, contents, size);
+    bc->callback = callback;
+    bc->contents = bc->inline_contents.data;
+}
+
 yasm_bytecode *
 yasm_bc_create_common(const yasm_bytecode_callback *callback, void *contents,
                       unsigned long line)
 {
-    yasm_bytecode *bc = yasm_xmalloc(sizeof(yasm_bytecode));
+    yasm_bytecode *bc = bc_alloc();
 
+    yasm_stats_inc(YASM_STATS_BYTECODES);
     bc->callback = callback;
     bc->section = NULL;
     bc->multiple = (yasm_expr *)NULL;
@@ -105,12 +183,26 @@ yasm_bc_create_common(const yasm_bytecode_callback *callback, void *contents,
     bc->mult_int = 1;
     bc->line = line;
     bc->offset = ~0UL;  /* obviously incorrect / uninitialized value */
+    bc->bc_index = 0;
     bc->symrecs = NULL;
     bc->contents = contents;
 
     return bc;
 }
 
+yasm_bytecode *
+yasm_bc_create_inline(const yasm_bytecode_callback *callback, size_t size,
+                      unsigned long line)
+{
+    yasm_bytecode *bc;
+
+    if (size > YASM_BC_INLINE_SIZE)
+        yasm_internal_error(N_("bytecode contents too large to hold inline"));
+    bc = yasm_bc_create_common(callback, NULL, line);
+    bc->contents = bc->inline_contents.data;
+    return bc;
+}
+
 yasm_section *
 yasm_bc_get_section(yasm_bytecode *bc)
 {
@@ -149,7 +241,7 @@ yasm_bc_destroy(yasm_bytecode *bc)
     yasm_expr_destroy(bc->multiple);
     if (bc->symrecs)
         yasm_xfree(bc->symrecs);
-    yasm_xfree(bc);
+    bc_free_node(bc);
 }
 
 void
@@ -315,28 +407,33 @@ yasm_bc_tobytes(yasm_bytecode *bc, unsigned char *buf, unsigned long *bufsize,
         *bufsize = 0;
         return NULL;
     }
-    bc->mult_int = mult;
+    /* The optimizer has already set mult_int; sections may be output in
+     * parallel, reading it through yasm_bc_next_offset(), so only store it
+     * if it actually changed.
+     */
+    if (bc->mult_int != mult)
+        bc->mult_int = mult;
 
     /* special case for reserve bytecodes */
     if (bc->callback->special == YASM_BC_SPECIAL_RESERVE) {
-        *bufsize = bc->len*bc->mult_int;
+        *bufsize = bc->len*mult;
         *gap = 1;
         return NULL;    /* we didn't allocate a buffer */
     }
     *gap = 0;
 
-    if (*bufsize < bc->len*bc->mult_int) {
-        mybuf = yasm_xmalloc(bc->len*bc->mult_int);
+    if (*bufsize < bc->len*mult) {
+        mybuf = yasm_xmalloc(bc->len*mult);
         destbuf = mybuf;
     } else
         destbuf = buf;
     bufstart = destbuf;
 
-    *bufsize = bc->len*bc->mult_int;
+    *bufsize = bc->len*mult;
 
     if (!bc->callback)
         yasm_internal_error(N_("got empty bytecode in bc_tobytes"));
-    else for (i=0; i<bc->mult_int; i++) {
+    else for (i=0; i<mult; i++) {
         origbuf = destbuf;
         error = bc->callback->tobytes(bc, &destbuf, bufstart, d, output_value,
                                       output_reloc);
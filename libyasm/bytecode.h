@@ -64,6 +64,8 @@ typedef struct yasm_bytecode_callback {
     /** Destroys the implementation-specific data.
      * Called from yasm_bc_destroy().
      * \param contents  #yasm_bytecode.contents
+     * \note Contents held inline (see yasm_bc_create_inline()) are part of
+     *       the bytecode, so must not be freed themselves.
      */
     void (*destroy) (/*@only@*/ void *contents);
 
@@ -179,6 +181,11 @@ typedef struct yasm_bytecode_callback {
     } special;
 } yasm_bytecode_callback;
 
+/** Maximum size of bytecode contents that can be held within the bytecode
+ * itself.  See yasm_bc_create_inline().
+ */
+#define YASM_BC_INLINE_SIZE     72
+
 /** A bytecode. */
 struct yasm_bytecode {
     /** Bytecodes are stored as a singly linked list, with tail insertion.
@@ -215,7 +222,10 @@ struct yasm_bytecode {
      */
     unsigned long offset;
 
-    /** Unique integer index of bytecode.  Used during optimization. */
+    /** Unique integer index of bytecode.  Used during optimization.  Before
+     * then, nonzero if a label or current position symbol refers to the
+     * position following this bytecode.
+     */
     unsigned long bc_index;
 
     /** NULL-terminated array of labels that point to this bytecode (as the
@@ -225,6 +235,16 @@ struct yasm_bytecode {
 
     /** Implementation-specific data (type identified by callback). */
     void *contents;
+
+    /** Storage for implementation-specific data held inline; unused unless
+     * contents points here.  See yasm_bc_create_inline().
+     */
+    union {
+        void *p;
+        long l;
+        double d;
+        unsigned char data[YASM_BC_INLINE_SIZE];
+    } inline_contents;
 };
 
 /** Create a bytecode of any specified type.
@@ -249,6 +269,35 @@ void yasm_bc_transform(yasm_bytecode *bc,
                        const yasm_bytecode_callback *callback,
                        void *contents);
 
+/** Create a bytecode whose type-specific data is held within the bytecode
+ * itself rather than separately allocated, saving an allocation and keeping
+ * the data next to the rest of the bytecode.  The callback destroy function
+ * must not free the contents (only what they refer to).
+ * \param callback      bytecode callback functions
+ * \param size          size of type-specific data; at most
+ *                      #YASM_BC_INLINE_SIZE
+ * \param line          virtual line (from yasm_linemap)
+ * \return Newly allocated bytecode of the specified type; the
+ *         type-specific data at #yasm_bytecode.contents is uninitialized.
+ */
+YASM_LIB_DECL
+/*@only@*/ yasm_bytecode *yasm_bc_create_inline
+    (const yasm_bytecode_callback *callback, size_t size, unsigned long line);
+
+/** Transform a bytecode of any type into a different type, with the new
+ * type-specific data held inline (see yasm_bc_create_inline()).
+ * \param bc            bytecode to transform
+ * \param callback      new bytecode callback function
+ * \param contents      new type-specific data; copied, after the old data
+ *                      has been destroyed
+ * \param size          size of type-specific data; at most
+ *                      #YASM_BC_INLINE_SIZE
+ */
+YASM_LIB_DECL
+void yasm_bc_transform_inline(yasm_bytecode *bc,
+                              const yasm_bytecode_callback *callback,
+                              const void *contents, size_t size);
+
 /** Common bytecode callback finalize function, for where no finalization
  * is ever required for this type of bytecode.
  */
@@ -320,6 +369,60 @@ YASM_LIB_DECL
 /*@only@*/ yasm_bytecode *yasm_bc_create_leb128
     (yasm_datavalhead *datahead, int sign, unsigned long line);
 
+/** Get the length of a bytecode if it consists only of constant data: a
+ * data bytecode without a multiple whose values have all been converted to
+ * raw bytes.  Only such bytecodes may be passed to yasm_bc_data_append().
+ * \param bc            bytecode
+ * \return Length of the data in bytes; 0 if bc is not constant data (or is
+ *         empty).
+ */
+YASM_LIB_DECL
+unsigned long yasm_bc_data_const_len(const yasm_bytecode *bc);
+
+/** Append the contents of a constant data bytecode to another.  Repeating
+ * this over a run of bytecodes collects the entire run into a single raw
+ * data value, so that the later stages handle one bytecode rather than one
+ * per source line.
+ * \param bc            constant data bytecode
+ * \param src           constant data bytecode from the same or a later line
+ *                      than any appended so far; not modified (the caller
+ *                      should delete it)
+ * \param keep_lines    if nonzero, keep the line and length of each part in
+ *                      a side table (see yasm_bc_get_line_span()); must be the
+ *                      same for all calls on bc
+ */
+YASM_LIB_DECL
+void yasm_bc_data_append(yasm_bytecode *bc, const yasm_bytecode *src,
+                         int keep_lines);
+
+/** Get the portion of a bytecode's contents generated by a virtual line.
+ * Bytecodes normally belong to a single line, but those that have had data
+ * appended by yasm_bc_data_append() with keep_lines set span several.
+ * \param bc            bytecode
+ * \param line          virtual line
+ * \param startp        offset of the portion within the bytecode (output)
+ * \param lenp          length of the portion (output)
+ * \return Nonzero if the line generated part of the bytecode, 0 if not.
+ * \note Should only be called after yasm_bc_calc_len().
+ */
+YASM_LIB_DECL
+int yasm_bc_get_line_span(const yasm_bytecode *bc, unsigned long line,
+                          /*@out@*/ unsigned long *startp,
+                          /*@out@*/ unsigned long *lenp);
+
+/** Write the contents of a constant data bytecode straight to a file if
+ * part of it has been moved to the object's data spool (see
+ * #yasm_object.spool_data).  This avoids reading the whole bytecode back
+ * into memory, as yasm_bc_tobytes() would.
+ * \param bc            bytecode
+ * \param f             output file
+ * \return Nonzero if bc was written, 0 if it is not spooled data (and should
+ *         be output normally).
+ * \note Should only be called after yasm_bc_calc_len().
+ */
+YASM_LIB_DECL
+int yasm_bc_data_write_spooled(yasm_bytecode *bc, FILE *f);
+
 /** Create a bytecode reserving space.
  * \param numitems      number of reserve "items" (kept, do not free)
  * \param itemsize      reserved size (in bytes) for each item
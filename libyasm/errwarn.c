@@ -54,12 +54,13 @@ static const char *def_gettext_hook(const char *msgid);
 /*@exits@*/ void (*yasm_fatal) (const char *message, va_list va) = def_fatal;
 const char * (*yasm_gettext_hook) (const char *msgid) = def_gettext_hook;
 
-/* Error indicator */
-/* yasm_eclass is not static so that yasm_error_occurred macro can access it */
-yasm_error_class yasm_eclass;
-static /*@only@*/ /*@null@*/ char *yasm_estr;
-static unsigned long yasm_exrefline;
-static /*@only@*/ /*@null@*/ char *yasm_exrefstr;
+/* Error indicator.  The error and warning indicators are per-thread, as
+ * output may run in several threads.
+ */
+static YASM_THREAD_LOCAL yasm_error_class yasm_eclass;
+static YASM_THREAD_LOCAL /*@only@*/ /*@null@*/ char *yasm_estr;
+static YASM_THREAD_LOCAL unsigned long yasm_exrefline;
+static YASM_THREAD_LOCAL /*@only@*/ /*@null@*/ char *yasm_exrefstr;
 
 /* Warning indicator */
 typedef struct warn {
@@ -68,37 +69,46 @@ typedef struct warn {
     yasm_warn_class wclass;
     /*@owned@*/ /*@null@*/ char *wstr;
 } warn;
-static STAILQ_HEAD(warn_head, warn) yasm_warns;
+static YASM_THREAD_LOCAL STAILQ_HEAD(warn_head, warn) yasm_warns;
 
 /* Enabled warnings.  See errwarn.h for a list. */
 static unsigned long warn_class_enabled;
 
 typedef struct errwarn_data {
-    /*@reldef@*/ SLIST_ENTRY(errwarn_data) link;
-
     enum { WE_UNKNOWN, WE_ERROR, WE_WARNING, WE_PARSERERROR } type;
 
     unsigned long line;
+    unsigned long seq;          /* order added; breaks ties between lines */
     unsigned long xrefline;
     /*@owned@*/ char *msg;
     /*@owned@*/ char *xrefmsg;
 } errwarn_data;
 
 struct yasm_errwarns {
-    /*@reldef@*/ SLIST_HEAD(errwarn_head, errwarn_data) errwarns;
+    /* Errors and warnings in the order they were added.  They are sorted
+     * by line (keeping entries on the same line in the order added) only
+     * when output, as outputs and optimizations add them in section
+     * rather than source order.
+     */
+    /*@only@*/ /*@null@*/ errwarn_data *we;
+    size_t num_we;
+    size_t alloc_we;
+
+    /* Nonzero if we[] is known to be in line order */
+    int sorted;
+
+    /* Sequence number of the next entry added */
+    unsigned long next_seq;
 
     /* Total error count */
     unsigned int ecount;
 
     /* Total warning count */
     unsigned int wcount;
-
-    /* Last inserted error/warning.  Used to speed up insertions. */
-    /*@null@*/ errwarn_data *previous_we;
 };
 
 /* Static buffer for use by conv_unprint(). */
-static char unprint[5];
+static YASM_THREAD_LOCAL char unprint[5];
 
 
 static const char *
@@ -183,67 +193,96 @@ def_fatal(const char *fmt, va_list va)
     exit(EXIT_FAILURE);
 }
 
-/* Create an errwarn structure in the correct linked list location.
- * If replace_parser_error is nonzero, overwrites the last error if its
- * type is WE_PARSERERROR.
+/* Returns nonzero if a comes after b in output order. */
+static int
+errwarn_data_after(const errwarn_data *a, const errwarn_data *b)
+{
+    return a->line > b->line || (a->line == b->line && a->seq > b->seq);
+}
+
+static int
+errwarn_data_compare(const void *a, const void *b)
+{
+    const errwarn_data *wea = (const errwarn_data *)a;
+    const errwarn_data *web = (const errwarn_data *)b;
+
+    if (errwarn_data_after(wea, web))
+        return 1;
+    if (errwarn_data_after(web, wea))
+        return -1;
+    return 0;
+}
+
+/* Find the entry that a new entry on line would directly follow in output
+ * order, or if there is none, the first entry in output order.  Returns
+ * NULL if there are no entries.
+ */
+static /*@null@*/ errwarn_data *
+errwarn_data_find_prev(yasm_errwarns *errwarns, unsigned long line)
+{
+    errwarn_data *prev = NULL, *first = NULL, *we;
+    size_t i;
+
+    if (errwarns->num_we == 0)
+        return NULL;
+
+    /* Common case: entries added in line order */
+    we = &errwarns->we[errwarns->num_we-1];
+    if (errwarns->sorted && we->line <= line)
+        return we;
+
+    for (i=0; i<errwarns->num_we; i++) {
+        we = &errwarns->we[i];
+        if (!first || errwarn_data_after(first, we))
+            first = we;
+        if (we->line <= line && (!prev || errwarn_data_after(we, prev)))
+            prev = we;
+    }
+    return prev ? prev : first;
+}
+
+/* Add an errwarn structure.  If replace_parser_error is nonzero, overwrites
+ * the error the new one would follow if its type is WE_PARSERERROR.  The
+ * returned pointer is only valid until the next entry is added.
  */
 static errwarn_data *
 errwarn_data_new(yasm_errwarns *errwarns, unsigned long line,
                  int replace_parser_error)
 {
-    errwarn_data *first, *next, *ins_we, *we;
-    enum { INS_NONE, INS_HEAD, INS_AFTER } action = INS_NONE;
+    errwarn_data *we;
 
-    /* Find the entry with either line=line or the last one with line<line.
-     * Start with the last entry added to speed the search.
-     */
-    ins_we = errwarns->previous_we;
-    first = SLIST_FIRST(&errwarns->errwarns);
-    if (!ins_we || !first)
-        action = INS_HEAD;
-    while (action == INS_NONE) {
-        next = SLIST_NEXT(ins_we, link);
-        if (line < ins_we->line) {
-            if (ins_we == first)
-                action = INS_HEAD;
-            else
-                ins_we = first;
-        } else if (!next)
-            action = INS_AFTER;
-        else if (line >= ins_we->line && line < next->line)
-            action = INS_AFTER;
-        else
-            ins_we = next;
+    if (replace_parser_error) {
+        we = errwarn_data_find_prev(errwarns, line);
+        if (we && we->type == WE_PARSERERROR)
+            return we;      /* overwrite last error */
     }
 
-    if (replace_parser_error && ins_we && ins_we->type == WE_PARSERERROR) {
-        /* overwrite last error */      
-        we = ins_we;
-    } else {
-        /* add a new error */
-        we = yasm_xmalloc(sizeof(errwarn_data));
-
-        we->type = WE_UNKNOWN;
-        we->line = line;
-        we->xrefline = 0;
-        we->msg = NULL;
-        we->xrefmsg = NULL;
-
-        if (action == INS_HEAD)
-            SLIST_INSERT_HEAD(&errwarns->errwarns, we, link);
-        else if (action == INS_AFTER) {
-            assert(ins_we != NULL);
-            SLIST_INSERT_AFTER(ins_we, we, link);
-        } else
-            yasm_internal_error(N_("Unexpected errwarn insert action"));
+    if (errwarns->num_we >= errwarns->alloc_we) {
+        errwarns->alloc_we = errwarns->alloc_we ? errwarns->alloc_we*2 : 16;
+        errwarns->we = yasm_xrealloc(errwarns->we,
+                                     errwarns->alloc_we*sizeof(errwarn_data));
     }
 
-    /* Remember previous err/warn */
-    errwarns->previous_we = we;
+    if (errwarns->num_we > 0 && errwarns->we[errwarns->num_we-1].line > line)
+        errwarns->sorted = 0;
+
+    we = &errwarns->we[errwarns->num_we++];
+    we->type = WE_UNKNOWN;
+    we->line = line;
+    we->seq = errwarns->next_seq++;
+    we->xrefline = 0;
+    we->msg = NULL;
+    we->xrefmsg = NULL;
 
     return we;
 }
 
+yasm_error_class
+yasm_error_occurred(void)
+{
+    return yasm_eclass;
+}
+
 void
 yasm_error_clear(void)
 {
@@ -360,6 +399,12 @@ yasm_warn_set_va(yasm_warn_class wclass, const char *format, va_list va)
     if (!(warn_class_enabled & (1UL<<wclass)))
         return;     /* warning is part of disabled class */
 
+    /* The list head is only zero-initialized in threads other than the one
+     * that called yasm_errwarn_initialize().
+     */
+    if (!yasm_warns.stqh_last)
+        STAILQ_INIT(&yasm_warns);
+
     w = yasm_xmalloc(sizeof(warn));
     w->wclass = wclass;
     w->wstr = yasm_xmalloc(MSG_MAXSIZE+1);
@@ -420,29 +465,31 @@ yasm_errwarns *
 yasm_errwarns_create(void)
 {
     yasm_errwarns *errwarns = yasm_xmalloc(sizeof(yasm_errwarns));
-    SLIST_INIT(&errwarns->errwarns);
+    errwarns->we = NULL;
+    errwarns->num_we = 0;
+    errwarns->alloc_we = 0;
+    errwarns->sorted = 1;
+    errwarns->next_seq = 0;
     errwarns->ecount = 0;
     errwarns->wcount = 0;
-    errwarns->previous_we = NULL;
     return errwarns;
 }
 
 void
 yasm_errwarns_destroy(yasm_errwarns *errwarns)
 {
-    errwarn_data *we;
+    size_t i;
 
     /* Delete all error/warnings */
-    while (!SLIST_EMPTY(&errwarns->errwarns)) {
-        we = SLIST_FIRST(&errwarns->errwarns);
+    for (i=0; i<errwarns->num_we; i++) {
+        errwarn_data *we = &errwarns->we[i];
         if (we->msg)
             yasm_xfree(we->msg);
         if (we->xrefmsg)
             yasm_xfree(we->xrefmsg);
-
-        SLIST_REMOVE_HEAD(&errwarns->errwarns, link);
-        yasm_xfree(we);
     }
+    if (errwarns->we)
+        yasm_xfree(errwarns->we);
 
     yasm_xfree(errwarns);
 }
@@ -473,6 +520,32 @@ yasm_errwarn_propagate(yasm_errwarns *errwarns, unsigned long line)
     }
 }
 
+void
+yasm_errwarns_merge(yasm_errwarns *errwarns, yasm_errwarns *src)
+{
+    size_t i;
+
+    /* Moving src's entries in the order they were added gives the same
+     * result as propagating them into errwarns directly.
+     */
+    for (i=0; i<src->num_we; i++) {
+        errwarn_data *swe = &src->we[i];
+        errwarn_data *we = errwarn_data_new(errwarns, swe->line, 0);
+
+        we->type = swe->type;
+        we->xrefline = swe->xrefline;
+        we->msg = swe->msg;
+        we->xrefmsg = swe->xrefmsg;
+    }
+    src->num_we = 0;
+    src->sorted = 1;
+
+    errwarns->ecount += src->ecount;
+    errwarns->wcount += src->wcount;
+    src->ecount = 0;
+    src->wcount = 0;
+}
+
 unsigned int
 yasm_errwarns_num_errors(yasm_errwarns *errwarns, int warning_as_error)
 {
@@ -491,6 +564,7 @@ yasm_errwarns_output_all(yasm_errwarns *errwarns, yasm_linemap *lm,
     errwarn_data *we;
     const char *filename, *xref_filename;
     unsigned long line, xref_line;
+    size_t i;
 
     /* If we're treating warnings as errors, tell the user about it. */
     if (warning_as_error && warning_as_error != 2) {
@@ -500,8 +574,16 @@ yasm_errwarns_output_all(yasm_errwarns *errwarns, yasm_linemap *lm,
         warning_as_error = 2;
     }
 
+    /* Sort into line order (stable, as seq breaks ties) */
+    if (!errwarns->sorted) {
+        qsort(errwarns->we, errwarns->num_we, sizeof(errwarn_data),
+              errwarn_data_compare);
+        errwarns->sorted = 1;
+    }
+
     /* Output error/warnings. */
-    SLIST_FOREACH(we, &errwarns->errwarns, link) {
+    for (i=0; i<errwarns->num_we; i++) {
+        we = &errwarns->we[i];
         /* Output error/warning */
         yasm_linemap_lookup(lm, we->line, &filename, &line);
         if (we->xrefline)
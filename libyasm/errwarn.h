@@ -126,6 +126,7 @@ void yasm_error_clear(void);
  * be treated as a boolean value.
  * \return Current error indicator.
  */
+YASM_LIB_DECL
 yasm_error_class yasm_error_occurred(void);
 
 /** Check the error indicator against an error class.  To check if any error
@@ -138,12 +139,6 @@ yasm_error_class yasm_error_occurred(void);
 YASM_LIB_DECL
 int yasm_error_matches(yasm_error_class eclass);
 
-#ifndef YASM_DOXYGEN
-YASM_LIB_DECL
-extern yasm_error_class yasm_eclass;
-#define yasm_error_occurred()       yasm_eclass
-#endif
-
 /** Set the error indicator (va_list version).  Has no effect if the error
  * indicator is already set.
  * \param eclass    error class
@@ -289,6 +284,16 @@ void yasm_errwarns_destroy(/*@only@*/ yasm_errwarns *errwarns);
 YASM_LIB_DECL
 void yasm_errwarn_propagate(yasm_errwarns *errwarns, unsigned long line);
 
+/** Move all errors and warnings from one error/warning set into another.
+ * They are inserted in the same way as if they had been propagated
+ * directly into the destination set, in the order they were added to the
+ * source set.
+ * \param errwarns  destination error/warning set
+ * \param src       source error/warning set (left empty)
+ */
+YASM_LIB_DECL
+void yasm_errwarns_merge(yasm_errwarns *errwarns, yasm_errwarns *src);
+
 /** Get total number of errors logged.
  * \param errwarns          error/warning set
  * \param warning_as_error  if nonzero, warnings are treated as errors.
@@ -34,6 +34,7 @@
 #include "intnum.h"
 #include "floatnum.h"
 #include "expr.h"
+#include "stats.h"
 #include "symrec.h"
 
 #include "bytecode.h"
@@ -54,8 +55,8 @@ static void expr_delete_term(yasm_expr__item *term, int recurse);
 /* Bitmap of used items.  We should really never need more than 2 at a time,
  * so 31 is pretty much overkill.
  */
-static unsigned long itempool_used = 0;
-static yasm_expr__item itempool[31];
+static YASM_THREAD_LOCAL unsigned long itempool_used = 0;
+static YASM_THREAD_LOCAL yasm_expr__item itempool[31];
 
 /* allocate a new expression node, with children as defined.
  * If it's a unary operator, put the element in left and set right=NULL. */
@@ -1016,6 +1017,7 @@ yasm_expr__level_tree(yasm_expr *e, int fold_const, int simplify_ident,
     if (!e)
         return 0;
 
+    yasm_stats_inc(YASM_STATS_EXPR_SIMPLIFY);
     e = expr_expand_equ(e, &eh);
     e = expr_level_tree(e, fold_const, simplify_ident, simplify_reg_mul,
                         calc_bc_dist, expr_xform_extra, expr_xform_extra_data);
@@ -45,6 +45,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "errwarn.h"
 #include "file.h"
@@ -534,6 +535,20 @@ typedef struct incpath {
 
 STAILQ_HEAD(incpath_head, incpath) incpaths = STAILQ_HEAD_INITIALIZER(incpaths);
 
+/*@null@*/ static void (*dep_absent) (const char *path, void *d) = NULL;
+/*@null@*/ static void (*dep_env) (const char *name, void *d) = NULL;
+/*@null@*/ static void *dep_data = NULL;
+
+/* Try to open an include file candidate, reporting it if not found. */
+static /*@null@*/ FILE *
+fopen_include_candidate(const char *path, const char *mode)
+{
+    FILE *f = fopen(path, mode);
+    if (!f && dep_absent)
+        dep_absent(path, dep_data);
+    return f;
+}
+
 FILE *
 yasm_fopen_include(const char *iname, const char *from, const char *mode,
                    char **oname)
@@ -545,7 +560,7 @@ yasm_fopen_include(const char *iname, const char *from, const char *mode,
     /* Try directly relative to from first, then each of the include paths */
     if (from) {
         combine = yasm__combpath(from, iname);
-        f = fopen(combine, mode);
+        f = fopen_include_candidate(combine, mode);
         if (f) {
             if (oname)
                 *oname = combine;
@@ -558,7 +573,7 @@ yasm_fopen_include(const char *iname, const char *from, const char *mode,
 
     STAILQ_FOREACH(np, &incpaths, link) {
         combine = yasm__combpath(np->path, iname);
-        f = fopen(combine, mode);
+        f = fopen_include_candidate(combine, mode);
         if (f) {
             if (oname)
                 *oname = combine;
@@ -623,6 +638,23 @@ yasm_add_include_path(const char *path)
     STAILQ_INSERT_TAIL(&incpaths, np, link);
 }
 
+void
+yasm_set_dependency_funcs(void (*absent) (const char *path, void *d),
+                          void (*env) (const char *name, void *d), void *d)
+{
+    dep_absent = absent;
+    dep_env = env;
+    dep_data = d;
+}
+
+const char *
+yasm_getenv(const char *name)
+{
+    if (dep_env)
+        dep_env(name, dep_data);
+    return getenv(name);
+}
+
 size_t
 yasm_fwrite_16_l(unsigned short val, FILE *f)
 {
@@ -670,3 +702,43 @@ yasm_fwrite_32_b(unsigned long val, FILE *f)
         return 0;
     return 1;
 }
+
+/* Zero runs at least this long at the end of a regular file are left as a
+ * hole instead of being written.
+ */
+#define ZERO_HOLE_MIN   (64*1024)
+
+/* Zero page used to write runs that can't be left as holes. */
+static unsigned char zero_page[64*1024];
+
+size_t
+yasm_fwrite_zeros(unsigned long len, FILE *f)
+{
+    size_t n;
+
+#if defined(HAVE_SYS_STAT_H) && defined(S_ISREG) && defined(HAVE_FILENO)
+    if (len >= ZERO_HOLE_MIN) {
+        struct stat st;
+        long pos;
+
+        /* Only past the current end of file is it safe to skip bytes:
+         * anything before that may hold stale data.
+         */
+        if (fflush(f) == 0 && fstat(fileno(f), &st) == 0 &&
+            S_ISREG(st.st_mode) && (pos = ftell(f)) >= 0 &&
+            (unsigned long)pos >= (unsigned long)st.st_size &&
+            len - 1 <= (unsigned long)LONG_MAX - (unsigned long)pos) {
+            if (fseek(f, (long)(len - 1), SEEK_CUR) == 0)
+                return fwrite(zero_page, 1, 1, f);
+        }
+    }
+#endif
+
+    while (len > 0) {
+        n = len < sizeof(zero_page) ? (size_t)len : sizeof(zero_page);
+        if (fwrite(zero_page, n, 1, f) != 1)
+            return 0;
+        len -= (unsigned long)n;
+    }
+    return 1;
+}
@@ -241,6 +241,32 @@ const char * yasm_get_include_dir(void **iter);
 YASM_LIB_DECL
 void yasm_add_include_path(const char *path);
 
+/** Set functions to be told about inputs to an assembly other than the files
+ * it reads, so a caller that caches outputs can tell when they change: each
+ * path yasm_fopen_include() tries without finding a file, and each
+ * environment variable looked up with yasm_getenv().  Either function may
+ * be NULL.
+ *
+ * \param absent    called with each path not found
+ * \param env       called with the name of each variable looked up
+ * \param d         data passed to the functions
+ */
+YASM_LIB_DECL
+void yasm_set_dependency_funcs
+    (/*@null@*/ void (*absent) (const char *path, void *d),
+     /*@null@*/ void (*env) (const char *name, void *d),
+     /*@null@*/ void *d);
+
+/** Look up an environment variable whose value affects the output, as
+ * getenv() does, reporting the lookup to the function set with
+ * yasm_set_dependency_funcs().
+ *
+ * \param name      variable name
+ * \return Value of the variable, or NULL if it is not set.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@observer@*/ const char *yasm_getenv(const char *name);
+
 /** Write an 8-bit value to a buffer, incrementing buffer pointer.
  * \note Only works properly if ptr is an (unsigned char *).
  * \param ptr   buffer
@@ -402,6 +428,17 @@ size_t yasm_fwrite_16_b(unsigned short val, FILE *f);
 YASM_LIB_DECL
 size_t yasm_fwrite_32_b(unsigned long val, FILE *f);
 
+/** Write a run of zero bytes to a file.  On a regular file positioned at or
+ * past its end, long runs are left as a hole by seeking over them, so the
+ * cost doesn't depend on the length; otherwise zeros are written from a
+ * shared zero page.
+ * \param len   number of zero bytes
+ * \param f     file
+ * \return 1 if the write was successful, 0 if not (just like fwrite()).
+ */
+YASM_LIB_DECL
+size_t yasm_fwrite_zeros(unsigned long len, FILE *f);
+
 /** Read an 8-bit value from a buffer, incrementing buffer pointer.
  * \note Only works properly if ptr is an (unsigned char *).
  * \param ptr   buffer
@@ -0,0 +1,255 @@
+/*
+ * Shared included-file cache
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "util.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_FILENO)
+#include <sys/types.h>
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
+#include "file.h"
+#include "filecache.h"
+
+
+/* A loaded file, identified by its resolved pathname. */
+typedef struct filecache_file {
+    /*@reldef@*/ SLIST_ENTRY(filecache_file) link;
+    /*@owned@*/ char *path;
+    /*@owned@*/ unsigned char *data;
+    unsigned long len;
+    int mapped;                 /* nonzero if data is an mmap'ed region */
+} filecache_file;
+
+/* An include name resolved relative to a particular including file. */
+typedef struct filecache_name {
+    /*@reldef@*/ SLIST_ENTRY(filecache_name) link;
+    /*@owned@*/ char *iname;
+    /*@owned@*/ /*@null@*/ char *from;
+    /*@dependent@*/ filecache_file *file;
+} filecache_name;
+
+struct yasm_filecache {
+    /* Very few distinct files are typically included, so simple lists are
+     * used; the most recently resolved entries are found first.
+     */
+    SLIST_HEAD(filecache_fileshead, filecache_file) files;
+    SLIST_HEAD(filecache_nameshead, filecache_name) names;
+};
+
+/* Used for empty files so that a non-NULL pointer can be returned. */
+static unsigned char empty_data[1];
+
+yasm_filecache *
+yasm_filecache_create(void)
+{
+    yasm_filecache *cache = yasm_xmalloc(sizeof(yasm_filecache));
+    SLIST_INIT(&cache->files);
+    SLIST_INIT(&cache->names);
+    return cache;
+}
+
+void
+yasm_filecache_destroy(yasm_filecache *cache)
+{
+    while (!SLIST_EMPTY(&cache->names)) {
+        filecache_name *name = SLIST_FIRST(&cache->names);
+        SLIST_REMOVE_HEAD(&cache->names, link);
+        yasm_xfree(name->iname);
+        if (name->from)
+            yasm_xfree(name->from);
+        yasm_xfree(name);
+    }
+
+    while (!SLIST_EMPTY(&cache->files)) {
+        filecache_file *file = SLIST_FIRST(&cache->files);
+        SLIST_REMOVE_HEAD(&cache->files, link);
+#ifdef USE_MMAP
+        if (file->mapped)
+            munmap((void *)file->data, (size_t)file->len);
+        else
+#endif
+        if (file->data != empty_data)
+            yasm_xfree(file->data);
+        yasm_xfree(file->path);
+        yasm_xfree(file);
+    }
+
+    yasm_xfree(cache);
+}
+
+/* Load the entire contents of an open file.  Returns nonzero on error. */
+static int
+filecache_load(filecache_file *file, FILE *f)
+{
+    long flen;
+
+    if (fseek(f, 0L, SEEK_END) < 0 || (flen = ftell(f)) < 0)
+        return 1;
+    file->len = (unsigned long)flen;
+    file->mapped = 0;
+
+    if (file->len == 0) {
+        file->data = empty_data;
+        return 0;
+    }
+
+#ifdef USE_MMAP
+    {
+        void *p = mmap(NULL, (size_t)file->len, PROT_READ, MAP_PRIVATE,
+                       fileno(f), 0);
+        if (p != MAP_FAILED) {
+            file->data = p;
+            file->mapped = 1;
+            return 0;
+        }
+    }
+#endif
+
+    /* Fall back to reading the file into memory */
+    if (fseek(f, 0L, SEEK_SET) < 0)
+        return 1;
+    file->data = yasm_xmalloc((size_t)file->len);
+    if (fread(file->data, 1, (size_t)file->len, f) < (size_t)file->len) {
+        yasm_xfree(file->data);
+        return 1;
+    }
+    return 0;
+}
+
+static /*@null@*/ filecache_file *
+filecache_find(yasm_filecache *cache, const char *path)
+{
+    filecache_file *file;
+
+    SLIST_FOREACH(file, &cache->files, link) {
+        if (strcmp(file->path, path) == 0)
+            return file;
+    }
+    return NULL;
+}
+
+/* Load a file from an open stream (which is closed) and add it to the
+ * cache.  Takes ownership of path.  Returns NULL on error.
+ */
+static /*@null@*/ filecache_file *
+filecache_add(yasm_filecache *cache, /*@only@*/ char *path, FILE *f)
+{
+    filecache_file *file = yasm_xmalloc(sizeof(filecache_file));
+
+    file->path = path;
+    if (filecache_load(file, f)) {
+        fclose(f);
+        yasm_xfree(file->path);
+        yasm_xfree(file);
+        return NULL;
+    }
+    fclose(f);
+    SLIST_INSERT_HEAD(&cache->files, file, link);
+    return file;
+}
+
+const unsigned char *
+yasm_filecache_get(yasm_filecache *cache, const char *iname, const char *from,
+                   unsigned long *len)
+{
+    filecache_name *name;
+    filecache_file *file;
+    char *path;
+    FILE *f;
+
+    SLIST_FOREACH(name, &cache->names, link) {
+        if (strcmp(name->iname, iname) == 0 &&
+            (name->from == from ||
+             (name->from && from && strcmp(name->from, from) == 0))) {
+            *len = name->file->len;
+            return name->file->data;
+        }
+    }
+
+    /* Not seen before; search the include path */
+    f = yasm_fopen_include(iname, from, "rb", &path);
+    if (!f)
+        return NULL;
+
+    /* The same file may already be loaded under a different name */
+    file = filecache_find(cache, path);
+    if (file) {
+        yasm_xfree(path);
+        fclose(f);
+    } else {
+        file = filecache_add(cache, path, f);
+        if (!file)
+            return NULL;
+    }
+
+    name = yasm_xmalloc(sizeof(filecache_name));
+    name->iname = yasm__xstrdup(iname);
+    name->from = from ? yasm__xstrdup(from) : NULL;
+    name->file = file;
+    SLIST_INSERT_HEAD(&cache->names, name, link);
+
+    *len = file->len;
+    return file->data;
+}
+
+const unsigned char *
+yasm_filecache_get_path(yasm_filecache *cache, const char *path,
+                        unsigned long *len)
+{
+    filecache_file *file;
+    FILE *f;
+
+    file = filecache_find(cache, path);
+    if (!file) {
+        f = fopen(path, "rb");
+        if (!f)
+            return NULL;
+        file = filecache_add(cache, yasm__xstrdup(path), f);
+        if (!file)
+            return NULL;
+    }
+
+    *len = file->len;
+    return file->data;
+}
+
+int
+yasm_filecache_traverse(yasm_filecache *cache, void *d,
+                        int (*func) (const char *path,
+                                     const unsigned char *data,
+                                     unsigned long len, void *d))
+{
+    filecache_file *file;
+
+    SLIST_FOREACH(file, &cache->files, link) {
+        int retval = func(file->path, file->data, file->len, d);
+        if (retval != 0)
+            return retval;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * \file libyasm/filecache.h
+ * \brief YASM shared included-file cache interface.
+ *
+ * \license
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * \endlicense
+ */
+#ifndef YASM_FILECACHE_H
+#define YASM_FILECACHE_H
+
+#ifndef YASM_LIB_DECL
+#define YASM_LIB_DECL
+#endif
+
+/** Cache of the contents of files included as binary data (e.g. by
+ * incbin).  Each distinct include name is resolved through the include
+ * path only once, and each resolved file is loaded (memory-mapped where
+ * possible) only once, no matter how many times it is referenced.
+ */
+typedef struct yasm_filecache yasm_filecache;
+
+/** Create a new, empty file cache.
+ * \return Newly allocated file cache.
+ */
+YASM_LIB_DECL
+/*@only@*/ yasm_filecache *yasm_filecache_create(void);
+
+/** Destroy a file cache, releasing the contents of all cached files.
+ * Pointers previously returned by yasm_filecache_get() become invalid.
+ * \param cache     file cache
+ */
+YASM_LIB_DECL
+void yasm_filecache_destroy(/*@only@*/ yasm_filecache *cache);
+
+/** Get the contents of a file, loading it on first use.  The file is
+ * located with the same search rules as yasm_fopen_include().
+ * \param cache     file cache
+ * \param iname     file to include
+ * \param from      file doing the including
+ * \param len       length of the file contents (output)
+ * \return Read-only file contents (valid until the cache is destroyed), or
+ *         NULL if the file could not be found or read.  A non-NULL pointer
+ *         is returned for empty files.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@dependent@*/ const unsigned char *yasm_filecache_get
+    (yasm_filecache *cache, const char *iname, /*@null@*/ const char *from,
+     /*@out@*/ unsigned long *len);
+
+/** Get the contents of a file given its exact pathname, loading it on
+ * first use.  Unlike yasm_filecache_get(), the include path is not
+ * searched.
+ * \param cache     file cache
+ * \param path      pathname of file
+ * \param len       length of the file contents (output)
+ * \return Read-only file contents (valid until the cache is destroyed), or
+ *         NULL if the file could not be read.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@dependent@*/ const unsigned char *yasm_filecache_get_path
+    (yasm_filecache *cache, const char *path, /*@out@*/ unsigned long *len);
+
+/** Traverse over all files loaded into a file cache, calling function on
+ * each.  Each file is visited once, regardless of how many names it was
+ * requested under.
+ * \param cache     file cache
+ * \param d         data to pass to each call to func
+ * \param func      function to call; receives the resolved pathname and
+ *                  contents of the file
+ * \return Stops early (and returns func's return value) if func returns a
+ *         nonzero value; otherwise 0.
+ */
+YASM_LIB_DECL
+int yasm_filecache_traverse
+    (yasm_filecache *cache, /*@null@*/ void *d,
+     int (*func) (const char *path, const unsigned char *data,
+                  unsigned long len, /*@null@*/ void *d));
+
+#endif
@@ -300,8 +300,276 @@ floatnum_mul(yasm_floatnum *acc, const yasm_floatnum *op)
     BitVector_Destroy(op2);
 }
 
-yasm_floatnum *
-yasm_floatnum_create(const char *str)
+/* Fast conversion using fixed-size arithmetic.
+ *
+ * This performs exactly the same computation as floatnum_create_bv() below:
+ * the decimal significand is accumulated into an integer mantissa, which is
+ * normalized and then multiplied by entries of the power of ten tables, each
+ * product being truncated to MANT_BITS bits.  The results are therefore
+ * bit-for-bit identical, but the mantissa is kept in an array of 16-bit
+ * limbs instead of in allocated bitvectors, which avoids the generic
+ * bit-at-a-time shifts and multiplies.
+ *
+ * Only the common case is handled: at most FAST_SIGDIGITS integer digits
+ * and a plain decimal exponent.  Anything else returns NULL so the caller
+ * can use the general conversion.
+ */
+#define MANT_LIMBS      (MANT_BITS/16)
+#define FAST_SIGDIGITS  19
+
+/* Each limb holds 16 bits; unsigned long is wide enough for a limb product
+ * plus two carries.
+ */
+typedef unsigned long fast_limb;
+
+static int
+fast_is_empty(const fast_limb *m, int len)
+{
+    int i;
+    for (i=0; i<len; i++) {
+        if (m[i] != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/* Index of the highest set bit; the value must be nonzero. */
+static int
+fast_msb(const fast_limb *m, int len)
+{
+    int i, bit;
+    for (i=len-1; m[i] == 0; i--)
+        ;
+    for (bit=15; !(m[i] & (1UL<<bit)); bit--)
+        ;
+    return i*16+bit;
+}
+
+static void
+fast_shift_left(fast_limb *m, int len, int n)
+{
+    int words = n/16, bits = n%16;
+    int i;
+
+    for (i=len-1; i>=0; i--) {
+        fast_limb v = 0;
+        if (i-words >= 0) {
+            v = m[i-words] << bits;
+            if (bits != 0 && i-words-1 >= 0)
+                v |= m[i-words-1] >> (16-bits);
+        }
+        m[i] = v & 0xFFFF;
+    }
+}
+
+/* m = m*10 + digit */
+static void
+fast_mul10_add(fast_limb *m, unsigned int digit)
+{
+    fast_limb carry = digit, t;
+    int i;
+
+    for (i=0; i<MANT_LIMBS; i++) {
+        t = m[i]*10 + carry;
+        m[i] = t & 0xFFFF;
+        carry = t >> 16;
+    }
+}
+
+/* Same as floatnum_mul(), with acc a positive limb mantissa. */
+static void
+fast_mul(fast_limb *acc, unsigned short *exponent, const POT_Entry_Source *op)
+{
+    fast_limb op2[MANT_LIMBS], product[MANT_LIMBS*2], carry, t;
+    long expon;
+    long norm_amt;
+    int i, j;
+
+    if (fast_is_empty(acc, MANT_LIMBS)) {
+        *exponent = EXP_ZERO;
+        return;
+    }
+
+    expon = (((int)*exponent)-EXP_BIAS) + (((int)op->exponent)-EXP_BIAS);
+    expon += EXP_BIAS;
+    if (expon > EXP_MAX) {
+        for (i=0; i<MANT_LIMBS; i++)
+            acc[i] = 0;
+        *exponent = EXP_INF;
+        return;
+    } else if (expon < EXP_MIN) {
+        for (i=0; i<MANT_LIMBS; i++)
+            acc[i] = 0;
+        *exponent = EXP_ZERO;
+        return;
+    }
+    *exponent = (unsigned short)(expon+1);
+
+    for (i=0; i<MANT_LIMBS; i++)
+        op2[i] = (fast_limb)op->mantissa[i*2] |
+            ((fast_limb)op->mantissa[i*2+1] << 8);
+
+    for (i=0; i<MANT_LIMBS*2; i++)
+        product[i] = 0;
+    for (i=0; i<MANT_LIMBS; i++) {
+        carry = 0;
+        for (j=0; j<MANT_LIMBS; j++) {
+            t = acc[i]*op2[j] + product[i+j] + carry;
+            product[i+j] = t & 0xFFFF;
+            carry = t >> 16;
+        }
+        product[i+MANT_LIMBS] = carry;
+    }
+
+    norm_amt = (MANT_BITS*2-1)-fast_msb(product, MANT_LIMBS*2);
+    if (norm_amt > (long)*exponent)
+        norm_amt = (long)*exponent;
+    fast_shift_left(product, MANT_LIMBS*2, (int)norm_amt);
+    *exponent -= (unsigned short)norm_amt;
+
+    for (i=0; i<MANT_LIMBS; i++)
+        acc[i] = product[i+MANT_LIMBS];
+}
+
+static /*@null@*/ yasm_floatnum *
+floatnum_create_fast(const char *str)
+{
+    yasm_floatnum *flt;
+    fast_limb mant[MANT_LIMBS];
+    unsigned char bytes[MANT_BYTES];
+    unsigned short exponent;
+    unsigned char sign = 0;
+    int dec_exponent = 0, dec_exp_add, exp_digits, exp_neg;
+    int POT_index;
+    int sig_digits = 0;
+    int decimal_pt = 1;
+    int i;
+
+    for (i=0; i<MANT_LIMBS; i++)
+        mant[i] = 0;
+
+    if (*str == '-') {
+        sign = 1;
+        str++;
+    } else if (*str == '+')
+        str++;
+
+    while (*str == '0')
+        str++;
+
+    if (*str == '.') {
+        str++;
+        while (*str == '0') {
+            str++;
+            dec_exponent--;
+        }
+    } else {
+        while (isdigit(*str)) {
+            if (sig_digits >= FAST_SIGDIGITS)
+                return NULL;
+            fast_mul10_add(mant, (unsigned int)(*str-'0'));
+            sig_digits++;
+            str++;
+        }
+        if (*str == '.')
+            str++;
+        else
+            decimal_pt = 0;
+    }
+
+    if (decimal_pt) {
+        while (isdigit(*str)) {
+            if (sig_digits < FAST_SIGDIGITS) {
+                dec_exponent--;
+                fast_mul10_add(mant, (unsigned int)(*str-'0'));
+            }
+            sig_digits++;
+            str++;
+        }
+    }
+
+    if (*str == 'e' || *str == 'E') {
+        str++;
+        exp_neg = 0;
+        if (*str == '-' || *str == '+')
+            exp_neg = (*str++ == '-');
+        dec_exp_add = 0;
+        for (exp_digits=0; isdigit(*str); exp_digits++, str++) {
+            if (exp_digits >= 5)
+                return NULL;
+            dec_exp_add = dec_exp_add*10 + (*str-'0');
+        }
+        if (exp_digits == 0)
+            return NULL;
+        dec_exponent += exp_neg ? -dec_exp_add : dec_exp_add;
+    }
+
+    flt = yasm_xmalloc(sizeof(yasm_floatnum));
+    flt->mantissa = BitVector_Create(MANT_BITS, TRUE);
+    flt->sign = sign;
+    flt->flags = 0;
+
+    if (fast_is_empty(mant, MANT_LIMBS)) {
+        flt->exponent = 0;
+        flt->flags |= FLAG_ISZERO;
+        return flt;
+    }
+
+    /* Normalize */
+    i = (MANT_BITS-1)-fast_msb(mant, MANT_LIMBS);
+    fast_shift_left(mant, MANT_LIMBS, i);
+    exponent = (unsigned short)(0x7FFF+(MANT_BITS-1)-i);
+
+    /* Multiply by 10 dec_exponent times, as in floatnum_create_bv() */
+    if (dec_exponent > 0) {
+        POT_index = 0;
+        while ((POT_index < 14) && (dec_exponent != 0) &&
+               (exponent != EXP_INF)) {
+            while (dec_exponent < POT_TableP[POT_index].dec_exponent)
+                POT_index++;
+            if (POT_index < 14) {
+                dec_exponent -= POT_TableP[POT_index].dec_exponent;
+                fast_mul(mant, &exponent, &POT_TableP_Source[POT_index]);
+            }
+        }
+    } else if (dec_exponent < 0) {
+        POT_index = 0;
+        while ((POT_index < 14) && (dec_exponent != 0) &&
+               (exponent != EXP_ZERO)) {
+            while (dec_exponent > POT_TableN[POT_index].dec_exponent)
+                POT_index++;
+            if (POT_index < 14) {
+                dec_exponent -= POT_TableN[POT_index].dec_exponent;
+                fast_mul(mant, &exponent, &POT_TableN_Source[POT_index]);
+            }
+        }
+    }
+
+    /* Round the result, unless overflowed, underflowed, or all ones */
+    if ((exponent != EXP_INF) && (exponent != EXP_ZERO)) {
+        for (i=0; i<MANT_LIMBS && mant[i] == 0xFFFF; i++)
+            ;
+        if (i < MANT_LIMBS) {
+            for (i=0; i<MANT_LIMBS; i++) {
+                mant[i] = (mant[i]+1) & 0xFFFF;
+                if (mant[i] != 0)
+                    break;
+            }
+        }
+    }
+
+    for (i=0; i<MANT_LIMBS; i++) {
+        bytes[i*2] = (unsigned char)(mant[i] & 0xFF);
+        bytes[i*2+1] = (unsigned char)(mant[i] >> 8);
+    }
+    BitVector_Block_Store(flt->mantissa, bytes, MANT_BYTES);
+    flt->exponent = exponent;
+    return flt;
+}
+
+/* General conversion using bitvector arithmetic. */
+static yasm_floatnum *
+floatnum_create_bv(const char *str)
 {
     yasm_floatnum *flt;
     int dec_exponent, dec_exp_add;      /* decimal (powers of 10) exponent */
@@ -490,6 +758,16 @@ yasm_floatnum_create(const char *str)
     return flt;
 }
 
+yasm_floatnum *
+yasm_floatnum_create(const char *str)
+{
+    yasm_floatnum *flt = floatnum_create_fast(str);
+
+    if (!flt)
+        flt = floatnum_create_bv(str);
+    return flt;
+}
+
 yasm_floatnum *
 yasm_floatnum_copy(const yasm_floatnum *flt)
 {
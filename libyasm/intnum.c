@@ -35,6 +35,7 @@
 
 #include "errwarn.h"
 #include "intnum.h"
+#include "stats.h"
 
 
 /* "Native" "word" size for intnum calculations. */
@@ -48,18 +49,28 @@ struct yasm_intnum {
     enum { INTNUM_L, INTNUM_BV } type;
 };
 
+/* The static bitvects are per-thread, as output may run in several threads;
+ * each thread calls yasm_intnum_initialize() and yasm_intnum_cleanup().
+ * Calls may be nested; only the outermost pair allocates and frees.
+ */
+static YASM_THREAD_LOCAL unsigned int init_count = 0;
+
 /* static bitvect used for conversions */
-static /*@only@*/ wordptr conv_bv;
+static YASM_THREAD_LOCAL /*@only@*/ wordptr conv_bv;
 
 /* static bitvects used for computation */
-static /*@only@*/ wordptr result, spare, op1static, op2static;
+static YASM_THREAD_LOCAL /*@only@*/ wordptr result, spare, op1static,
+    op2static;
 
-static /*@only@*/ BitVector_from_Dec_static_data *from_dec_data;
+static YASM_THREAD_LOCAL /*@only@*/ BitVector_from_Dec_static_data
+    *from_dec_data;
 
 
 void
 yasm_intnum_initialize(void)
 {
+    if (init_count++ > 0)
+        return;
     conv_bv = BitVector_Create(BITVECT_NATIVE_SIZE, FALSE);
     result = BitVector_Create(BITVECT_NATIVE_SIZE, FALSE);
     spare = BitVector_Create(BITVECT_NATIVE_SIZE, FALSE);
@@ -71,6 +82,8 @@ yasm_intnum_initialize(void)
 void
 yasm_intnum_cleanup(void)
 {
+    if (init_count == 0 || --init_count > 0)
+        return;
     BitVector_from_Dec_static_Shutdown(from_dec_data);
     BitVector_Destroy(op2static);
     BitVector_Destroy(op1static);
@@ -99,6 +112,7 @@ intnum_frombv(/*@out@*/ yasm_intnum *intn, wordptr bv)
             BitVector_Negate(bv, bv);
             intn->type = INTNUM_BV;
             intn->val.bv = BitVector_Clone(bv);
+            yasm_stats_inc(YASM_STATS_INTNUM_BV);
         } else {
             intn->type = INTNUM_L;
             intn->val.l = -((long)ul);
@@ -106,6 +120,7 @@ intnum_frombv(/*@out@*/ yasm_intnum *intn, wordptr bv)
     } else {
         intn->type = INTNUM_BV;
         intn->val.bv = BitVector_Clone(bv);
+        yasm_stats_inc(YASM_STATS_INTNUM_BV);
     }
 }
 
@@ -128,11 +143,109 @@ intnum_tobv(/*@returned@*/ wordptr bv, const yasm_intnum *intn)
     return bv;
 }
 
+/* Digit value of an ASCII character in any radix up to 16, or 16 if it is
+ * not a digit.
+ */
+static unsigned int
+intnum_digit(int c)
+{
+    if (c >= '0' && c <= '9')
+        return (unsigned int)(c - '0');
+    if (c >= 'a' && c <= 'f')
+        return (unsigned int)(c - 'a' + 10);
+    if (c >= 'A' && c <= 'F')
+        return (unsigned int)(c - 'A' + 10);
+    return 16;
+}
+
+/* Store a value of up to 64 bits, given as low and high 32-bit halves. */
+static void
+intnum_from_halves(/*@out@*/ yasm_intnum *intn, unsigned long lo,
+                   unsigned long hi)
+{
+    if (hi == 0 && lo < 0x80000000UL) {
+        intn->type = INTNUM_L;
+        intn->val.l = (long)lo;
+        return;
+    }
+    intn->type = INTNUM_BV;
+    intn->val.bv = BitVector_Create(BITVECT_NATIVE_SIZE, TRUE);
+    BitVector_Chunk_Store(intn->val.bv, 32, 0, lo);
+    BitVector_Chunk_Store(intn->val.bv, 32, 32, hi);
+    yasm_stats_inc(YASM_STATS_INTNUM_BV);
+}
+
+/* Fast conversion of a binary, octal, or hex literal (bits per digit of 1,
+ * 3, or 4) that fits in 64 bits.  Returns 0 without touching intn if the
+ * literal is malformed or larger, so the caller can fall back to the
+ * general bitvector conversion.
+ */
+static int
+intnum_from_pow2_str(/*@out@*/ yasm_intnum *intn, const char *str,
+                     unsigned int bits)
+{
+    unsigned long lo = 0, hi = 0;
+    unsigned int radix = 1U<<bits;
+    unsigned int d;
+
+    for (; *str != '\0'; str++) {
+        if (*str == '_')
+            continue;
+        d = intnum_digit(*str);
+        if (d >= radix || (hi >> (32-bits)) != 0)
+            return 0;
+        hi = ((hi << bits) | (lo >> (32-bits))) & 0xFFFFFFFFUL;
+        lo = ((lo << bits) | d) & 0xFFFFFFFFUL;
+    }
+    intnum_from_halves(intn, lo, hi);
+    return 1;
+}
+
+/* Fast conversion of an unsigned decimal literal of up to 19 significant
+ * digits (always less than 2^64).  Returns 0 without touching intn if the
+ * literal is malformed or longer.
+ */
+static int
+intnum_from_dec_str(/*@out@*/ yasm_intnum *intn, const char *str)
+{
+    unsigned long lo = 0, hi = 0, t, u;
+    unsigned int d, ndigits = 0;
+
+    if (*str == '\0')
+        return 0;
+    while (*str == '0')
+        str++;
+
+    /* Up to 9 digits always fit in 31 bits */
+    for (; *str != '\0' && ndigits < 9; str++, ndigits++) {
+        d = intnum_digit(*str);
+        if (d >= 10)
+            return 0;
+        lo = lo*10 + d;
+    }
+
+    /* Longer literals: multiply the two halves by 10 in 16-bit pieces */
+    for (; *str != '\0'; str++, ndigits++) {
+        d = intnum_digit(*str);
+        if (d >= 10 || ndigits >= 19)
+            return 0;
+        t = (lo & 0xFFFF)*10 + d;
+        u = (lo >> 16)*10 + (t >> 16);
+        lo = ((u & 0xFFFF) << 16) | (t & 0xFFFF);
+        hi = (hi*10 + (u >> 16)) & 0xFFFFFFFFUL;
+    }
+    intnum_from_halves(intn, lo, hi);
+    return 1;
+}
+
 yasm_intnum *
 yasm_intnum_create_dec(char *str)
 {
     yasm_intnum *intn = yasm_xmalloc(sizeof(yasm_intnum));
 
+    if (intnum_from_dec_str(intn, str))
+        return intn;
+
     switch (BitVector_from_Dec_static(from_dec_data, conv_bv,
                                       (unsigned char *)str)) {
         case ErrCode_Pars:
@@ -154,6 +267,9 @@ yasm_intnum_create_bin(char *str)
 {
     yasm_intnum *intn = yasm_xmalloc(sizeof(yasm_intnum));
 
+    if (intnum_from_pow2_str(intn, str, 1))
+        return intn;
+
     switch (BitVector_from_Bin(conv_bv, (unsigned char *)str)) {
         case ErrCode_Pars:
             yasm_error_set(YASM_ERROR_VALUE, N_("invalid binary literal"));
@@ -174,6 +290,9 @@ yasm_intnum_create_oct(char *str)
 {
     yasm_intnum *intn = yasm_xmalloc(sizeof(yasm_intnum));
 
+    if (intnum_from_pow2_str(intn, str, 3))
+        return intn;
+
     switch (BitVector_from_Oct(conv_bv, (unsigned char *)str)) {
         case ErrCode_Pars:
             yasm_error_set(YASM_ERROR_VALUE, N_("invalid octal literal"));
@@ -194,6 +313,9 @@ yasm_intnum_create_hex(char *str)
 {
     yasm_intnum *intn = yasm_xmalloc(sizeof(yasm_intnum));
 
+    if (intnum_from_pow2_str(intn, str, 4))
+        return intn;
+
     switch (BitVector_from_Hex(conv_bv, (unsigned char *)str)) {
         case ErrCode_Pars:
             yasm_error_set(YASM_ERROR_VALUE, N_("invalid hex literal"));
@@ -224,6 +346,7 @@ yasm_intnum_create_charconst_nasm(const char *str)
     if (len > 3) {
         BitVector_Empty(conv_bv);
         intn->type = INTNUM_BV;
+        yasm_stats_inc(YASM_STATS_INTNUM_BV);
     } else {
         intn->val.l = 0;
         intn->type = INTNUM_L;
@@ -270,6 +393,7 @@ yasm_intnum_create_charconst_tasm(const char *str)
     if (len > 3) {
         BitVector_Empty(conv_bv);
         intn->type = INTNUM_BV;
+        yasm_stats_inc(YASM_STATS_INTNUM_BV);
     } else {
         intn->val.l = 0;
         intn->type = INTNUM_L;
@@ -313,6 +437,7 @@ yasm_intnum_create_uint(unsigned long i)
         /* Too big, store as bitvector */
         intn->val.bv = BitVector_Create(BITVECT_NATIVE_SIZE, TRUE);
         intn->type = INTNUM_BV;
+        yasm_stats_inc(YASM_STATS_INTNUM_BV);
         BitVector_Chunk_Store(intn->val.bv, 32, 0, i);
     } else {
         intn->val.l = (long)i;
@@ -666,6 +791,7 @@ yasm_intnum_set_uint(yasm_intnum *intn, unsigned long val)
         if (intn->type != INTNUM_BV) {
             intn->val.bv = BitVector_Create(BITVECT_NATIVE_SIZE, TRUE);
             intn->type = INTNUM_BV;
+            yasm_stats_inc(YASM_STATS_INTNUM_BV);
         }
         BitVector_Chunk_Store(intn->val.bv, 32, 0, val);
     } else {
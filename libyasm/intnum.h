@@ -34,11 +34,15 @@
 #define YASM_LIB_DECL
 #endif
 
-/** Initialize intnum internal data structures. */
+/** Initialize intnum internal data structures for the calling thread.
+ * Calls may be nested, each matched by a call to yasm_intnum_cleanup().
+ */
 YASM_LIB_DECL
 void yasm_intnum_initialize(void);
 
-/** Clean up internal intnum allocations. */
+/** Clean up internal intnum allocations for the calling thread once the
+ * outermost yasm_intnum_initialize() call has been matched.
+ */
 YASM_LIB_DECL
 void yasm_intnum_cleanup(void);
 
@@ -51,7 +51,12 @@ typedef struct line_source_info {
     /*@null@*/ /*@dependent@*/ yasm_bytecode *bc;
 
     /* source code line */
-    /*@owned@*/ char *source;
+    /*@null@*/ const char *source;
+
+    /* nonzero if source is owned (must be freed); zero if it points into a
+     * kept buffer
+     */
+    int owned;
 } line_source_info;
 
 struct yasm_linemap {
@@ -69,6 +74,11 @@ struct yasm_linemap {
     /* Bytecode and source line information */
     /*@only@*/ line_source_info *source_info;
     size_t source_info_size;
+
+    /* Buffers referenced by source lines, freed on destroy */
+    /*@only@*/ void **buffers;
+    size_t num_buffers;
+    size_t alloc_buffers;
 };
 
 static void
@@ -182,8 +192,13 @@ yasm_linemap_create(void)
     for (i=0; i<linemap->source_info_size; i++) {
         linemap->source_info[i].bc = NULL;
         linemap->source_info[i].source = NULL;
+        linemap->source_info[i].owned = 0;
     }
 
+    linemap->buffers = NULL;
+    linemap->num_buffers = 0;
+    linemap->alloc_buffers = 0;
+
     return linemap;
 }
 
@@ -192,11 +207,16 @@ yasm_linemap_destroy(yasm_linemap *linemap)
 {
     size_t i;
     for (i=0; i<linemap->source_info_size; i++) {
-        if (linemap->source_info[i].source)
-            yasm_xfree(linemap->source_info[i].source);
+        if (linemap->source_info[i].owned)
+            yasm_xfree((char *)linemap->source_info[i].source);
     }
     yasm_xfree(linemap->source_info);
 
+    for (i=0; i<linemap->num_buffers; i++)
+        yasm_xfree(linemap->buffers[i]);
+    if (linemap->buffers)
+        yasm_xfree(linemap->buffers);
+
     yasm_xfree(linemap->map_vector);
 
     if (linemap->filenames)
@@ -211,10 +231,10 @@ yasm_linemap_get_current(yasm_linemap *linemap)
     return linemap->current;
 }
 
-void
-yasm_linemap_add_source(yasm_linemap *linemap, yasm_bytecode *bc,
-                        const char *source)
+static line_source_info *
+linemap_current_source(yasm_linemap *linemap)
 {
+    line_source_info *info;
     size_t i;
 
     while (linemap->current > linemap->source_info_size) {
@@ -224,16 +244,50 @@ yasm_linemap_add_source(yasm_linemap *linemap, yasm_bytecode *bc,
         for (i=linemap->source_info_size; i<linemap->source_info_size*2; i++) {
             linemap->source_info[i].bc = NULL;
             linemap->source_info[i].source = NULL;
+            linemap->source_info[i].owned = 0;
         }
         linemap->source_info_size *= 2;
     }
 
     /* Delete existing info for that line (if any) */
-    if (linemap->source_info[linemap->current-1].source)
-        yasm_xfree(linemap->source_info[linemap->current-1].source);
+    info = &linemap->source_info[linemap->current-1];
+    if (info->owned)
+        yasm_xfree((char *)info->source);
+    return info;
+}
 
-    linemap->source_info[linemap->current-1].bc = bc;
-    linemap->source_info[linemap->current-1].source = yasm__xstrdup(source);
+void
+yasm_linemap_add_source(yasm_linemap *linemap, yasm_bytecode *bc,
+                        const char *source)
+{
+    line_source_info *info = linemap_current_source(linemap);
+
+    info->bc = bc;
+    info->source = yasm__xstrdup(source);
+    info->owned = 1;
+}
+
+void
+yasm_linemap_add_source_ref(yasm_linemap *linemap, yasm_bytecode *bc,
+                            const char *source)
+{
+    line_source_info *info = linemap_current_source(linemap);
+
+    info->bc = bc;
+    info->source = source;
+    info->owned = 0;
+}
+
+void
+yasm_linemap_keep_buffer(yasm_linemap *linemap, void *buf)
+{
+    if (linemap->num_buffers >= linemap->alloc_buffers) {
+        linemap->alloc_buffers = linemap->alloc_buffers ?
+            2*linemap->alloc_buffers : 4;
+        linemap->buffers = yasm_xrealloc(linemap->buffers,
+            linemap->alloc_buffers*sizeof(void *));
+    }
+    linemap->buffers[linemap->num_buffers++] = buf;
 }
 
 unsigned long
@@ -80,6 +80,30 @@ void yasm_linemap_add_source(yasm_linemap *linemap,
                              /*@null@*/ yasm_bytecode *bc,
                              const char *source);
 
+/** Add bytecode and source line information to the current virtual line,
+ * without copying the source line.
+ * \attention Deletes any existing bytecode and source line information for
+ *            the current virtual line.
+ * \param linemap       line mapping repository
+ * \param bc            bytecode (if any)
+ * \param source        source code line; must remain valid until the
+ *                      repository is destroyed (e.g. by being part of a
+ *                      buffer passed to yasm_linemap_keep_buffer())
+ */
+YASM_LIB_DECL
+void yasm_linemap_add_source_ref(yasm_linemap *linemap,
+                                 /*@null@*/ yasm_bytecode *bc,
+                                 /*@dependent@*/ const char *source);
+
+/** Transfer ownership of a buffer to a line mapping repository.  The buffer
+ * is freed with yasm_xfree() when the repository is destroyed, so source
+ * lines within it may be added with yasm_linemap_add_source_ref().
+ * \param linemap       line mapping repository
+ * \param buf           buffer allocated with yasm_xmalloc()
+ */
+YASM_LIB_DECL
+void yasm_linemap_keep_buffer(yasm_linemap *linemap, /*@only@*/ void *buf);
+
 /** Go to the next line (increments the current virtual line).
  * \param linemap       line mapping repository
  * \return The current (new) virtual line.
@@ -0,0 +1,59 @@
+/*
+ * Preprocessor module interface helpers
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "util.h"
+
+#include "coretype.h"
+#include "preproc.h"
+
+
+/* Line returned by the most recent get_line() fallback; owned here and freed
+ * on the next fallback call.
+ */
+static YASM_THREAD_LOCAL /*@null@*/ /*@only@*/ char *fallback_line = NULL;
+
+int
+yasm_preproc_get_line_ref(yasm_preproc *preproc, yasm_preproc_line *line)
+{
+    const yasm_preproc_module *module =
+        ((yasm_preproc_base *)preproc)->module;
+
+    if (module->get_line_ref)
+        return module->get_line_ref(preproc, line);
+
+    /* Module doesn't implement get_line_ref; use an allocated line. */
+    if (fallback_line) {
+        yasm_xfree(fallback_line);
+        fallback_line = NULL;
+    }
+    fallback_line = module->get_line(preproc);
+    if (!fallback_line)
+        return 0;
+    line->text = fallback_line;
+    line->len = strlen(fallback_line);
+    line->persistent = 0;
+    return 1;
+}
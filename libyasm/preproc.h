@@ -40,6 +40,30 @@ typedef struct yasm_preproc_base {
 } yasm_preproc_base;
 #endif
 
+/** Line of preprocessed source code returned by yasm_preproc_get_line_ref().
+ * The text is owned by the preprocessor, not by the caller.
+ */
+typedef struct yasm_preproc_line {
+    /** Line of code, without the trailing \n.  Always NUL-terminated.  The
+     * caller may modify the text in place (e.g. to terminate tokens), but
+     * not beyond the terminating NUL.
+     */
+    char *text;
+
+    /** Length of text, excluding the terminating NUL. */
+    size_t len;
+
+    /** Lifetime of text.  If zero, the text is valid only until the next
+     * yasm_preproc_get_line() or yasm_preproc_get_line_ref() call on the
+     * same preprocessor, or until the preprocessor is destroyed.  If
+     * nonzero, the text is in a buffer the preprocessor has handed to the
+     * line mapping repository with yasm_linemap_keep_buffer(), and remains
+     * valid until that repository is destroyed; it may then be saved with
+     * yasm_linemap_add_source_ref() rather than copied.
+     */
+    int persistent;
+} yasm_preproc_line;
+
 /** YASM preprocesor module interface. */
 typedef struct yasm_preproc_module {
     /** One-line description of the preprocessor. */
@@ -106,6 +130,32 @@ typedef struct yasm_preproc_module {
      * Call yasm_preproc_add_standard() instead of calling this function.
      */
     void (*add_standard) (yasm_preproc *preproc, const char **macros);
+
+    /** Module-level implementation of yasm_preproc_get_line_ref().
+     * Call yasm_preproc_get_line_ref() instead of calling this function.
+     * May be NULL, in which case yasm_preproc_get_line_ref() falls back to
+     * get_line() and the returned text is only valid until the next
+     * yasm_preproc_get_line_ref() call.
+     */
+    int (*get_line_ref) (yasm_preproc *preproc,
+                         /*@out@*/ yasm_preproc_line *line);
+
+    /** Module-level implementation of yasm_preproc_use_snapshot().
+     * Call yasm_preproc_use_snapshot() instead of calling this function.
+     * NULL if the preprocessor does not support snapshots.
+     */
+    void (*use_snapshot) (yasm_preproc *preproc, const char *filename);
+
+    /** Create preprocessor reading from an open stream.
+     * Module-level implementation of yasm_preproc_create_stream().
+     * Call yasm_preproc_create_stream() instead of calling this function.
+     * NULL if the preprocessor can only read from named files.
+     */
+    /*@only@*/ yasm_preproc * (*create_stream) (/*@only@*/ FILE *f,
+                                                const char *in_filename,
+                                                yasm_symtab *symtab,
+                                                yasm_linemap *lm,
+                                                yasm_errwarns *errwarns);
 } yasm_preproc_module;
 
 /** Initialize preprocessor.
@@ -123,6 +173,22 @@ typedef struct yasm_preproc_module {
     (yasm_preproc_module *module, const char *in_filename,
      yasm_symtab *symtab, yasm_linemap *lm, yasm_errwarns *errwarns);
 
+/** Initialize preprocessor, reading the initial input from an already open
+ * stream rather than from a named file.  Only available if the module's
+ * create_stream function is non-NULL.
+ * \param module        preprocessor module
+ * \param f             input stream; closed by the preprocessor
+ * \param in_filename   filename used for line numbering and messages
+ * \param symtab        symbol table (may be NULL if none)
+ * \param lm            line mapping repository
+ * \param errwarns      error/warning set
+ * \return New preprocessor.
+ * \note Errors/warnings are stored into errwarns.
+ */
+/*@only@*/ yasm_preproc *yasm_preproc_create_stream
+    (yasm_preproc_module *module, /*@only@*/ FILE *f, const char *in_filename,
+     yasm_symtab *symtab, yasm_linemap *lm, yasm_errwarns *errwarns);
+
 /** Cleans up any allocated preproc memory.
  * \param preproc       preprocessor
  */
@@ -134,6 +200,17 @@ void yasm_preproc_destroy(/*@only@*/ yasm_preproc *preproc);
  */
 char *yasm_preproc_get_line(yasm_preproc *preproc);
 
+/** Gets a single line of preprocessed source code without copying it.
+ * Unlike yasm_preproc_get_line(), the line is not allocated for the caller
+ * and must not be freed; see #yasm_preproc_line for how long it is valid.
+ * \param preproc       preprocessor
+ * \param line          line of code (output)
+ * \return Nonzero if a line was returned, zero at end of input.
+ */
+YASM_LIB_DECL
+int yasm_preproc_get_line_ref(yasm_preproc *preproc,
+                              /*@out@*/ yasm_preproc_line *line);
+
 /** Get the next filename included by the source code.
  * \param preproc       preprocessor
  * \param buf           destination buffer for filename
@@ -178,12 +255,24 @@ void yasm_preproc_define_builtin(yasm_preproc *preproc,
 void yasm_preproc_add_standard(yasm_preproc *preproc,
                                const char **macros);
 
+/** Save the state reached after the builtin, standard, and pre-included
+ * macros to a snapshot file, or restore it from there if the file is up
+ * to date, skipping their processing.  Must be called before the first
+ * line is requested.  Only available if the module's use_snapshot
+ * function is non-NULL.
+ * \param preproc       preprocessor
+ * \param filename      snapshot filename
+ */
+void yasm_preproc_use_snapshot(yasm_preproc *preproc, const char *filename);
+
 #ifndef YASM_DOXYGEN
 
 /* Inline macro implementations for preproc functions */
 
 #define yasm_preproc_create(module, in_filename, symtab, lm, ews) \
     module->create(in_filename, symtab, lm, ews)
+#define yasm_preproc_create_stream(module, f, in_filename, symtab, lm, ews) \
+    module->create_stream(f, in_filename, symtab, lm, ews)
 
 #define yasm_preproc_destroy(preproc) \
     ((yasm_preproc_base *)preproc)->module->destroy(preproc)
@@ -204,6 +293,8 @@ void yasm_preproc_add_standard(yasm_preproc *preproc,
 #define yasm_preproc_add_standard(preproc, macros) \
     ((yasm_preproc_base *)preproc)->module->add_standard(preproc, \
                                                          macros)
+#define yasm_preproc_use_snapshot(preproc, filename) \
+    ((yasm_preproc_base *)preproc)->module->use_snapshot(preproc, filename)
 
 #endif
 
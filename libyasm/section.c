@@ -26,11 +26,16 @@
  */
 #include "util.h"
 
+#include <ctype.h>
 #include <limits.h>
 
+#ifdef YASM_THREADS
+#include <pthread.h>
+#endif
+
 #include "libyasm-stdint.h"
 #include "coretype.h"
-#include "hamt.h"
+#include "phash.h"
 #include "valparam.h"
 #include "assocdat.h"
 
@@ -44,6 +49,8 @@
 #include "bytecode.h"
 #include "arch.h"
 #include "section.h"
+#include "filecache.h"
+#include "stats.h"
 
 #include "dbgfmt.h"
 #include "objfmt.h"
@@ -73,19 +80,28 @@ struct yasm_section {
     /* the bytecodes for the section's contents */
     /*@reldef@*/ STAILQ_HEAD(yasm_bytecodehead, yasm_bytecode) bcs;
 
-    /* the relocations for the section */
-    /*@reldef@*/ STAILQ_HEAD(yasm_relochead, yasm_reloc) relocs;
+    /* the relocations for the section, stored contiguously by value */
+    /*@null@*/ /*@owned@*/ unsigned char *relocs;
+    size_t reloc_size;          /* size of each relocation */
+    unsigned long num_relocs;
+    unsigned long max_relocs;
+
+    /*@null@*/ void (*destroy_reloc) (void *reloc);
+
+    /* contents rendered by yasm_object_render_sections(); NULL if none.
+     * Allocated by open_memstream(), so must be released with free().
+     */
+    /*@null@*/ /*@only@*/ char *rendered;
+    size_t rendered_len;
 
-    void (*destroy_reloc) (/*@only@*/ void *reloc);
+    /* where yasm_section_output() wrote the contents in the output file */
+    int has_output;
+    unsigned long output_pos;
+    unsigned long output_len;
 };
 
 static void yasm_section_destroy(/*@only@*/ yasm_section *sect);
 
-/* Wrapper around directive for HAMT insertion */
-typedef struct yasm_directive_wrap {
-    const yasm_directive *directive;
-} yasm_directive_wrap;
-
 /*
  * Standard "builtin" object directives.
  */
@@ -160,53 +176,22 @@ dir_section(yasm_object *object, yasm_valparamhead *valparams,
                        N_("invalid argument to directive `%s'"), "SECTION");
 }
 
-static const yasm_directive object_directives[] = {
-    { ".extern",        "gas",  dir_extern,     YASM_DIR_ID_REQUIRED },
-    { ".global",        "gas",  dir_global,     YASM_DIR_ID_REQUIRED },
-    { ".globl",         "gas",  dir_global,     YASM_DIR_ID_REQUIRED },
-    { "extern",         "nasm", dir_extern,     YASM_DIR_ID_REQUIRED },
-    { "global",         "nasm", dir_global,     YASM_DIR_ID_REQUIRED },
-    { "common",         "nasm", dir_common,     YASM_DIR_ID_REQUIRED },
-    { "section",        "nasm", dir_section,    YASM_DIR_ARG_REQUIRED },
-    { "segment",        "nasm", dir_section,    YASM_DIR_ARG_REQUIRED },
-    { NULL, NULL, NULL, 0 }
-};
-
-static void
-directive_level2_delete(/*@only@*/ void *data)
-{
-    yasm_xfree(data);
-}
-
-static void
-directive_level1_delete(/*@only@*/ void *data)
-{
-    HAMT_destroy(data, directive_level2_delete);
-}
+#include "objdirs.c"
 
-static void
-directives_add(yasm_object *object, /*@null@*/ const yasm_directive *dir)
+/* Find a directive in a module's NULL-terminated directive list. */
+static /*@null@*/ const yasm_directive *
+directive_find(/*@null@*/ const yasm_directive *dir, const char *name,
+               const char *parser)
 {
     if (!dir)
-        return;
+        return NULL;
 
-    while (dir->name) {
-        HAMT *level2 = HAMT_search(object->directives, dir->parser);
-        int replace;
-        yasm_directive_wrap *wrap = yasm_xmalloc(sizeof(yasm_directive_wrap));
-
-        if (!level2) {
-            replace = 0;
-            level2 = HAMT_insert(object->directives, dir->parser,
-                                 HAMT_create(1, yasm_internal_error_),
-                                 &replace, directive_level1_delete);
-        }
-        replace = 0;
-        wrap->directive = dir;
-        HAMT_insert(level2, dir->name, wrap, &replace,
-                    directive_level2_delete);
-        dir++;
+    for (; dir->name; dir++) {
+        if (yasm__strcasecmp(dir->name, name) == 0 &&
+            yasm__strcasecmp(dir->parser, parser) == 0)
+            return dir;
     }
+    return NULL;
 }
 
 /*@-compdestroy@*/
@@ -232,8 +217,14 @@ yasm_object_create(const char *src_filename, const char *obj_filename,
     /* Initialize sections linked list */
     STAILQ_INIT(&object->sections);
 
-    /* Create directives HAMT */
-    object->directives = HAMT_create(1, yasm_internal_error_);
+    /* Create empty included file cache */
+    object->filecache = yasm_filecache_create();
+
+    /* Generate output in a single thread by default */
+    object->threads = 1;
+    object->coalesce_data = 0;
+    object->spool_data = 0;
+    object->data_spool = NULL;
 
     /* Initialize the target architecture */
     object->arch = arch;
@@ -290,15 +281,6 @@ yasm_object_create(const char *src_filename, const char *obj_filename,
         goto error;
     }
 
-    /* Add directives to HAMT.  Note ordering here determines priority. */
-    directives_add(object,
-                   ((yasm_objfmt_base *)object->objfmt)->module->directives);
-    directives_add(object,
-                   ((yasm_dbgfmt_base *)object->dbgfmt)->module->directives);
-    directives_add(object,
-                   ((yasm_arch_base *)object->arch)->module->directives);
-    directives_add(object, object_directives);
-
     return object;
 
 error:
@@ -331,6 +313,7 @@ yasm_object_get_general(yasm_object *object, const char *name,
     /* Okay, the name is valid; now allocate and initialize */
     s = yasm_xcalloc(1, sizeof(yasm_section));
     STAILQ_INSERT_TAIL(&object->sections, s, link);
+    yasm_stats_inc(YASM_STATS_SECTIONS);
 
     s->object = object;
     s->name = yasm__xstrdup(name);
@@ -347,13 +330,22 @@ yasm_object_get_general(yasm_object *object, const char *name,
     STAILQ_INSERT_TAIL(&s->bcs, bc, link);
 
     /* Initialize relocs */
-    STAILQ_INIT(&s->relocs);
+    s->relocs = NULL;
+    s->reloc_size = 0;
+    s->num_relocs = 0;
+    s->max_relocs = 0;
     s->destroy_reloc = NULL;
 
     s->code = code;
     s->res_only = res_only;
     s->def = 0;
 
+    s->rendered = NULL;
+    s->rendered_len = 0;
+    s->has_output = 0;
+    s->output_pos = 0;
+    s->output_len = 0;
+
     /* Initialize object format specific data */
     yasm_objfmt_init_new_section(s, line);
 
@@ -368,19 +360,32 @@ yasm_object_directive(yasm_object *object, const char *name,
                       yasm_valparamhead *objext_valparams,
                       unsigned long line)
 {
-    HAMT *level2;
-    yasm_directive_wrap *wrap;
+    const yasm_directive *dir;
+    char lcasename[16];
+    size_t i, len;
 
-    level2 = HAMT_search(object->directives, parser);
-    if (!level2)
-        return 1;
-
-    wrap = HAMT_search(level2, name);
-    if (!wrap)
-        return 1;
+    /* Module directives, in priority order, override the builtin ones. */
+    dir = directive_find(((yasm_objfmt_base *)object->objfmt)->module->
+                         directives, name, parser);
+    if (!dir)
+        dir = directive_find(((yasm_dbgfmt_base *)object->dbgfmt)->module->
+                             directives, name, parser);
+    if (!dir)
+        dir = directive_find(((yasm_arch_base *)object->arch)->module->
+                             directives, name, parser);
+    if (!dir) {
+        len = strlen(name);
+        if (len >= sizeof(lcasename))
+            return 1;
+        for (i=0; i<len; i++)
+            lcasename[i] = tolower((unsigned char)name[i]);
+        lcasename[len] = '\0';
+        dir = object_directive_find(lcasename, len);
+        if (!dir || yasm__strcasecmp(dir->parser, parser) != 0)
+            return 1;
+    }
 
-    yasm_call_directive(wrap->directive, object, valparams, objext_valparams,
-                        line);
+    yasm_call_directive(dir, object, valparams, objext_valparams, line);
     return 0;
 }
 
@@ -476,8 +481,12 @@ yasm_object_destroy(yasm_object *object)
         cur = next;
     }
 
-    /* Delete directives HAMT */
-    HAMT_destroy(object->directives, directive_level1_delete);
+    /* Delete included file cache */
+    yasm_filecache_destroy(object->filecache);
+
+    /* Delete spooled data */
+    if (object->data_spool)
+        fclose(object->data_spool);
 
     /* Delete prefix/suffix */
     yasm_xfree(object->global_prefix);
@@ -515,29 +524,202 @@ yasm_object_print(const yasm_object *object, FILE *f, int indent_level)
     }
 }
 
-void
-yasm_object_finalize(yasm_object *object, yasm_errwarns *errwarns)
+#ifdef YASM_THREADS
+/* Protects object state shared between sections; see yasm__object_lock(). */
+static pthread_mutex_t object_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct section_job {
+    yasm_section *sect;
+    /*@owned@*/ yasm_errwarns *errwarns;
+    /*@null@*/ void *data;      /* per-section data for func */
+} section_job;
+
+typedef struct section_pool {
+    pthread_mutex_t lock;       /* protects next and stats merging */
+    section_job *jobs;
+    size_t njobs;
+    size_t next;                /* next job to be taken */
+
+    /*@null@*/ void *d;
+    void (*func) (section_job *job, /*@null@*/ void *d);
+} section_pool;
+
+static void *
+section_worker(void *arg)
 {
+    section_pool *pool = (section_pool *)arg;
+
+    yasm_intnum_initialize();
+
+    for (;;) {
+        section_job *job = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        if (pool->next < pool->njobs)
+            job = &pool->jobs[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!job)
+            break;
+        pool->func(job, pool->d);
+    }
+
+    yasm_intnum_cleanup();
+
+    pthread_mutex_lock(&pool->lock);
+    yasm_stats_merge_thread();
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Create one job per section, each with its own error/warning set.  Returns
+ * NULL if the object should not be processed in parallel (too few threads
+ * or sections).
+ */
+static /*@null@*/ section_job *
+section_jobs_create(yasm_object *object, /*@out@*/ size_t *njobs)
+{
+    section_job *jobs;
     yasm_section *sect;
+    size_t i;
 
-    /* Iterate through sections */
+    if (object->threads <= 1)
+        return NULL;
+
+    *njobs = 0;
+    STAILQ_FOREACH(sect, &object->sections, link)
+        (*njobs)++;
+    if (*njobs < 2)
+        return NULL;
+
+    jobs = yasm_xmalloc(*njobs*sizeof(section_job));
+    i = 0;
     STAILQ_FOREACH(sect, &object->sections, link) {
-        yasm_bytecode *cur = STAILQ_FIRST(&sect->bcs);
-        yasm_bytecode *prev;
+        jobs[i].sect = sect;
+        jobs[i].errwarns = yasm_errwarns_create();
+        jobs[i].data = NULL;
+        i++;
+    }
+    return jobs;
+}
 
-        /* Skip our locally created empty bytecode first. */
+/* Run func on each job in up to object->threads threads.  Any jobs left
+ * over (if threads could not be started) are run in the calling thread.
+ */
+static void
+section_jobs_run(yasm_object *object, section_job *jobs, size_t njobs,
+                 void (*func) (section_job *job, /*@null@*/ void *d),
+                 /*@null@*/ void *d)
+{
+    section_pool pool;
+    pthread_t *threads;
+    unsigned int nthreads, started, i;
+
+    pool.jobs = jobs;
+    pool.njobs = njobs;
+    pool.next = 0;
+    pool.d = d;
+    pool.func = func;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    nthreads = object->threads;
+    if (nthreads > njobs)
+        nthreads = (unsigned int)njobs;
+    threads = yasm_xmalloc(nthreads*sizeof(pthread_t));
+    for (started=0; started<nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, section_worker, &pool))
+            break;
+    }
+    for (i=0; i<started; i++)
+        pthread_join(threads[i], NULL);
+    yasm_xfree(threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    while (pool.next < njobs)
+        func(&jobs[pool.next++], d);
+}
+
+/* Merge the jobs' errors/warnings into errwarns in section order, so they
+ * come out the same as if the sections had been processed one after
+ * another, and free the jobs.
+ */
+static void
+section_jobs_destroy(section_job *jobs, size_t njobs,
+                     yasm_errwarns *errwarns)
+{
+    size_t i;
+
+    for (i=0; i<njobs; i++) {
+        yasm_errwarns_merge(errwarns, jobs[i].errwarns);
+        yasm_errwarns_destroy(jobs[i].errwarns);
+    }
+    yasm_xfree(jobs);
+}
+#endif
+
+void
+yasm__object_lock(void)
+{
+#ifdef YASM_THREADS
+    pthread_mutex_lock(&object_lock);
+#endif
+}
+
+void
+yasm__object_unlock(void)
+{
+#ifdef YASM_THREADS
+    pthread_mutex_unlock(&object_lock);
+#endif
+}
+
+static void
+section_finalize(yasm_section *sect, yasm_errwarns *errwarns)
+{
+    yasm_bytecode *cur = STAILQ_FIRST(&sect->bcs);
+    yasm_bytecode *prev;
+
+    /* Skip our locally created empty bytecode first. */
+    prev = cur;
+    cur = STAILQ_NEXT(cur, link);
+
+    /* Iterate through the remainder, if any. */
+    while (cur) {
+        /* Finalize */
+        yasm_bc_finalize(cur, prev);
+        yasm_errwarn_propagate(errwarns, cur->line);
         prev = cur;
         cur = STAILQ_NEXT(cur, link);
+    }
+}
 
-        /* Iterate through the remainder, if any. */
-        while (cur) {
-            /* Finalize */
-            yasm_bc_finalize(cur, prev);
-            yasm_errwarn_propagate(errwarns, cur->line);
-            prev = cur;
-            cur = STAILQ_NEXT(cur, link);
-        }
+#ifdef YASM_THREADS
+static void
+finalize_job(section_job *job, /*@unused@*/ void *d)
+{
+    section_finalize(job->sect, job->errwarns);
+}
+#endif
+
+void
+yasm_object_finalize(yasm_object *object, yasm_errwarns *errwarns)
+{
+    yasm_section *sect;
+#ifdef YASM_THREADS
+    section_job *jobs;
+    size_t njobs;
+
+    jobs = section_jobs_create(object, &njobs);
+    if (jobs) {
+        section_jobs_run(object, jobs, njobs, finalize_job, NULL);
+        section_jobs_destroy(jobs, njobs, errwarns);
+        return;
     }
+#endif
+
+    /* Iterate through sections */
+    STAILQ_FOREACH(sect, &object->sections, link)
+        section_finalize(sect, errwarns);
 }
 
 int
@@ -555,6 +737,114 @@ yasm_object_sections_traverse(yasm_object *object, /*@null@*/ void *d,
     return 0;
 }
 
+#ifdef YASM_THREADS
+typedef struct render_data {
+    /*@null@*/ void *d;
+    int (*func) (yasm_section *sect, FILE *f, yasm_errwarns *errwarns,
+                 /*@null@*/ void *d);
+} render_data;
+
+static void
+render_job(section_job *job, void *d)
+{
+    render_data *rd = (render_data *)d;
+    yasm_section *sect = job->sect;
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f;
+    int retval;
+
+    f = open_memstream(&buf, &len);
+    if (!f)
+        return;     /* section will be output directly */
+
+    retval = rd->func(sect, f, job->errwarns, rd->d);
+    yasm_errwarn_propagate(job->errwarns, 0);
+
+    if (fclose(f) == 0 && retval == 0 && buf) {
+        sect->rendered = buf;
+        sect->rendered_len = len;
+    } else if (buf)
+        free(buf);
+}
+#endif
+
+void
+yasm_object_render_sections(yasm_object *object, yasm_errwarns *errwarns,
+                            void *d,
+                            int (*func) (yasm_section *sect, FILE *f,
+                                         yasm_errwarns *errwarns, void *d))
+{
+#ifdef YASM_THREADS
+    section_job *jobs;
+    size_t njobs;
+    render_data rd;
+
+    jobs = section_jobs_create(object, &njobs);
+    if (!jobs)
+        return;
+
+    rd.d = d;
+    rd.func = func;
+    section_jobs_run(object, jobs, njobs, render_job, &rd);
+    section_jobs_destroy(jobs, njobs, errwarns);
+#endif
+}
+
+int
+yasm_section_output_rendered(yasm_section *sect, FILE *f)
+{
+    if (!sect->rendered)
+        return 0;
+
+    if (sect->rendered_len > 0)
+        fwrite(sect->rendered, sect->rendered_len, 1, f);
+    free(sect->rendered);
+    sect->rendered = NULL;
+    sect->rendered_len = 0;
+    return 1;
+}
+
+int
+yasm_section_output(yasm_section *sect, FILE *f, yasm_errwarns *errwarns,
+                    void *d, int (*func) (yasm_bytecode *bc, void *d))
+{
+    long start, end;
+    int retval = 0;
+
+    start = ftell(f);
+    if (!yasm_section_output_rendered(sect, f))
+        retval = yasm_section_bcs_traverse(sect, errwarns, d, func);
+    end = ftell(f);
+
+    if (start >= 0 && end >= start) {
+        sect->has_output = 1;
+        sect->output_pos = (unsigned long)start;
+        sect->output_len = (unsigned long)(end-start);
+    }
+    return retval;
+}
+
+void
+yasm_section_set_output_range(yasm_section *sect, unsigned long pos,
+                              unsigned long len)
+{
+    sect->has_output = 1;
+    sect->output_pos = pos;
+    sect->output_len = len;
+}
+
+int
+yasm_section_get_output_range(const yasm_section *sect,
+                              unsigned long *pos, unsigned long *len)
+{
+    if (!sect->has_output)
+        return 0;
+    *pos = sect->output_pos;
+    *len = sect->output_len;
+    return 1;
+}
+
 /*@-onlytrans@*/
 yasm_section *
 yasm_object_find_general(yasm_object *object, const char *name)
@@ -569,33 +859,121 @@ yasm_object_find_general(yasm_object *object, const char *name)
 }
 /*@=onlytrans@*/
 
-void
-yasm_section_add_reloc(yasm_section *sect, yasm_reloc *reloc,
-                       void (*destroy_func) (/*@only@*/ void *reloc))
+yasm_reloc *
+yasm_section_add_reloc(yasm_section *sect, const yasm_reloc *reloc,
+                       size_t size, void (*destroy_func) (void *reloc))
 {
-    STAILQ_INSERT_TAIL(&sect->relocs, reloc, link);
-    if (!destroy_func)
-        yasm_internal_error(N_("NULL destroy function given to add_reloc"));
-    else if (sect->destroy_reloc && destroy_func != sect->destroy_reloc)
+    unsigned char *dest;
+
+    if (sect->num_relocs == 0 && !sect->relocs) {
+        sect->reloc_size = size;
+        sect->destroy_reloc = destroy_func;
+    } else if (size != sect->reloc_size)
+        yasm_internal_error(N_("different size given to add_reloc"));
+    else if (destroy_func != sect->destroy_reloc)
         yasm_internal_error(N_("different destroy function given to add_reloc"));
-    sect->destroy_reloc = destroy_func;
+
+    if (sect->num_relocs >= sect->max_relocs) {
+        sect->max_relocs = sect->max_relocs ? sect->max_relocs*2 : 16;
+        sect->relocs = yasm_xrealloc(sect->relocs,
+                                     sect->max_relocs*sect->reloc_size);
+    }
+    dest = sect->relocs + sect->num_relocs*sect->reloc_size;
+    memcpy(dest, reloc, size);
+    sect->num_relocs++;
+    return (yasm_reloc *)dest;
+}
+
+unsigned long
+yasm_section_num_relocs(const yasm_section *sect)
+{
+    return sect->num_relocs;
 }
 
 /*@null@*/ yasm_reloc *
 yasm_section_relocs_first(yasm_section *sect)
 {
-    return STAILQ_FIRST(&sect->relocs);
+    if (sect->num_relocs == 0)
+        return NULL;
+    return (yasm_reloc *)sect->relocs;
 }
 
-#undef yasm_section_reloc_next
 /*@null@*/ yasm_reloc *
-yasm_section_reloc_next(yasm_reloc *reloc)
+yasm_section_reloc_next(yasm_section *sect, yasm_reloc *reloc)
 {
-    return STAILQ_NEXT(reloc, link);
+    unsigned char *next = (unsigned char *)reloc + sect->reloc_size;
+    if (next >= sect->relocs + sect->num_relocs*sect->reloc_size)
+        return NULL;
+    return (yasm_reloc *)next;
 }
 
 void
-yasm_reloc_get(yasm_reloc *reloc, yasm_intnum **addrp, yasm_symrec **symp)
+yasm_section_sort_relocs(yasm_section *sect)
+{
+    unsigned long i, n = sect->num_relocs;
+    size_t size = sect->reloc_size;
+    unsigned long *keys, *idx, *tmp, *swap;
+    unsigned long count[256];
+    unsigned long prev, max;
+    unsigned int shift;
+    unsigned char *sorted;
+
+    /* Relocations are usually generated in address order already */
+    prev = 0;
+    max = 0;
+    for (i=0; i<n; i++) {
+        unsigned long addr =
+            ((yasm_reloc *)(sect->relocs + i*size))->addr;
+        if (addr < prev)
+            break;
+        prev = addr;
+    }
+    if (i >= n)
+        return;
+
+    /* LSD radix sort of indices, 8 bits at a time; being stable, equal
+     * addresses keep their order.
+     */
+    keys = yasm_xmalloc(n*sizeof(unsigned long));
+    idx = yasm_xmalloc(n*sizeof(unsigned long));
+    tmp = yasm_xmalloc(n*sizeof(unsigned long));
+    for (i=0; i<n; i++) {
+        keys[i] = ((yasm_reloc *)(sect->relocs + i*size))->addr;
+        if (keys[i] > max)
+            max = keys[i];
+        idx[i] = i;
+    }
+    for (shift=0; shift < sizeof(unsigned long)*8 && (max >> shift) != 0;
+         shift += 8) {
+        unsigned long sum = 0;
+        memset(count, 0, sizeof(count));
+        for (i=0; i<n; i++)
+            count[(keys[idx[i]] >> shift) & 0xFF]++;
+        for (i=0; i<256; i++) {
+            unsigned long c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (i=0; i<n; i++)
+            tmp[count[(keys[idx[i]] >> shift) & 0xFF]++] = idx[i];
+        swap = idx;
+        idx = tmp;
+        tmp = swap;
+    }
+
+    sorted = yasm_xmalloc(sect->max_relocs*size);
+    for (i=0; i<n; i++)
+        memcpy(sorted + i*size, sect->relocs + idx[i]*size, size);
+    yasm_xfree(sect->relocs);
+    sect->relocs = sorted;
+
+    yasm_xfree(keys);
+    yasm_xfree(idx);
+    yasm_xfree(tmp);
+}
+
+void
+yasm_reloc_get(yasm_reloc *reloc, unsigned long *addrp, yasm_symrec **symp)
 {
     *addrp = reloc->addr;
     *symp = reloc->sym;
@@ -623,11 +1001,31 @@ yasm_section_bcs_append(yasm_section *sect, yasm_bytecode *bc)
             STAILQ_INSERT_TAIL(&sect->bcs, bc, link);
             return bc;
         } else
-            yasm_xfree(bc);
+            yasm_bc_destroy(bc);
     }
     return (yasm_bytecode *)NULL;
 }
 
+yasm_bytecode *
+yasm_section_bcs_append_data(yasm_section *sect, yasm_bytecode *bc,
+                             int keep_lines)
+{
+    yasm_bytecode *last = STAILQ_LAST(&sect->bcs, yasm_bytecode, link);
+
+    /* Merge into the last bytecode if both are constant data, unless a
+     * symbol refers to the position between them.
+     */
+    if (bc && sect->object->coalesce_data && last->bc_index == 0 &&
+        last->line <= bc->line && yasm_bc_data_const_len(bc) > 0 &&
+        yasm_bc_data_const_len(last) > 0) {
+        yasm_bc_data_append(last, bc, keep_lines);
+        yasm_bc_destroy(bc);
+        yasm_stats_inc(YASM_STATS_DATA_COALESCED);
+        return last;
+    }
+    return yasm_section_bcs_append(sect, bc);
+}
+
 int
 yasm_section_bcs_traverse(yasm_section *sect,
                           /*@null@*/ yasm_errwarns *errwarns,
@@ -674,7 +1072,7 @@ static void
 yasm_section_destroy(yasm_section *sect)
 {
     yasm_bytecode *cur, *next;
-    yasm_reloc *r_cur, *r_next;
+    unsigned long i;
 
     if (!sect)
         return;
@@ -691,13 +1089,15 @@ yasm_section_destroy(yasm_section *sect)
     }
 
     /* Delete relocations */
-    r_cur = STAILQ_FIRST(&sect->relocs);
-    while (r_cur) {
-        r_next = STAILQ_NEXT(r_cur, link);
-        yasm_intnum_destroy(r_cur->addr);
-        sect->destroy_reloc(r_cur);
-        r_cur = r_next;
+    if (sect->destroy_reloc) {
+        for (i=0; i<sect->num_relocs; i++)
+            sect->destroy_reloc(sect->relocs + i*sect->reloc_size);
     }
+    if (sect->relocs)
+        yasm_xfree(sect->relocs);
+
+    if (sect->rendered)
+        free(sect->rendered);
 
     yasm_xfree(sect);
 }
@@ -930,6 +1330,7 @@ optimize_add_span(void *add_span_data, yasm_bytecode *bc, int id,
     yasm_span *span;
     span = create_span(bc, id, value, neg_thres, pos_thres, optd->os);
     TAILQ_INSERT_TAIL(&optd->spans, span, link);
+    yasm_stats_inc(YASM_STATS_SPANS);
 }
 
 static void
@@ -1290,6 +1691,161 @@ optimize_term_expand(IntervalTreeNode *node, void *d)
     span->active = 2;       /* Mark as being in Q */
 }
 
+/* Create a new placeholder offset setter for spans to point to; this will
+ * get updated if/when we actually run into one.
+ */
+static yasm_offset_setter *
+optimize_add_offset_setter(optimize_data *optd)
+{
+    yasm_offset_setter *os = yasm_xmalloc(sizeof(yasm_offset_setter));
+    os->bc = NULL;
+    os->cur_val = 0;
+    os->new_val = 0;
+    os->thres = 0;
+    STAILQ_INSERT_TAIL(&optd->offset_setters, os, link);
+    optd->os = os;
+    return os;
+}
+
+/* Step 1a for a single section: number the bytecodes starting at *bc_index,
+ * and calculate the minimum length of each, collecting spans and offset
+ * setters into optd.  Returns nonzero if an error occurred.
+ */
+static int
+optimize_section_lengths(yasm_section *sect, unsigned long *bc_index,
+                         optimize_data *optd, yasm_errwarns *errwarns)
+{
+    unsigned long offset = 0;
+    int saw_error = 0;
+    int retval;
+
+    yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
+
+    bc->bc_index = (*bc_index)++;
+
+    /* Skip our locally created empty bytecode first. */
+    bc = STAILQ_NEXT(bc, link);
+
+    /* Iterate through the remainder, if any. */
+    while (bc) {
+        bc->bc_index = (*bc_index)++;
+        bc->offset = offset;
+
+        retval = yasm_bc_calc_len(bc, optimize_add_span, optd);
+        yasm_errwarn_propagate(errwarns, bc->line);
+        if (retval)
+            saw_error = 1;
+        else {
+            if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
+                /* Remember it as offset setter */
+                optd->os->bc = bc;
+                optd->os->thres = yasm_bc_next_offset(bc);
+
+                /* Create new placeholder */
+                optimize_add_offset_setter(optd);
+
+                if (bc->multiple) {
+                    yasm_error_set(YASM_ERROR_VALUE,
+                        N_("cannot combine multiples and setting assembly position"));
+                    yasm_errwarn_propagate(errwarns, bc->line);
+                    saw_error = 1;
+                }
+            }
+
+            offset += bc->len*bc->mult_int;
+        }
+
+        bc = STAILQ_NEXT(bc, link);
+    }
+    return saw_error;
+}
+
+#ifdef YASM_THREADS
+typedef struct optimize_job {
+    optimize_data optd;         /* only spans, offset setters, and os used */
+    unsigned long bc_index;     /* index of the section's first bytecode */
+    int saw_error;
+} optimize_job;
+
+static void
+optimize_lengths_job(section_job *job, /*@unused@*/ void *d)
+{
+    optimize_job *oj = (optimize_job *)job->data;
+    oj->saw_error = optimize_section_lengths(job->sect, &oj->bc_index,
+                                             &oj->optd, job->errwarns);
+}
+
+/* Parallel version of step 1a.  Each section gets its own span and offset
+ * setter lists, which are then appended to optd in section order, so the
+ * result is identical to doing the sections one after another.  Returns -1
+ * if the object should not be processed in parallel.
+ */
+static int
+optimize_lengths_parallel(yasm_object *object, optimize_data *optd,
+                          yasm_errwarns *errwarns)
+{
+    section_job *jobs;
+    optimize_job *ojs;
+    size_t njobs, i;
+    unsigned long bc_index = 0;
+    int saw_error = 0;
+
+    jobs = section_jobs_create(object, &njobs);
+    if (!jobs)
+        return -1;
+
+    ojs = yasm_xmalloc(njobs*sizeof(optimize_job));
+    for (i=0; i<njobs; i++) {
+        yasm_bytecode *bc;
+
+        TAILQ_INIT(&ojs[i].optd.spans);
+        STAILQ_INIT(&ojs[i].optd.offset_setters);
+        optimize_add_offset_setter(&ojs[i].optd);
+        ojs[i].bc_index = bc_index;
+        ojs[i].saw_error = 0;
+        STAILQ_FOREACH(bc, &jobs[i].sect->bcs, link)
+            bc_index++;
+        jobs[i].data = &ojs[i];
+    }
+
+    section_jobs_run(object, jobs, njobs, optimize_lengths_job, NULL);
+
+    for (i=0; i<njobs; i++) {
+        optimize_data *joptd = &ojs[i].optd;
+        yasm_offset_setter *first = STAILQ_FIRST(&joptd->offset_setters);
+        yasm_span *span;
+
+        /* Spans before the section's first offset setter follow the last
+         * offset setter of the previous sections.
+         */
+        TAILQ_FOREACH(span, &joptd->spans, link) {
+            if (span->os != first)
+                break;
+            span->os = optd->os;
+        }
+
+        /* Merge the leading placeholder into the pending one */
+        optd->os->bc = first->bc;
+        optd->os->thres = first->thres;
+        STAILQ_REMOVE_HEAD(&joptd->offset_setters, link);
+        yasm_xfree(first);
+        if (!STAILQ_EMPTY(&joptd->offset_setters)) {
+            STAILQ_CONCAT(&optd->offset_setters, &joptd->offset_setters);
+            optd->os = joptd->os;
+        }
+
+        TAILQ_CONCAT(&optd->spans, &joptd->spans, link);
+
+        if (ojs[i].saw_error)
+            saw_error = 1;
+    }
+
+    yasm_xfree(ojs);
+    section_jobs_destroy(jobs, njobs, errwarns);
+    return saw_error;
+}
+#endif
+
 void
 yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
 {
@@ -1306,64 +1862,18 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
     STAILQ_INIT(&optd.offset_setters);
     optd.itree = IT_create();
 
-    /* Create an placeholder offset setter for spans to point to; this will
-     * get updated if/when we actually run into one.
-     */
-    os = yasm_xmalloc(sizeof(yasm_offset_setter));
-    os->bc = NULL;
-    os->cur_val = 0;
-    os->new_val = 0;
-    os->thres = 0;
-    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
-    optd.os = os;
+    optimize_add_offset_setter(&optd);
 
     /* Step 1a */
-    STAILQ_FOREACH(sect, &object->sections, link) {
-        unsigned long offset = 0;
-
-        yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
-
-        bc->bc_index = bc_index++;
-
-        /* Skip our locally created empty bytecode first. */
-        bc = STAILQ_NEXT(bc, link);
-
-        /* Iterate through the remainder, if any. */
-        while (bc) {
-            bc->bc_index = bc_index++;
-            bc->offset = offset;
-
-            retval = yasm_bc_calc_len(bc, optimize_add_span, &optd);
-            yasm_errwarn_propagate(errwarns, bc->line);
-            if (retval)
+#ifdef YASM_THREADS
+    saw_error = optimize_lengths_parallel(object, &optd, errwarns);
+    if (saw_error < 0)
+#endif
+    {
+        saw_error = 0;
+        STAILQ_FOREACH(sect, &object->sections, link) {
+            if (optimize_section_lengths(sect, &bc_index, &optd, errwarns))
                 saw_error = 1;
-            else {
-                if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
-                    /* Remember it as offset setter */
-                    os->bc = bc;
-                    os->thres = yasm_bc_next_offset(bc);
-
-                    /* Create new placeholder */
-                    os = yasm_xmalloc(sizeof(yasm_offset_setter));
-                    os->bc = NULL;
-                    os->cur_val = 0;
-                    os->new_val = 0;
-                    os->thres = 0;
-                    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
-                    optd.os = os;
-
-                    if (bc->multiple) {
-                        yasm_error_set(YASM_ERROR_VALUE,
-                            N_("cannot combine multiples and setting assembly position"));
-                        yasm_errwarn_propagate(errwarns, bc->line);
-                        saw_error = 1;
-                    }
-                }
-
-                offset += bc->len*bc->mult_int;
-            }
-
-            bc = STAILQ_NEXT(bc, link);
         }
     }
 
@@ -1379,6 +1889,7 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
             yasm_errwarn_propagate(errwarns, span->bc->line);
             saw_error = 1;
         } else if (recalc_normal_span(span)) {
+            yasm_stats_inc(YASM_STATS_SPAN_EXPANSIONS);
             retval = yasm_bc_expand(span->bc, span->id, span->cur_val,
                                     span->new_val, &span->neg_thres,
                                     &span->pos_thres);
@@ -1499,9 +2010,11 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
         if (!STAILQ_EMPTY(&optd.QA)) {
             span = STAILQ_FIRST(&optd.QA);
             STAILQ_REMOVE_HEAD(&optd.QA, linkq);
+            yasm_stats_inc(YASM_STATS_QA_ITERATIONS);
         } else {
             span = STAILQ_FIRST(&optd.QB);
             STAILQ_REMOVE_HEAD(&optd.QB, linkq);
+            yasm_stats_inc(YASM_STATS_QB_ITERATIONS);
         }
 
         if (!span->active)
@@ -1517,6 +2030,7 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
 
         orig_len = span->bc->len * span->bc->mult_int;
 
+        yasm_stats_inc(YASM_STATS_SPAN_EXPANSIONS);
         retval = yasm_bc_expand(span->bc, span->id, span->cur_val,
                                 span->new_val, &span->neg_thres,
                                 &span->pos_thres);
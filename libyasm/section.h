@@ -35,13 +35,13 @@
 #endif
 
 /** Basic YASM relocation.  Object formats will need to extend this
- * structure with additional fields for relocation type, etc.
+ * structure with additional fields for relocation type, etc.  Sections
+ * store relocations by value in a contiguous array.
  */
 typedef struct yasm_reloc yasm_reloc;
 
 struct yasm_reloc {
-    /*@reldef@*/ STAILQ_ENTRY(yasm_reloc) link; /**< Link to next reloc */
-    yasm_intnum *addr;          /**< Offset (address) within section */
+    unsigned long addr;         /**< Offset (address) within section */
     /*@dependent@*/ yasm_symrec *sym;       /**< Relocated symbol */
 };
 
@@ -73,10 +73,30 @@ struct yasm_object {
     /** Linked list of sections. */
     /*@reldef@*/ STAILQ_HEAD(yasm_sectionhead, yasm_section) sections;
 
-    /** Directives, organized as two level HAMT; first level is parser,
-     * second level is directive name.
+    /** Contents of files included as binary data (e.g. by incbin). */
+    /*@owned@*/ struct yasm_filecache *filecache;
+
+    /** Maximum number of threads to use for finalizing, optimizing, and
+     * generating output; 1 to do everything in a single thread.  See
+     * yasm_object_finalize(), yasm_object_optimize(), and
+     * yasm_object_render_sections().
+     */
+    unsigned int threads;
+
+    /** Nonzero to merge consecutive constant data bytecodes as they are
+     * parsed.  See yasm_section_bcs_append_data().
+     */
+    int coalesce_data;
+
+    /** Nonzero to move merged constant data out of memory into a temporary
+     * file (data_spool) in large blocks as it is parsed, so that data-heavy
+     * output need not be held in memory.  Spooled bytecodes are best written
+     * out with yasm_bc_data_write_spooled().
      */
-    /*@owned@*/ struct HAMT *directives;
+    int spool_data;
+
+    /** Temporary file holding spooled data; created when first needed. */
+    /*@null@*/ FILE *data_spool;
 
     /** Prefix prepended to externally-visible symbols (empty string if none) */
     /*@owned@*/ char *global_prefix;
@@ -152,7 +172,9 @@ void yasm_object_destroy(/*@only@*/ yasm_object *object);
 YASM_LIB_DECL
 void yasm_object_print(const yasm_object *object, FILE *f, int indent_level);
 
-/** Finalize an object after parsing.
+/** Finalize an object after parsing.  If object->threads is greater than 1,
+ * sections are finalized concurrently; errors/warnings are still reported in
+ * section order.
  * \param object        object
  * \param errwarns      error/warning set
  * \note Errors/warnings are stored into errwarns.
@@ -160,6 +182,21 @@ void yasm_object_print(const yasm_object *object, FILE *f, int indent_level);
 YASM_LIB_DECL
 void yasm_object_finalize(yasm_object *object, yasm_errwarns *errwarns);
 
+/** Lock object state that is shared between sections (e.g. the symbol table
+ * and the file cache) against concurrent modification while sections are
+ * being finalized or optimized in multiple threads.  Does nothing if yasm
+ * was built without thread support.
+ * \internal
+ */
+YASM_LIB_DECL
+void yasm__object_lock(void);
+
+/** Unlock object state locked by yasm__object_lock().
+ * \internal
+ */
+YASM_LIB_DECL
+void yasm__object_unlock(void);
+
 /** Traverses all sections in an object, calling a function on each section.
  * \param object        object
  * \param d             data pointer passed to func on each call
@@ -172,6 +209,36 @@ int yasm_object_sections_traverse
     (yasm_object *object, /*@null@*/ void *d,
      int (*func) (yasm_section *sect, /*@null@*/ void *d));
 
+/** Render the contents of all sections in an object into memory,
+ * concurrently in up to object->threads threads.  This is intended for use
+ * by object formats: func is called once for each section, and should write
+ * the section contents to the memory stream f, adding relocations to the
+ * section as it goes.  Each call gets its own error/warning set, which is
+ * merged into errwarns in section order once all sections are done, so the
+ * result is the same as rendering the sections one after another.  The
+ * rendered contents are written out with yasm_section_output_rendered().
+ *
+ * Does nothing if object->threads is 1 or less, if the object has only one
+ * section, or if yasm was built without thread support.
+ *
+ * func may run concurrently for different sections.  It must only modify
+ * its own section (and data associated with it), and must not output
+ * anything other than to f.  The libyasm state used while converting
+ * bytecodes to bytes (intnum calculation, expression simplification, and
+ * errors/warnings) is per-thread.
+ * \param object        object
+ * \param errwarns      error/warning set
+ * \param d             data pointer passed to func on each call
+ * \param func          function; to skip a section, it should return
+ *                      nonzero without doing anything else, and the section
+ *                      is then treated as not rendered
+ */
+YASM_LIB_DECL
+void yasm_object_render_sections
+    (yasm_object *object, yasm_errwarns *errwarns, /*@null@*/ void *d,
+     int (*func) (yasm_section *sect, FILE *f, yasm_errwarns *errwarns,
+                  /*@null@*/ void *d));
+
 /** Find a general section in an object, based on its name.
  * \param object        object
  * \param name          section name
@@ -204,6 +271,9 @@ void yasm_object_set_global_suffix(yasm_object *object, const char *suffix);
 
 /** Optimize an object.  Takes the unoptimized object and optimizes it.
  * If successful, the object is ready for output to an object file.
+ * If object->threads is greater than 1, the initial (minimum) lengths of
+ * the bytecodes in different sections are calculated concurrently; the
+ * result is the same as with a single thread.
  * \param object        object
  * \param errwarns      error/warning set
  * \note Optimization failures are stored into errwarns.
@@ -274,18 +344,32 @@ void yasm_section_add_data(yasm_section *sect,
                            const yasm_assoc_data_callback *callback,
                            /*@null@*/ /*@only@*/ void *data);
 
-/** Add a relocation to a section.
+/** Add a relocation to a section.  The relocation is copied into the
+ * section's relocation array, so it may be built in a local variable.
  * \param sect          section
  * \param reloc         relocation
- * \param destroy_func  function that can destroy the relocation
- * \note Does not make a copy of reloc.  The same destroy_func must be
- * used for all relocations in a section or an internal error will occur.
- * The section will destroy the relocation address; it is the caller's
- * responsibility to destroy any other allocated data.
+ * \param size          size of the relocation, including any object format
+ *                      specific fields that follow the #yasm_reloc
+ * \param destroy_func  function that destroys any data owned by a stored
+ *                      relocation (but not the relocation itself); may be
+ *                      NULL if there is none
+ * \return The stored relocation; valid until another relocation is added
+ *         to or the relocations are sorted in the section.
+ * \note The same size and destroy_func must be used for all relocations
+ * in a section or an internal error will occur.
+ */
+YASM_LIB_DECL
+yasm_reloc *yasm_section_add_reloc(yasm_section *sect,
+                                   const yasm_reloc *reloc, size_t size,
+                                   /*@null@*/ void (*destroy_func)
+                                       (void *reloc));
+
+/** Get the number of relocations in a section.
+ * \param sect          section
+ * \return Number of relocations.
  */
 YASM_LIB_DECL
-void yasm_section_add_reloc(yasm_section *sect, yasm_reloc *reloc,
-    void (*destroy_func) (/*@only@*/ void *reloc));
+unsigned long yasm_section_num_relocs(const yasm_section *sect);
 
 /** Get the first relocation for a section.
  * \param sect          section
@@ -295,13 +379,21 @@ YASM_LIB_DECL
 /*@null@*/ yasm_reloc *yasm_section_relocs_first(yasm_section *sect);
 
 /** Get the next relocation for a section.
+ * \param sect          section
  * \param reloc         previous relocation
  * \return Next relocation for section.  NULL if no more relocations.
  */
-/*@null@*/ yasm_reloc *yasm_section_reloc_next(yasm_reloc *reloc);
-#ifndef YASM_DOXYGEN
-#define yasm_section_reloc_next(x)      STAILQ_NEXT((x), link)
-#endif
+YASM_LIB_DECL
+/*@null@*/ yasm_reloc *yasm_section_reloc_next(yasm_section *sect,
+                                              yasm_reloc *reloc);
+
+/** Sort the relocations of a section by address.  The sort is stable, so
+ * relocations at the same address keep their relative order.  Relocations
+ * already in address order (the usual case) are detected and left alone.
+ * \param sect          section
+ */
+YASM_LIB_DECL
+void yasm_section_sort_relocs(yasm_section *sect);
 
 /** Get the basic relocation information for a relocation.
  * \param reloc         relocation
@@ -309,7 +401,7 @@ YASM_LIB_DECL
  * \param symp          relocated symbol (returned)
  */
 YASM_LIB_DECL
-void yasm_reloc_get(yasm_reloc *reloc, yasm_intnum **addrp,
+void yasm_reloc_get(yasm_reloc *reloc, /*@out@*/ unsigned long *addrp,
                     /*@dependent@*/ yasm_symrec **symp);
 
 /** Get the first bytecode in a section.
@@ -342,6 +434,25 @@ YASM_LIB_DECL
     (yasm_section *sect,
      /*@returned@*/ /*@only@*/ /*@null@*/ yasm_bytecode *bc);
 
+/** Add bytecode to the end of a section, merging it into the last bytecode
+ * if the object allows it (see #yasm_object.coalesce_data) and both consist
+ * only of constant data (see yasm_bc_data_append()).  Large tables of
+ * db/dw/dd/dq lines then take a single bytecode rather than one per line.
+ * Data is not merged across a position referred to by a label or current
+ * position symbol.
+ * \note Intended for use by parsers; as bc may be deleted, don't use the bc
+ *       pointer after calling this function.
+ * \param sect          section
+ * \param bc            bytecode (may be NULL)
+ * \param keep_lines    if nonzero, keep the portion of a merged bytecode
+ *                      generated by each line (for source listings)
+ * \return The bytecode bc was merged into, or as yasm_section_bcs_append().
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ yasm_bytecode *yasm_section_bcs_append_data
+    (yasm_section *sect, /*@only@*/ /*@null@*/ yasm_bytecode *bc,
+     int keep_lines);
+
 /** Traverses all bytecodes in a section, calling a function on each bytecode.
  * \param sect      section
  * \param errwarns  error/warning set (may be NULL)
@@ -357,6 +468,56 @@ int yasm_section_bcs_traverse
     (yasm_section *sect, /*@null@*/ yasm_errwarns *errwarns,
      /*@null@*/ void *d, int (*func) (yasm_bytecode *bc, /*@null@*/ void *d));
 
+/** Write out the contents of a section previously rendered by
+ * yasm_object_render_sections(), and release them.
+ * \param sect      section
+ * \param f         output file
+ * \return Nonzero if the section had been rendered (and was written to f),
+ *         0 if not (in which case its bytecodes need to be output directly).
+ */
+YASM_LIB_DECL
+int yasm_section_output_rendered(yasm_section *sect, FILE *f);
+
+/** Write out the contents of a section at the current position of the
+ * output file: its rendered contents if yasm_object_render_sections()
+ * rendered it, otherwise by calling func for each bytecode as
+ * yasm_section_bcs_traverse() does.  The range of the file written is
+ * recorded for yasm_section_get_output_range().
+ * \param sect      section
+ * \param f         output file
+ * \param errwarns  error/warning set (may be NULL)
+ * \param d         data pointer passed to func on each call (may be NULL)
+ * \param func      bytecode output function
+ * \return Stops early (and returns func's return value) if func returns a
+ *         nonzero value; otherwise 0.
+ */
+YASM_LIB_DECL
+int yasm_section_output
+    (yasm_section *sect, FILE *f, /*@null@*/ yasm_errwarns *errwarns,
+     /*@null@*/ void *d, int (*func) (yasm_bytecode *bc, /*@null@*/ void *d));
+
+/** Record where the contents of a section were written in the output file,
+ * for object formats that do not write them with yasm_section_output().
+ * \param sect      section
+ * \param pos       file offset of the section contents
+ * \param len       number of bytes written
+ */
+YASM_LIB_DECL
+void yasm_section_set_output_range(yasm_section *sect, unsigned long pos,
+                                   unsigned long len);
+
+/** Get where the contents of a section were written in the output file.
+ * \param sect      section
+ * \param pos       file offset of the section contents (output)
+ * \param len       number of bytes written (output)
+ * \return Nonzero if the section contents were written, 0 if not (e.g. for
+ *         BSS sections, or before output).
+ */
+YASM_LIB_DECL
+int yasm_section_get_output_range(const yasm_section *sect,
+                                  /*@out@*/ unsigned long *pos,
+                                  /*@out@*/ unsigned long *len);
+
 /** Get name of a section.
  * \param   sect    section
  * \return Section name.
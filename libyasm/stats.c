@@ -0,0 +1,280 @@
+/*
+ * Assembly statistics (phase timings and counters)
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "util.h"
+
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+
+#include "coretype.h"
+#include "errwarn.h"
+#include "stats.h"
+
+
+/* Maximum phase nesting depth */
+#define STATS_MAX_DEPTH     8
+
+typedef struct phase_stats {
+    double time;
+    unsigned long allocs;
+    unsigned long alloc_bytes;
+} phase_stats;
+
+static const char *phase_names[YASM_STATS_NUM_PHASES] = {
+    "parse",
+    "symtab",
+    "finalize",
+    "optimize",
+    "dbgfmt",
+    "output",
+    "list"
+};
+
+static const char *counter_names[YASM_STATS_NUM_COUNTERS] = {
+    "allocs",
+    "alloc_bytes",
+    "bytecodes",
+    "sections",
+    "symbols",
+    "spans",
+    "span_expansions",
+    "qa_iterations",
+    "qb_iterations",
+    "expr_simplify",
+    "intnum_bv",
+    "macro_expansions",
+    "data_coalesced",
+    "snapshot_saves",
+    "snapshot_loads"
+};
+
+YASM_LIB_DECL
+int yasm_stats_enabled = 0;
+
+/* Event counters are per-thread, as output may run in several threads. */
+static YASM_THREAD_LOCAL unsigned long counters[YASM_STATS_NUM_COUNTERS];
+
+/* Counters of the thread that enabled statistics. */
+static unsigned long *main_counters = NULL;
+
+static phase_stats phases[YASM_STATS_NUM_PHASES];
+
+/* Stack of active phases; only the top one is being charged. */
+static yasm_stats_phase phase_stack[STATS_MAX_DEPTH];
+static int phase_depth = 0;
+
+/* Marks at the time the top phase was last charged. */
+static double mark_time;
+static unsigned long mark_allocs, mark_alloc_bytes;
+
+/* Allocators in effect before statistics were enabled. */
+static void * (*orig_xmalloc) (size_t size);
+static void * (*orig_xcalloc) (size_t nelem, size_t elsize);
+static void * (*orig_xrealloc) (void *oldmem, size_t size);
+
+static void *
+stats_xmalloc(size_t size)
+{
+    counters[YASM_STATS_ALLOCS]++;
+    counters[YASM_STATS_ALLOC_BYTES] += (unsigned long)size;
+    return orig_xmalloc(size);
+}
+
+static void *
+stats_xcalloc(size_t nelem, size_t elsize)
+{
+    counters[YASM_STATS_ALLOCS]++;
+    counters[YASM_STATS_ALLOC_BYTES] +=
+        (unsigned long)(nelem*elsize);
+    return orig_xcalloc(nelem, elsize);
+}
+
+static void *
+stats_xrealloc(void *oldmem, size_t size)
+{
+    counters[YASM_STATS_ALLOCS]++;
+    counters[YASM_STATS_ALLOC_BYTES] += (unsigned long)size;
+    return orig_xrealloc(oldmem, size);
+}
+
+static double
+stats_now(void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#else
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+/* Charge everything since the last mark to the currently active phase. */
+static void
+stats_charge(void)
+{
+    double now = stats_now();
+    unsigned long allocs = counters[YASM_STATS_ALLOCS];
+    unsigned long bytes = counters[YASM_STATS_ALLOC_BYTES];
+
+    if (phase_depth > 0 && phase_depth <= STATS_MAX_DEPTH) {
+        phase_stats *ps = &phases[phase_stack[phase_depth-1]];
+        ps->time += now - mark_time;
+        ps->allocs += allocs - mark_allocs;
+        ps->alloc_bytes += bytes - mark_alloc_bytes;
+    }
+
+    mark_time = now;
+    mark_allocs = allocs;
+    mark_alloc_bytes = bytes;
+}
+
+void
+yasm_stats_enable(void)
+{
+    int i;
+
+    for (i=0; i<YASM_STATS_NUM_COUNTERS; i++)
+        counters[i] = 0;
+    for (i=0; i<YASM_STATS_NUM_PHASES; i++) {
+        phases[i].time = 0.0;
+        phases[i].allocs = 0;
+        phases[i].alloc_bytes = 0;
+    }
+    phase_depth = 0;
+
+    /* Hook the allocators to count allocations */
+    if (yasm_xmalloc != stats_xmalloc) {
+        orig_xmalloc = yasm_xmalloc;
+        orig_xcalloc = yasm_xcalloc;
+        orig_xrealloc = yasm_xrealloc;
+        yasm_xmalloc = stats_xmalloc;
+        yasm_xcalloc = stats_xcalloc;
+        yasm_xrealloc = stats_xrealloc;
+    }
+
+    main_counters = counters;
+    yasm_stats_enabled = 1;
+    stats_charge();
+}
+
+void
+yasm_stats__add(yasm_stats_counter counter, unsigned long n)
+{
+    counters[counter] += n;
+}
+
+unsigned long
+yasm_stats_get(yasm_stats_counter counter)
+{
+    return counters[counter];
+}
+
+void
+yasm_stats_merge_thread(void)
+{
+    int i;
+
+    if (!yasm_stats_enabled || counters == main_counters)
+        return;
+    for (i=0; i<YASM_STATS_NUM_COUNTERS; i++) {
+        main_counters[i] += counters[i];
+        counters[i] = 0;
+    }
+}
+
+void
+yasm_stats_phase_begin(yasm_stats_phase phase)
+{
+    if (!yasm_stats_enabled)
+        return;
+    stats_charge();
+    if (phase_depth < STATS_MAX_DEPTH)
+        phase_stack[phase_depth] = phase;
+    phase_depth++;
+}
+
+void
+yasm_stats_phase_end(yasm_stats_phase phase)
+{
+    if (!yasm_stats_enabled)
+        return;
+    if (phase_depth == 0 || (phase_depth <= STATS_MAX_DEPTH &&
+                             phase_stack[phase_depth-1] != phase))
+        yasm_internal_error(N_("mismatched statistics phase end"));
+    stats_charge();
+    phase_depth--;
+}
+
+double
+yasm_stats_phase_time(yasm_stats_phase phase)
+{
+    return phases[phase].time;
+}
+
+void
+yasm_stats_output(FILE *f, int json)
+{
+    double total = 0.0;
+    int i;
+
+    if (!yasm_stats_enabled)
+        return;
+
+    stats_charge();
+    for (i=0; i<YASM_STATS_NUM_PHASES; i++)
+        total += phases[i].time;
+
+    if (json) {
+        fprintf(f, "{\n  \"phases\": {\n");
+        for (i=0; i<YASM_STATS_NUM_PHASES; i++)
+            fprintf(f, "    \"%s\": {\"time\": %.6f, \"allocs\": %lu, "
+                    "\"alloc_bytes\": %lu}%s\n", phase_names[i],
+                    phases[i].time, phases[i].allocs, phases[i].alloc_bytes,
+                    i == YASM_STATS_NUM_PHASES-1 ? "" : ",");
+        fprintf(f, "  },\n  \"total_time\": %.6f,\n  \"counters\": {\n",
+                total);
+        for (i=0; i<YASM_STATS_NUM_COUNTERS; i++)
+            fprintf(f, "    \"%s\": %lu%s\n", counter_names[i],
+                    counters[i],
+                    i == YASM_STATS_NUM_COUNTERS-1 ? "" : ",");
+        fprintf(f, "  }\n}\n");
+        return;
+    }
+
+    fprintf(f, "%-18s %12s %12s %14s\n", "phase", "time (s)", "allocs",
+            "alloc bytes");
+    for (i=0; i<YASM_STATS_NUM_PHASES; i++)
+        fprintf(f, "%-18s %12.6f %12lu %14lu\n", phase_names[i],
+                phases[i].time, phases[i].allocs, phases[i].alloc_bytes);
+    fprintf(f, "%-18s %12.6f\n\n", "total", total);
+    for (i=0; i<YASM_STATS_NUM_COUNTERS; i++)
+        fprintf(f, "%-18s %12lu\n", counter_names[i],
+                counters[i]);
+}
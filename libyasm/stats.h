@@ -0,0 +1,146 @@
+/**
+ * \file libyasm/stats.h
+ * \brief YASM assembly statistics (phase timings and counters) interface.
+ *
+ * \license
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ * \endlicense
+ */
+#ifndef YASM_STATS_H
+#define YASM_STATS_H
+
+#ifndef YASM_LIB_DECL
+#define YASM_LIB_DECL
+#endif
+
+/** Assembly phases that are individually timed.  Phases nest; time spent in
+ * an inner phase is not counted against the enclosing phase.
+ */
+typedef enum yasm_stats_phase {
+    YASM_STATS_PHASE_PARSE = 0,     /**< Preprocess and parse */
+    YASM_STATS_PHASE_SYMTAB,        /**< Symbol table parser finalize */
+    YASM_STATS_PHASE_FINALIZE,      /**< Object finalize */
+    YASM_STATS_PHASE_OPTIMIZE,      /**< Object optimize */
+    YASM_STATS_PHASE_DBGFMT,        /**< Debug format generate */
+    YASM_STATS_PHASE_OUTPUT,        /**< Object format output */
+    YASM_STATS_PHASE_LIST,          /**< List file output */
+    YASM_STATS_NUM_PHASES
+} yasm_stats_phase;
+
+/** Event counters. */
+typedef enum yasm_stats_counter {
+    YASM_STATS_ALLOCS = 0,          /**< Memory allocations */
+    YASM_STATS_ALLOC_BYTES,         /**< Bytes requested from allocator */
+    YASM_STATS_BYTECODES,           /**< Bytecodes created */
+    YASM_STATS_SECTIONS,            /**< Sections created */
+    YASM_STATS_SYMBOLS,             /**< Symbols created */
+    YASM_STATS_SPANS,               /**< Optimizer spans created */
+    YASM_STATS_SPAN_EXPANSIONS,     /**< Bytecode expansions due to spans */
+    YASM_STATS_QA_ITERATIONS,       /**< Optimizer QA (times) iterations */
+    YASM_STATS_QB_ITERATIONS,       /**< Optimizer QB (non-times) iterations */
+    YASM_STATS_EXPR_SIMPLIFY,       /**< Expression tree levelings */
+    YASM_STATS_INTNUM_BV,           /**< Intnums promoted to bitvectors */
+    YASM_STATS_MACRO_EXPANSIONS,    /**< Multi-line macro expansions */
+    YASM_STATS_DATA_COALESCED,      /**< Data bytecodes coalesced */
+    YASM_STATS_SNAPSHOT_SAVES,      /**< Preprocessor snapshots written */
+    YASM_STATS_SNAPSHOT_LOADS,      /**< Preprocessor snapshots restored */
+    YASM_STATS_NUM_COUNTERS
+} yasm_stats_counter;
+
+/** Nonzero if statistics collection is enabled.  Set with
+ * yasm_stats_enable().
+ */
+YASM_LIB_DECL
+extern int yasm_stats_enabled;
+
+/** Enable statistics collection and reset all timings and counters. */
+YASM_LIB_DECL
+void yasm_stats_enable(void);
+
+/** Add to an event counter (internal; use yasm_stats_add()).
+ * \param counter   counter
+ * \param n         amount to add
+ */
+YASM_LIB_DECL
+void yasm_stats__add(yasm_stats_counter counter, unsigned long n);
+
+/** Add to an event counter.  Does nothing if statistics are disabled, and
+ * is cheap enough to be used on hot paths.
+ * \param counter   counter
+ * \param n         amount to add
+ */
+#define yasm_stats_add(counter, n) \
+    do { \
+        if (yasm_stats_enabled) \
+            yasm_stats__add(counter, (unsigned long)(n)); \
+    } while (0)
+
+/** Increment an event counter by one.
+ * \param counter   counter
+ */
+#define yasm_stats_inc(counter)     yasm_stats_add(counter, 1)
+
+/** Get the current value of an event counter.
+ * \param counter   counter
+ * \return Counter value.
+ */
+YASM_LIB_DECL
+unsigned long yasm_stats_get(yasm_stats_counter counter);
+
+/** Fold the event counts made by the calling (worker) thread into the
+ * counters of the thread that enabled statistics.  Must be called by each
+ * worker thread before it exits, and not concurrently with other threads.
+ */
+YASM_LIB_DECL
+void yasm_stats_merge_thread(void);
+
+/** Start timing a phase.  Suspends timing of the currently active phase (if
+ * any) until the matching yasm_stats_phase_end().
+ * \param phase     phase
+ */
+YASM_LIB_DECL
+void yasm_stats_phase_begin(yasm_stats_phase phase);
+
+/** Stop timing the most recently started phase and resume the enclosing
+ * one.
+ * \param phase     phase (must match the last yasm_stats_phase_begin())
+ */
+YASM_LIB_DECL
+void yasm_stats_phase_end(yasm_stats_phase phase);
+
+/** Get the accumulated wall time spent in a phase.
+ * \param phase     phase
+ * \return Time in seconds.
+ */
+YASM_LIB_DECL
+double yasm_stats_phase_time(yasm_stats_phase phase);
+
+/** Output all phase timings and counters.
+ * \param f         output file
+ * \param json      nonzero to output JSON, zero for human-readable text
+ */
+YASM_LIB_DECL
+void yasm_stats_output(FILE *f, int json);
+
+#endif
@@ -27,12 +27,10 @@
 #include "util.h"
 
 #include <limits.h>
-#include <ctype.h>
 
 #include "libyasm-stdint.h"
 #include "coretype.h"
 #include "valparam.h"
-#include "hamt.h"
 #include "assocdat.h"
 
 #include "errwarn.h"
@@ -40,6 +38,7 @@
 #include "floatnum.h"
 #include "expr.h"
 #include "symrec.h"
+#include "stats.h"
 
 #include "bytecode.h"
 #include "section.h"
@@ -76,19 +75,48 @@ struct yasm_symrec {
 
     /* associated data; NULL if none */
     /*@null@*/ /*@only@*/ yasm__assoc_data *assoc_data;
+
+    /* next symbol in the table, in insertion order */
+    /*@null@*/ /*@dependent@*/ yasm_symrec *next;
 };
 
-/* Linked list of symbols not in the symbol table. */
-typedef struct non_table_symrec_s {
-     /*@reldef@*/ SLIST_ENTRY(non_table_symrec_s) link;
-     /*@owned@*/ yasm_symrec *rec;
-} non_table_symrec;
+/* Symbol records are allocated in chunks, so that they are laid out densely
+ * in insertion order and never move once created.
+ */
+#define SYMREC_CHUNK_SIZE   256
+
+typedef struct symrec_chunk {
+    /*@null@*/ /*@owned@*/ struct symrec_chunk *next;
+    unsigned int used;
+    yasm_symrec recs[SYMREC_CHUNK_SIZE];
+} symrec_chunk;
+
+/* Index entry.  The full hash is kept alongside the symbol so that most
+ * mismatches during probing never touch the symbol record itself.
+ */
+typedef struct symtab_slot {
+    unsigned long hash;
+    /*@null@*/ /*@dependent@*/ yasm_symrec *rec;
+} symtab_slot;
+
+#define SYMTAB_INIT_SIZE    256     /* must be a power of two */
 
 struct yasm_symtab {
-    /* The symbol table: a hash array mapped trie (HAMT). */
-    /*@only@*/ HAMT *sym_table;
-    /* Symbols not in the table */
-    SLIST_HEAD(nontablesymhead_s, non_table_symrec_s) non_table_syms;
+    /* The symbol index: open addressing with linear probing; the number of
+     * slots is a power of two and is kept at least twice the number of
+     * symbols.
+     */
+    /*@only@*/ symtab_slot *slots;
+    unsigned long size;             /* number of slots */
+    unsigned long count;            /* number of symbols in the index */
+
+    /* Symbols in the table, in insertion order */
+    /*@null@*/ /*@dependent@*/ yasm_symrec *first, **last;
+
+    /* Storage for all symbols, both in and not in the table; the head is the
+     * most recently allocated (and only partially used) chunk.
+     */
+    /*@only@*/ symrec_chunk *chunks;
 
     int case_sensitive;
 };
@@ -134,8 +162,14 @@ yasm_symtab *
 yasm_symtab_create(void)
 {
     yasm_symtab *symtab = yasm_xmalloc(sizeof(yasm_symtab));
-    symtab->sym_table = HAMT_create(0, yasm_internal_error_);
-    SLIST_INIT(&symtab->non_table_syms);
+    symtab->slots = yasm_xcalloc(SYMTAB_INIT_SIZE, sizeof(symtab_slot));
+    symtab->size = SYMTAB_INIT_SIZE;
+    symtab->count = 0;
+    symtab->first = NULL;
+    symtab->last = &symtab->first;
+    symtab->chunks = yasm_xmalloc(sizeof(symrec_chunk));
+    symtab->chunks->next = NULL;
+    symtab->chunks->used = 0;
     symtab->case_sensitive = 1;
     return symtab;
 }
@@ -147,28 +181,170 @@ yasm_symtab_set_case_sensitive(yasm_symtab *symtab, int sensitive)
 }
 
 static void
-symrec_destroy_one(/*@only@*/ void *d)
+symrec_destroy_one(/*@only@*/ yasm_symrec *sym)
 {
-    yasm_symrec *sym = d;
     yasm_xfree(sym->name);
     if (sym->type == SYM_EQU && (sym->status & YASM_SYM_VALUED))
         yasm_expr_destroy(sym->value.expn);
     yasm__assoc_data_destroy(sym->assoc_data);
-    yasm_xfree(sym);
 }
 
-static /*@partial@*/ yasm_symrec *
-symrec_new_common(/*@keep@*/ char *name, int case_sensitive)
+/* Fold ASCII upper case to lower case.  Symbol names are plain ASCII, so
+ * this matches tolower() in the C locale without a per-character call.
+ */
+#define SYM_FOLD(c)     ((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 'a' : (c))
+
+/* Continue an FNV-1a hash over a symbol name, optionally case-folded. */
+static unsigned long
+symtab_hash_more(unsigned long hash, const char *name, int case_sensitive)
+{
+    const unsigned char *c = (const unsigned char *)name;
+
+    if (case_sensitive) {
+        for (; *c; c++)
+            hash = ((hash ^ *c) * 16777619UL) & 0xFFFFFFFFUL;
+    } else {
+        for (; *c; c++)
+            hash = ((hash ^ SYM_FOLD(*c)) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/* Hash of a symbol name given as an optional prefix (the name of the parent
+ * of a local label) followed by the rest of the name.  As FNV-1a is computed
+ * a byte at a time, this is the hash of the concatenated name.
+ */
+static unsigned long
+symtab_hash(/*@null@*/ const char *prefix, const char *name,
+            int case_sensitive)
+{
+    unsigned long hash = 2166136261UL;
+
+    if (prefix)
+        hash = symtab_hash_more(hash, prefix, case_sensitive);
+    return symtab_hash_more(hash, name, case_sensitive);
+}
+
+/* Match name against the start of a stored symbol name.  Returns the rest of
+ * the stored name, or NULL if the stored name doesn't start with name.
+ */
+static /*@null@*/ const char *
+symtab_name_match(const char *stored, const char *name, int case_sensitive)
 {
-    yasm_symrec *rec = yasm_xmalloc(sizeof(yasm_symrec));
+    const unsigned char *s = (const unsigned char *)stored;
+    const unsigned char *n = (const unsigned char *)name;
+
+    if (case_sensitive) {
+        for (; *n; s++, n++) {
+            if (*s != *n)
+                return NULL;
+        }
+    } else {
+        for (; *n; s++, n++) {
+            if (*s != SYM_FOLD(*n))
+                return NULL;
+        }
+    }
+    return (const char *)s;
+}
 
-    if (!case_sensitive) {
+/* Compare a lookup name (an optional prefix followed by the rest of the
+ * name) against a stored symbol name.  When the table is case-insensitive,
+ * stored names are already lower case.
+ */
+static int
+symtab_name_eq(const char *stored, /*@null@*/ const char *prefix,
+               const char *name, int case_sensitive)
+{
+    if (prefix) {
+        stored = symtab_name_match(stored, prefix, case_sensitive);
+        if (!stored)
+            return 0;
+    }
+    if (case_sensitive)
+        return strcmp(stored, name) == 0;
+    stored = symtab_name_match(stored, name, case_sensitive);
+    return stored && *stored == '\0';
+}
+
+/* Find the index slot for a name: either the slot holding the matching
+ * symbol, or the empty slot where it would be inserted.
+ */
+static symtab_slot *
+symtab_find_slot(const yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                 const char *name, unsigned long hash)
+{
+    unsigned long mask = symtab->size - 1;
+    unsigned long i = hash & mask;
+
+    for (;;) {
+        symtab_slot *slot = &symtab->slots[i];
+        if (!slot->rec)
+            return slot;
+        if (slot->hash == hash &&
+            symtab_name_eq(slot->rec->name, prefix, name,
+                           symtab->case_sensitive))
+            return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+/* Double the size of the symbol index. */
+static void
+symtab_grow(yasm_symtab *symtab)
+{
+    symtab_slot *oldslots = symtab->slots;
+    unsigned long oldsize = symtab->size;
+    unsigned long mask, i;
+
+    symtab->size = oldsize * 2;
+    symtab->slots = yasm_xcalloc(symtab->size, sizeof(symtab_slot));
+    mask = symtab->size - 1;
+
+    for (i=0; i<oldsize; i++) {
+        unsigned long j;
+        if (!oldslots[i].rec)
+            continue;
+        j = oldslots[i].hash & mask;
+        while (symtab->slots[j].rec)
+            j = (j + 1) & mask;
+        symtab->slots[j] = oldslots[i];
+    }
+
+    yasm_xfree(oldslots);
+}
+
+static /*@partial@*/ yasm_symrec *
+symrec_new_common(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                  const char *name)
+{
+    symrec_chunk *chunk = symtab->chunks;
+    yasm_symrec *rec;
+
+    if (chunk->used == SYMREC_CHUNK_SIZE) {
+        chunk = yasm_xmalloc(sizeof(symrec_chunk));
+        chunk->next = symtab->chunks;
+        chunk->used = 0;
+        symtab->chunks = chunk;
+    }
+    rec = &chunk->recs[chunk->used++];
+
+    if (prefix) {
+        /* The full name of a local label is only built here, when the
+         * symbol is created.
+         */
+        size_t prefix_len = strlen(prefix), name_len = strlen(name);
+        rec->name = yasm_xmalloc(prefix_len+name_len+1);
+        memcpy(rec->name, prefix, prefix_len);
+        memcpy(rec->name+prefix_len, name, name_len+1);
+    } else
+        rec->name = yasm__xstrdup(name);
+    if (!symtab->case_sensitive) {
         char *c;
-        for (c=name; *c; c++)
-            *c = tolower(*c);
+        for (c=rec->name; *c; c++)
+            *c = SYM_FOLD(*c);
     }
 
-    rec->name = name;
     rec->type = SYM_UNKNOWN;
     rec->def_line = 0;
     rec->decl_line = 0;
@@ -177,83 +353,179 @@ symrec_new_common(/*@keep@*/ char *name, int case_sensitive)
     rec->size = 0;
     rec->segment = NULL;
     rec->assoc_data = NULL;
+    rec->next = NULL;
+    yasm_stats_inc(YASM_STATS_SYMBOLS);
     return rec;
 }
 
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
-symtab_get_or_new_in_table(yasm_symtab *symtab, /*@only@*/ char *name)
+symtab_get_or_new_in_table(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                           const char *name)
 {
-    yasm_symrec *rec = symrec_new_common(name, symtab->case_sensitive);
-    int replace = 0;
+    unsigned long hash = symtab_hash(prefix, name, symtab->case_sensitive);
+    symtab_slot *slot = symtab_find_slot(symtab, prefix, name, hash);
+    yasm_symrec *rec;
+
+    if (slot->rec)
+        return slot->rec;
 
+    rec = symrec_new_common(symtab, prefix, name);
     rec->status = YASM_SYM_NOSTATUS;
 
-    if (!symtab->case_sensitive) {
-        char *c;
-        for (c=name; *c; c++)
-            *c = tolower(*c);
-    }
+    slot->hash = hash;
+    slot->rec = rec;
+    *symtab->last = rec;
+    symtab->last = &rec->next;
 
-    return HAMT_insert(symtab->sym_table, name, rec, &replace,
-                       symrec_destroy_one);
+    if (++symtab->count * 2 > symtab->size)
+        symtab_grow(symtab);
+    return rec;
 }
 
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
-symtab_get_or_new_not_in_table(yasm_symtab *symtab, /*@only@*/ char *name)
+symtab_get_or_new_not_in_table(yasm_symtab *symtab,
+                               /*@null@*/ const char *prefix, const char *name)
 {
-    non_table_symrec *sym = yasm_xmalloc(sizeof(non_table_symrec));
-    sym->rec = symrec_new_common(name, symtab->case_sensitive);
-
-    sym->rec->status = YASM_SYM_NOTINTABLE;
-
-    SLIST_INSERT_HEAD(&symtab->non_table_syms, sym, link);
-
-    return sym->rec;
+    yasm_symrec *rec = symrec_new_common(symtab, prefix, name);
+    rec->status = YASM_SYM_NOTINTABLE;
+    return rec;
 }
 
-/* create a new symrec */
-/*@-freshtrans -mustfree@*/
+/* create a new symrec; prefix is the parent name for local labels */
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
-symtab_get_or_new(yasm_symtab *symtab, const char *name, int in_table)
+symtab_get_or_new(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                  const char *name, int in_table)
 {
-    char *symname = yasm__xstrdup(name);
-
     if (in_table)
-        return symtab_get_or_new_in_table(symtab, symname);
+        return symtab_get_or_new_in_table(symtab, prefix, name);
     else
-        return symtab_get_or_new_not_in_table(symtab, symname);
+        return symtab_get_or_new_not_in_table(symtab, prefix, name);
 }
-/*@=freshtrans =mustfree@*/
 
 int
 yasm_symtab_traverse(yasm_symtab *symtab, void *d,
                      int (*func) (yasm_symrec *sym, void *d))
 {
-    return HAMT_traverse(symtab->sym_table, d, (int (*) (void *, void *))func);
+    yasm_symrec *sym;
+
+    /* Symbols added by func are appended and will also be visited */
+    for (sym = symtab->first; sym; sym = sym->next) {
+        int retval = func(sym, d);
+        if (retval != 0)
+            return retval;
+    }
+    return 0;
 }
 
 const yasm_symtab_iter *
 yasm_symtab_first(const yasm_symtab *symtab)
 {
-    return (const yasm_symtab_iter *)HAMT_first(symtab->sym_table);
+    return (const yasm_symtab_iter *)symtab->first;
 }
 
 /*@null@*/ const yasm_symtab_iter *
 yasm_symtab_next(const yasm_symtab_iter *prev)
 {
-    return (const yasm_symtab_iter *)HAMT_next((const HAMTEntry *)prev);
+    return (const yasm_symtab_iter *)((const yasm_symrec *)prev)->next;
 }
 
 yasm_symrec *
 yasm_symtab_iter_value(const yasm_symtab_iter *cur)
 {
-    return (yasm_symrec *)HAMTEntry_get_data((const HAMTEntry *)cur);
+    return (yasm_symrec *)cur;
+}
+
+yasm_symexport_plan *
+yasm_symtab_export_plan(yasm_symtab *symtab, const yasm_object *object,
+                        int nclasses, yasm_symexport_select_func select,
+                        void *d)
+{
+    yasm_symexport_plan *plan = yasm_xmalloc(sizeof(yasm_symexport_plan));
+    unsigned long max = 64;
+    unsigned char *classes;
+    yasm_symrec *sym;
+
+    plan->syms = yasm_xmalloc(max*sizeof(yasm_symexport));
+    plan->num = 0;
+    plan->names_len = 0;
+    classes = yasm_xmalloc(max);
+
+    for (sym = symtab->first; sym; sym = sym->next) {
+        yasm_symexport *entry;
+        void *data = NULL;
+        int cls = select(sym, sym->visibility, &data, d);
+
+        if (cls < 0)
+            continue;
+        if (cls >= nclasses || cls > UCHAR_MAX)
+            yasm_internal_error(N_("invalid symbol export class"));
+
+        if (plan->num == max) {
+            max *= 2;
+            plan->syms = yasm_xrealloc(plan->syms,
+                                       max*sizeof(yasm_symexport));
+            classes = yasm_xrealloc(classes, max);
+        }
+        classes[plan->num] = (unsigned char)cls;
+        entry = &plan->syms[plan->num++];
+
+        entry->sym = sym;
+        entry->name = yasm_symrec_get_global_name(sym, object);
+        entry->name_len = strlen(entry->name);
+        entry->vis = sym->visibility;
+        entry->sect = NULL;
+        entry->offset = 0;
+        if ((sym->type == SYM_LABEL || sym->type == SYM_CURPOS)
+            && sym->value.precbc) {
+            entry->sect = yasm_bc_get_section(sym->value.precbc);
+            if (entry->sect)
+                entry->offset = yasm_bc_next_offset(sym->value.precbc);
+        }
+        entry->strtab_offset = 0;
+        entry->data = data;
+        plan->names_len += (unsigned long)entry->name_len + 1;
+    }
+
+    /* Stable counting sort by class */
+    if (nclasses > 1 && plan->num > 0) {
+        unsigned long *start = yasm_xcalloc((size_t)nclasses+1,
+                                            sizeof(unsigned long));
+        yasm_symexport *sorted =
+            yasm_xmalloc(plan->num*sizeof(yasm_symexport));
+        unsigned long i;
+        int c;
+
+        for (i=0; i<plan->num; i++)
+            start[classes[i]+1]++;
+        for (c=0; c<nclasses; c++)
+            start[c+1] += start[c];
+        for (i=0; i<plan->num; i++)
+            sorted[start[classes[i]]++] = plan->syms[i];
+
+        yasm_xfree(start);
+        yasm_xfree(plan->syms);
+        plan->syms = sorted;
+    }
+
+    yasm_xfree(classes);
+    return plan;
+}
+
+void
+yasm_symexport_plan_destroy(yasm_symexport_plan *plan)
+{
+    unsigned long i;
+
+    for (i=0; i<plan->num; i++)
+        yasm_xfree(plan->syms[i].name);
+    yasm_xfree(plan->syms);
+    yasm_xfree(plan);
 }
 
 yasm_symrec *
 yasm_symtab_abs_sym(yasm_symtab *symtab)
 {
-    yasm_symrec *rec = symtab_get_or_new(symtab, "", 1);
+    yasm_symrec *rec = symtab_get_or_new(symtab, NULL, "", 1);
     rec->def_line = 0;
     rec->decl_line = 0;
     rec->use_line = 0;
@@ -264,37 +536,47 @@ yasm_symtab_abs_sym(yasm_symtab *symtab)
     return rec;
 }
 
-yasm_symrec *
-yasm_symtab_use(yasm_symtab *symtab, const char *name, unsigned long line)
+static /*@dependent@*/ yasm_symrec *
+symtab_use(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+           const char *name, unsigned long line)
 {
-    yasm_symrec *rec = symtab_get_or_new(symtab, name, 1);
+    yasm_symrec *rec = symtab_get_or_new(symtab, prefix, name, 1);
     if (rec->use_line == 0)
         rec->use_line = line;   /* set line number of first use */
     rec->status |= YASM_SYM_USED;
     return rec;
 }
 
+yasm_symrec *
+yasm_symtab_use(yasm_symtab *symtab, const char *name, unsigned long line)
+{
+    return symtab_use(symtab, NULL, name, line);
+}
+
+yasm_symrec *
+yasm_symtab_use_local(yasm_symtab *symtab, const char *parent,
+                      const char *name, unsigned long line)
+{
+    return symtab_use(symtab, parent, name, line);
+}
+
 yasm_symrec *
 yasm_symtab_get(yasm_symtab *symtab, const char *name)
 {
-    if (!symtab->case_sensitive) {
-        char *_name = yasm__xstrdup(name);
-        char *c;
-        yasm_symrec *ret;
-        for (c=_name; *c; c++)
-            *c = tolower(*c);
-        ret = HAMT_search(symtab->sym_table, _name);
-        yasm_xfree(_name);
-        return ret;
-    } else
-      return HAMT_search(symtab->sym_table, name);
+    unsigned long hash = symtab_hash(NULL, name, symtab->case_sensitive);
+    return symtab_find_slot(symtab, NULL, name, hash)->rec;
 }
 
 static /*@dependent@*/ yasm_symrec *
-symtab_define(yasm_symtab *symtab, const char *name, sym_type type,
-              int in_table, unsigned long line)
+symtab_define(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+              const char *name, sym_type type, int in_table,
+              unsigned long line)
 {
-    yasm_symrec *rec = symtab_get_or_new(symtab, name, in_table);
+    yasm_symrec *rec = symtab_get_or_new(symtab, prefix, name, in_table);
+
+    /* Report local labels by their full name */
+    if (prefix)
+        name = rec->name;
 
     /* Has it been defined before (either by DEFINED or COMMON/EXTERN)? */
     if (rec->status & YASM_SYM_DEFINED) {
@@ -315,11 +597,11 @@ symtab_define(yasm_symtab *symtab, const char *name, sym_type type,
     return rec;
 }
 
-yasm_symrec *
-yasm_symtab_define_equ(yasm_symtab *symtab, const char *name, yasm_expr *e,
-                       unsigned long line)
+static /*@dependent@*/ yasm_symrec *
+symtab_define_equ(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                  const char *name, yasm_expr *e, unsigned long line)
 {
-    yasm_symrec *rec = symtab_define(symtab, name, SYM_EQU, 1, line);
+    yasm_symrec *rec = symtab_define(symtab, prefix, name, SYM_EQU, 1, line);
     if (yasm_error_occurred())
         return rec;
     rec->value.expn = e;
@@ -328,27 +610,63 @@ yasm_symtab_define_equ(yasm_symtab *symtab, const char *name, yasm_expr *e,
 }
 
 yasm_symrec *
-yasm_symtab_define_label(yasm_symtab *symtab, const char *name,
-                         yasm_bytecode *precbc, int in_table,
-                         unsigned long line)
+yasm_symtab_define_equ(yasm_symtab *symtab, const char *name, yasm_expr *e,
+                       unsigned long line)
+{
+    return symtab_define_equ(symtab, NULL, name, e, line);
+}
+
+yasm_symrec *
+yasm_symtab_define_equ_local(yasm_symtab *symtab, const char *parent,
+                             const char *name, yasm_expr *e,
+                             unsigned long line)
 {
-    yasm_symrec *rec = symtab_define(symtab, name, SYM_LABEL, in_table, line);
+    return symtab_define_equ(symtab, parent, name, e, line);
+}
+
+static /*@dependent@*/ yasm_symrec *
+symtab_define_label(yasm_symtab *symtab, /*@null@*/ const char *prefix,
+                    const char *name, yasm_bytecode *precbc, int in_table,
+                    unsigned long line)
+{
+    yasm_symrec *rec = symtab_define(symtab, prefix, name, SYM_LABEL, in_table,
+                                     line);
     if (yasm_error_occurred())
         return rec;
     rec->value.precbc = precbc;
+    if (precbc)
+        precbc->bc_index = 1;   /* see yasm_section_bcs_append_data() */
     if (in_table && precbc)
         yasm_bc__add_symrec(precbc, rec);
     return rec;
 }
 
+yasm_symrec *
+yasm_symtab_define_label(yasm_symtab *symtab, const char *name,
+                         yasm_bytecode *precbc, int in_table,
+                         unsigned long line)
+{
+    return symtab_define_label(symtab, NULL, name, precbc, in_table, line);
+}
+
+yasm_symrec *
+yasm_symtab_define_label_local(yasm_symtab *symtab, const char *parent,
+                               const char *name, yasm_bytecode *precbc,
+                               unsigned long line)
+{
+    return symtab_define_label(symtab, parent, name, precbc, 1, line);
+}
+
 yasm_symrec *
 yasm_symtab_define_curpos(yasm_symtab *symtab, const char *name,
                           yasm_bytecode *precbc, unsigned long line)
 {
-    yasm_symrec *rec = symtab_define(symtab, name, SYM_CURPOS, 0, line);
+    yasm_symrec *rec = symtab_define(symtab, NULL, name, SYM_CURPOS, 0, line);
     if (yasm_error_occurred())
         return rec;
     rec->value.precbc = precbc;
+    if (precbc)
+        precbc->bc_index = 1;   /* see yasm_section_bcs_append_data() */
     return rec;
 }
 
@@ -356,7 +674,7 @@ yasm_symrec *
 yasm_symtab_define_special(yasm_symtab *symtab, const char *name,
                            yasm_sym_vis vis)
 {
-    yasm_symrec *rec = symtab_define(symtab, name, SYM_SPECIAL, 1, 0);
+    yasm_symrec *rec = symtab_define(symtab, NULL, name, SYM_SPECIAL, 1, 0);
     if (yasm_error_occurred())
         return rec;
     rec->status |= YASM_SYM_VALUED;
@@ -368,7 +686,7 @@ yasm_symrec *
 yasm_symtab_declare(yasm_symtab *symtab, const char *name, yasm_sym_vis vis,
                     unsigned long line)
 {
-    yasm_symrec *rec = symtab_get_or_new(symtab, name, 1);
+    yasm_symrec *rec = symtab_get_or_new(symtab, NULL, name, 1);
     yasm_symrec_declare(rec, vis, line);
     return rec;
 }
@@ -436,26 +754,31 @@ yasm_symtab_parser_finalize(yasm_symtab *symtab, int undef_extern,
     info.firstundef_line = ULONG_MAX;
     info.undef_extern = undef_extern;
     info.errwarns = errwarns;
+    yasm_stats_phase_begin(YASM_STATS_PHASE_SYMTAB);
     yasm_symtab_traverse(symtab, &info, symtab_parser_finalize_checksym);
     if (info.firstundef_line < ULONG_MAX) {
         yasm_error_set(YASM_ERROR_GENERAL,
                        N_(" (Each undefined symbol is reported only once.)"));
         yasm_errwarn_propagate(errwarns, info.firstundef_line);
     }
+    yasm_stats_phase_end(YASM_STATS_PHASE_SYMTAB);
 }
 
 void
 yasm_symtab_destroy(yasm_symtab *symtab)
 {
-    HAMT_destroy(symtab->sym_table, symrec_destroy_one);
-
-    while (!SLIST_EMPTY(&symtab->non_table_syms)) {
-        non_table_symrec *sym = SLIST_FIRST(&symtab->non_table_syms);
-        SLIST_REMOVE_HEAD(&symtab->non_table_syms, link);
-        symrec_destroy_one(sym->rec);
-        yasm_xfree(sym);
+    symrec_chunk *chunk = symtab->chunks;
+
+    while (chunk) {
+        symrec_chunk *next = chunk->next;
+        unsigned int i;
+        for (i=0; i<chunk->used; i++)
+            symrec_destroy_one(&chunk->recs[i]);
+        yasm_xfree(chunk);
+        chunk = next;
     }
 
+    yasm_xfree(symtab->slots);
     yasm_xfree(symtab);
 }
 
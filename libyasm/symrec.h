@@ -110,6 +110,21 @@ YASM_LIB_DECL
 /*@null@*/ /*@dependent@*/ yasm_symrec *yasm_symtab_get
     (yasm_symtab *symtab, const char *name);
 
+/** Get a reference to (use) a local label.  A local label is named by its
+ * parent (the preceding non-local label) and a suffix; its full name is the
+ * parent name followed by the suffix, but the lookup doesn't build that name
+ * unless the symbol is new.
+ * \param symtab    symbol table
+ * \param parent    parent label name; if NULL, name is the full name
+ * \param name      local label suffix
+ * \param line      virtual line where referenced
+ * \return Symbol (dependent pointer, do not free).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ yasm_symrec *yasm_symtab_use_local
+    (yasm_symtab *symtab, /*@null@*/ const char *parent,
+     const char *name, unsigned long line);
+
 /** Define a symbol as an EQU value.
  * \param symtab    symbol table
  * \param name      symbol (EQU) name
@@ -122,6 +137,19 @@ YASM_LIB_DECL
     (yasm_symtab *symtab, const char *name, /*@keep@*/ yasm_expr *e,
      unsigned long line);
 
+/** Define a local label as an EQU value.  See yasm_symtab_use_local().
+ * \param symtab    symbol table
+ * \param parent    parent label name; if NULL, name is the full name
+ * \param name      local label suffix
+ * \param e         EQU value (expression)
+ * \param line      virtual line of EQU
+ * \return Symbol (dependent pointer, do not free).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ yasm_symrec *yasm_symtab_define_equ_local
+    (yasm_symtab *symtab, /*@null@*/ const char *parent,
+     const char *name, /*@keep@*/ yasm_expr *e, unsigned long line);
+
 /** Define a symbol as a label.
  * \param symtab    symbol table
  * \param name      symbol (label) name
@@ -136,6 +164,21 @@ YASM_LIB_DECL
     (yasm_symtab *symtab, const char *name,
      /*@dependent@*/ yasm_bytecode *precbc, int in_table, unsigned long line);
 
+/** Define a local label as a label.  See yasm_symtab_use_local().  The
+ * label is always inserted into the symbol table.
+ * \param symtab    symbol table
+ * \param parent    parent label name; if NULL, name is the full name
+ * \param name      local label suffix
+ * \param precbc    bytecode preceding label
+ * \param line      virtual line of label
+ * \return Symbol (dependent pointer, do not free).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ yasm_symrec *yasm_symtab_define_label_local
+    (yasm_symtab *symtab, /*@null@*/ const char *parent,
+     const char *name, /*@dependent@*/ yasm_bytecode *precbc,
+     unsigned long line);
+
 /** Define a symbol as a label representing the current assembly position.
  * This should be used for this purpose instead of yasm_symtab_define_label()
  * as value_finalize_scan() looks for usage of this symbol type for special
@@ -231,6 +274,67 @@ YASM_LIB_DECL
 YASM_LIB_DECL
 yasm_symrec *yasm_symtab_iter_value(const yasm_symtab_iter *cur);
 
+/** A symbol selected for output by an object format, with the details
+ * common to all object formats derived once.
+ */
+typedef struct yasm_symexport {
+    /*@dependent@*/ yasm_symrec *sym;   /**< Symbol */
+    /*@only@*/ char *name;      /**< Global name of symbol */
+    size_t name_len;            /**< Length of name (excluding NUL) */
+    yasm_sym_vis vis;           /**< Visibility */
+    /** Section containing the symbol's label; NULL if the symbol is not a
+     * label or is not in a section.
+     */
+    /*@dependent@*/ /*@null@*/ yasm_section *sect;
+    unsigned long offset;       /**< Offset of label within sect */
+    unsigned long strtab_offset;    /**< Set by object format as desired */
+    /*@dependent@*/ /*@null@*/ void *data;  /**< Object format data */
+} yasm_symexport;
+
+/** The symbols an object format writes to its symbol table, in output
+ * order.
+ */
+typedef struct yasm_symexport_plan {
+    /*@only@*/ yasm_symexport *syms;    /**< Selected symbols */
+    unsigned long num;          /**< Number of selected symbols */
+    /** Total length of all names, each including its terminating NUL. */
+    unsigned long names_len;
+} yasm_symexport_plan;
+
+/** Callback function for yasm_symtab_export_plan().
+ * \param sym       symbol
+ * \param vis       visibility of symbol
+ * \param data      object format data to store in the plan entry
+ *                  (initialized to NULL)
+ * \param d         data passed into yasm_symtab_export_plan()
+ * \return Negative to leave the symbol out of the plan, otherwise the class
+ *         of the symbol (less than the number of classes).
+ */
+typedef int (*yasm_symexport_select_func)
+    (yasm_symrec *sym, yasm_sym_vis vis, /*@out@*/ void **data,
+     /*@null@*/ void *d);
+
+/** Build the list of symbols to be written to an object file's symbol table
+ * in a single traversal of the symbol table.  Symbols are ordered by class,
+ * and within each class in symbol table order.
+ * \param symtab    symbol table
+ * \param object    object (for global names)
+ * \param nclasses  number of symbol classes
+ * \param select    selection callback
+ * \param d         data to pass to each call of select
+ * \return Newly allocated plan.
+ */
+YASM_LIB_DECL
+/*@only@*/ yasm_symexport_plan *yasm_symtab_export_plan
+    (yasm_symtab *symtab, const yasm_object *object, int nclasses,
+     yasm_symexport_select_func select, /*@null@*/ void *d);
+
+/** Destroy a symbol export plan.
+ * \param plan      plan
+ */
+YASM_LIB_DECL
+void yasm_symexport_plan_destroy(/*@only@*/ yasm_symexport_plan *plan);
+
 /** Finalize symbol table after parsing stage.  Checks for symbols that are
  * used but never defined or declared #YASM_SYM_EXTERN or #YASM_SYM_COMMON.
  * \param symtab        symbol table
@@ -0,0 +1,335 @@
+/*
+ * In-memory assembly tests
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "libyasm.h"
+#include "libyasm/bitvect.h"
+
+typedef struct Test_Entry {
+    /* test name */
+    const char *name;
+
+    /* test function; returns nonzero and sets failmsg on failure */
+    int (*run) (void);
+} Test_Entry;
+
+static char failed[4000];
+static char failmsg[400];
+
+/* Last error reported through print_error */
+static char errmsg[200];
+
+static void
+save_error(const char *fn, unsigned long line, const char *msg,
+           const char *xref_fn, unsigned long xref_line,
+           const char *xref_msg)
+{
+    strncpy(errmsg, msg, sizeof(errmsg)-1);
+    errmsg[sizeof(errmsg)-1] = '\0';
+}
+
+static const char bin_src[] = "[bits 32]\nmov eax, 1\nret\n";
+static const unsigned char bin_result[] = {
+    0xb8, 0x01, 0x00, 0x00, 0x00, 0xc3
+};
+
+/* Check that out holds exactly len bytes equal to expect. */
+static int
+check_output(const char *what, const yasm_assemble_output *out,
+             const unsigned char *expect, size_t len)
+{
+    if (out->len != len) {
+        sprintf(failmsg, "%s: bad output length: expected %lu, got %lu!",
+                what, (unsigned long)len, (unsigned long)out->len);
+        return 1;
+    }
+    if (memcmp(out->data, expect, len) != 0) {
+        sprintf(failmsg, "%s: bad output!", what);
+        return 1;
+    }
+    return 0;
+}
+
+static int
+test_bin(void)
+{
+    yasm_assemble_options opts;
+    yasm_assemble_output out = {NULL, 0, 0};
+    static const char macro_src[] = "%define VAL 2\ndb VAL, VAL+1\n";
+    static const unsigned char macro_result[] = {0x02, 0x03};
+    int fail;
+
+    yasm_assemble_options_init(&opts);
+    opts.preproc = "raw";
+    fail = yasm_assemble_buffer(&opts, bin_src, strlen(bin_src), &out);
+    if (fail)
+        sprintf(failmsg, "bin: assembly failed!");
+    else
+        fail = check_output("bin", &out, bin_result, sizeof(bin_result));
+
+    /* Default (NASM) preprocessor */
+    if (!fail) {
+        fail = yasm_assemble_buffer(NULL, macro_src, strlen(macro_src), &out);
+        if (fail)
+            sprintf(failmsg, "bin: assembly with macros failed!");
+        else
+            fail = check_output("bin with macros", &out, macro_result,
+                                sizeof(macro_result));
+    }
+    yasm_xfree(out.data);
+    return fail;
+}
+
+static int
+test_elf(void)
+{
+    yasm_assemble_options opts;
+    yasm_assembly result;
+    static const char src[] = "global f\nextern g\nf: call g\n";
+    unsigned long i;
+    int fail = 1;
+
+    yasm_assemble_options_init(&opts);
+    opts.objfmt = "elf64";
+    yasm_assembly_init(&result);
+    if (yasm_assemble_collect(&opts, src, strlen(src), &result)) {
+        sprintf(failmsg, "elf: assembly failed!");
+        goto done;
+    }
+    if (result.output.len < 64 ||
+        memcmp(result.output.data, "\177ELF", 4) != 0 ||
+        result.output.data[4] != 2) {
+        sprintf(failmsg, "elf: output is not a 64-bit ELF object!");
+        goto done;
+    }
+    for (i=0; i<result.num_sections; i++) {
+        yasm_assembly_section *sect = &result.sections[i];
+        if (strcmp(result.names + sect->name, ".text") == 0)
+            break;
+    }
+    if (i == result.num_sections || result.sections[i].len != 5 ||
+        result.output.data[result.sections[i].offset] != 0xe8) {
+        sprintf(failmsg, "elf: .text section missing or wrong!");
+        goto done;
+    }
+    if (result.sections[i].num_relocs != 1) {
+        sprintf(failmsg, "elf: expected 1 relocation in .text, got %lu!",
+                result.sections[i].num_relocs);
+        goto done;
+    }
+    i = result.sections[i].first_reloc;
+    if (result.relocs[i].offset != 1 || result.relocs[i].symbol < 0 ||
+        strcmp(result.names +
+               result.symbols[result.relocs[i].symbol].name, "g") != 0) {
+        sprintf(failmsg, "elf: relocation is not against g at offset 1!");
+        goto done;
+    }
+    fail = 0;
+done:
+    yasm_assembly_free(&result);
+    return fail;
+}
+
+static const char *lines[] = {"[bits 32]", "mov eax, 1", "ret", NULL};
+
+static const char *
+get_line(void *d, size_t *len)
+{
+    int *n = (int *)d;
+    const char *line = lines[*n];
+
+    if (!line)
+        return NULL;
+    (*n)++;
+    *len = strlen(line);
+    return line;
+}
+
+static int
+test_lines(void)
+{
+    yasm_assemble_options opts;
+    yasm_assemble_output out = {NULL, 0, 0};
+    int n = 0, fail;
+
+    yasm_assemble_options_init(&opts);
+    opts.preproc = "raw";
+    fail = yasm_assemble_lines(&opts, get_line, &n, &out);
+    if (fail)
+        sprintf(failmsg, "lines: assembly failed!");
+    else
+        fail = check_output("lines", &out, bin_result, sizeof(bin_result));
+    yasm_xfree(out.data);
+    return fail;
+}
+
+/* Assemble with options that must be rejected with the given message. */
+static int
+check_rejected(const char *what, const yasm_assemble_options *opts,
+               const char *expect)
+{
+    yasm_assemble_output out = {NULL, 0, 0};
+    int fail = 0;
+
+    errmsg[0] = '\0';
+    if (!yasm_assemble_buffer(opts, bin_src, strlen(bin_src), &out)) {
+        sprintf(failmsg, "%s: assembly did not fail!", what);
+        fail = 1;
+    } else if (strcmp(errmsg, expect) != 0) {
+        sprintf(failmsg, "%s: expected error `%s', got `%s'!", what, expect,
+                errmsg);
+        fail = 1;
+    }
+    if (out.data)
+        yasm_xfree(out.data);
+    return fail;
+}
+
+static int
+test_rejected(void)
+{
+    yasm_assemble_options opts;
+
+    yasm_assemble_options_init(&opts);
+    opts.print_error = save_error;
+    opts.parser = "gas";
+    opts.preproc = "gas";
+    if (check_rejected("gas preproc", &opts,
+                       "preprocessor `gas' cannot read from memory"))
+        return 1;
+
+    opts.parser = "nasm";
+    opts.preproc = "cpp";
+    if (check_rejected("cpp with nasm", &opts,
+                       "`cpp' is not a valid preprocessor for nasm"))
+        return 1;
+
+    opts.preproc = NULL;
+    opts.objfmt = "dbg";
+    return check_rejected("dbg objfmt", &opts,
+                          "object format `dbg' cannot write to memory");
+}
+
+static int
+test_source_error(void)
+{
+    yasm_assemble_options opts;
+    yasm_assemble_output out = {NULL, 0, 0};
+    static const char src[] = "mov eax,\n";
+    int fail = 0;
+
+    yasm_assemble_options_init(&opts);
+    opts.print_error = save_error;
+    errmsg[0] = '\0';
+    if (!yasm_assemble_buffer(&opts, src, strlen(src), &out)) {
+        sprintf(failmsg, "source error: assembly did not fail!");
+        fail = 1;
+    } else if (errmsg[0] == '\0') {
+        sprintf(failmsg, "source error: no error reported!");
+        fail = 1;
+    }
+    if (out.data)
+        yasm_xfree(out.data);
+    return fail;
+}
+
+/* Reuse one output buffer for several assemblies, with a failing one in
+ * between; no state may carry over from one call to the next.
+ */
+static int
+test_repeated(void)
+{
+    yasm_assemble_options opts;
+    yasm_assemble_output out = {NULL, 0, 0};
+    static const char bad_src[] = "mov eax,\n";
+    static const char sym_src[] = "[bits 32]\nx: mov eax, 1\nret\n";
+    int i, fail = 0;
+
+    yasm_assemble_options_init(&opts);
+    for (i=0; !fail && i<3; i++) {
+        /* Defines x each time; a leftover symbol table would make it a
+         * redefinition.
+         */
+        if (yasm_assemble_buffer(&opts, sym_src, strlen(sym_src), &out)) {
+            sprintf(failmsg, "repeated: assembly %d failed!", i);
+            fail = 1;
+        } else
+            fail = check_output("repeated", &out, bin_result,
+                                sizeof(bin_result));
+        if (!fail && !yasm_assemble_buffer(&opts, bad_src, strlen(bad_src),
+                                           &out)) {
+            sprintf(failmsg, "repeated: bad source %d did not fail!", i);
+            fail = 1;
+        }
+    }
+    yasm_xfree(out.data);
+    return fail;
+}
+
+static Test_Entry tests[] = {
+    {"bin", test_bin},
+    {"elf", test_elf},
+    {"lines", test_lines},
+    {"rejected", test_rejected},
+    {"source error", test_source_error},
+    {"repeated", test_repeated}
+};
+
+int
+main(void)
+{
+    int nf = 0;
+    int numtests = sizeof(tests)/sizeof(Test_Entry);
+    int i;
+
+    if (BitVector_Boot() != ErrCode_Ok)
+        return EXIT_FAILURE;
+    yasm_errwarn_initialize();
+    yasm_floatnum_initialize();
+
+    failed[0] = '\0';
+    printf("Test assemble_test: ");
+    for (i=0; i<numtests; i++) {
+        int fail = tests[i].run();
+        printf("%c", fail>0 ? 'F':'.');
+        fflush(stdout);
+        if (fail)
+            sprintf(failed, "%s ** F: %s\n", failed, failmsg);
+        nf += fail;
+    }
+
+    printf(" +%d-%d/%d %d%%\n%s",
+           numtests-nf, nf, numtests, 100*(numtests-nf)/numtests, failed);
+
+    yasm_floatnum_cleanup();
+    yasm_errwarn_cleanup();
+    BitVector_Shutdown();
+    return (nf == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -228,6 +228,82 @@ test_new_normalized_edgecase(void)
     return 0;
 }
 
+/* Literals checked for identical results from the fast and general
+ * conversions; random literals are generated in addition to these.
+ */
+static const char *differential_vals[] = {
+    "0", "0.0", "-0.0", "1", "1.5", "-2.75", "3.14159", "0.1", "0.2", "0.3",
+    "1e10", "1E-10", "1.0e+0", "6.02214076e23", "1.602176634e-19",
+    "123456789012345678", "1234567890123456789", "1234567890123456789.5",
+    ".000000000000000000000000000000123", "00012.5000",
+    "3.4028234663852886e38", "1.1754943508222875e-38", "1.401298464e-45",
+    "1.7976931348623157e308", "2.2250738585072014e-308",
+    "4.9406564584124654e-324", "1.18973149535723176502e4932",
+    "3.64519953188247460253e-4951", "1e4932", "1e4933", "1e-4950",
+    "1e-4951", "1e-5000", "1e5000", "9999999999999999999e4913",
+    "0.9999999999999999999", "1e", "1e+", "2.5e-", "1.5e007",
+};
+
+static int
+differential_check(const char *str)
+{
+    yasm_floatnum *fast, *ref;
+    int result = 0;
+
+    fast = floatnum_create_fast(str);
+    if (!fast)
+        return 0;       /* handled by the general conversion only */
+    ref = floatnum_create_bv(str);
+
+    if (BitVector_Compare(fast->mantissa, ref->mantissa) != 0 ||
+        fast->exponent != ref->exponent || fast->sign != ref->sign ||
+        fast->flags != ref->flags) {
+        sprintf(result_msg, "%.60s: fast conversion mismatch", str);
+        result = 1;
+    }
+    yasm_floatnum_destroy(fast);
+    yasm_floatnum_destroy(ref);
+    return result;
+}
+
+static int
+test_new_differential(void)
+{
+    int i, j, num = sizeof(differential_vals)/sizeof(const char *);
+    unsigned long seed = 1;
+    char str[64], *p;
+    int ndigits, point;
+
+    for (i=0; i<num; i++) {
+        if (differential_check(differential_vals[i]) != 0)
+            return 1;
+    }
+
+    for (i=0; i<20000; i++) {
+        p = str;
+        seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+        if (seed & 0x10000)
+            *p++ = '-';
+        ndigits = (int)((seed >> 4) % 22) + 1;
+        point = (int)((seed >> 9) % (unsigned long)(ndigits+1));
+        for (j=0; j<ndigits; j++) {
+            if (j == point)
+                *p++ = '.';
+            seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+            *p++ = (char)('0' + (seed >> 16) % 10);
+        }
+        if (i % 3 == 0)
+            sprintf(p, "e%d", (int)((seed >> 3) % 1301) - 650);
+        else if (i % 3 == 1)
+            sprintf(p, "e%d", (int)((seed >> 3) % 9901) - 4950);
+        else
+            *p = '\0';
+        if (differential_check(str) != 0)
+            return 1;
+    }
+    return 0;
+}
+
 static void
 get_family_setup(void)
 {
@@ -441,13 +517,14 @@ main(void)
     printf("Test floatnum_test: ");
     nf += runtest(new_normalized, NULL, NULL);
     nf += runtest(new_normalized_edgecase, NULL, NULL);
+    nf += runtest(new_differential, NULL, NULL);
     nf += runtest(get_single_normalized, get_family_setup, get_family_teardown);
     nf += runtest(get_single_normalized_edgecase, get_family_setup, get_family_teardown);
     nf += runtest(get_double_normalized, get_family_setup, get_family_teardown);
     nf += runtest(get_double_normalized_edgecase, get_family_setup, get_family_teardown);
     nf += runtest(get_extended_normalized, get_family_setup, get_family_teardown);
     nf += runtest(get_extended_normalized_edgecase, get_family_setup, get_family_teardown);
-    printf(" +%d-%d/8 %d%%\n%s",
-           8-nf, nf, 100*(8-nf)/8, failed);
+    printf(" +%d-%d/9 %d%%\n%s",
+           9-nf, nf, 100*(9-nf)/9, failed);
     return (nf == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
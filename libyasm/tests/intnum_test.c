@@ -0,0 +1,219 @@
+/*
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libyasm/intnum.c"
+
+/* Checks the fast literal conversions in yasm_intnum_create_{bin,oct,dec,
+ * hex} against the general bitvector conversions they short-circuit.
+ */
+
+typedef struct Test_Entry {
+    /* radix (2, 8, 10, or 16) */
+    int radix;
+
+    /* input literal, as passed by the parsers */
+    const char *input;
+} Test_Entry;
+
+static Test_Entry tests[] = {
+    {16, ""},
+    {16, "0"},
+    {16, "7fffffff"},
+    {16, "80000000"},
+    {16, "FFFFFFFF"},
+    {16, "100000000"},
+    {16, "3f80_0000"},
+    {16, "7fffffffffffffff"},
+    {16, "ffffffffffffffff"},
+    {16, "0000000000000000ffffffffffffffff"},
+    {16, "10000000000000000"},
+    {16, "123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"},
+    {16, "12g4"},
+    {10, "0"},
+    {10, "000123"},
+    {10, "999999999"},
+    {10, "2147483647"},
+    {10, "2147483648"},
+    {10, "4294967296"},
+    {10, "9999999999999999999"},
+    {10, "18446744073709551615"},
+    {10, "18446744073709551616"},
+    {10, "00000000000000000000000000042"},
+    {10, "123456789012345678901234567890"},
+    {10, "-5"},
+    {10, "12_3"},
+    {8, "0"},
+    {8, "17777777777"},
+    {8, "20000000000"},
+    {8, "1777777777777777777777"},
+    {8, "2000000000000000000000"},
+    {8, "0777_777"},
+    {8, "78"},
+    {2, "0"},
+    {2, "1111111111111111111111111111111"},
+    {2, "10000000000000000000000000000000"},
+    {2, "1111_0000"},
+    {2, "102"},
+};
+
+static char failed[1000];
+static char failmsg[100];
+
+/* Conversion through the general bitvector path only. */
+static yasm_intnum *
+ref_create(int radix, const char *input)
+{
+    yasm_intnum *intn = yasm_xmalloc(sizeof(yasm_intnum));
+    ErrCode err = ErrCode_Ok;
+
+    switch (radix) {
+        case 2:
+            err = BitVector_from_Bin(conv_bv, (unsigned char *)input);
+            break;
+        case 8:
+            err = BitVector_from_Oct(conv_bv, (unsigned char *)input);
+            break;
+        case 10:
+            err = BitVector_from_Dec_static(from_dec_data, conv_bv,
+                                            (unsigned char *)input);
+            break;
+        case 16:
+            err = BitVector_from_Hex(conv_bv, (unsigned char *)input);
+            break;
+    }
+    if (err != ErrCode_Ok)
+        yasm_error_set(YASM_ERROR_VALUE, "reference error");
+    intnum_frombv(intn, conv_bv);
+    return intn;
+}
+
+static int
+run_test(int radix, const char *input)
+{
+    char *str = yasm__xstrdup(input);
+    yasm_intnum *intn = NULL, *ref;
+    int err, referr;
+
+    switch (radix) {
+        case 2:  intn = yasm_intnum_create_bin(str); break;
+        case 8:  intn = yasm_intnum_create_oct(str); break;
+        case 10: intn = yasm_intnum_create_dec(str); break;
+        case 16: intn = yasm_intnum_create_hex(str); break;
+    }
+    err = yasm_error_occurred() != YASM_ERROR_NONE;
+    yasm_error_clear();
+
+    ref = ref_create(radix, input);
+    referr = yasm_error_occurred() != YASM_ERROR_NONE;
+    yasm_error_clear();
+    yasm_xfree(str);
+
+    if (err != referr) {
+        sprintf(failmsg, "radix %d `%.40s': error mismatch", radix, input);
+        goto fail;
+    }
+    if (intn->type != ref->type) {
+        sprintf(failmsg, "radix %d `%.40s': type mismatch", radix, input);
+        goto fail;
+    }
+    if (yasm_intnum_compare(intn, ref) != 0) {
+        sprintf(failmsg, "radix %d `%.40s': value mismatch", radix, input);
+        goto fail;
+    }
+    yasm_intnum_destroy(intn);
+    yasm_intnum_destroy(ref);
+    return 0;
+
+fail:
+    yasm_intnum_destroy(intn);
+    yasm_intnum_destroy(ref);
+    return 1;
+}
+
+/* Deterministic pseudo-random literals of every length up to 24 digits. */
+static int
+run_random_tests(int *numtests)
+{
+    static const char digits[] = "0123456789abcdef";
+    static const int radixes[] = {2, 8, 10, 16};
+    unsigned long seed = 12345;
+    char str[32];
+    int nf = 0;
+    int i, r, len, j;
+
+    for (i=0; i<2000; i++) {
+        for (r=0; r<4; r++) {
+            len = i % 24 + 1;
+            for (j=0; j<len; j++) {
+                seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+                str[j] = digits[(seed >> 16) % (unsigned long)radixes[r]];
+            }
+            str[len] = '\0';
+            nf += run_test(radixes[r], str);
+            (*numtests)++;
+        }
+    }
+    return nf;
+}
+
+int
+main(void)
+{
+    int nf = 0;
+    int numtests = sizeof(tests)/sizeof(Test_Entry);
+    int i;
+
+    if (BitVector_Boot() != ErrCode_Ok)
+        return EXIT_FAILURE;
+    yasm_intnum_initialize();
+
+    failed[0] = '\0';
+    printf("Test intnum_test: ");
+    for (i=0; i<numtests; i++) {
+        int fail = run_test(tests[i].radix, tests[i].input);
+        printf("%c", fail>0 ? 'F':'.');
+        fflush(stdout);
+        if (fail && strlen(failed) < sizeof(failed)-sizeof(failmsg)-10)
+            sprintf(failed+strlen(failed), " ** F: %s\n", failmsg);
+        nf += fail;
+    }
+
+    i = run_random_tests(&numtests);
+    printf("%c", i>0 ? 'F':'.');
+    if (i > 0)
+        sprintf(failed+strlen(failed), " ** F: %d random literals mismatched\n",
+                i);
+    nf += i;
+
+    yasm_intnum_cleanup();
+
+    printf(" +%d-%d/%d %d%%\n%s",
+           numtests-nf, nf, numtests, 100*(numtests-nf)/numtests, failed);
+    return (nf == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -117,7 +117,9 @@ yasm_value_set_curpos_rel(yasm_value *value, yasm_bytecode *bc,
      */
     if (!value->rel) {
         yasm_object *object = yasm_section_get_object(yasm_bc_get_section(bc));
+        yasm__object_lock();
         value->rel = yasm_symtab_abs_sym(object->symtab);
+        yasm__object_unlock();
     }
 }
 
@@ -299,9 +301,11 @@ value_finalize_scan(yasm_value *value, yasm_expr *e,
                                 yasm_object *object =
                                     yasm_section_get_object(sect2);
                                 yasm_symtab *symtab = object->symtab;
+                                yasm__object_lock();
                                 e->terms[j].data.sym =
                                     yasm_symtab_define_curpos
                                     (symtab, ".", expr_precbc, e->line);
+                                yasm__object_unlock();
                             }
                             break;      /* stop looking */
                         }
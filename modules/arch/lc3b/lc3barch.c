@@ -202,6 +202,7 @@ yasm_arch_module yasm_lc3b_LTX_arch = {
     lc3b_reg_print,
     NULL,       /*yasm_lc3b__segreg_print*/
     lc3b_ea_create_expr,
+    NULL,       /*ea_create_regs*/
     yasm_lc3b__ea_destroy,
     lc3b_ea_print,
     yasm_lc3b__create_empty_insn,
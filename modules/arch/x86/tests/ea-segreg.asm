@@ -0,0 +1,9 @@
+; Segment overrides must survive when the base/index registers of a
+; memory operand are split out of the displacement.
+[bits 32]
+mov ecx, 8[es:eax]
+mov ecx, [es:eax+8]
+mov ecx, [fs:eax+ebx*4+8]
+mov ecx, [es:eax-8]
+[bits 16]
+mov cx, 8[ss:bx+si]
@@ -623,6 +623,7 @@ yasm_arch_module yasm_x86_LTX_arch = {
     x86_reg_print,
     x86_segreg_print,
     yasm_x86__ea_create_expr,
+    yasm_x86__ea_create_regs,
     yasm_x86__ea_destroy,
     yasm_x86__ea_print,
     yasm_x86__create_empty_insn,
@@ -201,6 +201,15 @@ typedef struct x86_effaddr {
     unsigned char valid_sib;    /* 1 if SIB byte currently valid, 0 if not */
     unsigned char need_sib;     /* 1 if SIB byte needed, 0 if not,
                                    0xff if unknown */
+
+    /* Registers handed over separately by the parser (see
+     * yasm_x86__ea_create_regs()).  If nregs is nonzero, ea.disp holds only
+     * the register-free displacement and checkea takes register usage from
+     * regs[] instead of walking the expression.
+     */
+    unsigned char nregs;
+    unsigned char rip_disp;     /* 1 if GAS foo(%rip): disp is PC-relative */
+    yasm_arch_ea_reg regs[2];
 } x86_effaddr;
 
 void yasm_x86__ea_init(x86_effaddr *x86_ea, unsigned int spare,
@@ -213,6 +222,10 @@ x86_effaddr *yasm_x86__ea_create_imm
     (x86_effaddr *x86_ea, /*@keep@*/ yasm_expr *imm, unsigned int im_len);
 yasm_effaddr *yasm_x86__ea_create_expr(yasm_arch *arch,
                                        /*@keep@*/ yasm_expr *e);
+/*@null@*/ yasm_effaddr *yasm_x86__ea_create_regs
+    (yasm_arch *arch, const yasm_arch_ea_reg *regs, size_t nregs,
+     /*@null@*/ /*@keep@*/ yasm_expr *disp);
+void yasm_x86__ea_expand_regs(x86_effaddr *x86_ea);
 void yasm_x86__ea_destroy(yasm_effaddr *ea);
 void yasm_x86__ea_print(const yasm_effaddr *ea, FILE *f, int indent_level);
 
@@ -296,6 +309,9 @@ typedef struct x86_jmpfar {
     yasm_value offset;          /* target offset */
 } x86_jmpfar;
 
+/* The insn and jmp contents are copied into the bytecode (see
+ * yasm_bc_transform_inline()); jmpfar, being too large for that, is kept.
+ */
 void yasm_x86__bc_transform_insn(yasm_bytecode *bc, x86_insn *insn);
 void yasm_x86__bc_transform_jmp(yasm_bytecode *bc, x86_jmp *jmp);
 void yasm_x86__bc_transform_jmpfar(yasm_bytecode *bc, x86_jmpfar *jmpfar);
@@ -141,13 +141,15 @@ yasm_x86__set_rex_from_reg(unsigned char *rex, unsigned char *low3,
 void
 yasm_x86__bc_transform_insn(yasm_bytecode *bc, x86_insn *insn)
 {
-    yasm_bc_transform(bc, &x86_bc_callback_insn, insn);
+    yasm_bc_transform_inline(bc, &x86_bc_callback_insn, insn,
+                             sizeof(x86_insn));
 }
 
 void
 yasm_x86__bc_transform_jmp(yasm_bytecode *bc, x86_jmp *jmp)
 {
-    yasm_bc_transform(bc, &x86_bc_callback_jmp, jmp);
+    yasm_bc_transform_inline(bc, &x86_bc_callback_jmp, jmp,
+                             sizeof(x86_jmp));
 }
 
 void
@@ -197,6 +199,8 @@ ea_create(void)
     x86_ea->sib = 0;
     x86_ea->valid_sib = 0;
     x86_ea->need_sib = 0;
+    x86_ea->nregs = 0;
+    x86_ea->rip_disp = 0;
 
     return x86_ea;
 }
@@ -255,6 +259,90 @@ yasm_x86__ea_create_expr(yasm_arch *arch, yasm_expr *e)
     return (yasm_effaddr *)x86_ea;
 }
 
+yasm_effaddr *
+yasm_x86__ea_create_regs(yasm_arch *arch, const yasm_arch_ea_reg *regs,
+                         size_t nregs, yasm_expr *disp)
+{
+    yasm_arch_x86 *arch_x86 = (yasm_arch_x86 *)arch;
+    x86_effaddr *x86_ea;
+    int rip_disp = 0;
+    size_t i;
+
+    /* Anything beyond a couple of positively-scaled registers is left to
+     * the general expression path (and its error reporting).
+     */
+    if (nregs == 0 || nregs > NELEMS(x86_ea->regs))
+        return NULL;
+    for (i=0; i<nregs; i++) {
+        if (regs[i].mult <= 0 || regs[i].mult > 0x7fff)
+            return NULL;
+        if (regs[i].reg == X86_RIP) {
+            /* Mirror the foo+rip -> foo wrt rip conversion done by
+             * yasm_x86__ea_create_expr() for GAS: only a lone leading base.
+             */
+            if (arch_x86->parser != X86_PARSER_GAS)
+                continue;
+            if (i != 0 || nregs != 1 || regs[i].explicit_mult)
+                return NULL;
+            /* (A zero displacement is folded away by the expression
+             * builder, leaving a plain rip base.)
+             */
+            rip_disp = disp && !(disp->op == YASM_EXPR_IDENT &&
+                                 disp->terms[0].type == YASM_EXPR_INT &&
+                                 yasm_intnum_is_zero(disp->terms[0].data.intn));
+        }
+    }
+    if (disp && yasm_expr__contains(disp, YASM_EXPR_REG))
+        return NULL;
+
+    x86_ea = ea_create();
+    if (!disp)
+        disp = yasm_expr_create_ident(yasm_expr_int(yasm_intnum_create_uint(0)),
+                                      0);
+    yasm_value_initialize(&x86_ea->ea.disp, disp, 0);
+    x86_ea->ea.need_disp = 1;
+    x86_ea->need_modrm = 1;
+    x86_ea->need_sib = 0xff;
+    x86_ea->nregs = (unsigned char)nregs;
+    x86_ea->rip_disp = (unsigned char)rip_disp;
+    for (i=0; i<nregs; i++)
+        x86_ea->regs[i] = regs[i];
+
+    return (yasm_effaddr *)x86_ea;
+}
+
+void
+yasm_x86__ea_expand_regs(x86_effaddr *x86_ea)
+{
+    yasm_expr *e = x86_ea->ea.disp.abs;
+    unsigned long line = e ? e->line : 0;
+    int i;
+
+    if (x86_ea->nregs == 0)
+        return;
+
+    if (x86_ea->rip_disp)
+        e = yasm_expr_create(YASM_EXPR_WRT, yasm_expr_expr(e),
+                             yasm_expr_reg(X86_RIP), line);
+    else {
+        for (i=x86_ea->nregs-1; i>=0; i--) {
+            yasm_expr__item *term = yasm_expr_reg(x86_ea->regs[i].reg);
+            if (x86_ea->regs[i].explicit_mult)
+                term = yasm_expr_expr(yasm_expr_create(YASM_EXPR_MUL, term,
+                    yasm_expr_int(yasm_intnum_create_int(
+                        x86_ea->regs[i].mult)), line));
+            if (e)
+                e = yasm_expr_create(YASM_EXPR_ADD, term, yasm_expr_expr(e),
+                                     line);
+            else
+                e = yasm_expr_create_ident(term, line);
+        }
+    }
+    x86_ea->ea.disp.abs = e;
+    x86_ea->nregs = 0;
+    x86_ea->rip_disp = 0;
+}
+
 /*@-compmempass@*/
 x86_effaddr *
 yasm_x86__ea_create_imm(x86_effaddr *x86_ea, yasm_expr *imm,
@@ -263,6 +351,7 @@ yasm_x86__ea_create_imm(x86_effaddr *x86_ea, yasm_expr *imm,
     if (!x86_ea)
         x86_ea = ea_create();
     yasm_value_initialize(&x86_ea->ea.disp, imm, im_len);
+    x86_ea->nregs = 0;
     x86_ea->ea.need_disp = 1;
 
     return x86_ea;
@@ -364,7 +453,6 @@ x86_bc_insn_destroy(void *contents)
         yasm_value_delete(insn->imm);
         yasm_xfree(insn->imm);
     }
-    yasm_xfree(contents);
 }
 
 static void
@@ -372,7 +460,6 @@ x86_bc_jmp_destroy(void *contents)
 {
     x86_jmp *jmp = (x86_jmp *)contents;
     yasm_value_delete(&jmp->target);
-    yasm_xfree(contents);
 }
 
 static void
@@ -395,8 +482,13 @@ void
 yasm_x86__ea_print(const yasm_effaddr *ea, FILE *f, int indent_level)
 {
     const x86_effaddr *x86_ea = (const x86_effaddr *)ea;
+    unsigned int i;
     fprintf(f, "%*sDisp:\n", indent_level, "");
     yasm_value_print(&ea->disp, f, indent_level+1);
+    for (i=0; i<x86_ea->nregs; i++)
+        fprintf(f, "%*sReg=%lx Mult=%ld%s\n", indent_level, "",
+                (unsigned long)x86_ea->regs[i].reg, x86_ea->regs[i].mult,
+                x86_ea->rip_disp ? " (wrt rip)" : "");
     fprintf(f, "%*sNoSplit=%u\n", indent_level, "", (unsigned int)ea->nosplit);
     fprintf(f, "%*sSegmentOv=%02x\n", indent_level, "",
             (unsigned int)x86_ea->ea.segreg);
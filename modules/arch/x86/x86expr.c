@@ -101,10 +101,9 @@ x86_expr_checkea_get_reg16(yasm_expr__item *ei, int *regnum, void *d)
 {
     x86_checkea_reg16_data *data = d;
     /* in order: ax,cx,dx,bx,sp,bp,si,di */
-    /*@-nullassign@*/
-    static int *reg16[8] = {0,0,0,0,0,0,0,0};
-    /*@=nullassign@*/
+    int *reg16[8];
 
+    reg16[0] = reg16[1] = reg16[2] = reg16[4] = NULL;
     reg16[3] = &data->bx;
     reg16[5] = &data->bp;
     reg16[6] = &data->si;
@@ -426,6 +425,72 @@ x86_expr_checkea_getregusage(yasm_expr **ep, /*@null@*/ int *indexreg,
     return 0;
 }
 
+/* Register usage for an EA whose registers were handed over by the parser
+ * (yasm_x86__ea_create_regs()): same accounting as
+ * x86_expr_checkea_getregusage() applies to reg and reg*mult terms, but
+ * taken straight from regs[] since ea.disp holds no registers.
+ */
+static int
+x86_expr_checkea_getregs(x86_effaddr *x86_ea, /*@null@*/ int *indexreg,
+    int *pcrel, unsigned int bits, void *data,
+    int *(*get_reg)(yasm_expr__item *ei, int *regnum, void *d))
+{
+    unsigned int i;
+    int *reg;
+    int regnum;
+    int indexval = 0;
+    int indexmult = 0;
+    yasm_expr__item ei;
+
+    for (i=0; i<x86_ea->nregs; i++) {
+        ei.type = YASM_EXPR_REG;
+        ei.data.reg = x86_ea->regs[i].reg;
+        reg = get_reg(&ei, &regnum, data);
+        if (!reg)
+            return 1;
+        /* get_reg overwrites the item with a zero intnum; we don't need it */
+        yasm_intnum_destroy(ei.data.intn);
+
+        if (x86_ea->rip_disp) {
+            /* Same as the WRT rip case */
+            if (bits != 64 || regnum != 16)
+                return 1;
+            (*reg)++;
+            *pcrel = 1;
+        } else if (!x86_ea->regs[i].explicit_mult) {
+            (*reg)++;
+            /* Let last, largest multipler win indexreg */
+            if (indexreg && *reg > 0 && indexval <= *reg && !indexmult) {
+                *indexreg = regnum;
+                indexval = *reg;
+            }
+        } else {
+            (*reg) += (int)x86_ea->regs[i].mult;
+            if (indexreg && indexval <= *reg) {
+                *indexreg = regnum;
+                indexval = *reg;
+                indexmult = 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Register usage from whichever form the EA was created in. */
+static int
+x86_expr_checkea_regusage(x86_effaddr *x86_ea, /*@null@*/ int *indexreg,
+    int *pcrel, unsigned int bits, void *data,
+    int *(*get_reg)(yasm_expr__item *ei, int *regnum, void *d))
+{
+    if (x86_ea->nregs)
+        return x86_expr_checkea_getregs(x86_ea, indexreg, pcrel, bits, data,
+                                        get_reg);
+    if (x86_ea->ea.disp.abs)
+        return x86_expr_checkea_getregusage(&x86_ea->ea.disp.abs, indexreg,
+                                            pcrel, bits, data, get_reg);
+    return 0;
+}
+
 /* Calculate the displacement length, if possible.
  * Takes several extra inputs so it can be used by both 32-bit and 16-bit
  * expressions:
@@ -628,7 +693,19 @@ yasm_x86__expr_checkea(x86_effaddr *x86_ea, unsigned char *addrsize,
                 /* check for use of 16 or 32-bit registers; if none are used
                  * default to bits setting.
                  */
-                if (!x86_ea->ea.disp.abs ||
+                if (x86_ea->nregs) {
+                    unsigned int i;
+                    yasm_expr__item ei;
+                    ei.type = YASM_EXPR_REG;
+                    for (i=0; i<x86_ea->nregs; i++) {
+                        ei.data.reg = x86_ea->regs[i].reg;
+                        if (x86_expr_checkea_getregsize_callback(&ei,
+                                                                 addrsize))
+                            break;
+                    }
+                    if (i == x86_ea->nregs)
+                        *addrsize = bits;
+                } else if (!x86_ea->ea.disp.abs ||
                     !yasm_expr__traverse_leaves_in(x86_ea->ea.disp.abs,
                         addrsize, x86_expr_checkea_getregsize_callback))
                     *addrsize = bits;
@@ -693,10 +770,10 @@ yasm_x86__expr_checkea(x86_effaddr *x86_ea, unsigned char *addrsize,
         reg3264_data.vsib_mode = x86_ea->vsib_mode;
         reg3264_data.bits = bits;
         reg3264_data.addrsize = *addrsize;
-        if (x86_ea->ea.disp.abs) {
+        {
             int pcrel = 0;
-            switch (x86_expr_checkea_getregusage
-                    (&x86_ea->ea.disp.abs, &indexreg, &pcrel, bits,
+            switch (x86_expr_checkea_regusage
+                    (x86_ea, &indexreg, &pcrel, bits,
                      &reg3264_data, x86_expr_checkea_get_reg3264)) {
                 case 1:
                     yasm_error_set(YASM_ERROR_VALUE,
@@ -967,10 +1044,10 @@ yasm_x86__expr_checkea(x86_effaddr *x86_ea, unsigned char *addrsize,
         x86_ea->valid_sib = 0;
         x86_ea->need_sib = 0;
 
-        if (x86_ea->ea.disp.abs) {
+        {
             int pcrel = 0;
-            switch (x86_expr_checkea_getregusage
-                    (&x86_ea->ea.disp.abs, (int *)NULL, &pcrel, bits,
+            switch (x86_expr_checkea_regusage
+                    (x86_ea, (int *)NULL, &pcrel, bits,
                      &reg16mult, x86_expr_checkea_get_reg16)) {
                 case 1:
                     yasm_error_set(YASM_ERROR_VALUE,
@@ -381,6 +381,52 @@ x86_expr_contains_simd(const yasm_expr *e, int ymm)
                                                x86_expr_contains_simd_cb);
 }
 
+/* The following look at an EA's registers wherever they are kept: in the
+ * displacement expression, or split out by yasm_x86__ea_create_regs().
+ */
+static int
+x86_ea_contains_simd(const yasm_effaddr *ea, int ymm)
+{
+    const x86_effaddr *x86_ea = (const x86_effaddr *)ea;
+    yasm_expr__item ei;
+    unsigned int i;
+
+    if (x86_ea->nregs == 0)
+        return x86_expr_contains_simd(ea->disp.abs, ymm);
+    ei.type = YASM_EXPR_REG;
+    for (i=0; i<x86_ea->nregs; i++) {
+        ei.data.reg = x86_ea->regs[i].reg;
+        if (x86_expr_contains_simd_cb(&ei, &ymm))
+            return 1;
+    }
+    return 0;
+}
+
+static int
+x86_ea_contains_reg(const yasm_effaddr *ea)
+{
+    return ((const x86_effaddr *)ea)->nregs != 0 ||
+        (ea->disp.abs && yasm_expr__contains(ea->disp.abs, YASM_EXPR_REG));
+}
+
+/* Returns the register if the EA is exactly [reg], otherwise NULL. */
+static /*@null@*/ const uintptr_t *
+x86_ea_get_reg(yasm_effaddr *ea)
+{
+    x86_effaddr *x86_ea = (x86_effaddr *)ea;
+    const yasm_intnum *num;
+
+    if (x86_ea->nregs == 0)
+        return yasm_expr_get_reg(&ea->disp.abs, 0);
+    if (x86_ea->nregs != 1 || x86_ea->regs[0].explicit_mult ||
+        x86_ea->rip_disp)
+        return NULL;
+    num = yasm_expr_get_intnum(&ea->disp.abs, 0);
+    if (!num || !yasm_intnum_is_zero(num))
+        return NULL;
+    return &x86_ea->regs[0].reg;
+}
+
 static void
 x86_finalize_common(x86_common *common, const x86_insn_info *info,
                     unsigned int mode_bits)
@@ -501,7 +547,7 @@ x86_finalize_jmp(yasm_bytecode *bc, yasm_bytecode *prev_bc,
                  const x86_insn_info *jinfo)
 {
     x86_id_insn *id_insn = (x86_id_insn *)bc->contents;
-    x86_jmp *jmp;
+    x86_jmp jmp_local, *jmp = &jmp_local;
     int num_info = id_insn->num_info;
     const x86_insn_info *info = id_insn->group;
     unsigned char *mod_data = id_insn->mod_data;
@@ -517,7 +563,6 @@ x86_finalize_jmp(yasm_bytecode *bc, yasm_bytecode *prev_bc,
     if (op->type != YASM_INSN__OPERAND_IMM)
         yasm_internal_error(N_("invalid operand conversion"));
 
-    jmp = yasm_xmalloc(sizeof(x86_jmp));
     x86_finalize_common(&jmp->common, jinfo, mode_bits);
     if (yasm_value_finalize_expr(&jmp->target, op->data.val, prev_bc, 0))
         yasm_error_set(YASM_ERROR_TOO_COMPLEX,
@@ -842,8 +887,7 @@ x86_find_match(x86_id_insn *id_insn, yasm_insn_operand **ops,
                     break;
                 case OPT_MemOffs:
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        yasm_expr__contains(op->data.ea->disp.abs,
-                                            YASM_EXPR_REG) ||
+                        x86_ea_contains_reg(op->data.ea) ||
                         op->data.ea->pc_rel ||
                         (!op->data.ea->not_pc_rel && id_insn->default_rel &&
                          op->data.ea->disp.size != 64))
@@ -871,7 +915,7 @@ x86_find_match(x86_id_insn *id_insn, yasm_insn_operand **ops,
                 case OPT_MemrAX: {
                     const uintptr_t *regp;
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        !(regp = yasm_expr_get_reg(&op->data.ea->disp.abs, 0)) ||
+                        !(regp = x86_ea_get_reg(op->data.ea)) ||
                         (*regp != (X86_REG16 | 0) &&
                          *regp != (X86_REG32 | 0) &&
                          *regp != (X86_REG64 | 0)))
@@ -881,19 +925,19 @@ x86_find_match(x86_id_insn *id_insn, yasm_insn_operand **ops,
                 case OPT_MemEAX: {
                     const uintptr_t *regp;
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        !(regp = yasm_expr_get_reg(&op->data.ea->disp.abs, 0)) ||
+                        !(regp = x86_ea_get_reg(op->data.ea)) ||
                         *regp != (X86_REG32 | 0))
                         mismatch = 1;
                     break;
                 }
                 case OPT_MemXMMIndex:
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        !x86_expr_contains_simd(op->data.ea->disp.abs, 0))
+                        !x86_ea_contains_simd(op->data.ea, 0))
                         mismatch = 1;
                     break;
                 case OPT_MemYMMIndex:
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        !x86_expr_contains_simd(op->data.ea->disp.abs, 1))
+                        !x86_ea_contains_simd(op->data.ea, 1))
                         mismatch = 1;
                     break;
                 default:
@@ -1063,7 +1107,7 @@ static void
 x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
 {
     x86_id_insn *id_insn = (x86_id_insn *)bc->contents;
-    x86_insn *insn;
+    x86_insn insn_local, *insn = &insn_local;
     const x86_insn_info *info = id_insn->group;
     unsigned int mode_bits = id_insn->mode_bits;
     unsigned char *mod_data = id_insn->mod_data;
@@ -1091,8 +1135,17 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
     ops[0] = ops[1] = ops[2] = ops[3] = ops[4] = NULL;
     for (i = 0, op = yasm_insn_ops_first(&id_insn->insn);
          op && i < id_insn->insn.num_operands;
-         op = yasm_insn_op_next(op), i++)
+         op = yasm_insn_op_next(op), i++) {
         ops[i] = op;
+        /* An EQU expanded by yasm_insn_finalize() can bring registers into
+         * a displacement the parser split registers out of; fold the split
+         * registers back so they're all seen together.
+         */
+        if (op->type == YASM_INSN__OPERAND_MEMORY &&
+            ((x86_effaddr *)op->data.ea)->nregs &&
+            yasm_expr__contains(op->data.ea->disp.abs, YASM_EXPR_REG))
+            yasm_x86__ea_expand_regs((x86_effaddr *)op->data.ea);
+    }
 
     /* If we're running in GAS mode, build a reverse array of the operands
      * as most GAS instructions have reversed operands from Intel style.
@@ -1125,6 +1178,7 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
                 if (op->data.ea->segreg != 0)
                     yasm_warn_set(YASM_WARN_GENERAL,
                                   N_("skipping prefixes on this instruction"));
+                yasm_x86__ea_expand_regs((x86_effaddr *)op->data.ea);
                 imm = op->data.ea->disp.abs;
                 op->data.ea->disp.abs = NULL;
                 yasm_x86__ea_destroy(op->data.ea);
@@ -1156,7 +1210,6 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
     }
 
     /* Copy what we can from info */
-    insn = yasm_xmalloc(sizeof(x86_insn));
     x86_finalize_common(&insn->common, info, mode_bits);
     x86_finalize_opcode(&insn->opcode, info);
     insn->x86_ea = NULL;
@@ -1288,8 +1341,7 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
                                        !op->data.ea->not_pc_rel &&
                                        op->data.ea->segreg != 0x6404 &&
                                        op->data.ea->segreg != 0x6505 &&
-                                       !yasm_expr__contains(
-                                          op->data.ea->disp.abs, YASM_EXPR_REG))
+                                       !x86_ea_contains_reg(op->data.ea))
                                 /* Enable default PC-rel if no regs and segreg
                                  * is not FS or GS.
                                  */
@@ -1393,7 +1445,7 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
                      * for now.
                      */
                     if (op->type != YASM_INSN__OPERAND_MEMORY ||
-                        !(regp = yasm_expr_get_reg(&op->data.ea->disp.abs, 0)))
+                        !(regp = x86_ea_get_reg(op->data.ea)))
                         yasm_internal_error(N_("invalid operand conversion"));
                     /* 64-bit mode does not allow 16-bit addresses */
                     if (mode_bits == 64 && *regp == (X86_REG16 | 0))
@@ -1549,9 +1601,7 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
             if (!id_insn->default_rel &&
                 insn->common.mode_bits == 64 &&
                 insn->common.addrsize == 32 &&
-                (!insn->x86_ea->ea.disp.abs ||
-                 !yasm_expr__contains(insn->x86_ea->ea.disp.abs,
-                                      YASM_EXPR_REG))) {
+                !x86_ea_contains_reg(&insn->x86_ea->ea)) {
                 yasm_x86__ea_set_disponly(insn->x86_ea);
                 /* Make the short form permanent. */
                 insn->opcode.opcode[0] = insn->opcode.opcode[1];
@@ -1707,7 +1757,7 @@ typedef struct insnprefix_parse_data {
 static const char *
 cpu_find_reverse(unsigned int cpu0, unsigned int cpu1, unsigned int cpu2)
 {
-    static char cpuname[200];
+    static YASM_THREAD_LOCAL char cpuname[200];
     wordptr cpu = BitVector_Create(128, TRUE);
 
     if (cpu0 != CPU_Any)
@@ -1796,7 +1846,7 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
     yasm_arch_x86 *arch_x86 = (yasm_arch_x86 *)arch;
     /*@null@*/ const insnprefix_parse_data *pdata;
     size_t i;
-    static char lcaseid[17];
+    char lcaseid[17];
 
     *bc = (yasm_bytecode *)NULL;
     *prefix = 0;
@@ -1836,7 +1886,9 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
         if (arch_x86->mode_bits == 64 && (pdata->misc_flags & NOT_64)) {
             yasm_error_set(YASM_ERROR_GENERAL,
                            N_("`%s' invalid in 64-bit mode"), id);
-            id_insn = yasm_xmalloc(sizeof(x86_id_insn));
+            *bc = yasm_bc_create_inline(&x86_id_insn_callback,
+                                        sizeof(x86_id_insn), line);
+            id_insn = (x86_id_insn *)(*bc)->contents;
             yasm_insn_initialize(&id_insn->insn);
             id_insn->group = not64_insn;
             id_insn->cpu_enabled = cpu_enabled;
@@ -1851,7 +1903,6 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
 	
             id_insn->force_strict = arch_x86->force_strict != 0;
             id_insn->default_rel = arch_x86->default_rel != 0;
-            *bc = yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
             return YASM_ARCH_INSN;
         }
 
@@ -1868,7 +1919,9 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
             return YASM_ARCH_NOTINSNPREFIX;
         }
 
-        id_insn = yasm_xmalloc(sizeof(x86_id_insn));
+        *bc = yasm_bc_create_inline(&x86_id_insn_callback,
+                                    sizeof(x86_id_insn), line);
+        id_insn = (x86_id_insn *)(*bc)->contents;
         yasm_insn_initialize(&id_insn->insn);
         id_insn->group = pdata->group;
         id_insn->cpu_enabled = cpu_enabled;
@@ -1882,7 +1935,6 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
         id_insn->parser = PARSER(arch_x86);
         id_insn->force_strict = arch_x86->force_strict != 0;
         id_insn->default_rel = arch_x86->default_rel != 0;
-        *bc = yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
         return YASM_ARCH_INSN;
     } else {
         unsigned long type = pdata->num_info<<8;
@@ -1915,7 +1967,6 @@ x86_id_insn_destroy(void *contents)
 {
     x86_id_insn *id_insn = (x86_id_insn *)contents;
     yasm_insn_delete(&id_insn->insn, yasm_x86__ea_destroy);
-    yasm_xfree(contents);
 }
 
 static void
@@ -1930,7 +1981,9 @@ x86_id_insn_print(const void *contents, FILE *f, int indent_level)
 yasm_x86__create_empty_insn(yasm_arch *arch, unsigned long line)
 {
     yasm_arch_x86 *arch_x86 = (yasm_arch_x86 *)arch;
-    x86_id_insn *id_insn = yasm_xmalloc(sizeof(x86_id_insn));
+    yasm_bytecode *bc = yasm_bc_create_inline(&x86_id_insn_callback,
+                                              sizeof(x86_id_insn), line);
+    x86_id_insn *id_insn = (x86_id_insn *)bc->contents;
 
     yasm_insn_initialize(&id_insn->insn);
     id_insn->group = empty_insn;
@@ -1946,6 +1999,6 @@ yasm_x86__create_empty_insn(yasm_arch *arch, unsigned long line)
     id_insn->force_strict = arch_x86->force_strict != 0;
     id_insn->default_rel = arch_x86->default_rel != 0;
 
-    return yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
+    return bc;
 }
 
@@ -58,6 +58,7 @@ typedef struct bcreloc {
 typedef struct nasm_listfmt_output_info {
     yasm_arch *arch;
     /*@reldef@*/ STAILQ_HEAD(bcrelochead, bcreloc) bcrelocs;
+    /*@null@*/ yasm_section *sect;      /* section of next_reloc */
     /*@null@*/ yasm_reloc *next_reloc;  /* next relocation in section */
     unsigned long next_reloc_addr;
 } nasm_listfmt_output_info;
@@ -108,12 +109,13 @@ nasm_listfmt_output_value(yasm_value *value, unsigned char *buf,
         STAILQ_INSERT_TAIL(&info->bcrelocs, reloc, link);
 
         /* Get next reloc's info */
-        info->next_reloc = yasm_section_reloc_next(info->next_reloc);
+        info->next_reloc = yasm_section_reloc_next(info->sect,
+                                                   info->next_reloc);
         if (info->next_reloc) {
-            yasm_intnum *addr;
+            unsigned long addr;
             yasm_symrec *sym;
             yasm_reloc_get(info->next_reloc, &addr, &sym);
-            info->next_reloc_addr = yasm_intnum_get_uint(addr);
+            info->next_reloc_addr = addr;
         }
     }
 
@@ -148,11 +150,17 @@ nasm_listfmt_output(yasm_listfmt *listfmt, FILE *f, yasm_linemap *linemap,
     unsigned long line = 1;
     unsigned long listline = 1;
     /*@only@*/ unsigned char *buf;
+    /* contents of a bytecode spanning several lines, kept between lines */
+    /*@null@*/ yasm_bytecode *keptbc = NULL;
+    /*@null@*/ /*@only@*/ unsigned char *keptbuf = NULL;
+    unsigned long keptsize = 0;
+    int keptgap = 0;
     nasm_listfmt_output_info info;
     /*@reldef@*/ SLIST_HEAD(sectrelochead, sectreloc) reloc_hist;
     /*@null@*/ sectreloc *last_hist = NULL;
     /*@null@*/ bcreloc *reloc = NULL;
     yasm_section *sect;
+    unsigned long start, len;
 
     SLIST_INIT(&reloc_hist);
 
@@ -181,46 +189,74 @@ nasm_listfmt_output(yasm_listfmt *listfmt, FILE *f, yasm_linemap *linemap,
                     /* not found, add to list*/
                     last_hist = yasm_xmalloc(sizeof(sectreloc));
                     last_hist->sect = sect;
+                    yasm_section_sort_relocs(sect);
                     last_hist->next_reloc = yasm_section_relocs_first(sect);
 
                     if (last_hist->next_reloc) {
-                        yasm_intnum *addr;
+                        unsigned long addr;
                         yasm_symrec *sym;
                         yasm_reloc_get(last_hist->next_reloc, &addr, &sym);
-                        last_hist->next_reloc_addr =
-                            yasm_intnum_get_uint(addr);
+                        last_hist->next_reloc_addr = addr;
                     }
 
                     SLIST_INSERT_HEAD(&reloc_hist, last_hist, link);
                 }
             }
 
+            info.sect = sect;
             info.next_reloc = last_hist->next_reloc;
             info.next_reloc_addr = last_hist->next_reloc_addr;
             STAILQ_INIT(&info.bcrelocs);
 
             /* loop over bytecodes on this line (usually only one) */
-            while (bc && bc->line == line) {
-                /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+            while (bc && yasm_bc_get_line_span(bc, line, &start, &len)) {
+                /*@null@*/ /*@only@*/ unsigned char *bigbuf = NULL;
                 unsigned long size = REGULAR_BUF_SIZE;
                 long multiple;
-                unsigned long offset = bc->offset;
+                unsigned long offset = bc->offset + start;
                 unsigned char *origp, *p;
                 int gap;
 
                 /* convert bytecode into bytes, recording relocs along the
-                 * way
+                 * way; a bytecode spanning several lines (coalesced data,
+                 * so without relocs) is only converted once
                  */
-                bigbuf = yasm_bc_tobytes(bc, buf, &size, &gap, &info,
-                                         nasm_listfmt_output_value, NULL);
+                if (bc == keptbc) {
+                    size = keptsize;
+                    gap = keptgap;
+                } else
+                    bigbuf = yasm_bc_tobytes(bc, buf, &size, &gap, &info,
+                                             nasm_listfmt_output_value, NULL);
                 yasm_bc_get_multiple(bc, &multiple, 1);
                 if (multiple <= 0)
                     size = 0;
                 else
                     size /= multiple;
+                if (bc != keptbc && start+len < size) {
+                    if (keptbuf)
+                        yasm_xfree(keptbuf);
+                    if (!bigbuf) {
+                        bigbuf = yasm_xmalloc(size);
+                        memcpy(bigbuf, buf, size);
+                    }
+                    keptbc = bc;
+                    keptbuf = bigbuf;
+                    keptsize = size;
+                    keptgap = gap;
+                }
+                if (bc == keptbc)
+                    bigbuf = NULL;
 
                 /* output bytes with reloc information */
-                origp = bigbuf ? bigbuf : buf;
+                origp = (bc == keptbc) ? keptbuf : bigbuf ? bigbuf : buf;
+                if (start < size) {
+                    origp += start;
+                    if (len < size-start)
+                        size = len;
+                    else
+                        size -= start;
+                } else
+                    size = 0;
                 p = origp;
                 reloc = STAILQ_FIRST(&info.bcrelocs);
                 if (gap) {
@@ -263,6 +299,10 @@ nasm_listfmt_output(yasm_listfmt *listfmt, FILE *f, yasm_linemap *linemap,
 
                 if (bigbuf)
                     yasm_xfree(bigbuf);
+
+                /* the rest of the bytecode belongs to later lines */
+                if (bc == keptbc && start+len < keptsize)
+                    break;
                 bc = STAILQ_NEXT(bc, link);
             }
 
@@ -288,6 +328,8 @@ nasm_listfmt_output(yasm_listfmt *listfmt, FILE *f, yasm_linemap *linemap,
         yasm_xfree(last_hist);
     }
 
+    if (keptbuf)
+        yasm_xfree(keptbuf);
     yasm_xfree(buf);
 }
 
@@ -118,6 +118,11 @@ bin_objfmt_create(yasm_object *object)
 
     object->overrides->value_finalize = bin_objfmt_value_finalize;
 
+    /* Flat binaries are often mostly data (boot images, tables); keep large
+     * runs of it out of memory until output.
+     */
+    object->spool_data = 1;
+
     return (yasm_objfmt *)objfmt_bin;
 }
 
@@ -1144,6 +1149,10 @@ bin_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     assert(info != NULL);
 
+    /* Copy spooled data directly rather than reading it all into memory. */
+    if (yasm_bc_data_write_spooled(bc, info->f))
+        return 0;
+
     bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
                              bin_objfmt_output_value, NULL);
 
@@ -1156,17 +1165,9 @@ bin_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_fwrite_zeros(size, info->f);
     } else {
         /* Output buf (or bigbuf if non-NULL) to file */
         fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
@@ -1242,8 +1243,8 @@ bin_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         if (fseek(info->f, yasm_intnum_get_int(info->tmp_intn) + info->start,
                   SEEK_SET) < 0)
             yasm__fatal(N_("could not seek on output file"));
-        yasm_section_bcs_traverse(sect, info->errwarns,
-                                  info, bin_objfmt_output_bytecode);
+        yasm_section_output(sect, info->f, info->errwarns,
+                            info, bin_objfmt_output_bytecode);
     }
 
     return 0;
@@ -1866,6 +1867,10 @@ bin_section_data_destroy(void *data)
         yasm_intnum_destroy(bsd->ivstart);
     if (bsd->length)
         yasm_intnum_destroy(bsd->length);
+    if (bsd->align)
+        yasm_intnum_destroy(bsd->align);
+    if (bsd->valign)
+        yasm_intnum_destroy(bsd->valign);
     yasm_xfree(data);
 }
 
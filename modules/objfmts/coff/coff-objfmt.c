@@ -197,6 +197,10 @@ typedef struct coff_objfmt_output_info {
     unsigned long indx;                 /* current symbol index */
     int all_syms;                       /* outputting all symbols? */
     unsigned long strtab_offset;        /* current string table offset */
+
+    /* string table contents following the section names */
+    /*@only@*/ unsigned char *strtab;
+    unsigned long strtab_len, strtab_max;
 } coff_objfmt_output_info;
 
 static void coff_section_data_destroy(/*@only@*/ void *d);
@@ -468,7 +472,7 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
         yasm_sym_vis vis = yasm_symrec_get_visibility(value->rel);
         /*@dependent@*/ /*@null@*/ yasm_symrec *sym = value->rel;
         unsigned long addr;
-        coff_reloc *reloc;
+        coff_reloc reloc;
         int nobase = info->csd->flags2 & COFF_FLAG_NOBASE;
 
         /* Sometimes we want the relocation to be generated against one
@@ -557,15 +561,14 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
         }
 
         /* Generate reloc */
-        reloc = yasm_xmalloc(sizeof(coff_reloc));
         addr = bc->offset + offset;
-        reloc->reloc.addr = yasm_intnum_create_uint(addr);
-        reloc->reloc.sym = sym;
+        reloc.reloc.addr = addr;
+        reloc.reloc.sym = sym;
 
         if (value->curpos_rel) {
             if (objfmt_coff->machine == COFF_MACHINE_I386) {
                 if (valsize == 32)
-                    reloc->type = COFF_RELOC_I386_REL32;
+                    reloc.type = COFF_RELOC_I386_REL32;
                 else {
                     yasm_error_set(YASM_ERROR_TYPE,
                                    N_("coff: invalid relocation size"));
@@ -578,25 +581,25 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
                     return 1;
                 }
                 if (!value->ip_rel)
-                    reloc->type = COFF_RELOC_AMD64_REL32;
+                    reloc.type = COFF_RELOC_AMD64_REL32;
                 else switch (bc->len*bc->mult_int - (offset+destsize)) {
                     case 0:
-                        reloc->type = COFF_RELOC_AMD64_REL32;
+                        reloc.type = COFF_RELOC_AMD64_REL32;
                         break;
                     case 1:
-                        reloc->type = COFF_RELOC_AMD64_REL32_1;
+                        reloc.type = COFF_RELOC_AMD64_REL32_1;
                         break;
                     case 2:
-                        reloc->type = COFF_RELOC_AMD64_REL32_2;
+                        reloc.type = COFF_RELOC_AMD64_REL32_2;
                         break;
                     case 3:
-                        reloc->type = COFF_RELOC_AMD64_REL32_3;
+                        reloc.type = COFF_RELOC_AMD64_REL32_3;
                         break;
                     case 4:
-                        reloc->type = COFF_RELOC_AMD64_REL32_4;
+                        reloc.type = COFF_RELOC_AMD64_REL32_4;
                         break;
                     case 5:
-                        reloc->type = COFF_RELOC_AMD64_REL32_5;
+                        reloc.type = COFF_RELOC_AMD64_REL32_5;
                         break;
                     default:
                         yasm_error_set(YASM_ERROR_TYPE,
@@ -607,32 +610,32 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
                 yasm_internal_error(N_("coff objfmt: unrecognized machine"));
         } else if (value->seg_of) {
             if (objfmt_coff->machine == COFF_MACHINE_I386)
-                reloc->type = COFF_RELOC_I386_SECTION;
+                reloc.type = COFF_RELOC_I386_SECTION;
             else if (objfmt_coff->machine == COFF_MACHINE_AMD64)
-                reloc->type = COFF_RELOC_AMD64_SECTION;
+                reloc.type = COFF_RELOC_AMD64_SECTION;
             else
                 yasm_internal_error(N_("coff objfmt: unrecognized machine"));
         } else if (value->section_rel) {
             if (objfmt_coff->machine == COFF_MACHINE_I386)
-                reloc->type = COFF_RELOC_I386_SECREL;
+                reloc.type = COFF_RELOC_I386_SECREL;
             else if (objfmt_coff->machine == COFF_MACHINE_AMD64)
-                reloc->type = COFF_RELOC_AMD64_SECREL;
+                reloc.type = COFF_RELOC_AMD64_SECREL;
             else
                 yasm_internal_error(N_("coff objfmt: unrecognized machine"));
         } else {
             if (objfmt_coff->machine == COFF_MACHINE_I386) {
                 if (nobase)
-                    reloc->type = COFF_RELOC_I386_ADDR32NB;
+                    reloc.type = COFF_RELOC_I386_ADDR32NB;
                 else
-                    reloc->type = COFF_RELOC_I386_ADDR32;
+                    reloc.type = COFF_RELOC_I386_ADDR32;
             } else if (objfmt_coff->machine == COFF_MACHINE_AMD64) {
                 if (valsize == 32) {
                     if (nobase)
-                        reloc->type = COFF_RELOC_AMD64_ADDR32NB;
+                        reloc.type = COFF_RELOC_AMD64_ADDR32NB;
                     else
-                        reloc->type = COFF_RELOC_AMD64_ADDR32;
+                        reloc.type = COFF_RELOC_AMD64_ADDR32;
                 } else if (valsize == 64)
-                    reloc->type = COFF_RELOC_AMD64_ADDR64;
+                    reloc.type = COFF_RELOC_AMD64_ADDR64;
                 else {
                     yasm_error_set(YASM_ERROR_TYPE,
                                    N_("coff: invalid relocation size"));
@@ -642,7 +645,8 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
                 yasm_internal_error(N_("coff objfmt: unrecognized machine"));
         }
         info->csd->nreloc++;
-        yasm_section_add_reloc(info->sect, (yasm_reloc *)reloc, yasm_xfree);
+        yasm_section_add_reloc(info->sect, &reloc.reloc, sizeof(coff_reloc),
+                               NULL);
     }
 
     /* Build up final integer output from intn_val, intn_minus, value->abs,
@@ -704,17 +708,9 @@ coff_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_fwrite_zeros(size, info->f);
     } else {
         /* Output buf (or bigbuf if non-NULL) to file */
         fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
@@ -727,6 +723,35 @@ coff_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
     return 0;
 }
 
+static int
+coff_objfmt_render_section(yasm_section *sect, FILE *f,
+                           yasm_errwarns *errwarns, /*@null@*/ void *d)
+{
+    /*@null@*/ coff_objfmt_output_info *pinfo = (coff_objfmt_output_info *)d;
+    coff_objfmt_output_info info;
+    /*@dependent@*/ /*@null@*/ coff_section_data *csd;
+
+    assert(pinfo != NULL);
+    csd = yasm_section_get_data(sect, &coff_section_data_cb);
+    assert(csd != NULL);
+
+    /* BSS sections aren't in the file */
+    if ((csd->flags & COFF_STYP_STD_MASK) == COFF_STYP_BSS)
+        return 1;
+
+    /* May run concurrently with other sections; use a private copy */
+    info = *pinfo;
+    info.errwarns = errwarns;
+    info.f = f;
+    info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
+    info.sect = sect;
+    info.csd = csd;
+    yasm_section_bcs_traverse(sect, errwarns, &info,
+                              coff_objfmt_output_bytecode);
+    yasm_xfree(info.buf);
+    return 0;
+}
+
 static int
 coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 {
@@ -734,6 +759,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     /*@dependent@*/ /*@null@*/ coff_section_data *csd;
     long pos;
     coff_reloc *reloc;
+    /*@only@*/ unsigned char *buf;
     unsigned char *localbuf;
 
     assert(info != NULL);
@@ -768,8 +794,8 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 
         info->sect = sect;
         info->csd = csd;
-        yasm_section_bcs_traverse(sect, info->errwarns, info,
-                                  coff_objfmt_output_bytecode);
+        yasm_section_output(sect, info->f, info->errwarns, info,
+                            coff_objfmt_output_bytecode);
 
         /* Sanity check final section size */
         if (yasm_errwarns_num_errors(info->errwarns, 0) == 0 &&
@@ -798,35 +824,37 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     }
     csd->relptr = (unsigned long)pos;
 
+    /* Format all relocations into one buffer and write them at once */
+    buf = yasm_xmalloc((yasm_section_num_relocs(sect)+1)*10);
+    localbuf = buf;
+
     /* If >=64K relocs (for Win32/64), we set a flag in the section header
      * (NRELOC_OVFL) and the first relocation contains the number of relocs.
      */
     if (csd->nreloc >= 64*1024 && info->objfmt_coff->win32) {
-        localbuf = info->buf;
         YASM_WRITE_32_L(localbuf, csd->nreloc+1);   /* address of relocation */
         YASM_WRITE_32_L(localbuf, 0);           /* relocated symbol */
         YASM_WRITE_16_L(localbuf, 0);           /* type of relocation */
-        fwrite(info->buf, 10, 1, info->f);
     }
 
     reloc = (coff_reloc *)yasm_section_relocs_first(sect);
     while (reloc) {
         /*@null@*/ coff_symrec_data *csymd;
-        localbuf = info->buf;
 
         csymd = yasm_symrec_get_data(reloc->reloc.sym, &coff_symrec_data_cb);
         if (!csymd)
             yasm_internal_error(
                 N_("coff: no symbol data for relocated symbol"));
 
-        yasm_intnum_get_sized(reloc->reloc.addr, localbuf, 4, 32, 0, 0, 0);
-        localbuf += 4;                          /* address of relocation */
+        YASM_WRITE_32_L(localbuf, reloc->reloc.addr);   /* address of reloc */
         YASM_WRITE_32_L(localbuf, csymd->index);    /* relocated symbol */
         YASM_WRITE_16_L(localbuf, reloc->type);     /* type of relocation */
-        fwrite(info->buf, 10, 1, info->f);
 
-        reloc = (coff_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
+        reloc = (coff_reloc *)yasm_section_reloc_next(sect,
+                                                      (yasm_reloc *)reloc);
     }
+    fwrite(buf, (size_t)(localbuf-buf), 1, info->f);
+    yasm_xfree(buf);
 
     return 0;
 }
@@ -910,222 +938,182 @@ coff_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 }
 
 static int
-coff_objfmt_count_sym(yasm_symrec *sym, /*@null@*/ void *d)
+coff_objfmt_select_sym(yasm_symrec *sym, yasm_sym_vis vis, void **data,
+                       /*@null@*/ void *d)
 {
     /*@null@*/ coff_objfmt_output_info *info = (coff_objfmt_output_info *)d;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
     coff_symrec_data *sym_data;
 
     assert(info != NULL);
 
     sym_data = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
 
-    if (info->all_syms || vis != YASM_SYM_LOCAL || yasm_symrec_is_abs(sym) ||
-        (sym_data && sym_data->forcevis)) {
-        /* Save index in symrec data */
-        if (!sym_data)
-            sym_data = coff_objfmt_sym_set_data(sym, COFF_SCL_NULL, 0,
-                                                COFF_SYMTAB_AUX_NONE);
-        /* Set storage class based on visibility if not already set */
-        if (sym_data->sclass == COFF_SCL_NULL) {
-            if (vis & (YASM_SYM_EXTERN|YASM_SYM_GLOBAL|YASM_SYM_COMMON))
-                sym_data->sclass = COFF_SCL_EXT;
-            else
-                sym_data->sclass = COFF_SCL_STAT;
-        }
-
-        sym_data->index = info->indx;
+    /* Don't output local syms unless outputting all syms */
+    if (!(info->all_syms || vis != YASM_SYM_LOCAL || yasm_symrec_is_abs(sym)
+          || (sym_data && sym_data->forcevis)))
+        return -1;
 
-        info->indx += sym_data->numaux + 1;
+    /* Save index in symrec data */
+    if (!sym_data)
+        sym_data = coff_objfmt_sym_set_data(sym, COFF_SCL_NULL, 0,
+                                            COFF_SYMTAB_AUX_NONE);
+    /* Set storage class based on visibility if not already set */
+    if (sym_data->sclass == COFF_SCL_NULL) {
+        if (vis & (YASM_SYM_EXTERN|YASM_SYM_GLOBAL|YASM_SYM_COMMON))
+            sym_data->sclass = COFF_SCL_EXT;
+        else
+            sym_data->sclass = COFF_SCL_STAT;
     }
-    return 0;
-}
-
-static int
-coff_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
-{
-    /*@null@*/ coff_objfmt_output_info *info = (coff_objfmt_output_info *)d;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
-    int is_abs = yasm_symrec_is_abs(sym);
-    /*@dependent@*/ /*@null@*/ coff_symrec_data *csymd;
-    yasm_valparamhead *objext_valparams =
-        yasm_symrec_get_objext_valparams(sym);
-    csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
-
-    assert(info != NULL);
 
     /* Look for "function" flag on global syms */
-    if (csymd && csymd->type == 0 && (vis & YASM_SYM_GLOBAL) != 0) {
+    if (sym_data->type == 0 && (vis & YASM_SYM_GLOBAL) != 0) {
+        yasm_valparamhead *objext_valparams =
+            yasm_symrec_get_objext_valparams(sym);
         if (objext_valparams) {
             const char *id = yasm_vp_id(yasm_vps_first(objext_valparams));
             if (yasm__strcasecmp(id, "function") == 0)
-                csymd->type = 0x20;
+                sym_data->type = 0x20;
         }
     }
 
-    /* Don't output local syms unless outputting all syms */
-    if (info->all_syms || vis != YASM_SYM_LOCAL || is_abs ||
-        (csymd && csymd->forcevis)) {
-        /*@only*/ char *name;
-        const yasm_expr *equ_val;
-        const yasm_intnum *intn;
-        unsigned char *localbuf;
-        size_t len;
-        int aux;
-        unsigned long value = 0;
-        unsigned int scnum = 0xfffe;    /* -2 = debugging symbol */
-        /*@dependent@*/ /*@null@*/ yasm_section *sect;
-        /*@dependent@*/ /*@null@*/ yasm_bytecode *precbc;
-        unsigned long scnlen = 0;   /* for sect auxent */
-        unsigned long nreloc = 0;   /* for sect auxent */
-
-        if (is_abs)
-            name = yasm__xstrdup(".absolut");
-        else
-            name = yasm_symrec_get_global_name(sym, info->object);
-        len = strlen(name);
-
-        /* Get symrec's of_data (needed for storage class) */
-        if (!csymd)
-            yasm_internal_error(N_("coff: expected sym data to be present"));
+    sym_data->index = info->indx;
+    info->indx += sym_data->numaux + 1;
 
-        /* Look at symrec for value/scnum/etc. */
-        if (yasm_symrec_get_label(sym, &precbc)) {
-            if (precbc)
-                sect = yasm_bc_get_section(precbc);
-            else
-                sect = NULL;
-            /* it's a label: get value and offset.
-             * If there is not a section, leave as debugging symbol.
-             */
-            if (sect) {
-                /*@dependent@*/ /*@null@*/ coff_section_data *csectd;
-                csectd = yasm_section_get_data(sect, &coff_section_data_cb);
-                if (csectd) {
-                    scnum = csectd->scnum;
-                    scnlen = csectd->size;
-                    nreloc = csectd->nreloc;
-                } else
-                    yasm_internal_error(N_("didn't understand section"));
-                if (precbc)
-                    value += yasm_bc_next_offset(precbc);
-            }
-        } else if ((equ_val = yasm_symrec_get_equ(sym))) {
-            yasm_expr *equ_val_copy = yasm_expr_copy(equ_val);
-            intn = yasm_expr_get_intnum(&equ_val_copy, 1);
-            if (!intn) {
-                if (vis & YASM_SYM_GLOBAL) {
-                    yasm_error_set(YASM_ERROR_NOT_CONSTANT,
-                        N_("global EQU value not an integer expression"));
-                    yasm_errwarn_propagate(info->errwarns, equ_val->line);
-                }
-            } else
-                value = yasm_intnum_get_uint(intn);
-            yasm_expr_destroy(equ_val_copy);
+    *data = sym_data;
+    return 0;
+}
 
-            scnum = 0xffff;     /* -1 = absolute symbol */
-        } else {
-            if (vis & YASM_SYM_COMMON) {
-                /*@dependent@*/ /*@null@*/ yasm_expr **csize_expr;
-                csize_expr = yasm_symrec_get_common_size(sym);
-                assert(csize_expr != NULL);
-                intn = yasm_expr_get_intnum(csize_expr, 1);
-                if (!intn) {
-                    yasm_error_set(YASM_ERROR_NOT_CONSTANT,
-                        N_("COMMON data size not an integer expression"));
-                    yasm_errwarn_propagate(info->errwarns,
-                                           (*csize_expr)->line);
-                } else
-                    value = yasm_intnum_get_uint(intn);
-                scnum = 0;
-            }
-            if (vis & YASM_SYM_EXTERN)
-                scnum = 0;
-        }
+/* Append a string to the string table, returning its offset. */
+static unsigned long
+coff_objfmt_add_str(coff_objfmt_output_info *info, const char *str,
+                    size_t len)
+{
+    unsigned long offset = info->strtab_offset;
 
-        localbuf = info->buf;
-        if (len > 8) {
-            YASM_WRITE_32_L(localbuf, 0);       /* "zeros" field */
-            YASM_WRITE_32_L(localbuf, info->strtab_offset); /* strtab offset */
-            info->strtab_offset += (unsigned long)(len+1);
-        } else {
-            /* <8 chars, so no string table entry needed */
-            strncpy((char *)localbuf, name, 8);
-            localbuf += 8;
-        }
-        YASM_WRITE_32_L(localbuf, value);       /* value */
-        YASM_WRITE_16_L(localbuf, scnum);       /* section number */
-        YASM_WRITE_16_L(localbuf, csymd->type); /* type */
-        YASM_WRITE_8(localbuf, csymd->sclass);  /* storage class */
-        YASM_WRITE_8(localbuf, csymd->numaux);  /* number of aux entries */
-        fwrite(info->buf, 18, 1, info->f);
-        for (aux=0; aux<csymd->numaux; aux++) {
-            localbuf = info->buf;
-            memset(localbuf, 0, 18);
-            switch (csymd->auxtype) {
-                case COFF_SYMTAB_AUX_NONE:
-                    break;
-                case COFF_SYMTAB_AUX_SECT:
-                    YASM_WRITE_32_L(localbuf, scnlen);  /* section length */
-                    YASM_WRITE_16_L(localbuf, nreloc);  /* number relocs */
-                    YASM_WRITE_16_L(localbuf, 0);       /* number line nums */
-                    break;
-                case COFF_SYMTAB_AUX_FILE:
-                    len = strlen(csymd->aux[0].fname);
-                    if (len > 14) {
-                        YASM_WRITE_32_L(localbuf, 0);
-                        YASM_WRITE_32_L(localbuf, info->strtab_offset);
-                        info->strtab_offset += (unsigned long)(len+1);
-                    } else
-                        strncpy((char *)localbuf, csymd->aux[0].fname, 14);
-                    break;
-                default:
-                    yasm_internal_error(
-                        N_("coff: unrecognized aux symtab type"));
-            }
-            fwrite(info->buf, 18, 1, info->f);
-        }
-        yasm_xfree(name);
+    while (info->strtab_len + len + 1 > info->strtab_max) {
+        info->strtab_max *= 2;
+        info->strtab = yasm_xrealloc(info->strtab, info->strtab_max);
     }
-    return 0;
+    memcpy(info->strtab + info->strtab_len, str, len + 1);
+    info->strtab_len += (unsigned long)(len + 1);
+    info->strtab_offset += (unsigned long)(len + 1);
+    return offset;
 }
 
-static int
-coff_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
+/* Format a symbol table entry and its auxiliary entries into localbuf;
+ * returns the position following them.
+ */
+static unsigned char *
+coff_objfmt_output_sym(yasm_symexport *export, coff_objfmt_output_info *info,
+                       unsigned char *localbuf)
 {
-    /*@null@*/ coff_objfmt_output_info *info = (coff_objfmt_output_info *)d;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
-    /*@dependent@*/ /*@null@*/ coff_symrec_data *csymd;
-    csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    yasm_symrec *sym = export->sym;
+    yasm_sym_vis vis = export->vis;
+    coff_symrec_data *csymd = export->data;
+    const char *name = export->name;
+    size_t len = export->name_len;
+    const yasm_expr *equ_val;
+    const yasm_intnum *intn;
+    int aux;
+    unsigned long value = 0;
+    unsigned int scnum = 0xfffe;    /* -2 = debugging symbol */
+    unsigned long scnlen = 0;   /* for sect auxent */
+    unsigned long nreloc = 0;   /* for sect auxent */
+
+    if (yasm_symrec_is_abs(sym)) {
+        name = ".absolut";
+        len = 8;
+    }
 
-    assert(info != NULL);
+    /* Look at symrec for value/scnum/etc. */
+    if (export->sect) {
+        /* it's a label: get value and offset.
+         * If there is not a section, leave as debugging symbol.
+         */
+        /*@dependent@*/ /*@null@*/ coff_section_data *csectd;
+        csectd = yasm_section_get_data(export->sect, &coff_section_data_cb);
+        if (csectd) {
+            scnum = csectd->scnum;
+            scnlen = csectd->size;
+            nreloc = csectd->nreloc;
+        } else
+            yasm_internal_error(N_("didn't understand section"));
+        value = export->offset;
+    } else if ((equ_val = yasm_symrec_get_equ(sym))) {
+        yasm_expr *equ_val_copy = yasm_expr_copy(equ_val);
+        intn = yasm_expr_get_intnum(&equ_val_copy, 1);
+        if (!intn) {
+            if (vis & YASM_SYM_GLOBAL) {
+                yasm_error_set(YASM_ERROR_NOT_CONSTANT,
+                    N_("global EQU value not an integer expression"));
+                yasm_errwarn_propagate(info->errwarns, equ_val->line);
+            }
+        } else
+            value = yasm_intnum_get_uint(intn);
+        yasm_expr_destroy(equ_val_copy);
 
-    /* Don't output local syms unless outputting all syms */
-    if (info->all_syms || vis != YASM_SYM_LOCAL ||
-        (csymd && csymd->forcevis)) {
-        /*@only@*/ char *name = yasm_symrec_get_global_name(sym, info->object);
-        size_t len = strlen(name);
-        int aux;
+        scnum = 0xffff;     /* -1 = absolute symbol */
+    } else {
+        if (vis & YASM_SYM_COMMON) {
+            /*@dependent@*/ /*@null@*/ yasm_expr **csize_expr;
+            csize_expr = yasm_symrec_get_common_size(sym);
+            assert(csize_expr != NULL);
+            intn = yasm_expr_get_intnum(csize_expr, 1);
+            if (!intn) {
+                yasm_error_set(YASM_ERROR_NOT_CONSTANT,
+                    N_("COMMON data size not an integer expression"));
+                yasm_errwarn_propagate(info->errwarns,
+                                       (*csize_expr)->line);
+            } else
+                value = yasm_intnum_get_uint(intn);
+            scnum = 0;
+        }
+        if (vis & YASM_SYM_EXTERN)
+            scnum = 0;
+    }
 
-        if (!csymd)
-            yasm_internal_error(N_("coff: expected sym data to be present"));
-
-        if (len > 8)
-            fwrite(name, len+1, 1, info->f);
-        for (aux=0; aux<csymd->numaux; aux++) {
-            switch (csymd->auxtype) {
-                case COFF_SYMTAB_AUX_FILE:
-                    len = strlen(csymd->aux[0].fname);
-                    if (len > 14)
-                        fwrite(csymd->aux[0].fname, len+1, 1, info->f);
-                    break;
-                default:
-                    break;
-            }
+    if (len > 8) {
+        unsigned long stroff = coff_objfmt_add_str(info, name, len);
+        YASM_WRITE_32_L(localbuf, 0);       /* "zeros" field */
+        YASM_WRITE_32_L(localbuf, stroff);  /* strtab offset */
+    } else {
+        /* <8 chars, so no string table entry needed */
+        strncpy((char *)localbuf, name, 8);
+        localbuf += 8;
+    }
+    YASM_WRITE_32_L(localbuf, value);       /* value */
+    YASM_WRITE_16_L(localbuf, scnum);       /* section number */
+    YASM_WRITE_16_L(localbuf, csymd->type); /* type */
+    YASM_WRITE_8(localbuf, csymd->sclass);  /* storage class */
+    YASM_WRITE_8(localbuf, csymd->numaux);  /* number of aux entries */
+    for (aux=0; aux<csymd->numaux; aux++) {
+        unsigned char *auxbuf = localbuf;
+        memset(auxbuf, 0, 18);
+        switch (csymd->auxtype) {
+            case COFF_SYMTAB_AUX_NONE:
+                break;
+            case COFF_SYMTAB_AUX_SECT:
+                YASM_WRITE_32_L(auxbuf, scnlen);    /* section length */
+                YASM_WRITE_16_L(auxbuf, nreloc);    /* number relocs */
+                YASM_WRITE_16_L(auxbuf, 0);         /* number line nums */
+                break;
+            case COFF_SYMTAB_AUX_FILE:
+                len = strlen(csymd->aux[0].fname);
+                if (len > 14) {
+                    unsigned long stroff =
+                        coff_objfmt_add_str(info, csymd->aux[0].fname, len);
+                    YASM_WRITE_32_L(auxbuf, 0);
+                    YASM_WRITE_32_L(auxbuf, stroff);
+                } else
+                    strncpy((char *)auxbuf, csymd->aux[0].fname, 14);
+                break;
+            default:
+                yasm_internal_error(
+                    N_("coff: unrecognized aux symtab type"));
         }
-        yasm_xfree(name);
+        localbuf += 18;
     }
-    return 0;
+    return localbuf;
 }
 
 static void
@@ -1134,7 +1122,9 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_coff *objfmt_coff = (yasm_objfmt_coff *)object->objfmt;
     coff_objfmt_output_info info;
-    unsigned char *localbuf;
+    /*@only@*/ yasm_symexport_plan *plan;
+    unsigned char *localbuf, *symbuf;
+    unsigned long i;
     long pos;
     unsigned long symtab_pos;
     unsigned long symtab_count;
@@ -1178,14 +1168,25 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     /* Finalize symbol table (assign index to each symbol) */
     info.indx = 0;
     info.all_syms = all_syms;
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_count_sym);
+    plan = yasm_symtab_export_plan(object->symtab, object, 1,
+                                   coff_objfmt_select_sym, &info);
     symtab_count = info.indx;
 
+    /* Render section contents in parallel if requested.  Standard COFF
+     * simplifies shared COMMON size expressions while outputting values, so
+     * only Win32/Win64 sections are rendered concurrently.
+     */
+    if (objfmt_coff->win32)
+        yasm_object_render_sections(object, errwarns, &info,
+                                    coff_objfmt_render_section);
+
     /* Section data/relocs */
     info.addr = 0;
     if (yasm_object_sections_traverse(object, &info,
-                                      coff_objfmt_output_section))
+                                      coff_objfmt_output_section)) {
+        yasm_symexport_plan_destroy(plan);
         return;
+    }
 
     /* Symbol table */
     pos = ftell(f);
@@ -1195,12 +1196,22 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         return;
     }
     symtab_pos = (unsigned long)pos;
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_output_sym);
+    info.strtab_max = plan->names_len + 1;
+    info.strtab = yasm_xmalloc(info.strtab_max);
+    info.strtab_len = 0;
+    symbuf = yasm_xmalloc(18*symtab_count);
+    localbuf = symbuf;
+    for (i=0; i<plan->num; i++)
+        localbuf = coff_objfmt_output_sym(&plan->syms[i], &info, localbuf);
+    fwrite(symbuf, 18, symtab_count, f);
+    yasm_xfree(symbuf);
+    yasm_symexport_plan_destroy(plan);
 
     /* String table */
     yasm_fwrite_32_l(info.strtab_offset, f); /* total length */
     yasm_object_sections_traverse(object, &info, coff_objfmt_output_sectstr);
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_output_str);
+    fwrite(info.strtab, info.strtab_len, 1, f);
+    yasm_xfree(info.strtab);
 
     /* Write headers */
     if (fseek(f, 0, SEEK_SET) < 0) {
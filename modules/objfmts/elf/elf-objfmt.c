@@ -51,6 +51,9 @@
 typedef struct yasm_objfmt_elf {
     yasm_objfmt_base objfmt;            /* base structure */
 
+    const elf_machine_handler *elf_march;   /* machine handler */
+    /*@null@*/ /*@only@*/ yasm_symrec **ssyms;  /* "special" syms */
+
     elf_symtab_head* elf_symtab;        /* symbol table of indexed syms */
     elf_strtab_head* shstrtab;          /* section name strtab */
     elf_strtab_head* strtab;            /* strtab entries */
@@ -356,13 +359,15 @@ elf_objfmt_create_common(yasm_object *object, yasm_objfmt_module *module,
     const elf_machine_handler *elf_march;
 
     objfmt_elf->objfmt.module = module;
-    elf_march = elf_set_arch(object->arch, object->symtab, bits_pref);
+    elf_march = elf_set_arch(object->arch, bits_pref);
     if (!elf_march) {
         yasm_xfree(objfmt_elf);
         return NULL;
     }
     if (elf_march_out)
         *elf_march_out = elf_march;
+    objfmt_elf->elf_march = elf_march;
+    objfmt_elf->ssyms = elf_define_special_syms(elf_march, object->symtab);
 
     objfmt_elf->shstrtab = elf_strtab_create();
     objfmt_elf->strtab = elf_strtab_create();
@@ -457,22 +462,21 @@ elf_objfmt_output_reloc(yasm_symrec *sym, yasm_bytecode *bc,
                         unsigned char *buf, unsigned int destsize,
                         unsigned int valsize, int warn, void *d)
 {
-    elf_reloc_entry *reloc;
+    elf_reloc_entry reloc;
     elf_objfmt_output_info *info = d;
     yasm_intnum *zero;
     int retval;
 
-    reloc = elf_reloc_entry_create(sym, NULL,
-        yasm_intnum_create_uint(bc->offset), 0, valsize, 0);
-    if (reloc == NULL) {
+    if (!elf_reloc_entry_init(info->objfmt_elf->elf_march, &reloc, sym, NULL,
+                              bc->offset, 0, valsize, 0)) {
         yasm_error_set(YASM_ERROR_TYPE, N_("elf: invalid relocation size"));
         return 1;
     }
-    /* allocate .rel[a] sections on a need-basis */
-    elf_secthead_append_reloc(info->sect, info->shead, reloc);
 
     zero = yasm_intnum_create_uint(0);
-    elf_handle_reloc_addend(zero, reloc, 0);
+    elf_handle_reloc_addend(info->objfmt_elf->elf_march, zero, &reloc, 0);
+    /* allocate .rel[a] sections on a need-basis */
+    elf_secthead_append_reloc(info->sect, info->shead, &reloc);
     retval = yasm_arch_intnum_tobytes(info->object->arch, zero, buf, destsize,
                                       valsize, 0, bc, warn);
     yasm_intnum_destroy(zero);
@@ -487,6 +491,7 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
     /*@null@*/ elf_objfmt_output_info *info = (elf_objfmt_output_info *)d;
     /*@dependent@*/ /*@null@*/ yasm_intnum *intn;
     unsigned long intn_val;
+    elf_reloc_entry reloc_entry;
     /*@null@*/ elf_reloc_entry *reloc = NULL;
     int retval;
     unsigned int valsize = value->size;
@@ -556,16 +561,15 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
             intn_val += offset;
 
         /* Check for _GLOBAL_OFFSET_TABLE_ symbol reference */
-        reloc = elf_reloc_entry_create(sym, wrt,
-            yasm_intnum_create_uint(bc->offset + offset), value->curpos_rel,
-            valsize, sym == info->GOT_sym);
-        if (reloc == NULL) {
+        if (!elf_reloc_entry_init(info->objfmt_elf->elf_march, &reloc_entry,
+                                  sym, wrt, bc->offset + offset,
+                                  value->curpos_rel, valsize,
+                                  sym == info->GOT_sym)) {
             yasm_error_set(YASM_ERROR_TYPE,
                            N_("elf: invalid relocation (WRT or size)"));
             return 1;
         }
-        /* allocate .rel[a] sections on a need-basis */
-        elf_secthead_append_reloc(info->sect, info->shead, reloc);
+        reloc = &reloc_entry;
     }
 
     intn = yasm_intnum_create_uint(intn_val);
@@ -581,8 +585,12 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
         yasm_intnum_calc(intn, YASM_EXPR_ADD, intn2);
     }
 
-    if (reloc)
-        elf_handle_reloc_addend(intn, reloc, offset);
+    if (reloc) {
+        elf_handle_reloc_addend(info->objfmt_elf->elf_march, intn, reloc,
+                                offset);
+        /* allocate .rel[a] sections on a need-basis */
+        elf_secthead_append_reloc(info->sect, info->shead, reloc);
+    }
     retval = yasm_arch_intnum_tobytes(info->object->arch, intn, buf, destsize,
                                       valsize, 0, bc, warn);
     yasm_intnum_destroy(intn);
@@ -618,17 +626,9 @@ elf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(buf, 0, 256);
-        left = size;
-        while (left > 256) {
-            fwrite(buf, 256, 1, info->f);
-            left -= 256;
-        }
-        fwrite(buf, left, 1, info->f);
+        yasm_fwrite_zeros(size, info->f);
     } else {
         /* Output buf (or bigbuf if non-NULL) to file */
         fwrite(bigbuf ? bigbuf : buf, (size_t)size, 1, info->f);
@@ -641,6 +641,35 @@ elf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
     return 0;
 }
 
+static int
+elf_objfmt_render_section(yasm_section *sect, FILE *f,
+                          yasm_errwarns *errwarns, /*@null@*/ void *d)
+{
+    /*@null@*/ elf_objfmt_output_info *pinfo = (elf_objfmt_output_info *)d;
+    elf_objfmt_output_info info;
+    /*@dependent@*/ /*@null@*/ elf_secthead *shead;
+
+    if (pinfo == NULL)
+        yasm_internal_error("null info struct");
+    shead = yasm_section_get_data(sect, &elf_section_data);
+    if (shead == NULL)
+        yasm_internal_error("no associated data");
+
+    /* header-only sections have no contents */
+    if ((elf_secthead_get_type(shead) & SHT_NOBITS) == SHT_NOBITS)
+        return 1;
+
+    /* May run concurrently with other sections; use a private copy */
+    info = *pinfo;
+    info.errwarns = errwarns;
+    info.f = f;
+    info.sect = sect;
+    info.shead = shead;
+    yasm_section_bcs_traverse(sect, errwarns, &info,
+                              elf_objfmt_output_bytecode);
+    return 0;
+}
+
 static int
 elf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 {
@@ -686,20 +715,22 @@ elf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 
     info->sect = sect;
     info->shead = shead;
-    yasm_section_bcs_traverse(sect, info->errwarns, info,
-                              elf_objfmt_output_bytecode);
+    yasm_section_output(sect, info->f, info->errwarns, info,
+                        elf_objfmt_output_bytecode);
 
     elf_secthead_set_index(shead, ++info->sindex);
 
     /* No relocations to output?  Go on to next section */
-    if (elf_secthead_write_relocs_to_file(info->f, sect, shead,
+    if (elf_secthead_write_relocs_to_file(info->objfmt_elf->elf_march,
+                                          info->f, sect, shead,
                                           info->errwarns) == 0)
         return 0;
     elf_secthead_set_rel_index(shead, ++info->sindex);
 
     /* name the relocation section .rel[a].foo */
     sectname = yasm_section_get_name(sect);
-    relname = elf_secthead_name_reloc_section(sectname);
+    relname = elf_secthead_name_reloc_section(info->objfmt_elf->elf_march,
+                                              sectname);
     elf_secthead_set_rel_name(shead,
         elf_strtab_append_str(info->objfmt_elf->shstrtab, relname));
     yasm_xfree(relname);
@@ -719,14 +750,15 @@ elf_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
     if (shead == NULL)
         yasm_internal_error("no section header attached to section");
 
-    if(elf_secthead_write_to_file(info->f, shead, info->sindex+1))
+    if(elf_secthead_write_to_file(info->objfmt_elf->elf_march, info->f, shead,
+                                  info->sindex+1))
         info->sindex++;
 
     /* output strtab headers here? */
 
     /* relocation entries for .foo are stored in section .rel[a].foo */
-    if(elf_secthead_write_rel_to_file(info->f, 3, sect, shead,
-                                      info->sindex+1))
+    if(elf_secthead_write_rel_to_file(info->objfmt_elf->elf_march, info->f, 3,
+                                      sect, shead, info->sindex+1))
         info->sindex++;
 
     return 0;
@@ -737,6 +769,7 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
                   yasm_errwarns *errwarns)
 {
     yasm_objfmt_elf *objfmt_elf = (yasm_objfmt_elf *)object->objfmt;
+    const elf_machine_handler *elf_march = objfmt_elf->elf_march;
     elf_objfmt_output_info info;
     build_symtab_info buildsym_info;
     long pos;
@@ -758,7 +791,7 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
                              object->src_filename);
 
     /* Allocate space for Ehdr by seeking forward */
-    if (fseek(f, (long)(elf_proghead_get_size()), SEEK_SET) < 0) {
+    if (fseek(f, (long)(elf_proghead_get_size(elf_march)), SEEK_SET) < 0) {
         yasm_error_set(YASM_ERROR_IO, N_("could not seek on output file"));
         yasm_errwarn_propagate(errwarns, 0);
         return;
@@ -774,6 +807,10 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
                          elf_objfmt_build_symtab);
     elf_symtab_nlocal = elf_symtab_assign_indices(objfmt_elf->elf_symtab);
 
+    /* render section contents in parallel if requested */
+    yasm_object_render_sections(object, errwarns, &info,
+                                elf_objfmt_render_section);
+
     /* output known sections - includes reloc sections which aren't in yasm's
      * list.  Assign indices as we go. */
     info.sindex = 3;
@@ -809,7 +846,8 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         return;
     }
     elf_symtab_offset = (unsigned long) pos;
-    elf_symtab_size = elf_symtab_write_to_file(f, objfmt_elf->elf_symtab,
+    elf_symtab_size = elf_symtab_write_to_file(elf_march, f,
+                                               objfmt_elf->elf_symtab,
                                                errwarns);
 
     /* output section header table */
@@ -840,29 +878,29 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     /* output dummy section header - 0 */
     info.sindex = 0;
 
-    esdn = elf_secthead_create(NULL, SHT_NULL, 0, 0, 0);
+    esdn = elf_secthead_create(elf_march, NULL, SHT_NULL, 0, 0, 0);
     elf_secthead_set_index(esdn, 0);
-    elf_secthead_write_to_file(f, esdn, 0);
+    elf_secthead_write_to_file(elf_march, f, esdn, 0);
     elf_secthead_destroy(esdn);
 
-    esdn = elf_secthead_create(elf_shstrtab_name, SHT_STRTAB, 0,
+    esdn = elf_secthead_create(elf_march, elf_shstrtab_name, SHT_STRTAB, 0,
                                elf_shstrtab_offset, elf_shstrtab_size);
     elf_secthead_set_index(esdn, 1);
-    elf_secthead_write_to_file(f, esdn, 1);
+    elf_secthead_write_to_file(elf_march, f, esdn, 1);
     elf_secthead_destroy(esdn);
 
-    esdn = elf_secthead_create(elf_strtab_name, SHT_STRTAB, 0,
+    esdn = elf_secthead_create(elf_march, elf_strtab_name, SHT_STRTAB, 0,
                                elf_strtab_offset, elf_strtab_size);
     elf_secthead_set_index(esdn, 2);
-    elf_secthead_write_to_file(f, esdn, 2);
+    elf_secthead_write_to_file(elf_march, f, esdn, 2);
     elf_secthead_destroy(esdn);
 
-    esdn = elf_secthead_create(elf_symtab_name, SHT_SYMTAB, 0,
+    esdn = elf_secthead_create(elf_march, elf_symtab_name, SHT_SYMTAB, 0,
                                elf_symtab_offset, elf_symtab_size);
     elf_secthead_set_index(esdn, 3);
     elf_secthead_set_info(esdn, elf_symtab_nlocal);
     elf_secthead_set_link(esdn, 2);     /* for .strtab, which is index 2 */
-    elf_secthead_write_to_file(f, esdn, 3);
+    elf_secthead_write_to_file(elf_march, f, esdn, 3);
     elf_secthead_destroy(esdn);
 
     info.sindex = 3;
@@ -876,7 +914,7 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         return;
     }
 
-    elf_proghead_write_to_file(f, elf_shead_addr, info.sindex+1, 1);
+    elf_proghead_write_to_file(elf_march, f, elf_shead_addr, info.sindex+1, 1);
 }
 
 static void
@@ -886,6 +924,8 @@ elf_objfmt_destroy(yasm_objfmt *objfmt)
     elf_symtab_destroy(objfmt_elf->elf_symtab);
     elf_strtab_destroy(objfmt_elf->shstrtab);
     elf_strtab_destroy(objfmt_elf->strtab);
+    if (objfmt_elf->ssyms)
+        yasm_xfree(objfmt_elf->ssyms);
     yasm_xfree(objfmt);
 }
 
@@ -909,7 +949,7 @@ elf_objfmt_init_new_section(yasm_section *sect, unsigned long line)
         type = SHT_STRTAB;
     }
 
-    esd = elf_secthead_create(name, type, 0, 0, 0);
+    esd = elf_secthead_create(objfmt_elf->elf_march, name, type, 0, 0, 0);
     elf_secthead_set_entsize(esd, entsize);
     yasm_section_add_data(sect, &elf_section_data, esd);
     sym = yasm_symtab_define_label(object->symtab, sectname,
@@ -1140,11 +1180,12 @@ static /*@observer@*/ /*@null@*/ yasm_symrec *
 elf_objfmt_get_special_sym(yasm_object *object, const char *name,
                            const char *parser)
 {
-    if (yasm__strcasecmp(name, "sym") == 0) {
-        yasm_objfmt_elf *objfmt_elf = (yasm_objfmt_elf *)object->objfmt;
+    yasm_objfmt_elf *objfmt_elf = (yasm_objfmt_elf *)object->objfmt;
+
+    if (yasm__strcasecmp(name, "sym") == 0)
         return objfmt_elf->dotdotsym;
-    }
-    return elf_get_special_sym(name, parser);
+    return elf_get_special_sym(objfmt_elf->elf_march, objfmt_elf->ssyms,
+                               name, parser);
 }
 
 static void
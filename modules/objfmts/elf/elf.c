@@ -66,16 +66,12 @@ static const elf_machine_handler *elf_machine_handlers[] =
     &elf_machine_handler_x86_x32,
     NULL
 };
-static const elf_machine_handler elf_null_machine = {0, 0, 0, 0, 0, 0, 0, 0,
-                                                     0, 0, 0, 0, 0, 0, 0, 0,
-                                                     0, 0, 0};
-static elf_machine_handler const *elf_march = &elf_null_machine;
-static yasm_symrec **elf_ssyms;
 
 const elf_machine_handler *
-elf_set_arch(yasm_arch *arch, yasm_symtab *symtab, int bits_pref)
+elf_set_arch(yasm_arch *arch, int bits_pref)
 {
     const char *machine = yasm_arch_get_machine(arch);
+    const elf_machine_handler *elf_march;
     int i;
 
     for (i=0, elf_march = elf_machine_handlers[0];
@@ -93,32 +89,40 @@ elf_set_arch(yasm_arch *arch, yasm_symtab *symtab, int bits_pref)
         }
     }
 
-    if (elf_march && elf_march->num_ssyms > 0)
+    return elf_march;
+}
+
+yasm_symrec **
+elf_define_special_syms(const elf_machine_handler *elf_march,
+                        yasm_symtab *symtab)
+{
+    yasm_symrec **ssyms;
+    size_t i;
+
+    if (elf_march->num_ssyms == 0)
+        return NULL;
+
+    ssyms = yasm_xmalloc(elf_march->num_ssyms * sizeof(yasm_symrec *));
+    for (i=0; i<elf_march->num_ssyms; i++)
     {
-        /* Allocate "special" syms */
-        elf_ssyms =
-            yasm_xmalloc(elf_march->num_ssyms * sizeof(yasm_symrec *));
-        for (i=0; (unsigned int)i<elf_march->num_ssyms; i++)
-        {
-            /* FIXME: misuse of NULL bytecode */
-            elf_ssyms[i] = yasm_symtab_define_label(symtab,
-                                                    elf_march->ssyms[i].name,
-                                                    NULL, 0, 0);
-            yasm_symrec_add_data(elf_ssyms[i], &elf_ssym_symrec_data,
-                                 (void*)&elf_march->ssyms[i]);
-        }
+        /* FIXME: misuse of NULL bytecode */
+        ssyms[i] = yasm_symtab_define_label(symtab, elf_march->ssyms[i].name,
+                                            NULL, 0, 0);
+        yasm_symrec_add_data(ssyms[i], &elf_ssym_symrec_data,
+                             (void*)&elf_march->ssyms[i]);
     }
-
-    return elf_march;
+    return ssyms;
 }
 
 yasm_symrec *
-elf_get_special_sym(const char *name, const char *parser)
+elf_get_special_sym(const elf_machine_handler *elf_march,
+                    yasm_symrec **ssyms, const char *name,
+                    const char *parser)
 {
-    int i;
-    for (i=0; (unsigned int)i<elf_march->num_ssyms; i++) {
+    size_t i;
+    for (i=0; i<elf_march->num_ssyms; i++) {
         if (yasm__strcasecmp(name, elf_march->ssyms[i].name) == 0)
-            return elf_ssyms[i];
+            return ssyms[i];
     }
     return NULL;
 }
@@ -141,39 +145,32 @@ elf_is_wrt_pos_adjusted(yasm_symrec *wrt)
 int
 elf_ssym_has_flag(yasm_symrec *wrt, int flag)
 {
-    int i;
-    for (i=0; (unsigned int)i<elf_march->num_ssyms; i++) {
-        if (elf_ssyms[i] == wrt)
-            return (elf_march->ssyms[i].sym_rel & flag) != 0;
-    }
-    return 0;
+    const elf_machine_ssym *ssym =
+        yasm_symrec_get_data(wrt, &elf_ssym_symrec_data);
+    return ssym && (ssym->sym_rel & flag) != 0;
 }
 
 /* takes ownership of addr */
-elf_reloc_entry *
-elf_reloc_entry_create(yasm_symrec *sym,
-                       yasm_symrec *wrt,
-                       yasm_intnum *addr,
-                       int rel,
-                       size_t valsize,
-                       int is_GOT_sym)
+/* Returns zero if the machine does not accept the relocation. */
+int
+elf_reloc_entry_init(const elf_machine_handler *elf_march,
+                     elf_reloc_entry *entry,
+                     yasm_symrec *sym,
+                     yasm_symrec *wrt,
+                     unsigned long addr,
+                     int rel,
+                     size_t valsize,
+                     int is_GOT_sym)
 {
-    elf_reloc_entry *entry;
-
     if (!elf_march->accepts_reloc)
         yasm_internal_error(N_("Unsupported machine for ELF output"));
 
     if (!elf_march->accepts_reloc(valsize, wrt))
-    {
-        if (addr)
-            yasm_intnum_destroy(addr);
-        return NULL;
-    }
+        return 0;
 
     if (sym == NULL)
         yasm_internal_error("sym is null");
 
-    entry = yasm_xmalloc(sizeof(elf_reloc_entry));
     entry->reloc.sym = sym;
     entry->reloc.addr = addr;
     entry->rtype_rel = rel;
@@ -182,7 +179,7 @@ elf_reloc_entry_create(yasm_symrec *sym,
     entry->wrt = wrt;
     entry->is_GOT_sym = is_GOT_sym;
 
-    return entry;
+    return 1;
 }
 
 void
@@ -190,7 +187,6 @@ elf_reloc_entry_destroy(void *entry)
 {
     if (((elf_reloc_entry*)entry)->addend)
         yasm_intnum_destroy(((elf_reloc_entry*)entry)->addend);
-    yasm_xfree(entry);
 }
 
 /* strtab functions */
@@ -277,18 +273,23 @@ elf_strtab_destroy(elf_strtab_head *strtab)
 unsigned long
 elf_strtab_output_to_file(FILE *f, elf_strtab_head *strtab)
 {
-    unsigned long size = 0;
-    elf_strtab_entry *entry;
+    unsigned long size;
+    unsigned char *buf;
+    elf_strtab_entry *entry, *last;
 
     if (strtab == NULL)
         yasm_internal_error("strtab is null");
 
+    /* Indexes are assigned sequentially, so the last entry gives the size */
+    last = STAILQ_LAST(strtab, elf_strtab_entry, qlink);
+    size = last->index + (unsigned long)strlen(last->str) + 1;
+
     /* consider optimizing tables here */
-    STAILQ_FOREACH(entry, strtab, qlink) {
-        size_t len = 1 + strlen(entry->str);
-        fwrite(entry->str, len, 1, f);
-        size += (unsigned long)len;
-    }
+    buf = yasm_xmalloc(size);
+    STAILQ_FOREACH(entry, strtab, qlink)
+        strcpy((char *)buf + entry->index, entry->str);
+    fwrite(buf, size, 1, f);
+    yasm_xfree(buf);
     return size;
 }
 
@@ -465,20 +466,27 @@ elf_symtab_assign_indices(elf_symtab_head *symtab)
 }
 
 unsigned long
-elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
-                         yasm_errwarns *errwarns)
+elf_symtab_write_to_file(const elf_machine_handler *elf_march, FILE *f,
+                         elf_symtab_head *symtab, yasm_errwarns *errwarns)
 {
-    unsigned char buf[SYMTAB_MAXSIZE], *bufp;
+    unsigned char *buf, *bufp;
     elf_symtab_entry *entry;
-    unsigned long size = 0;
+    unsigned long size = 0, count = 0;
 
     if (!symtab)
         yasm_internal_error(N_("symtab is null"));
+    if (!elf_march->write_symtab_entry || !elf_march->symtab_entry_size)
+        yasm_internal_error(N_("Unsupported machine for ELF output"));
+
+    /* Format the whole table into one buffer */
+    STAILQ_FOREACH(entry, symtab, qlink)
+        count++;
+    buf = yasm_xmalloc(count * elf_march->symtab_entry_size);
+    bufp = buf;
 
     STAILQ_FOREACH(entry, symtab, qlink) {
 
         yasm_intnum *size_intn=NULL, *value_intn=NULL;
-        bufp = buf;
 
         /* get size (if specified); expr overrides stored integer */
         if (entry->xsize) {
@@ -529,15 +537,15 @@ elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
             }
         }
 
-        if (!elf_march->write_symtab_entry || !elf_march->symtab_entry_size)
-            yasm_internal_error(N_("Unsupported machine for ELF output"));
         elf_march->write_symtab_entry(bufp, entry, value_intn, size_intn);
-        fwrite(buf, elf_march->symtab_entry_size, 1, f);
+        bufp += elf_march->symtab_entry_size;
         size += elf_march->symtab_entry_size;
 
         yasm_intnum_destroy(size_intn);
         yasm_intnum_destroy(value_intn);
     }
+    fwrite(buf, size, 1, f);
+    yasm_xfree(buf);
     return size;
 }
 
@@ -589,7 +597,8 @@ elf_sym_in_table(elf_symtab_entry *entry)
 }
 
 elf_secthead *
-elf_secthead_create(elf_strtab_entry    *name,
+elf_secthead_create(const elf_machine_handler *elf_march,
+                    elf_strtab_entry    *name,
                     elf_section_type     type,
                     elf_section_flags    flags,
                     elf_address          offset,
@@ -669,8 +678,8 @@ elf_secthead_print(void *data, FILE *f, int indent_level)
 }
 
 unsigned long
-elf_secthead_write_to_file(FILE *f, elf_secthead *shead,
-                           elf_section_index sindex)
+elf_secthead_write_to_file(const elf_machine_handler *elf_march, FILE *f,
+                           elf_secthead *shead, elf_section_index sindex)
 {
     unsigned char buf[SHDR_MAXSIZE], *bufp = buf;
     shead->index = sindex;
@@ -699,11 +708,13 @@ elf_secthead_append_reloc(yasm_section *sect, elf_secthead *shead,
         yasm_internal_error("reloc is null");
 
     shead->nreloc++;
-    yasm_section_add_reloc(sect, (yasm_reloc *)reloc, elf_reloc_entry_destroy);
+    yasm_section_add_reloc(sect, &reloc->reloc, sizeof(elf_reloc_entry),
+                           elf_reloc_entry_destroy);
 }
 
 char *
-elf_secthead_name_reloc_section(const char *basesect)
+elf_secthead_name_reloc_section(const elf_machine_handler *elf_march,
+                                const char *basesect)
 {
     if (!elf_march->reloc_section_prefix)
     {
@@ -721,7 +732,8 @@ elf_secthead_name_reloc_section(const char *basesect)
 }
 
 void
-elf_handle_reloc_addend(yasm_intnum *intn,
+elf_handle_reloc_addend(const elf_machine_handler *elf_march,
+                        yasm_intnum *intn,
                         elf_reloc_entry *reloc,
                         unsigned long offset)
 {
@@ -731,7 +743,8 @@ elf_handle_reloc_addend(yasm_intnum *intn,
 }
 
 unsigned long
-elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab_idx,
+elf_secthead_write_rel_to_file(const elf_machine_handler *elf_march,
+                               FILE *f, elf_section_index symtab_idx,
                                yasm_section *sect, elf_secthead *shead,
                                elf_section_index sindex)
 {
@@ -755,12 +768,13 @@ elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab_idx,
 }
 
 unsigned long
-elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
+elf_secthead_write_relocs_to_file(const elf_machine_handler *elf_march,
+                                  FILE *f, yasm_section *sect,
                                   elf_secthead *shead, yasm_errwarns *errwarns)
 {
     elf_reloc_entry *reloc;
-    unsigned char buf[RELOC_MAXSIZE], *bufp;
-    unsigned long size = 0;
+    /*@only@*/ unsigned char *buf, *bufp;
+    unsigned long size;
     long pos;
 
     if (shead == NULL)
@@ -770,6 +784,10 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
     if (!reloc)
         return 0;
 
+    if (!elf_march->map_reloc_info_to_type || !elf_march->write_reloc ||
+        !elf_march->reloc_entry_size)
+        yasm_internal_error(N_("Unsupported arch/machine for elf output"));
+
     /* first align section to multiple of 4 */
     pos = ftell(f);
     if (pos == -1) {
@@ -784,7 +802,10 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
     }
     shead->rel_offset = (unsigned long)pos;
 
-
+    /* Format all entries into one buffer and write them at once */
+    size = yasm_section_num_relocs(sect) * elf_march->reloc_entry_size;
+    buf = yasm_xmalloc(size);
+    bufp = buf;
     while (reloc) {
         unsigned int r_type=0, r_sym;
         elf_symtab_entry *esym;
@@ -795,20 +816,15 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
         else
             r_sym = STN_UNDEF;
 
-        if (!elf_march->map_reloc_info_to_type)
-            yasm_internal_error(N_("Unsupported arch/machine for elf output"));
         r_type = elf_march->map_reloc_info_to_type(reloc);
-
-        bufp = buf;
-        if (!elf_march->write_reloc || !elf_march->reloc_entry_size)
-            yasm_internal_error(N_("Unsupported arch/machine for elf output"));
         elf_march->write_reloc(bufp, reloc, r_type, r_sym);
-        fwrite(buf, elf_march->reloc_entry_size, 1, f);
-        size += elf_march->reloc_entry_size;
+        bufp += elf_march->reloc_entry_size;
 
         reloc = (elf_reloc_entry *)
-            yasm_section_reloc_next((yasm_reloc *)reloc);
+            yasm_section_reloc_next(sect, (yasm_reloc *)reloc);
     }
+    fwrite(buf, size, 1, f);
+    yasm_xfree(buf);
     return size;
 }
 
@@ -925,7 +941,7 @@ elf_secthead_set_file_offset(elf_secthead *shead, long pos)
 }
 
 unsigned long
-elf_proghead_get_size(void)
+elf_proghead_get_size(const elf_machine_handler *elf_march)
 {
     if (!elf_march->proghead_size)
         yasm_internal_error(N_("Unsupported ELF format for output"));
@@ -933,7 +949,8 @@ elf_proghead_get_size(void)
 }
 
 unsigned long
-elf_proghead_write_to_file(FILE *f,
+elf_proghead_write_to_file(const elf_machine_handler *elf_march,
+                           FILE *f,
                            elf_offset secthead_addr,
                            unsigned long secthead_count,
                            elf_section_index shstrtab_index)
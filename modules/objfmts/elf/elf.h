@@ -385,15 +385,6 @@ struct elf_secthead {
  *     info -> 0
  */
 
-struct elf_reloc_entry {
-    yasm_reloc           reloc;
-    int                  rtype_rel;
-    size_t               valsize;
-    yasm_intnum         *addend;
-    /*@null@*/ yasm_symrec *wrt;
-    int                  is_GOT_sym;
-};
-
 STAILQ_HEAD(elf_strtab_head, elf_strtab_entry);
 struct elf_strtab_entry {
     STAILQ_ENTRY(elf_strtab_entry) qlink;
@@ -420,26 +411,43 @@ struct elf_symtab_entry {
 
 #endif /* defined(YASM_OBJFMT_ELF_INTERNAL) */
 
+/* Public so callers can build an entry on the stack before it is copied
+ * into the section's relocation array.
+ */
+struct elf_reloc_entry {
+    yasm_reloc           reloc;
+    int                  rtype_rel;
+    size_t               valsize;
+    yasm_intnum         *addend;
+    /*@null@*/ yasm_symrec *wrt;
+    int                  is_GOT_sym;
+};
+
 extern const yasm_assoc_data_callback elf_section_data;
 extern const yasm_assoc_data_callback elf_symrec_data;
 extern const yasm_assoc_data_callback elf_ssym_symrec_data;
 
 
 const elf_machine_handler *elf_set_arch(struct yasm_arch *arch,
-                                        yasm_symtab *symtab,
                                         int bits_pref);
 
-yasm_symrec *elf_get_special_sym(const char *name, const char *parser);
+/*@null@*/ /*@only@*/ yasm_symrec **elf_define_special_syms
+    (const elf_machine_handler *elf_march, yasm_symtab *symtab);
+yasm_symrec *elf_get_special_sym(const elf_machine_handler *elf_march,
+                                 yasm_symrec **ssyms, const char *name,
+                                 const char *parser);
 
 /* reloc functions */
 int elf_is_wrt_sym_relative(yasm_symrec *wrt);
 int elf_is_wrt_pos_adjusted(yasm_symrec *wrt);
-elf_reloc_entry *elf_reloc_entry_create(yasm_symrec *sym,
-                                        /*@null@*/ yasm_symrec *wrt,
-                                        yasm_intnum *addr,
-                                        int rel,
-                                        size_t valsize,
-                                        int is_GOT_sym);
+int elf_reloc_entry_init(const elf_machine_handler *elf_march,
+                         /*@out@*/ elf_reloc_entry *entry,
+                         yasm_symrec *sym,
+                         /*@null@*/ yasm_symrec *wrt,
+                         unsigned long addr,
+                         int rel,
+                         size_t valsize,
+                         int is_GOT_sym);
 void elf_reloc_entry_destroy(void *entry);
 
 /* strtab functions */
@@ -459,7 +467,8 @@ void elf_symtab_insert_local_sym(elf_symtab_head *symtab,
                                  elf_symtab_entry *entry);
 void elf_symtab_destroy(elf_symtab_head *head);
 unsigned long elf_symtab_assign_indices(elf_symtab_head *symtab);
-unsigned long elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
+unsigned long elf_symtab_write_to_file(const elf_machine_handler *elf_march,
+                                       FILE *f, elf_symtab_head *symtab,
                                        yasm_errwarns *errwarns);
 void elf_symtab_set_nonzero(elf_symtab_entry    *entry,
                             struct yasm_section *sect,
@@ -475,13 +484,15 @@ void elf_sym_set_size(elf_symtab_entry *entry, struct yasm_expr *size);
 int elf_sym_in_table(elf_symtab_entry *entry);
 
 /* section header functions */
-elf_secthead *elf_secthead_create(elf_strtab_entry      *name,
+elf_secthead *elf_secthead_create(const elf_machine_handler *elf_march,
+                                  elf_strtab_entry      *name,
                                   elf_section_type      type,
                                   elf_section_flags     flags,
                                   elf_address           offset,
                                   elf_size              size);
 void elf_secthead_destroy(elf_secthead *esd);
-unsigned long elf_secthead_write_to_file(FILE *f, elf_secthead *esd,
+unsigned long elf_secthead_write_to_file(const elf_machine_handler *elf_march,
+                                         FILE *f, elf_secthead *esd,
                                          elf_section_index sindex);
 void elf_secthead_append_reloc(yasm_section *sect, elf_secthead *shead,
                                elf_reloc_entry *reloc);
@@ -507,24 +518,26 @@ elf_size elf_secthead_set_entsize(elf_secthead *shead, elf_size size);
 struct yasm_symrec *elf_secthead_set_sym(elf_secthead *shead,
                                          struct yasm_symrec *sym);
 void elf_secthead_add_size(elf_secthead *shead, yasm_intnum *size);
-char *elf_secthead_name_reloc_section(const char *basesect);
-void elf_handle_reloc_addend(yasm_intnum *intn,
+char *elf_secthead_name_reloc_section(const elf_machine_handler *elf_march,
+                                      const char *basesect);
+void elf_handle_reloc_addend(const elf_machine_handler *elf_march,
+                             yasm_intnum *intn,
                              elf_reloc_entry *reloc,
                              unsigned long offset);
-unsigned long elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab,
-                                             yasm_section *sect,
-                                             elf_secthead *esd,
-                                             elf_section_index sindex);
-unsigned long elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
-                                                elf_secthead *shead,
-                                                yasm_errwarns *errwarns);
+unsigned long elf_secthead_write_rel_to_file
+    (const elf_machine_handler *elf_march, FILE *f, elf_section_index symtab,
+     yasm_section *sect, elf_secthead *esd, elf_section_index sindex);
+unsigned long elf_secthead_write_relocs_to_file
+    (const elf_machine_handler *elf_march, FILE *f, yasm_section *sect,
+     elf_secthead *shead, yasm_errwarns *errwarns);
 long elf_secthead_set_file_offset(elf_secthead *shead, long pos);
 
 /* program header function */
 unsigned long
-elf_proghead_get_size(void);
+elf_proghead_get_size(const elf_machine_handler *elf_march);
 unsigned long
-elf_proghead_write_to_file(FILE *f,
+elf_proghead_write_to_file(const elf_machine_handler *elf_march,
+                           FILE *f,
                            elf_offset secthead_addr,
                            unsigned long secthead_count,
                            elf_section_index shstrtab_index);
@@ -276,7 +276,6 @@ typedef struct macho_section_data {
 typedef struct macho_symrec_data {
     unsigned long index;        /* index in output order */
     yasm_intnum *value;         /* valid after writing symtable to file */
-    unsigned long length;       /* length + 1 (plus auto underscore) */
 } macho_symrec_data;
 
 
@@ -310,10 +309,8 @@ typedef struct macho_objfmt_output_info {
     unsigned long rel_base;     /* first relocation in file */
     unsigned long s_reloff;     /* in-file offset to relocations */
 
-    unsigned long indx;         /* current symbol size in bytes (name length+1) */
     unsigned long symindex;     /* current symbol index in output order */
     int all_syms;               /* outputting all symbols? */
-    unsigned long strlength;    /* length of all strings */
 } macho_objfmt_output_info;
 
 
@@ -413,6 +410,7 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
     unsigned long intn_minus = 0, intn_plus = 0;
     int retval;
     unsigned int valsize = value->size;
+    macho_reloc reloc_entry;
     macho_reloc *reloc = NULL;
 
     assert(info != NULL);
@@ -444,8 +442,9 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
     if (value->rel) {
         yasm_sym_vis vis = yasm_symrec_get_visibility(value->rel);
 
-        reloc = yasm_xcalloc(sizeof(macho_reloc), 1);
-        reloc->reloc.addr = yasm_intnum_create_uint(bc->offset + offset);
+        reloc = &reloc_entry;
+        memset(reloc, 0, sizeof(macho_reloc));
+        reloc->reloc.addr = bc->offset + offset;
         reloc->reloc.sym = value->rel;
         switch (valsize) {
             case 64:
@@ -463,7 +462,6 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
             default:
                 yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                                N_("macho: relocation size unsupported"));
-                yasm_xfree(reloc);
                 return 1;
         }
         reloc->pcrel = 0;
@@ -474,14 +472,12 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
         if (value->rshift > 0) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("macho: shifted relocations not supported"));
-            yasm_xfree(reloc);
             return 1;
         }
 
         if (value->seg_of) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("macho: SEG not supported"));
-            yasm_xfree(reloc);
             return 1;
         }
 
@@ -492,7 +488,6 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
         } else if (value->wrt) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("macho: invalid WRT"));
-            yasm_xfree(reloc);
             return 1;
         }
 
@@ -546,7 +541,8 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
 
         info->msd->nreloc++;
         /*printf("reloc %s type %d ",yasm_symrec_get_name(reloc->reloc.sym),reloc->type);*/
-        yasm_section_add_reloc(info->sect, (yasm_reloc *)reloc, yasm_xfree);
+        yasm_section_add_reloc(info->sect, &reloc->reloc, sizeof(macho_reloc),
+                               NULL);
     }
 
     if (intn_minus <= intn_plus)
@@ -597,18 +593,9 @@ macho_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
-
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
                       N_("uninitialized space: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_fwrite_zeros(size, info->f);
     } else {
         /* Output buf (or bigbuf if non-NULL) to file */
         fwrite(bigbuf ? bigbuf : info->buf, (size_t) size, 1, info->f);
@@ -621,6 +608,35 @@ macho_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
     return 0;
 }
 
+static int
+macho_objfmt_render_section(yasm_section *sect, FILE *f,
+                            yasm_errwarns *errwarns, /*@null@*/ void *d)
+{
+    /*@null@*/ macho_objfmt_output_info *pinfo =
+        (macho_objfmt_output_info *)d;
+    macho_objfmt_output_info info;
+    /*@dependent@*/ /*@null@*/ macho_section_data *msd;
+
+    assert(pinfo != NULL);
+    msd = yasm_section_get_data(sect, &macho_section_data_cb);
+    assert(msd != NULL);
+
+    if (msd->flags & S_ZEROFILL)
+        return 1;
+
+    /* May run concurrently with other sections; use a private copy */
+    info = *pinfo;
+    info.errwarns = errwarns;
+    info.f = f;
+    info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
+    info.sect = sect;
+    info.msd = msd;
+    yasm_section_bcs_traverse(sect, errwarns, &info,
+                              macho_objfmt_output_bytecode);
+    yasm_xfree(info.buf);
+    return 0;
+}
+
 static int
 macho_objfmt_output_section(yasm_section *sect, /*@null@ */ void *d)
 {
@@ -636,8 +652,8 @@ macho_objfmt_output_section(yasm_section *sect, /*@null@ */ void *d)
         /* Output non-BSS sections */
         info->sect = sect;
         info->msd = msd;
-        yasm_section_bcs_traverse(sect, info->errwarns, info,
-                                  macho_objfmt_output_bytecode);
+        yasm_section_output(sect, info->f, info->errwarns, info,
+                            macho_objfmt_output_bytecode);
     }
     return 0;
 }
@@ -648,16 +664,22 @@ macho_objfmt_output_relocs(yasm_section *sect, /*@null@*/ void *d)
     /*@null@*/ macho_objfmt_output_info *info = (macho_objfmt_output_info *)d;
     /*@dependent@*/ /*@null@*/ macho_section_data *msd;
     macho_reloc *reloc;
+    /*@only@*/ unsigned char *buf;
+    unsigned char *localbuf;
 
     reloc = (macho_reloc *)yasm_section_relocs_first(sect);
+    if (!reloc)
+        return 0;
+
+    /* Format all relocations into one buffer and write them at once */
+    buf = yasm_xmalloc(yasm_section_num_relocs(sect)*8);
+    localbuf = buf;
     while (reloc) {
-        unsigned char *localbuf = info->buf;
         /*@null@*/ macho_symrec_data *xsymd;
         unsigned long symnum;
 
         xsymd = yasm_symrec_get_data(reloc->reloc.sym, &macho_symrec_data_cb);
-        yasm_intnum_get_sized(reloc->reloc.addr, localbuf, 4, 32, 0, 0, 0);
-        localbuf += 4;          /* address of relocation */
+        YASM_WRITE_32_L(localbuf, reloc->reloc.addr);   /* address of reloc */
 
         if (reloc->ext)
             symnum = xsymd->index;
@@ -677,9 +699,11 @@ macho_objfmt_output_relocs(yasm_section *sect, /*@null@*/ void *d)
                         (((unsigned long)reloc->length & 3) << 25) |
                         (((unsigned long)reloc->ext & 1) << 27) |
                         (((unsigned long)reloc->type & 0xf) << 28));
-        fwrite(info->buf, 8, 1, info->f);
-        reloc = (macho_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
+        reloc = (macho_reloc *)yasm_section_reloc_next(sect,
+                                                       (yasm_reloc *)reloc);
     }
+    fwrite(buf, (size_t)(localbuf-buf), 1, info->f);
+    yasm_xfree(buf);
 
     return 0;
 }
@@ -791,200 +815,144 @@ macho_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 
 
 static int
-macho_objfmt_count_sym(yasm_symrec *sym, /*@null@*/ void *d)
+macho_objfmt_select_sym(yasm_symrec *sym, yasm_sym_vis vis, void **data,
+                        /*@null@*/ void *d)
 {
     /*@null@*/ macho_objfmt_output_info *info = (macho_objfmt_output_info *)d;
-    /*@only@*/ char *name;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
+    macho_symrec_data *sym_data;
 
     assert(info != NULL);
-    if (info->all_syms ||
-        vis & (YASM_SYM_GLOBAL | YASM_SYM_COMMON | YASM_SYM_EXTERN)) {
-        if (0 == macho_objfmt_is_section_label(sym)) {
-            /* Save index in symrec data */
-            macho_symrec_data *sym_data =
-                yasm_symrec_get_data(sym, &macho_symrec_data_cb);
-            if (!sym_data) {
-                sym_data = yasm_xcalloc(sizeof(macho_symrec_data), 1);
-                yasm_symrec_add_data(sym, &macho_symrec_data_cb, sym_data);
-            }
-            sym_data->index = info->symindex;
-            info->symindex++;
-
-            name = yasm_symrec_get_global_name(sym, info->object);
-            /*printf("%s\n",name); */
-            /* name length + delimiter */
-            sym_data->length = (unsigned long)strlen(name) + 1;
-            info->strlength += sym_data->length;
-            info->indx++;
-            yasm_xfree(name);
-        }
+    if (!(info->all_syms ||
+          vis & (YASM_SYM_GLOBAL | YASM_SYM_COMMON | YASM_SYM_EXTERN)))
+        return -1;
+    if (macho_objfmt_is_section_label(sym))
+        return -1;
+
+    /* Save index in symrec data */
+    sym_data = yasm_symrec_get_data(sym, &macho_symrec_data_cb);
+    if (!sym_data) {
+        sym_data = yasm_xcalloc(sizeof(macho_symrec_data), 1);
+        yasm_symrec_add_data(sym, &macho_symrec_data_cb, sym_data);
     }
+    sym_data->index = info->symindex;
+    info->symindex++;
+
+    *data = sym_data;
     return 0;
 }
 
 
-static int
-macho_objfmt_output_symtable(yasm_symrec *sym, /*@null@*/ void *d)
+/* Format a symbol table (nlist) entry into localbuf; returns the position
+ * following it.
+ */
+static unsigned char *
+macho_objfmt_output_sym(yasm_symexport *export,
+                        macho_objfmt_output_info *info,
+                        unsigned char *localbuf)
 {
-    /*@null@*/ macho_objfmt_output_info *info = (macho_objfmt_output_info *)d;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
+    yasm_symrec *sym = export->sym;
+    yasm_sym_vis vis = export->vis;
+    const yasm_expr *equ_val;
+    const yasm_intnum *intn;
+    unsigned long value = 0;
+    long scnum = -3;        /* -3 = debugging symbol */
+    yasm_intnum *val;
+    unsigned int long_int_bytes = (info->is_64) ? 8 : 4;
+    unsigned int n_type = 0, n_sect = 0, n_desc = 0;
+    macho_symrec_data *symd = export->data;
 
-    assert(info != NULL);
+    val = yasm_intnum_create_uint(0);
 
-    if (info->all_syms ||
-        vis & (YASM_SYM_GLOBAL | YASM_SYM_COMMON | YASM_SYM_EXTERN)) {
-        const yasm_expr *equ_val;
-        const yasm_intnum *intn;
-        unsigned long value = 0;
-        long scnum = -3;        /* -3 = debugging symbol */
-        /*@dependent@*/ /*@null@*/ yasm_section *sect;
-        /*@dependent@*/ /*@null@*/ yasm_bytecode *precbc;
-        unsigned char *localbuf;
-        yasm_intnum *val;
-        unsigned int long_int_bytes = (info->is_64) ? 8 : 4;
-        unsigned int n_type = 0, n_sect = 0, n_desc = 0;
-        macho_symrec_data *symd;
-
-        val = yasm_intnum_create_uint(0);
-
-        symd = yasm_symrec_get_data(sym, &macho_symrec_data_cb);
-
-        /* Look at symrec for value/scnum/etc. */
-        if (yasm_symrec_get_label(sym, &precbc)) {
-            if (precbc)
-                sect = yasm_bc_get_section(precbc);
-            else
-                sect = NULL;
-            /* it's a label: get value and offset.
-             * If there is not a section, leave as debugging symbol.
-             */
-            if (sect) {
-                /*@dependent@*/ /*@null@*/ macho_section_data *msd;
-
-                msd = yasm_section_get_data(sect, &macho_section_data_cb);
-                if (msd) {
-                    if (msd->sym == sym) {
-                        /* don't store section names */
-                        yasm_intnum_destroy(val);
-                        return 0;
-                    }
-                    scnum = msd->scnum;
-                    n_type = N_SECT;
-                } else
-                    yasm_internal_error(N_("didn't understand section"));
-                if (precbc)
-                    value += yasm_bc_next_offset(precbc);
-                /* all values are subject to correction: base offset is first
-                 * raw section, therefore add section offset
-                 */
-                if (msd)
-                    value += msd->vmoff;
-                yasm_intnum_set_uint(val, value);
-                /*printf("%s offset %lx\n",name,value);*/
+    /* Look at symrec for value/scnum/etc. */
+    if (export->sect) {
+        /* it's a label: get value and offset.
+         * If there is not a section, leave as debugging symbol.
+         */
+        /*@dependent@*/ /*@null@*/ macho_section_data *msd;
+
+        msd = yasm_section_get_data(export->sect, &macho_section_data_cb);
+        if (!msd)
+            yasm_internal_error(N_("didn't understand section"));
+        scnum = msd->scnum;
+        n_type = N_SECT;
+        /* all values are subject to correction: base offset is first
+         * raw section, therefore add section offset
+         */
+        value = export->offset + msd->vmoff;
+        yasm_intnum_set_uint(val, value);
+    } else if ((equ_val = yasm_symrec_get_equ(sym))) {
+        yasm_expr *equ_val_copy = yasm_expr_copy(equ_val);
+
+        intn = yasm_expr_get_intnum(&equ_val_copy, 1);
+        if (!intn) {
+            if (vis & YASM_SYM_GLOBAL) {
+                yasm_error_set(YASM_ERROR_NOT_CONSTANT,
+                    N_("global EQU value not an integer expression"));
+                yasm_errwarn_propagate(info->errwarns, equ_val->line);
             }
-        } else if ((equ_val = yasm_symrec_get_equ(sym))) {
-            yasm_expr *equ_val_copy = yasm_expr_copy(equ_val);
+        } else
+            value = yasm_intnum_get_uint(intn);
+        yasm_expr_destroy(equ_val_copy);
+        yasm_intnum_set_uint(val, value);
+        n_type = N_ABS;
+        scnum = -2;         /* -2 = absolute symbol */
+    }
 
-            intn = yasm_expr_get_intnum(&equ_val_copy, 1);
+    if (vis & YASM_SYM_EXTERN) {
+        n_type = N_EXT;
+        scnum = -1;
+        /*n_desc = REFERENCE_FLAG_UNDEFINED_LAZY;   * FIXME: see definition of REFERENCE_FLAG_* above */
+    } else if (vis & YASM_SYM_COMMON) {
+        yasm_expr **csize = yasm_symrec_get_common_size(sym);
+        n_type = N_UNDF | N_EXT;
+        if (csize) {
+            intn = yasm_expr_get_intnum(csize, 1);
             if (!intn) {
-                if (vis & YASM_SYM_GLOBAL) {
-                    yasm_error_set(YASM_ERROR_NOT_CONSTANT,
-                        N_("global EQU value not an integer expression"));
-                    yasm_errwarn_propagate(info->errwarns, equ_val->line);
-                }
+                yasm_error_set(YASM_ERROR_NOT_CONSTANT,
+                               N_("COMMON data size not an integer expression"));
+                yasm_errwarn_propagate(info->errwarns, (*csize)->line);
             } else
-                value = yasm_intnum_get_uint(intn);
-            yasm_expr_destroy(equ_val_copy);
-            yasm_intnum_set_uint(val, value);
-            n_type = N_ABS;
-            scnum = -2;         /* -2 = absolute symbol */
+                yasm_intnum_set_uint(val, yasm_intnum_get_uint(intn));
         }
-
-        if (vis & YASM_SYM_EXTERN) {
-            n_type = N_EXT;
-            scnum = -1;
-            /*n_desc = REFERENCE_FLAG_UNDEFINED_LAZY;   * FIXME: see definition of REFERENCE_FLAG_* above */
-        } else if (vis & YASM_SYM_COMMON) {
-            yasm_expr **csize = yasm_symrec_get_common_size(sym);
-            n_type = N_UNDF | N_EXT;
-            if (csize) {
-                intn = yasm_expr_get_intnum(csize, 1);
-                if (!intn) {
-                    yasm_error_set(YASM_ERROR_NOT_CONSTANT,
-                                   N_("COMMON data size not an integer expression"));
-                    yasm_errwarn_propagate(info->errwarns, (*csize)->line);
-                } else
-                    yasm_intnum_set_uint(val, yasm_intnum_get_uint(intn));
-            }
-            /*printf("common symbol %s val %lu\n", name, yasm_intnum_get_uint(val));*/
-        } else if (vis & YASM_SYM_GLOBAL) {
-            yasm_valparamhead *valparams =
-                yasm_symrec_get_objext_valparams(sym);
-
-            struct macho_global_data {
-                unsigned long flag; /* N_PEXT */
-            } data;
-
-            data.flag = 0;
-
-            if (valparams) {
-                static const yasm_dir_help help[] = {
-                    { "private_extern", 0, yasm_dir_helper_flag_set,
-                      offsetof(struct macho_global_data, flag), N_PEXT },
-                };
-                yasm_dir_helper(sym, yasm_vps_first(valparams),
-                                yasm_symrec_get_decl_line(sym), help, NELEMS(help),
-                                &data, yasm_dir_helper_valparam_warn);
-            }
-
-            n_type |= N_EXT | data.flag;
+        /*printf("common symbol %s val %lu\n", name, yasm_intnum_get_uint(val));*/
+    } else if (vis & YASM_SYM_GLOBAL) {
+        yasm_valparamhead *valparams =
+            yasm_symrec_get_objext_valparams(sym);
+
+        struct macho_global_data {
+            unsigned long flag; /* N_PEXT */
+        } data;
+
+        data.flag = 0;
+
+        if (valparams) {
+            static const yasm_dir_help help[] = {
+                { "private_extern", 0, yasm_dir_helper_flag_set,
+                  offsetof(struct macho_global_data, flag), N_PEXT },
+            };
+            yasm_dir_helper(sym, yasm_vps_first(valparams),
+                            yasm_symrec_get_decl_line(sym), help, NELEMS(help),
+                            &data, yasm_dir_helper_valparam_warn);
         }
 
-        localbuf = info->buf;
-        YASM_WRITE_32_L(localbuf, info->indx);  /* offset in string table */
-        YASM_WRITE_8(localbuf, n_type); /* type of symbol entry */
-        n_sect = (scnum >= 0) ? scnum + 1 : NO_SECT;
-        YASM_WRITE_8(localbuf, n_sect); /* referring section where symbol is found */
-        YASM_WRITE_16_L(localbuf, n_desc);      /* extra description */
-        yasm_intnum_get_sized(val, localbuf, long_int_bytes, ((long_int_bytes) << 3), 0, 0, 0); /* value/argument */
-        localbuf += long_int_bytes;
-        if (symd)
-            symd->value = val;
-        else
-            yasm_intnum_destroy(val);
-
-        info->indx += symd->length;
-
-        fwrite(info->buf, 8 + long_int_bytes, 1, info->f);
+        n_type |= N_EXT | data.flag;
     }
 
-    return 0;
-}
-
-
-static int
-macho_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
-{
-    /*@null@*/ macho_objfmt_output_info *info = (macho_objfmt_output_info *)d;
-    yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
-
-    assert(info != NULL);
-
-    if (info->all_syms ||
-        vis & (YASM_SYM_GLOBAL | YASM_SYM_COMMON | YASM_SYM_EXTERN)) {
-        if (0 == macho_objfmt_is_section_label(sym)) {
-            /*@only@*/ char *name =
-                yasm_symrec_get_global_name(sym, info->object);
-            size_t len = strlen(name);
+    YASM_WRITE_32_L(localbuf, export->strtab_offset);   /* offset in string table */
+    YASM_WRITE_8(localbuf, n_type); /* type of symbol entry */
+    n_sect = (scnum >= 0) ? scnum + 1 : NO_SECT;
+    YASM_WRITE_8(localbuf, n_sect); /* referring section where symbol is found */
+    YASM_WRITE_16_L(localbuf, n_desc);      /* extra description */
+    yasm_intnum_get_sized(val, localbuf, long_int_bytes, ((long_int_bytes) << 3), 0, 0, 0); /* value/argument */
+    localbuf += long_int_bytes;
+    if (symd->value)
+        yasm_intnum_destroy(symd->value);
+    symd->value = val;
 
-            fwrite(name, len + 1, 1, info->f);
-            yasm_xfree(name);
-        }
-    }
-    return 0;
+    return localbuf;
 }
 
+
 static int
 macho_objfmt_calc_sectsize(yasm_section *sect, /*@null@ */ void *d)
 {
@@ -1028,8 +996,10 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_macho *objfmt_macho = (yasm_objfmt_macho *)object->objfmt;
     macho_objfmt_output_info info;
-    unsigned char *localbuf;
+    /*@only@*/ yasm_symexport_plan *plan;
+    unsigned char *localbuf, *symbuf;
     unsigned long symtab_count = 0;
+    unsigned long strlength, i;
     unsigned long headsize;
     unsigned int macho_segcmdsize, macho_sectcmdsize, macho_nlistsize;
     unsigned int macho_segcmd;
@@ -1082,12 +1052,13 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 
     /* Get number of symbols */
     info.symindex = 0;
-    info.indx = 0;
-    info.strlength = 1;         /* string table starts with a zero byte */
     info.all_syms = all_syms || info.is_64;
     /*info.all_syms = 1;                * force all syms into symbol table */
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_count_sym);
-    symtab_count = info.indx;
+    plan = yasm_symtab_export_plan(object->symtab, object, 1,
+                                   macho_objfmt_select_sym, &info);
+    symtab_count = plan->num;
+    /* string table starts with a zero byte */
+    strlength = 1 + plan->names_len;
 
     /* write raw section data first */
     if (fseek(f, (long)headsize, SEEK_SET) < 0) {
@@ -1104,6 +1075,10 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     info.offset = headsize;
     yasm_object_sections_traverse(object, &info, macho_objfmt_calc_sectsize);
 
+    /* render section contents in parallel if requested */
+    yasm_object_render_sections(object, errwarns, &info,
+                                macho_objfmt_render_section);
+
     /* output sections to file */
     yasm_object_sections_traverse(object, &info, macho_objfmt_output_section);
 
@@ -1213,7 +1188,7 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 
     YASM_WRITE_32_L(localbuf, macho_nlistsize * symtab_count + info.rel_base +
                     info.s_reloff);     /* string table offset */
-    YASM_WRITE_32_L(localbuf, info.strlength);  /* string table size */
+    YASM_WRITE_32_L(localbuf, strlength);       /* string table size */
     /* write symbol command */
     fwrite(info.buf, (size_t)(localbuf - info.buf), 1, f);
 
@@ -1235,13 +1210,28 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     /* relocation data */
     yasm_object_sections_traverse(object, &info, macho_objfmt_output_relocs);
 
-    /* symbol table (NLIST) */
-    info.indx = 1;              /* restart symbol table indices */
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_output_symtable);
-
-    /* symbol strings */
-    fwrite(pad_data, 1, 1, f);
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_output_str);
+    /* symbol table (NLIST) and symbol strings */
+    if (symtab_count > 0) {
+        unsigned char *strbuf = yasm_xmalloc(strlength);
+        unsigned long stroff = 0;
+
+        strbuf[stroff++] = 0;
+        symbuf = yasm_xmalloc(macho_nlistsize * symtab_count);
+        localbuf = symbuf;
+        for (i=0; i<symtab_count; i++) {
+            yasm_symexport *export = &plan->syms[i];
+            export->strtab_offset = stroff;
+            memcpy(strbuf+stroff, export->name, export->name_len+1);
+            stroff += (unsigned long)export->name_len+1;
+            localbuf = macho_objfmt_output_sym(export, &info, localbuf);
+        }
+        fwrite(symbuf, macho_nlistsize, symtab_count, f);
+        fwrite(strbuf, strlength, 1, f);
+        yasm_xfree(symbuf);
+        yasm_xfree(strbuf);
+    } else
+        fwrite(pad_data, 1, 1, f);
+    yasm_symexport_plan_destroy(plan);
 
     yasm_intnum_destroy(val);
     yasm_xfree(info.buf);
@@ -1538,6 +1528,10 @@ macho_section_data_print(void *data, FILE *f, int indent_level)
 static void
 macho_symrec_data_destroy(void *data)
 {
+    macho_symrec_data *msd = (macho_symrec_data *)data;
+
+    if (msd->value)
+        yasm_intnum_destroy(msd->value);
     yasm_xfree(data);
 }
 
@@ -223,25 +223,24 @@ rdf_objfmt_output_value(yasm_value *value, unsigned char *buf,
     intn_minus = 0;
     intn_plus = 0;
     if (value->rel) {
-        rdf_reloc *reloc;
+        rdf_reloc reloc;
         /*@null@*/ rdf_symrec_data *rsymd;
         /*@dependent@*/ yasm_bytecode *precbc;
 
-        reloc = yasm_xmalloc(sizeof(rdf_reloc));
-        reloc->reloc.addr = yasm_intnum_create_uint(bc->offset + offset);
-        reloc->reloc.sym = value->rel;
-        reloc->size = valsize/8;
+        reloc.reloc.addr = bc->offset + offset;
+        reloc.reloc.sym = value->rel;
+        reloc.size = valsize/8;
 
         if (value->seg_of)
-            reloc->type = RDF_RELOC_SEG;
+            reloc.type = RDF_RELOC_SEG;
         else if (value->curpos_rel) {
-            reloc->type = RDF_RELOC_REL;
+            reloc.type = RDF_RELOC_REL;
             /* Adjust to start of section, so subtract out the bytecode
              * offset.
              */
             intn_minus = bc->offset;
         } else
-            reloc->type = RDF_RELOC_NORM;
+            reloc.type = RDF_RELOC_NORM;
 
         if (yasm_symrec_get_label(value->rel, &precbc)) {
             /* local, set the value to be the offset, and the refseg to the
@@ -254,19 +253,20 @@ rdf_objfmt_output_value(yasm_value *value, unsigned char *buf,
             csectd = yasm_section_get_data(sect, &rdf_section_data_cb);
             if (!csectd)
                 yasm_internal_error(N_("didn't understand section"));
-            reloc->refseg = csectd->scnum;
+            reloc.refseg = csectd->scnum;
             intn_plus = yasm_bc_next_offset(precbc);
         } else {
             /* must be common/external */
-            rsymd = yasm_symrec_get_data(reloc->reloc.sym,
+            rsymd = yasm_symrec_get_data(reloc.reloc.sym,
                                          &rdf_symrec_data_cb);
             if (!rsymd)
                 yasm_internal_error(
                     N_("rdf: no symbol data for relocated symbol"));
-            reloc->refseg = rsymd->segment;
+            reloc.refseg = rsymd->segment;
         }
 
-        yasm_section_add_reloc(info->sect, (yasm_reloc *)reloc, yasm_xfree);
+        yasm_section_add_reloc(info->sect, &reloc.reloc, sizeof(rdf_reloc),
+                               NULL);
     }
 
     if (intn_minus > 0) {
@@ -381,6 +381,8 @@ rdf_objfmt_output_section_reloc(yasm_section *sect, /*@null@*/ void *d)
     /*@null@*/ rdf_objfmt_output_info *info = (rdf_objfmt_output_info *)d;
     /*@dependent@*/ /*@null@*/ rdf_section_data *rsd;
     rdf_reloc *reloc;
+    /*@only@*/ unsigned char *buf;
+    unsigned char *localbuf;
 
     assert(info != NULL);
     rsd = yasm_section_get_data(sect, &rdf_section_data_cb);
@@ -396,9 +398,13 @@ rdf_objfmt_output_section_reloc(yasm_section *sect, /*@null@*/ void *d)
         return 0;
 
     reloc = (rdf_reloc *)yasm_section_relocs_first(sect);
-    while (reloc) {
-        unsigned char *localbuf = info->buf;
+    if (!reloc)
+        return 0;
 
+    /* Format all relocation records into one buffer and write them at once */
+    buf = yasm_xmalloc(yasm_section_num_relocs(sect)*10);
+    localbuf = buf;
+    while (reloc) {
         if (reloc->type == RDF_RELOC_SEG)
             YASM_WRITE_8(localbuf, RDFREC_SEGRELOC);
         else
@@ -407,14 +413,15 @@ rdf_objfmt_output_section_reloc(yasm_section *sect, /*@null@*/ void *d)
         /* Section number, +0x40 if relative reloc */
         YASM_WRITE_8(localbuf, rsd->scnum +
                      (reloc->type == RDF_RELOC_REL ? 0x40 : 0));
-        yasm_intnum_get_sized(reloc->reloc.addr, localbuf, 4, 32, 0, 0, 0);
-        localbuf += 4;                          /* offset of relocation */
+        YASM_WRITE_32_L(localbuf, reloc->reloc.addr);   /* offset of reloc */
         YASM_WRITE_8(localbuf, reloc->size);        /* size of relocation */
         YASM_WRITE_16_L(localbuf, reloc->refseg);   /* relocated symbol */
-        fwrite(info->buf, 10, 1, info->f);
 
-        reloc = (rdf_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
+        reloc = (rdf_reloc *)yasm_section_reloc_next(sect,
+                                                     (yasm_reloc *)reloc);
     }
+    fwrite(buf, (size_t)(localbuf-buf), 1, info->f);
+    yasm_xfree(buf);
 
     return 0;
 }
@@ -425,6 +432,7 @@ rdf_objfmt_output_section_file(yasm_section *sect, /*@null@*/ void *d)
     /*@null@*/ rdf_objfmt_output_info *info = (rdf_objfmt_output_info *)d;
     /*@dependent@*/ /*@null@*/ rdf_section_data *rsd;
     unsigned char *localbuf;
+    long pos;
 
     assert(info != NULL);
     rsd = yasm_section_get_data(sect, &rdf_section_data_cb);
@@ -448,6 +456,9 @@ rdf_objfmt_output_section_file(yasm_section *sect, /*@null@*/ void *d)
     fwrite(info->buf, 10, 1, info->f);
 
     /* Section data */
+    pos = ftell(info->f);
+    if (pos >= 0)
+        yasm_section_set_output_range(sect, (unsigned long)pos, rsd->size);
     fwrite(rsd->raw_data, rsd->size, 1, info->f);
 
     /* Free section data */
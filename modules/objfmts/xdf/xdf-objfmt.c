@@ -181,30 +181,30 @@ xdf_objfmt_output_value(yasm_value *value, unsigned char *buf,
 
     intn_minus = 0;
     if (value->rel) {
-        xdf_reloc *reloc;
+        xdf_reloc reloc;
 
-        reloc = yasm_xmalloc(sizeof(xdf_reloc));
-        reloc->reloc.addr = yasm_intnum_create_uint(bc->offset + offset);
-        reloc->reloc.sym = value->rel;
-        reloc->base = NULL;
-        reloc->size = valsize/8;
-        reloc->shift = value->rshift;
+        reloc.reloc.addr = bc->offset + offset;
+        reloc.reloc.sym = value->rel;
+        reloc.base = NULL;
+        reloc.size = valsize/8;
+        reloc.shift = value->rshift;
 
         if (value->seg_of)
-            reloc->type = XDF_RELOC_SEG;
+            reloc.type = XDF_RELOC_SEG;
         else if (value->wrt) {
-            reloc->base = value->wrt;
-            reloc->type = XDF_RELOC_WRT;
+            reloc.base = value->wrt;
+            reloc.type = XDF_RELOC_WRT;
         } else if (value->curpos_rel) {
-            reloc->type = XDF_RELOC_RIP;
+            reloc.type = XDF_RELOC_RIP;
             /* Adjust to start of section, so subtract out the bytecode
              * offset.
              */
             intn_minus = bc->offset;
         } else
-            reloc->type = XDF_RELOC_REL;
+            reloc.type = XDF_RELOC_REL;
         info->xsd->nreloc++;
-        yasm_section_add_reloc(info->sect, (yasm_reloc *)reloc, yasm_xfree);
+        yasm_section_add_reloc(info->sect, &reloc.reloc, sizeof(xdf_reloc),
+                               NULL);
     }
 
     if (intn_minus > 0) {
@@ -254,17 +254,9 @@ xdf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
                       N_("uninitialized space: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_fwrite_zeros(size, info->f);
     } else {
         /* Output buf (or bigbuf if non-NULL) to file */
         fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
@@ -284,6 +276,8 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     /*@dependent@*/ /*@null@*/ xdf_section_data *xsd;
     long pos;
     xdf_reloc *reloc;
+    /*@only@*/ unsigned char *buf;
+    unsigned char *localbuf;
 
     assert(info != NULL);
     xsd = yasm_section_get_data(sect, &xdf_section_data_cb);
@@ -305,8 +299,8 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 
         info->sect = sect;
         info->xsd = xsd;
-        yasm_section_bcs_traverse(sect, info->errwarns, info,
-                                  xdf_objfmt_output_bytecode);
+        yasm_section_output(sect, info->f, info->errwarns, info,
+                            xdf_objfmt_output_bytecode);
 
         /* Sanity check final section size */
         if (xsd->size != yasm_bc_next_offset(yasm_section_bcs_last(sect)))
@@ -332,9 +326,11 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     }
     xsd->relptr = (unsigned long)pos;
 
+    /* Format all relocations into one buffer and write them at once */
+    buf = yasm_xmalloc(yasm_section_num_relocs(sect)*16);
+    localbuf = buf;
     reloc = (xdf_reloc *)yasm_section_relocs_first(sect);
     while (reloc) {
-        unsigned char *localbuf = info->buf;
         /*@null@*/ xdf_symrec_data *xsymd;
 
         xsymd = yasm_symrec_get_data(reloc->reloc.sym, &xdf_symrec_data_cb);
@@ -342,8 +338,7 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
             yasm_internal_error(
                 N_("xdf: no symbol data for relocated symbol"));
 
-        yasm_intnum_get_sized(reloc->reloc.addr, localbuf, 4, 32, 0, 0, 0);
-        localbuf += 4;                          /* address of relocation */
+        YASM_WRITE_32_L(localbuf, reloc->reloc.addr);   /* address of reloc */
         YASM_WRITE_32_L(localbuf, xsymd->index);    /* relocated symbol */
         if (reloc->base) {
             xsymd = yasm_symrec_get_data(reloc->base, &xdf_symrec_data_cb);
@@ -361,10 +356,12 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         YASM_WRITE_8(localbuf, reloc->size);        /* size of relocation */
         YASM_WRITE_8(localbuf, reloc->shift);       /* relocation shift */
         YASM_WRITE_8(localbuf, 0);                  /* flags */
-        fwrite(info->buf, 16, 1, info->f);
 
-        reloc = (xdf_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
+        reloc = (xdf_reloc *)yasm_section_reloc_next(sect,
+                                                     (yasm_reloc *)reloc);
     }
+    fwrite(buf, (size_t)(localbuf-buf), 1, info->f);
+    yasm_xfree(buf);
 
     return 0;
 }
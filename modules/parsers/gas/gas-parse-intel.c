@@ -39,7 +39,6 @@ extern yasm_bytecode *gas_intel_syntax_parse_instr(yasm_parser_nasm *parser_nasm
 #define SET_FIELDS(to, from) \
     (to)->object = (from)->object; \
     (to)->locallabel_base = (from)->locallabel_base; \
-    (to)->locallabel_base_len = (from)->locallabel_base_len; \
     (to)->preproc = (from)->preproc; \
     (to)->errwarns = (from)->errwarns; \
     (to)->linemap = (from)->linemap; \
@@ -68,11 +67,11 @@ yasm_bytecode *parse_instr_intel(yasm_parser_gas *parser_gas)
     }
 
     if (&stok[length] == slim && parser_gas->line) {
-        line = yasm_xmalloc(length + parser_gas->lineleft + 1);
+        /* Rest of the preprocessor line, less its terminating NUL */
+        line = yasm_xmalloc(length + parser_gas->lineleft);
         memcpy(line, parser_gas->s.tok, length);
-        memcpy(line + length, parser_gas->linepos, parser_gas->lineleft);
-        length += parser_gas->lineleft;
-        if (line[length - 1] == '\n') length--;
+        memcpy(line + length, parser_gas->linepos, parser_gas->lineleft - 1);
+        length += parser_gas->lineleft - 1;
     } else {
         line = yasm_xmalloc(length + 1);
         memcpy(line, parser_gas->s.tok, length);
@@ -30,6 +30,7 @@
 #include <util.h>
 
 #include <libyasm.h>
+#include <libyasm/phash.h>
 
 #include <ctype.h>
 #include <limits.h>
@@ -44,6 +45,10 @@ typedef struct dir_lookup {
     enum gas_parser_state newstate;
 } dir_lookup;
 
+/* Longest numeric local label name, "L<digit>\001<index>", plus the NUL */
+#define LOCAL_LABEL_NAME_MAX    (3+3*sizeof(unsigned long)+1)
+
+static /*@null@*/ const dir_lookup *dir_find(const char *id);
 static void cpp_line_marker(yasm_parser_gas *parser_gas);
 static void nasm_line_marker(yasm_parser_gas *parser_gas);
 static yasm_bytecode *parse_instr(yasm_parser_gas *parser_gas);
@@ -57,7 +62,10 @@ static yasm_expr *parse_expr0(yasm_parser_gas *parser_gas);
 static yasm_expr *parse_expr1(yasm_parser_gas *parser_gas);
 static yasm_expr *parse_expr2(yasm_parser_gas *parser_gas);
 
-static void define_label(yasm_parser_gas *parser_gas, char *name, int local);
+static const char *local_label_name(char *buf, char digit,
+                                    unsigned long index);
+static void define_label(yasm_parser_gas *parser_gas, const char *name,
+                         int local);
 static void define_lcomm(yasm_parser_gas *parser_gas, /*@only@*/ char *name,
                          yasm_expr *size, /*@null@*/ yasm_expr *align);
 static yasm_section *gas_get_section
@@ -107,7 +115,6 @@ destroy_curtok_(yasm_parser_gas *parser_gas)
             yasm_floatnum_destroy(curval.flt);
             break;
         case ID:
-        case LABEL:
         case STRING:
             yasm_xfree(curval.str.contents);
             break;
@@ -141,7 +148,7 @@ demand_eol_(yasm_parser_gas *parser_gas)
 static int
 expect_(yasm_parser_gas *parser_gas, int token)
 {
-    static char strch[] = "` '";
+    static YASM_THREAD_LOCAL char strch[] = "` '";
     const char *str;
 
     if (curtok == token)
@@ -159,6 +166,7 @@ expect_(yasm_parser_gas *parser_gas, int token)
         case RIGHT_OP:          str = ">>"; break;
         case ID:                str = "identifier"; break;
         case LABEL:             str = "label"; break;
+        case LOCAL_ID:          str = "local label"; break;
         default:
             strch[1] = token;
             str = strch;
@@ -191,7 +199,7 @@ parse_line(yasm_parser_gas *parser_gas)
             id = ID_val;
 
             /* See if it's a gas-specific directive */
-            dir = (const dir_lookup *)HAMT_search(parser_gas->dirs, id);
+            dir = dir_find(id);
             if (dir) {
                 parser_gas->state = dir->newstate;
                 get_next_token(); /* ID */
@@ -204,6 +212,7 @@ parse_line(yasm_parser_gas *parser_gas)
                 parser_gas->state = INITIAL;
                 get_next_token(); /* : */
                 define_label(parser_gas, id, 0);
+                yasm_xfree(id);
                 return parse_line(parser_gas);
             } else if (curtok == '=') {
                 /* EQU */
@@ -238,9 +247,13 @@ parse_line(yasm_parser_gas *parser_gas)
             yasm_xfree(id);
             return NULL;
         case LABEL:
-            define_label(parser_gas, LABEL_val, 0);
+        {
+            char name[LOCAL_LABEL_NAME_MAX];
+            define_label(parser_gas, local_label_name(name, LABEL_val.digit,
+                                                      LABEL_val.index), 0);
             get_next_token(); /* LABEL */
             return parse_line(parser_gas);
+        }
         case CPP_LINE_MARKER:
             get_next_token();
             cpp_line_marker(parser_gas);
@@ -627,6 +640,12 @@ dir_data(yasm_parser_gas *parser_gas, unsigned int size)
     return yasm_bc_create_data(&dvs, size, 0, p_object->arch, cur_line);
 }
 
+static yasm_bytecode *
+dir_word(yasm_parser_gas *parser_gas, unsigned int param)
+{
+    return dir_data(parser_gas, yasm_arch_wordsize(p_object->arch)/8);
+}
+
 static yasm_bytecode *
 dir_leb128(yasm_parser_gas *parser_gas, unsigned int sign)
 {
@@ -1141,18 +1160,20 @@ parse_memaddr(yasm_parser_gas *parser_gas)
         e1 = NULL;
 
     if (curtok == '(') {
-        int havereg = 0;
-        uintptr_t reg = 0;
+        int havebase = 0, havereg = 0;
+        uintptr_t base = 0, reg = 0;
         yasm_intnum *scale = NULL;
+        yasm_arch_ea_reg regs[2];
+        size_t nregs = 0;
 
         get_next_token(); /* '(' */
 
         /* base register */
         if (curtok == REG) {
-            e2 = p_expr_new_ident(yasm_expr_reg(REG_val));
+            base = REG_val;
+            havebase = 1;
             get_next_token(); /* REG */
-        } else
-            e2 = p_expr_new_ident(yasm_expr_int(yasm_intnum_create_uint(0)));
+        }
 
         if (curtok == ')')
             goto done;
@@ -1160,7 +1181,6 @@ parse_memaddr(yasm_parser_gas *parser_gas)
         if (!expect(',')) {
             yasm_error_set(YASM_ERROR_SYNTAX, N_("invalid memory expression"));
             if (e1) yasm_expr_destroy(e1);
-            yasm_expr_destroy(e2);
             return NULL;
         }
         get_next_token(); /* ',' */
@@ -1184,7 +1204,6 @@ parse_memaddr(yasm_parser_gas *parser_gas)
         if (!expect(INTNUM)) {
             yasm_error_set(YASM_ERROR_SYNTAX, N_("non-integer scale"));
             if (e1) yasm_expr_destroy(e1);
-            yasm_expr_destroy(e2);
             return NULL;
         }
         scale = INTNUM_val;
@@ -1195,24 +1214,53 @@ done:
             yasm_error_set(YASM_ERROR_SYNTAX, N_("invalid memory expression"));
             if (scale) yasm_intnum_destroy(scale);
             if (e1) yasm_expr_destroy(e1);
-            yasm_expr_destroy(e2);
             return NULL;
         }
         get_next_token(); /* ')' */
 
+        if (scale && !havereg) {
+            if (yasm_intnum_get_uint(scale) != 1)
+                yasm_warn_set(YASM_WARN_GENERAL,
+                    N_("scale factor of %u without an index register"),
+                    yasm_intnum_get_uint(scale));
+            yasm_intnum_destroy(scale);
+            scale = NULL;
+        }
+
+        /* The registers are already separated out; hand them to the
+         * architecture as-is rather than building an expression for it to
+         * take apart again.
+         */
+        if (havebase) {
+            regs[nregs].reg = base;
+            regs[nregs].mult = 1;
+            regs[nregs].explicit_mult = 0;
+            nregs++;
+        }
         if (scale) {
-            if (!havereg) {
-                if (yasm_intnum_get_uint(scale) != 1)
-                    yasm_warn_set(YASM_WARN_GENERAL,
-                        N_("scale factor of %u without an index register"),
-                        yasm_intnum_get_uint(scale));
+            regs[nregs].reg = reg;
+            regs[nregs].mult = yasm_intnum_get_int(scale);
+            regs[nregs].explicit_mult = 1;
+            nregs++;
+        }
+        if (nregs > 0 &&
+            (ea = yasm_arch_ea_create_regs(p_object->arch, regs, nregs, e1))) {
+            if (scale)
                 yasm_intnum_destroy(scale);
-            } else
-                e2 = p_expr_new(yasm_expr_expr(e2), YASM_EXPR_ADD,
-                    yasm_expr_expr(p_expr_new(yasm_expr_reg(reg), YASM_EXPR_MUL,
-                                              yasm_expr_int(scale))));
+            ea->strong = 1;
+            return ea;
         }
 
+        /* Otherwise build the equivalent expression. */
+        if (havebase)
+            e2 = p_expr_new_ident(yasm_expr_reg(base));
+        else
+            e2 = p_expr_new_ident(yasm_expr_int(yasm_intnum_create_uint(0)));
+        if (scale)
+            e2 = p_expr_new(yasm_expr_expr(e2), YASM_EXPR_ADD,
+                yasm_expr_expr(p_expr_new(yasm_expr_reg(reg), YASM_EXPR_MUL,
+                                          yasm_expr_int(scale))));
+
         if (e1) {
             /* Ordering is critical here to correctly detecting presence of
              * RIP in RIP-relative expressions.
@@ -1453,18 +1501,27 @@ parse_expr2(yasm_parser_gas *parser_gas)
             e = p_expr_new_ident(yasm_expr_float(FLTNUM_val));
             get_next_token();
             return e;
+        case LOCAL_ID:
         case ID:
         {
-            char *name = ID_val;
-            get_next_token(); /* ID */
+            if (curtok == LOCAL_ID) {
+                char name[LOCAL_LABEL_NAME_MAX];
+                sym = yasm_symtab_use(p_symtab,
+                    local_label_name(name, LOCAL_ID_val.digit,
+                                     LOCAL_ID_val.index), cur_line);
+                get_next_token(); /* LOCAL_ID */
+            } else {
+                char *name = ID_val;
+                get_next_token(); /* ID */
 
-            /* "." references the current assembly position */
-            if (name[1] == '\0' && name[0] == '.')
-                sym = yasm_symtab_define_curpos(p_symtab, ".",
-                                                parser_gas->prev_bc, cur_line);
-            else
-                sym = yasm_symtab_use(p_symtab, name, cur_line);
-            yasm_xfree(name);
+                /* "." references the current assembly position */
+                if (name[1] == '\0' && name[0] == '.')
+                    sym = yasm_symtab_define_curpos(p_symtab, ".",
+                        parser_gas->prev_bc, cur_line);
+                else
+                    sym = yasm_symtab_use(p_symtab, name, cur_line);
+                yasm_xfree(name);
+            }
 
             if (curtok == '@') {
                 yasm_symrec *wrt;
@@ -1494,21 +1551,27 @@ parse_expr2(yasm_parser_gas *parser_gas)
     }
 }
 
+/* Build the symbol name of instance index of numeric local label digit
+ * into buf, which must hold LOCAL_LABEL_NAME_MAX characters.  The names
+ * aren't kept; the symbol table copies a name only when it adds a symbol.
+ */
+static const char *
+local_label_name(char *buf, char digit, unsigned long index)
+{
+    sprintf(buf, "L%c\001%lu", digit, index);
+    return buf;
+}
+
 static void
-define_label(yasm_parser_gas *parser_gas, char *name, int local)
+define_label(yasm_parser_gas *parser_gas, const char *name, int local)
 {
-    if (!local) {
-        if (parser_gas->locallabel_base)
-            yasm_xfree(parser_gas->locallabel_base);
-        parser_gas->locallabel_base_len = strlen(name);
-        parser_gas->locallabel_base =
-            yasm_xmalloc(parser_gas->locallabel_base_len+1);
-        strcpy(parser_gas->locallabel_base, name);
-    }
+    yasm_symrec *sym = yasm_symtab_define_label(p_symtab, name,
+                                                parser_gas->prev_bc, 1,
+                                                cur_line);
 
-    yasm_symtab_define_label(p_symtab, name, parser_gas->prev_bc, 1,
-                             cur_line);
-    yasm_xfree(name);
+    /* Use the symbol's copy of the name as the base */
+    if (!local)
+        parser_gas->locallabel_base = yasm_symrec_get_name(sym);
 }
 
 static void
@@ -1656,89 +1719,29 @@ gas_parser_dir_fill(yasm_parser_gas *parser_gas, /*@only@*/ yasm_expr *repeat,
     return bc;
 }
 
-static dir_lookup dirs_static[] = {
-    /* FIXME: Whether this is power-of-two or not depends on arch and objfmt. */
-    {".align",      dir_align,  0,  INITIAL},
-    {".p2align",    dir_align,  1,  INITIAL},
-    {".balign",     dir_align,  0,  INITIAL},
-    {".org",        dir_org,    0,  INITIAL},
-    /* data visibility directives */
-    {".local",      dir_local,  0,  INITIAL},
-    {".comm",       dir_comm,   0,  INITIAL},
-    {".lcomm",      dir_comm,   1,  INITIAL},
-    /* integer data declaration directives */
-    {".byte",       dir_data,   1,  INITIAL},
-    {".2byte",      dir_data,   2,  INITIAL},
-    {".4byte",      dir_data,   4,  INITIAL},
-    {".8byte",      dir_data,   8,  INITIAL},
-    {".16byte",     dir_data,   16, INITIAL},
-    /* TODO: These should depend on arch */
-    {".short",      dir_data,   2,  INITIAL},
-    {".int",        dir_data,   4,  INITIAL},
-    {".long",       dir_data,   4,  INITIAL},
-    {".hword",      dir_data,   2,  INITIAL},
-    {".quad",       dir_data,   8,  INITIAL},
-    {".octa",       dir_data,   16, INITIAL},
-    /* XXX: At least on x86, this is 2 bytes */
-    {".value",      dir_data,   2,  INITIAL},
-    /* ASCII data declaration directives */
-    {".ascii",      dir_ascii,  0,  INITIAL},   /* no terminating zero */
-    {".asciz",      dir_ascii,  1,  INITIAL},   /* add terminating zero */
-    {".string",     dir_ascii,  1,  INITIAL},   /* add terminating zero */
-    /* LEB128 integer data declaration directives */
-    {".sleb128",    dir_leb128, 1,  INITIAL},   /* signed */
-    {".uleb128",    dir_leb128, 0,  INITIAL},   /* unsigned */
-    /* floating point data declaration directives */
-    {".float",      dir_data,   4,  INITIAL},
-    {".single",     dir_data,   4,  INITIAL},
-    {".double",     dir_data,   8,  INITIAL},
-    {".tfloat",     dir_data,   10, INITIAL},
-    /* section directives */
-    {".bss",        dir_bss_section,    0,  INITIAL},
-    {".data",       dir_data_section,   0,  INITIAL},
-    {".text",       dir_text_section,   0,  INITIAL},
-    {".section",    dir_section,        0, SECTION_DIRECTIVE},
-    /* empty space/fill directives */
-    {".skip",       dir_skip,   0,  INITIAL},
-    {".space",      dir_skip,   0,  INITIAL},
-    {".fill",       dir_fill,   0,  INITIAL},
-    {".zero",       dir_zero,   0,  INITIAL},
-    /* syntax directives */
-    {".intel_syntax", dir_intel_syntax, 0, INITIAL},
-    {".att_syntax",   dir_att_syntax,   0, INITIAL},    
-    /* other directives */
-    {".equ",        dir_equ,    0,  INITIAL},
-    {".file",       dir_file,   0,  INITIAL},
-    {".line",       dir_line,   0,  INITIAL},
-    {".set",        dir_equ,    0,  INITIAL}
-};
+#include "gas-dirs.c"
 
-static void
-no_delete(void *data)
+static const dir_lookup *
+dir_find(const char *id)
 {
+    char lcaseid[16];
+    size_t i, len;
+
+    /* Every directive starts with '.'; reject labels and the like early. */
+    if (id[0] != '.')
+        return NULL;
+    len = strlen(id);
+    if (len >= sizeof(lcaseid))
+        return NULL;
+    for (i=0; i<len; i++)
+        lcaseid[i] = tolower((unsigned char)id[i]);
+    lcaseid[len] = '\0';
+    return gas_dir_find(lcaseid, len);
 }
 
 void
 gas_parser_parse(yasm_parser_gas *parser_gas)
 {
-    dir_lookup word;
-    unsigned int i;
-    int replace = 1;
-
-    word.name = ".word";
-    word.handler = dir_data;
-    word.param = yasm_arch_wordsize(p_object->arch)/8;
-    word.newstate = INITIAL;
-
-    /* Create directive lookup */
-    parser_gas->dirs = HAMT_create(1, yasm_internal_error_);
-    HAMT_insert(parser_gas->dirs, word.name, &word, &replace, no_delete);
-    for (i=0; i<NELEMS(dirs_static); i++) {
-        replace = 1;
-        HAMT_insert(parser_gas->dirs, dirs_static[i].name,
-                    &dirs_static[i], &replace, no_delete);
-    }
-
     while (get_next_token() != 0) {
         yasm_bytecode *bc = NULL, *temp_bc;
 
@@ -1749,7 +1752,8 @@ gas_parser_parse(yasm_parser_gas *parser_gas)
 
         yasm_errwarn_propagate(parser_gas->errwarns, cur_line);
 
-        temp_bc = yasm_section_bcs_append(cursect, bc);
+        temp_bc = yasm_section_bcs_append_data(cursect, bc,
+                                               parser_gas->save_input);
         if (temp_bc)
             parser_gas->prev_bc = temp_bc;
         if (curtok == ';')
@@ -1761,6 +1765,4 @@ gas_parser_parse(yasm_parser_gas *parser_gas)
         yasm_linemap_goto_next(parser_gas->linemap);
         parser_gas->dir_line++; /* keep track for .line followed by .file */
     }
-
-    HAMT_destroy(parser_gas->dirs, no_delete);
 }
@@ -45,8 +45,7 @@ gas_parser_do_parse(yasm_object *object, yasm_preproc *pp,
     parser_gas.object = object;
     parser_gas.linemap = linemap;
 
-    parser_gas.locallabel_base = (char *)NULL;
-    parser_gas.locallabel_base_len = 0;
+    parser_gas.locallabel_base = NULL;
 
     parser_gas.dir_fileline = 0;
     parser_gas.dir_file = NULL;
@@ -94,10 +93,6 @@ gas_parser_do_parse(yasm_object *object, yasm_preproc *pp,
 
     yasm_scanner_delete(&parser_gas.s);
 
-    /* Free locallabel base if necessary */
-    if (parser_gas.locallabel_base)
-        yasm_xfree(parser_gas.locallabel_base);
-
     if (parser_gas.dir_file)
         yasm_xfree(parser_gas.dir_file);
 
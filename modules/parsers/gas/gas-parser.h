@@ -46,6 +46,7 @@ enum tokentype {
     RIGHT_OP,
     ID,
     LABEL,
+    LOCAL_ID,
     CPP_LINE_MARKER,
     NASM_LINE_MARKER,
     NONE
@@ -61,6 +62,10 @@ typedef union {
         char *contents;
         size_t len;
     } str;
+    struct {
+        char digit;             /* '0' to '9' */
+        unsigned long index;    /* instance of the label */
+    } local;
 } yystype;
 #define YYSTYPE yystype
 
@@ -74,9 +79,8 @@ enum gas_parser_state {
 typedef struct yasm_parser_gas {
     /*@only@*/ yasm_object *object;
 
-    /* last "base" label for local (.) labels */
-    /*@null@*/ char *locallabel_base;
-    size_t locallabel_base_len;
+    /* last "base" label for local (.) labels (name of its symbol) */
+    /*@null@*/ /*@dependent@*/ const char *locallabel_base;
 
     /* .line/.file: we have to see both to start setting linemap versions */
     int dir_fileline;
@@ -98,7 +102,7 @@ typedef struct yasm_parser_gas {
     YYCTYPE save_line[2][MAX_SAVED_LINE_LEN];
     int save_last;
 
-    /* Line data storage used in preproc_input(). */
+    /* Line data used in preproc_input(); owned by the preprocessor. */
     char *line, *linepos;
     size_t lineleft;
 
@@ -119,9 +123,6 @@ typedef struct yasm_parser_gas {
      */
     unsigned long local[10];
 
-    /* Parser-handled directives HAMT lookup */
-    HAMT *dirs;
-
     int intel_syntax;
 
     int is_nasm_preproc;
@@ -144,8 +145,8 @@ typedef struct yasm_parser_gas {
 #define TARGETMOD_val           (curval.arch_data)
 #define ID_val                  (curval.str.contents)
 #define ID_len                  (curval.str.len)
-#define LABEL_val               (curval.str.contents)
-#define LABEL_len               (curval.str.len)
+#define LABEL_val               (curval.local)
+#define LOCAL_ID_val            (curval.local)
 
 #define cur_line        (yasm_linemap_get_current(parser_gas->linemap))
 
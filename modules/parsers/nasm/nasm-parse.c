@@ -62,8 +62,10 @@ static void nasm_parser_directive
      /*@null@*/ yasm_valparamhead *valparams,
      /*@null@*/ yasm_valparamhead *objext_valparams);
 static void set_nonlocal_label(yasm_parser_nasm *parser_nasm, const char *name);
+static yasm_symrec *use_symbol(yasm_parser_nasm *parser_nasm, int token,
+                               const char *name);
 static void define_label(yasm_parser_nasm *parser_nasm, /*@only@*/ char *name,
-                         unsigned int size);
+                         int token, unsigned int size);
 
 static void yasm_ea_set_implicit_size_segment(yasm_parser_nasm *parser_nasm,
                                               yasm_effaddr *ea, yasm_expr *e)
@@ -154,7 +156,7 @@ demand_eol_(yasm_parser_nasm *parser_nasm)
 static const char *
 describe_token(int token)
 {
-    static char strch[] = "` '";
+    static YASM_THREAD_LOCAL char strch[] = "` '";
     const char *str;
 
     switch (token) {
@@ -214,16 +216,16 @@ expect_(yasm_parser_nasm *parser_nasm, int token)
 void
 nasm_parser_parse(yasm_parser_nasm *parser_nasm)
 {
-    unsigned char *line;
-    while ((line = (unsigned char *)
-            yasm_preproc_get_line(parser_nasm->preproc)) != NULL) {
+    yasm_preproc_line pline;
+    while (yasm_preproc_get_line_ref(parser_nasm->preproc, &pline)) {
+        unsigned char *line = (unsigned char *)pline.text;
         yasm_bytecode *bc = NULL, *temp_bc;
 
         parser_nasm->s.bot = line;
         parser_nasm->s.tok = line;
         parser_nasm->s.ptr = line;
         parser_nasm->s.cur = line;
-        parser_nasm->s.lim = line + strlen((char *)line)+1;
+        parser_nasm->s.lim = line + pline.len+1;
         parser_nasm->s.top = parser_nasm->s.lim;
 
         get_next_token();
@@ -261,18 +263,23 @@ nasm_parser_parse(yasm_parser_nasm *parser_nasm)
             }
             temp_bc = NULL;
         } else if (bc) {
-            temp_bc = yasm_section_bcs_append(cursect, bc);
+            temp_bc = yasm_section_bcs_append_data(cursect, bc,
+                                                   parser_nasm->save_input);
             if (temp_bc)
                 parser_nasm->prev_bc = temp_bc;
         } else
             temp_bc = NULL;
         yasm_errwarn_propagate(parser_nasm->errwarns, cur_line);
 
-        if (parser_nasm->save_input)
-            yasm_linemap_add_source(parser_nasm->linemap, temp_bc,
-                                    (char *)line);
+        if (parser_nasm->save_input) {
+            if (pline.persistent)
+                yasm_linemap_add_source_ref(parser_nasm->linemap, temp_bc,
+                                            pline.text);
+            else
+                yasm_linemap_add_source(parser_nasm->linemap, temp_bc,
+                                        pline.text);
+        }
         yasm_linemap_goto_next(parser_nasm->linemap);
-        yasm_xfree(line);
     }
 }
 
@@ -390,6 +397,7 @@ parse_line(yasm_parser_nasm *parser_nasm)
         case LOCAL_ID:
         {
             char *name = ID_val;
+            int token = curtok;
             int local = parser_nasm->tasm
                 ? (curtok == ID || curtok == LOCAL_ID ||
                         (curtok == SPECIAL_ID && name[0] == '@'))
@@ -403,7 +411,7 @@ parse_line(yasm_parser_nasm *parser_nasm)
                     N_("label alone on a line without a colon might be in error"));
                 if (!local)
                     set_nonlocal_label(parser_nasm, name);
-                define_label(parser_nasm, name, 0);
+                define_label(parser_nasm, name, token, 0);
                 return NULL;
             }
             if (curtok == ':')
@@ -426,7 +434,11 @@ parse_line(yasm_parser_nasm *parser_nasm)
                     yasm_xfree(name);
                     return NULL;
                 }
-                yasm_symtab_define_equ(p_symtab, name, e, cur_line);
+                if (token == LOCAL_ID)
+                    yasm_symtab_define_equ_local(p_symtab,
+                        parser_nasm->locallabel_base, name, e, cur_line);
+                else
+                    yasm_symtab_define_equ(p_symtab, name, e, cur_line);
                 yasm_xfree(name);
                 return NULL;
             }
@@ -443,11 +455,11 @@ parse_line(yasm_parser_nasm *parser_nasm)
                 set_nonlocal_label(parser_nasm, name);
 
             if (is_eol()) {
-                define_label(parser_nasm, name, size);
+                define_label(parser_nasm, name, token, size);
                 return NULL;
             }
             if (curtok == TIMES) {
-                define_label(parser_nasm, name, size);
+                define_label(parser_nasm, name, token, size);
                 get_next_token();
                 return parse_times(parser_nasm);
             }
@@ -457,7 +469,7 @@ parse_line(yasm_parser_nasm *parser_nasm)
                                N_("instruction expected after label"));
             if (parser_nasm->tasm && bc && !size)
                 size = yasm_bc_elem_size(bc);
-            define_label(parser_nasm, name, size);
+            define_label(parser_nasm, name, token, size);
             return bc;
         }
         default:
@@ -1011,8 +1023,8 @@ parse_operand(yasm_parser_nasm *parser_nasm)
             if (parser_nasm->tasm) {
                 get_peek_token(parser_nasm);
                 if (parser_nasm->peek_token == '[') {
-                    yasm_symrec *sym = yasm_symtab_use(p_symtab, ID_val,
-                                                       cur_line);
+                    yasm_symrec *sym = use_symbol(parser_nasm, curtok,
+                                                  ID_val);
                     yasm_expr *e = p_expr_new_ident(yasm_expr_sym(sym)), *f;
                     yasm_effaddr *ea;
                     yasm_xfree(ID_val);
@@ -1049,23 +1061,21 @@ parse_operand(yasm_parser_nasm *parser_nasm)
                     op = yasm_operand_create_mem(ea);
                     return op;
                 } else if (curtok == '[') {
-                    yasm_expr *f;
                     yasm_effaddr *ea;
-                    yasm_insn_operand *op2;
 
                     op = parse_operand(parser_nasm);
                     if (!op)
                         return NULL;
-    
-                    f = op->data.ea->disp.abs;
-                    e = p_expr_new_tree(e, YASM_EXPR_ADD, f);
-                    ea = yasm_arch_ea_create(p_object->arch, e);
-                    yasm_ea_set_implicit_size_segment(parser_nasm, ea, e);
-                    op2 = yasm_operand_create_mem(ea);
-
-                    yasm_xfree(op);
 
-                    return op2;
+                    /* Fold the leading expression into the displacement
+                     * (the registers may already be split out of it).
+                     */
+                    ea = op->data.ea;
+                    ea->disp.abs = p_expr_new_tree(e, YASM_EXPR_ADD,
+                                                   ea->disp.abs);
+                    yasm_ea_set_implicit_size_segment(parser_nasm, ea,
+                                                      ea->disp.abs);
+                    return op;
                 } else {
                     return yasm_operand_create_imm(e);
                 }
@@ -1086,6 +1096,172 @@ parse_operand(yasm_parser_nasm *parser_nasm)
 }
 
 /* memory addresses */
+/* Classify a term of a memory expression: 1 if it's reg or reg*scale
+ * (filled into *reg), 0 if it's free of registers, -1 otherwise.
+ */
+static int
+memaddr_regterm(const yasm_expr__item *item, yasm_arch_ea_reg *reg)
+{
+    const yasm_expr *e;
+    int r;
+
+    if (item->type == YASM_EXPR_REG) {
+        reg->reg = item->data.reg;
+        reg->mult = 1;
+        reg->explicit_mult = 0;
+        return 1;
+    }
+    if (item->type != YASM_EXPR_EXPR)
+        return 0;
+    e = item->data.expn;
+    if (e->op == YASM_EXPR_MUL && e->numterms == 2) {
+        r = e->terms[0].type == YASM_EXPR_REG ? 0 : 1;
+        if (e->terms[r].type == YASM_EXPR_REG &&
+            e->terms[1-r].type == YASM_EXPR_INT &&
+            !yasm_intnum_is_zero(e->terms[1-r].data.intn) &&
+            yasm_intnum_check_size(e->terms[1-r].data.intn, 8, 0, 0)) {
+            reg->reg = e->terms[r].data.reg;
+            reg->mult = yasm_intnum_get_int(e->terms[1-r].data.intn);
+            reg->explicit_mult = 1;
+            return 1;
+        }
+    }
+    return yasm_expr__contains(e, YASM_EXPR_REG) ? -1 : 0;
+}
+
+/* Drop the register terms (flagged in isreg) from a sum, returning what's
+ * left of it, or NULL if nothing is.
+ */
+static /*@null@*/ yasm_expr *
+memaddr_strip_regs(/*@only@*/ yasm_expr *e, const unsigned char *isreg)
+{
+    yasm_expr *ne;
+    int i, j;
+
+    for (i=0, j=0; i<e->numterms; i++) {
+        if (!isreg[i])
+            e->terms[j++] = e->terms[i];
+        else if (e->terms[i].type == YASM_EXPR_EXPR)
+            yasm_expr_destroy(e->terms[i].data.expn);
+    }
+    e->numterms = j;
+    if (j == 1 && e->terms[0].type == YASM_EXPR_EXPR) {
+        ne = e->terms[0].data.expn;
+        e->numterms = 0;
+        yasm_expr_destroy(e);
+        return ne;
+    }
+    if (j == 0) {
+        yasm_expr_destroy(e);
+        return NULL;
+    }
+    if (j == 1)
+        e->op = YASM_EXPR_IDENT;
+    return e;
+}
+
+/* Create an effective address for the common [reg + reg*scale + disp] and
+ * [... - disp] shapes by handing the architecture the registers directly,
+ * saving it from taking the whole expression apart again later.  Returns
+ * NULL, with e untouched, for any other shape.
+ */
+static /*@null@*/ yasm_effaddr *
+memaddr_create_regs(yasm_parser_nasm *parser_nasm, yasm_expr *e)
+{
+    yasm_arch_ea_reg regs[3];
+    unsigned char isreg[32];
+    yasm_expr__item whole;
+    yasm_expr *sum = e, *disp;
+    yasm_effaddr *ea;
+    size_t nregs = 0;
+    int i, n;
+
+    if (e->op == YASM_EXPR_SUB && e->numterms == 2) {
+        /* Registers on the left only */
+        if (memaddr_regterm(&e->terms[1], &regs[0]) != 0)
+            return NULL;
+        if (e->terms[0].type == YASM_EXPR_EXPR &&
+            e->terms[0].data.expn->op == YASM_EXPR_ADD)
+            sum = e->terms[0].data.expn;
+        else {
+            n = memaddr_regterm(&e->terms[0], &regs[0]);
+            if (n != 1)
+                return NULL;
+            nregs = 1;
+            sum = NULL;
+        }
+    } else if (e->op == YASM_EXPR_MUL) {
+        whole.type = YASM_EXPR_EXPR;
+        whole.data.expn = e;
+        if (memaddr_regterm(&whole, &regs[0]) != 1)
+            return NULL;
+        nregs = 1;
+        sum = NULL;
+    } else if (e->op != YASM_EXPR_ADD && e->op != YASM_EXPR_IDENT)
+        return NULL;
+
+    if (sum) {
+        if (sum->numterms > (int)NELEMS(isreg))
+            return NULL;
+        for (i=0; i<sum->numterms; i++) {
+            n = memaddr_regterm(&sum->terms[i], &regs[nregs]);
+            if (n < 0)
+                return NULL;
+            isreg[i] = (unsigned char)n;
+            if (n && ++nregs > 2)
+                return NULL;
+        }
+    }
+    if (nregs == 0)
+        return NULL;
+
+    /* Shape matches; what remains once the registers are taken out is the
+     * displacement.
+     */
+    if (e->op == YASM_EXPR_SUB) {
+        if (sum)
+            disp = memaddr_strip_regs(sum, isreg);
+        else {
+            if (e->terms[0].type == YASM_EXPR_EXPR)
+                yasm_expr_destroy(e->terms[0].data.expn);
+            disp = NULL;
+        }
+        if (disp) {
+            e->terms[0].type = YASM_EXPR_EXPR;
+            e->terms[0].data.expn = disp;
+        } else {
+            e->op = YASM_EXPR_NEG;
+            e->terms[0] = e->terms[1];
+            e->numterms = 1;
+        }
+        disp = e;
+    } else if (sum)
+        disp = memaddr_strip_regs(sum, isreg);
+    else {
+        yasm_expr_destroy(e);
+        disp = NULL;
+    }
+
+    ea = yasm_arch_ea_create_regs(p_object->arch, regs, nregs, disp);
+    if (ea)
+        return ea;
+
+    /* Not taken; put the registers back in front of the displacement. */
+    while (nregs-- > 0) {
+        yasm_expr__item *term = yasm_expr_reg(regs[nregs].reg);
+        if (regs[nregs].explicit_mult)
+            term = yasm_expr_expr(yasm_expr_create(YASM_EXPR_MUL, term,
+                yasm_expr_int(yasm_intnum_create_int(regs[nregs].mult)),
+                cur_line));
+        if (disp)
+            disp = yasm_expr_create(YASM_EXPR_ADD, term,
+                                    yasm_expr_expr(disp), cur_line);
+        else
+            disp = p_expr_new_ident(term);
+    }
+    return yasm_arch_ea_create(p_object->arch, disp);
+}
+
 static yasm_insn_operand *
 parse_memaddr(yasm_parser_nasm *parser_nasm)
 {
@@ -1143,8 +1319,16 @@ parse_memaddr(yasm_parser_nasm *parser_nasm)
             if (!e)
                 return NULL;
             if (curtok != ':') {
-                yasm_effaddr *ea = yasm_arch_ea_create(p_object->arch, e);
-                yasm_ea_set_implicit_size_segment(parser_nasm, ea, e);
+                yasm_effaddr *ea = NULL;
+                /* TASM needs e itself for its implicit size and segment,
+                 * and OFFSET (TASM/MASM only) wants the whole expression.
+                 */
+                if (!parser_nasm->tasm && !parser_nasm->masm)
+                    ea = memaddr_create_regs(parser_nasm, e);
+                if (!ea) {
+                    ea = yasm_arch_ea_create(p_object->arch, e);
+                    yasm_ea_set_implicit_size_segment(parser_nasm, ea, e);
+                }
                 return yasm_operand_create_mem(ea);
             } else {
                 yasm_effaddr *ea;
@@ -1462,7 +1646,7 @@ parse_expr6(yasm_parser_nasm *parser_nasm, expr_type type)
         case ID:
         case LOCAL_ID:
         case NONLOCAL_ID:
-            sym = yasm_symtab_use(p_symtab, ID_val, cur_line);
+            sym = use_symbol(parser_nasm, curtok, ID_val);
             e = p_expr_new_ident(yasm_expr_sym(sym));
             yasm_xfree(ID_val);
             break;
@@ -1497,25 +1681,41 @@ parse_expr6(yasm_parser_nasm *parser_nasm, expr_type type)
 static void
 set_nonlocal_label(yasm_parser_nasm *parser_nasm, const char *name)
 {
-    if (!parser_nasm->tasm || tasm_locals) {
-        if (parser_nasm->locallabel_base)
-            yasm_xfree(parser_nasm->locallabel_base);
-        parser_nasm->locallabel_base_len = strlen(name);
-        parser_nasm->locallabel_base =
-            yasm_xmalloc(parser_nasm->locallabel_base_len+1);
-        strcpy(parser_nasm->locallabel_base, name);
-    }
+    /* name is kept until define_label() switches to the symbol's name */
+    if (!parser_nasm->tasm || tasm_locals)
+        parser_nasm->locallabel_base = name;
+}
+
+/* Use the symbol named by an identifier token; local labels (LOCAL_ID) are
+ * named relative to the current non-local label.
+ */
+static yasm_symrec *
+use_symbol(yasm_parser_nasm *parser_nasm, int token, const char *name)
+{
+    if (token == LOCAL_ID)
+        return yasm_symtab_use_local(p_symtab, parser_nasm->locallabel_base,
+                                     name, cur_line);
+    return yasm_symtab_use(p_symtab, name, cur_line);
 }
 
 static void
-define_label(yasm_parser_nasm *parser_nasm, char *name, unsigned int size)
+define_label(yasm_parser_nasm *parser_nasm, char *name, int token,
+             unsigned int size)
 {
+    const char *parent = parser_nasm->locallabel_base;
     yasm_symrec *symrec;
 
-    if (parser_nasm->abspos)
-        symrec = yasm_symtab_define_equ(p_symtab, name,
-                                        yasm_expr_copy(parser_nasm->abspos),
-                                        cur_line);
+    if (parser_nasm->abspos) {
+        yasm_expr *e = yasm_expr_copy(parser_nasm->abspos);
+        if (token == LOCAL_ID)
+            symrec = yasm_symtab_define_equ_local(p_symtab, parent, name, e,
+                                                  cur_line);
+        else
+            symrec = yasm_symtab_define_equ(p_symtab, name, e, cur_line);
+    } else if (token == LOCAL_ID)
+        symrec = yasm_symtab_define_label_local(p_symtab, parent, name,
+                                                parser_nasm->prev_bc,
+                                                cur_line);
     else
         symrec = yasm_symtab_define_label(p_symtab, name, parser_nasm->prev_bc,
                                           1, cur_line);
@@ -1523,6 +1723,10 @@ define_label(yasm_parser_nasm *parser_nasm, char *name, unsigned int size)
     yasm_symrec_set_size(symrec, size);
     yasm_symrec_set_segment(symrec, tasm_segment);
 
+    /* name is about to be freed; use the symbol's copy as the base */
+    if (parent == name)
+        parser_nasm->locallabel_base = yasm_symrec_get_name(symrec);
+
     yasm_xfree(name);
 }
 
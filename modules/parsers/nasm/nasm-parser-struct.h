@@ -46,9 +46,11 @@ typedef struct yasm_parser_nasm {
 
     /*@only@*/ yasm_object *object;
 
-    /* last "base" label for local (.) labels */
-    /*@null@*/ char *locallabel_base;
-    size_t locallabel_base_len;
+    /* last "base" label for local (.) labels; local labels are looked up
+     * by this name and their suffix.  Not a copy: it's the name of the
+     * label's symbol, or the label token until the label is defined.
+     */
+    /*@null@*/ /*@dependent@*/ const char *locallabel_base;
 
     /*@dependent@*/ yasm_preproc *preproc;
     /*@dependent@*/ yasm_errwarns *errwarns;
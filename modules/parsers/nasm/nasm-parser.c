@@ -43,8 +43,7 @@ nasm_do_parse(yasm_object *object, yasm_preproc *pp, int save_input,
     parser_nasm.object = object;
     parser_nasm.linemap = linemap;
 
-    parser_nasm.locallabel_base = (char *)NULL;
-    parser_nasm.locallabel_base_len = 0;
+    parser_nasm.locallabel_base = NULL;
 
     parser_nasm.preproc = pp;
     parser_nasm.errwarns = errwarns;
@@ -67,10 +66,6 @@ nasm_do_parse(yasm_object *object, yasm_preproc *pp, int save_input,
 
     /*yasm_scanner_delete(&parser_nasm.s);*/
 
-    /* Free locallabel base if necessary */
-    if (parser_nasm.locallabel_base)
-        yasm_xfree(parser_nasm.locallabel_base);
-
     /* Check for undefined symbols */
     yasm_symtab_parser_finalize(object->symtab, 0, errwarns);
 }
@@ -0,0 +1,10 @@
+; local labels referenced by full name before and after their definition
+first:  db .end - first
+db first.mid - first
+.mid:
+db .mid - first
+.len equ .end - .mid
+db first.len
+.end:
+second: db .end - second, first.end - first
+.end:
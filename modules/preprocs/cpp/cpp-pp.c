@@ -0,0 +1,2309 @@
+/*
+ * In-process C preprocessor
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <util.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include <libyasm.h>
+
+#include "cpp-pp.h"
+
+
+/* Maximum nesting of #include */
+#define CPP_MAX_INCLUDE_DEPTH   200
+
+/* Emit a line marker rather than this many blank lines */
+#define CPP_MAX_BLANK_LINES     8
+
+/*******************************************************************************
+    Structures.
+*******************************************************************************/
+
+typedef enum cpp_token_type {
+    CPP_TOK_SPACE = 0,
+    CPP_TOK_IDENT,
+    CPP_TOK_NUMBER,
+    CPP_TOK_STRING,         /* string or character literal */
+    CPP_TOK_PUNCT,
+    CPP_TOK_PLACEMARKER,    /* empty operand of ## */
+    CPP_TOK_MACRO_END       /* end of a macro's replacement during rescan */
+} cpp_token_type;
+
+typedef struct cpp_token {
+    cpp_token_type type;
+
+    /* Nonzero if an identifier must not be expanded again, because it named
+     * a macro that was being expanded when it was encountered.
+     */
+    int noexpand;
+
+    /* In macro bodies, the parameter index of an identifier; otherwise -1. */
+    int param;
+
+    /*@dependent@*/ const char *text;
+    size_t len;
+
+    /* Macro to re-enable for CPP_TOK_MACRO_END */
+    /*@dependent@*/ /*@null@*/ struct cpp_macro *macro;
+} cpp_token;
+
+typedef struct cpp_tokens {
+    /*@only@*/ /*@null@*/ cpp_token *tok;
+    size_t num, alloc;
+} cpp_tokens;
+
+typedef enum cpp_builtin {
+    CPP_BUILTIN_NONE = 0,
+    CPP_BUILTIN_FILE,
+    CPP_BUILTIN_LINE
+} cpp_builtin;
+
+typedef struct cpp_macro {
+    /*@only@*/ char *name;
+
+    int defined;            /* zero after #undef */
+    cpp_builtin builtin;
+
+    int funclike;
+    int variadic;           /* last parameter collects remaining arguments */
+    int nparams;
+    /*@only@*/ /*@null@*/ char **params;
+
+    /* Replacement list, with whitespace normalized to single spaces, and its
+     * tokens (which point into it).
+     */
+    /*@only@*/ /*@null@*/ char *body;
+    cpp_tokens body_toks;
+
+    int disabled;           /* nonzero while its replacement is rescanned */
+} cpp_macro;
+
+typedef struct cpp_source {
+    /*@null@*/ struct cpp_source *parent;
+
+    /*@only@*/ char *path;  /* file path, for relative includes */
+    /*@only@*/ char *name;  /* name for line markers and __FILE__ */
+
+    /*@only@*/ char *buf;   /* entire file contents */
+    char *pos, *end;
+
+    unsigned long line;     /* last physical line read */
+    size_t cond_depth;      /* conditional nesting depth on entry */
+} cpp_source;
+
+typedef enum cpp_cond_state {
+    CPP_COND_TAKING = 0,    /* in the group being taken */
+    CPP_COND_SEEKING,       /* no group taken yet */
+    CPP_COND_DONE           /* a group was taken (or the parent is skipped) */
+} cpp_cond_state;
+
+typedef struct cpp_cond {
+    cpp_cond_state state;
+    int seen_else;
+} cpp_cond;
+
+typedef struct cpp_buf {
+    /*@only@*/ /*@null@*/ char *s;
+    size_t len, alloc;
+} cpp_buf;
+
+/* Storage for text created during expansion of a single line. */
+typedef struct cpp_pool_chunk {
+    /*@null@*/ struct cpp_pool_chunk *next;
+    size_t used, size;
+    char data[1];
+} cpp_pool_chunk;
+
+typedef struct cpp_dep {
+    STAILQ_ENTRY(cpp_dep) link;
+    /*@only@*/ char *name;
+} cpp_dep;
+
+typedef struct cpp_include {
+    STAILQ_ENTRY(cpp_include) link;
+    /*@only@*/ char *name;
+} cpp_include;
+
+struct cpp_pp {
+    /*@only@*/ char *in_filename;
+    yasm_linemap *cur_lm;
+    yasm_errwarns *errwarns;
+
+    /*@only@*/ HAMT *macros;
+
+    int started, done;
+    /*@null@*/ cpp_source *src;
+    /*@null@*/ /*@dependent@*/ cpp_source *main_src;
+    int depth;
+
+    /* -include files not yet processed */
+    STAILQ_HEAD(cpp_include_head, cpp_include) includes;
+
+    /*@only@*/ /*@null@*/ cpp_cond *conds;
+    size_t num_conds, alloc_conds;
+
+    cpp_buf lbuf;           /* current logical line */
+    cpp_buf jbuf;           /* lines joined for a macro invocation */
+    cpp_buf out;            /* output line */
+    cpp_buf key;            /* macro name lookup key */
+    cpp_buf mbuf;           /* line marker or blank line before held line */
+
+    /* Blank lines owed to keep the output in step with the input.  They are
+     * emitted only before the next text line (which is held in out
+     * meanwhile), so that line markers can absorb them.
+     */
+    unsigned long pending_blank;
+    int held;
+    unsigned long held_line;        /* input line of held line */
+    unsigned long held_extra;       /* extra input lines it spans */
+    unsigned long cur_line; /* first physical line of logical line */
+
+    /*@null@*/ cpp_pool_chunk *pool;
+
+    STAILQ_HEAD(cpp_dep_head, cpp_dep) deps;
+    int deps_started;
+    /*@null@*/ /*@dependent@*/ cpp_dep *next_dep;
+};
+
+typedef enum cpp_line_kind {
+    CPP_LINE_BLANK = 0,     /* directive consumed the line */
+    CPP_LINE_OUTPUT,        /* directive produced output (a line marker) */
+    CPP_LINE_TEXT           /* not a directive; treat as text */
+} cpp_line_kind;
+
+static void cpp_define(cpp_pp *pp, const char *p);
+static int cpp_expand(cpp_pp *pp, cpp_tokens *in, cpp_tokens *out,
+                      int in_if);
+
+/*******************************************************************************
+    Helpers.
+*******************************************************************************/
+
+/* Attach any error or warning to the input line being preprocessed. */
+static void
+cpp_error_propagate(cpp_pp *pp)
+{
+    if (!pp->src) {
+        yasm_errwarn_propagate(pp->errwarns,
+                               yasm_linemap_get_current(pp->cur_lm));
+        return;
+    }
+    yasm_errwarn_propagate(pp->errwarns,
+        yasm_linemap_poke(pp->cur_lm, pp->src->name, pp->cur_line));
+}
+
+static void
+buf_init(cpp_buf *b)
+{
+    b->s = NULL;
+    b->len = 0;
+    b->alloc = 0;
+}
+
+static void
+buf_reserve(cpp_buf *b, size_t n)
+{
+    if (b->len + n + 1 > b->alloc) {
+        b->alloc = b->alloc ? b->alloc : 128;
+        while (b->len + n + 1 > b->alloc)
+            b->alloc *= 2;
+        b->s = yasm_xrealloc(b->s, b->alloc);
+    }
+}
+
+static void
+buf_append(cpp_buf *b, const char *s, size_t n)
+{
+    buf_reserve(b, n);
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = '\0';
+}
+
+static void
+buf_set(cpp_buf *b, const char *s, size_t n)
+{
+    b->len = 0;
+    buf_append(b, s, n);
+}
+
+static void
+buf_free(cpp_buf *b)
+{
+    if (b->s)
+        yasm_xfree(b->s);
+}
+
+static void
+toks_push(cpp_tokens *toks, const cpp_token *tok)
+{
+    if (toks->num >= toks->alloc) {
+        toks->alloc = toks->alloc ? toks->alloc*2 : 16;
+        toks->tok = yasm_xrealloc(toks->tok, toks->alloc*sizeof(cpp_token));
+    }
+    toks->tok[toks->num++] = *tok;
+}
+
+static void
+toks_append(cpp_tokens *toks, const cpp_tokens *src)
+{
+    size_t i;
+    for (i=0; i<src->num; i++)
+        toks_push(toks, &src->tok[i]);
+}
+
+static void
+toks_init(cpp_tokens *toks)
+{
+    toks->tok = NULL;
+    toks->num = 0;
+    toks->alloc = 0;
+}
+
+static void
+toks_free(cpp_tokens *toks)
+{
+    if (toks->tok)
+        yasm_xfree(toks->tok);
+    toks_init(toks);
+}
+
+static int
+tok_is(const cpp_token *tok, const char *punct)
+{
+    return tok->type == CPP_TOK_PUNCT && tok->len == strlen(punct) &&
+        strncmp(tok->text, punct, tok->len) == 0;
+}
+
+static char *
+pool_alloc(cpp_pp *pp, size_t n)
+{
+    cpp_pool_chunk *chunk = pp->pool;
+
+    if (!chunk || chunk->used + n > chunk->size) {
+        size_t size = n > 4096 ? n : 4096;
+        chunk = yasm_xmalloc(sizeof(cpp_pool_chunk) + size);
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->next = pp->pool;
+        pp->pool = chunk;
+    }
+    chunk->used += n;
+    return &chunk->data[chunk->used - n];
+}
+
+/* Release all pool storage except the most recent chunk. */
+static void
+pool_reset(cpp_pp *pp)
+{
+    cpp_pool_chunk *chunk;
+
+    if (!pp->pool)
+        return;
+    while ((chunk = pp->pool->next) != NULL) {
+        pp->pool->next = chunk->next;
+        yasm_xfree(chunk);
+    }
+    pp->pool->used = 0;
+}
+
+static const char *
+skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\f' || *p == '\r')
+        p++;
+    return p;
+}
+
+static size_t
+ident_len(const char *p)
+{
+    size_t n = 0;
+    if (!isalpha((unsigned char)p[0]) && p[0] != '_')
+        return 0;
+    while (isalnum((unsigned char)p[n]) || p[n] == '_')
+        n++;
+    return n;
+}
+
+/*******************************************************************************
+    Tokenizer.
+*******************************************************************************/
+
+static void
+cpp_tokenize(const char *s, size_t len, cpp_tokens *toks)
+{
+    static const char *puncts2[] = {
+        "##", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||"
+    };
+    const char *end = s + len;
+
+    while (s < end) {
+        cpp_token tok;
+        unsigned char c = (unsigned char)*s;
+
+        tok.noexpand = 0;
+        tok.param = -1;
+        tok.macro = NULL;
+        tok.text = s;
+
+        if (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r') {
+            while (s < end && (*s == ' ' || *s == '\t' || *s == '\v' ||
+                               *s == '\f' || *s == '\r'))
+                s++;
+            tok.type = CPP_TOK_SPACE;
+        } else if (isalpha(c) || c == '_') {
+            while (s < end && (isalnum((unsigned char)*s) || *s == '_'))
+                s++;
+            tok.type = CPP_TOK_IDENT;
+        } else if (isdigit(c) ||
+                   (c == '.' && s+1 < end && isdigit((unsigned char)s[1]))) {
+            s++;
+            while (s < end) {
+                if ((*s == '+' || *s == '-') && strchr("eEpP", s[-1]))
+                    s++;
+                else if (isalnum((unsigned char)*s) || *s == '_' || *s == '.')
+                    s++;
+                else
+                    break;
+            }
+            tok.type = CPP_TOK_NUMBER;
+        } else if (c == '"' || c == '\'') {
+            /* Unterminated literals extend to the end of the line */
+            s++;
+            while (s < end && *s != (char)c) {
+                if (*s == '\\' && s+1 < end)
+                    s++;
+                s++;
+            }
+            if (s < end)
+                s++;
+            tok.type = CPP_TOK_STRING;
+        } else {
+            size_t i;
+            tok.type = CPP_TOK_PUNCT;
+            s++;
+            if (s < end) {
+                for (i=0; i<NELEMS(puncts2); i++) {
+                    if (puncts2[i][0] == (char)c && puncts2[i][1] == *s) {
+                        s++;
+                        break;
+                    }
+                }
+            }
+        }
+        tok.len = (size_t)(s - tok.text);
+        toks_push(toks, &tok);
+    }
+}
+
+/*******************************************************************************
+    Macros.
+*******************************************************************************/
+
+static void
+cpp_macro_clear(cpp_macro *m)
+{
+    int i;
+
+    for (i=0; i<m->nparams; i++)
+        yasm_xfree(m->params[i]);
+    if (m->params)
+        yasm_xfree(m->params);
+    if (m->body)
+        yasm_xfree(m->body);
+    toks_free(&m->body_toks);
+    m->params = NULL;
+    m->nparams = 0;
+    m->body = NULL;
+    m->funclike = 0;
+    m->variadic = 0;
+    m->builtin = CPP_BUILTIN_NONE;
+    m->defined = 0;
+}
+
+static void
+cpp_macro_delete(/*@only@*/ void *data)
+{
+    cpp_macro *m = data;
+    cpp_macro_clear(m);
+    yasm_xfree(m->name);
+    yasm_xfree(m);
+}
+
+/* Get the macro entry for a name, creating an undefined one if needed. */
+static cpp_macro *
+cpp_macro_get(cpp_pp *pp, const char *name, size_t len)
+{
+    cpp_macro *m;
+    int replace = 0;
+
+    buf_set(&pp->key, name, len);
+    m = HAMT_search(pp->macros, pp->key.s);
+    if (m)
+        return m;
+
+    m = yasm_xmalloc(sizeof(cpp_macro));
+    m->name = yasm__xstrndup(name, len);
+    m->defined = 0;
+    m->builtin = CPP_BUILTIN_NONE;
+    m->funclike = 0;
+    m->variadic = 0;
+    m->nparams = 0;
+    m->params = NULL;
+    m->body = NULL;
+    toks_init(&m->body_toks);
+    m->disabled = 0;
+    return HAMT_insert(pp->macros, m->name, m, &replace, cpp_macro_delete);
+}
+
+/* Look up a defined macro. */
+static /*@null@*/ cpp_macro *
+cpp_macro_find(cpp_pp *pp, const char *name, size_t len)
+{
+    cpp_macro *m;
+
+    buf_set(&pp->key, name, len);
+    m = HAMT_search(pp->macros, pp->key.s);
+    if (m && !m->defined)
+        return NULL;
+    return m;
+}
+
+static int
+cpp_macro_param(const cpp_macro *m, const char *name, size_t len)
+{
+    int i;
+    for (i=0; i<m->nparams; i++) {
+        if (strlen(m->params[i]) == len && strncmp(m->params[i], name, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Parse a #define (p points after "define"). */
+static void
+cpp_define(cpp_pp *pp, const char *p)
+{
+    cpp_macro *m;
+    size_t namelen, i, nbody;
+    int funclike = 0, variadic = 0, nparams = 0, same;
+    char **params = NULL;
+    cpp_tokens toks;
+    cpp_buf body;
+    const cpp_token *prev = NULL;
+    int space = 0;
+
+    p = skip_space(p);
+    namelen = ident_len(p);
+    if (namelen == 0) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("macro names must be identifiers"));
+        cpp_error_propagate(pp);
+        return;
+    }
+    if (namelen == 7 && strncmp(p, "defined", 7) == 0) {
+        yasm_error_set(YASM_ERROR_SYNTAX,
+                       N_("`defined' cannot be used as a macro name"));
+        cpp_error_propagate(pp);
+        return;
+    }
+
+    m = cpp_macro_get(pp, p, namelen);
+    p += namelen;
+
+    /* Parameter list must immediately follow the name */
+    if (*p == '(') {
+        funclike = 1;
+        p = skip_space(p+1);
+        if (*p != ')') {
+            for (;;) {
+                size_t len;
+                p = skip_space(p);
+                if (strncmp(p, "...", 3) == 0) {
+                    len = 0;
+                    variadic = 1;
+                } else if ((len = ident_len(p)) == 0)
+                    break;
+                params = yasm_xrealloc(params, (nparams+1)*sizeof(char *));
+                params[nparams++] = len ? yasm__xstrndup(p, len)
+                                        : yasm__xstrdup("__VA_ARGS__");
+                p = skip_space(p + (len ? len : 3));
+                if (len && strncmp(p, "...", 3) == 0) {
+                    variadic = 1;   /* GNU named variadic parameter */
+                    p = skip_space(p+3);
+                }
+                if (*p != ',' || variadic)
+                    break;
+                p++;
+            }
+        }
+        if (*p != ')') {
+            yasm_error_set(YASM_ERROR_SYNTAX,
+                           N_("invalid parameter list for macro `%s'"),
+                           m->name);
+            cpp_error_propagate(pp);
+            while (nparams > 0)
+                yasm_xfree(params[--nparams]);
+            if (params)
+                yasm_xfree(params);
+            return;
+        }
+        p++;
+    }
+
+    /* Normalize the replacement list: single spaces between tokens, none
+     * around ## or between # and a parameter name.  A space between # and
+     * ## is kept so that they don't run together into ##.
+     */
+    toks_init(&toks);
+    cpp_tokenize(p, strlen(p), &toks);
+    buf_init(&body);
+    buf_reserve(&body, 0);
+    body.s[0] = '\0';
+    for (i=0; i<toks.num; i++) {
+        const cpp_token *tok = &toks.tok[i];
+        if (tok->type == CPP_TOK_SPACE) {
+            space = 1;
+            continue;
+        }
+        if (space && prev &&
+            ((!tok_is(prev, "##") && !tok_is(tok, "##")) ||
+             tok_is(prev, "#") || tok_is(tok, "#")) &&
+            !(funclike && tok_is(prev, "#") && tok->type == CPP_TOK_IDENT))
+            buf_append(&body, " ", 1);
+        buf_append(&body, tok->text, tok->len);
+        prev = tok;
+        space = 0;
+    }
+    toks_free(&toks);
+
+    /* Identical redefinition is allowed silently */
+    same = m->defined && !m->builtin && m->funclike == funclike &&
+        m->variadic == variadic && m->nparams == nparams &&
+        strcmp(m->body, body.s) == 0;
+    for (i=0; same && i<(size_t)nparams; i++)
+        same = strcmp(m->params[i], params[i]) == 0;
+    if (m->defined && !same) {
+        yasm_warn_set(YASM_WARN_PREPROC, N_("`%s' redefined"), m->name);
+        cpp_error_propagate(pp);
+    }
+
+    cpp_macro_clear(m);
+    m->defined = 1;
+    m->funclike = funclike;
+    m->variadic = variadic;
+    m->nparams = nparams;
+    m->params = params;
+    m->body = body.s;
+
+    /* Drop any spaces left around ## so its operands are adjacent */
+    cpp_tokenize(m->body, body.len, &m->body_toks);
+    nbody = 0;
+    for (i=0; i<m->body_toks.num; i++) {
+        cpp_token *tok = &m->body_toks.tok[i];
+        if (tok->type == CPP_TOK_SPACE &&
+            ((nbody > 0 && tok_is(&m->body_toks.tok[nbody-1], "##")) ||
+             (i+1 < m->body_toks.num &&
+              tok_is(&m->body_toks.tok[i+1], "##"))))
+            continue;
+        if (tok->type == CPP_TOK_IDENT)
+            tok->param = cpp_macro_param(m, tok->text, tok->len);
+        m->body_toks.tok[nbody++] = *tok;
+    }
+    m->body_toks.num = nbody;
+    if (nbody > 0 && (tok_is(&m->body_toks.tok[0], "##") ||
+                      tok_is(&m->body_toks.tok[nbody-1], "##"))) {
+        yasm_error_set(YASM_ERROR_SYNTAX,
+            N_("`##' cannot appear at either end of a macro expansion"));
+        cpp_error_propagate(pp);
+        cpp_macro_clear(m);
+    }
+}
+
+static void
+cpp_undef(cpp_pp *pp, const char *p)
+{
+    size_t len;
+    cpp_macro *m;
+
+    p = skip_space(p);
+    len = ident_len(p);
+    if (len == 0) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("macro names must be identifiers"));
+        cpp_error_propagate(pp);
+        return;
+    }
+    m = cpp_macro_find(pp, p, len);
+    if (m)
+        cpp_macro_clear(m);
+}
+
+/*******************************************************************************
+    Macro expansion.
+*******************************************************************************/
+
+/* Make a string literal out of a macro argument. */
+static void
+cpp_stringize(cpp_pp *pp, const cpp_tokens *arg, cpp_token *result)
+{
+    size_t i, j, len = 2;
+    char *s;
+
+    for (i=0; i<arg->num; i++)
+        len += 2*arg->tok[i].len + 1;
+    s = pool_alloc(pp, len);
+
+    len = 0;
+    s[len++] = '"';
+    for (i=0; i<arg->num; i++) {
+        const cpp_token *tok = &arg->tok[i];
+        if (tok->type == CPP_TOK_SPACE) {
+            if (len > 1 && s[len-1] != ' ')
+                s[len++] = ' ';
+            continue;
+        }
+        for (j=0; j<tok->len; j++) {
+            if (tok->type == CPP_TOK_STRING &&
+                (tok->text[j] == '"' || tok->text[j] == '\\'))
+                s[len++] = '\\';
+            s[len++] = tok->text[j];
+        }
+    }
+    if (len > 1 && s[len-1] == ' ')
+        len--;
+    s[len++] = '"';
+
+    result->type = CPP_TOK_STRING;
+    result->noexpand = 0;
+    result->param = -1;
+    result->text = s;
+    result->len = len;
+    result->macro = NULL;
+}
+
+/* Paste rhs onto the last token of result. */
+static void
+cpp_paste(cpp_pp *pp, cpp_tokens *result, const cpp_token *rhs)
+{
+    cpp_token *lhs = &result->tok[result->num-1];
+    cpp_tokens pasted;
+    char *s;
+    size_t i;
+
+    s = pool_alloc(pp, lhs->len + rhs->len);
+    memcpy(s, lhs->text, lhs->len);
+    memcpy(s + lhs->len, rhs->text, rhs->len);
+
+    toks_init(&pasted);
+    cpp_tokenize(s, lhs->len + rhs->len, &pasted);
+    result->num--;
+    for (i=0; i<pasted.num; i++)
+        toks_push(result, &pasted.tok[i]);
+    toks_free(&pasted);
+}
+
+/* Substitute the arguments into a macro's replacement list. */
+static void
+cpp_substitute(cpp_pp *pp, cpp_macro *m, cpp_tokens *args,
+               /*@null@*/ cpp_tokens *expanded, cpp_tokens *result)
+{
+    const cpp_tokens *body = &m->body_toks;
+    size_t i, j;
+
+    for (i=0; i<body->num; i++) {
+        const cpp_token *tok = &body->tok[i];
+
+        if (m->funclike && tok_is(tok, "#") && i+1 < body->num &&
+            body->tok[i+1].param >= 0) {
+            cpp_token str;
+            cpp_stringize(pp, &args[body->tok[i+1].param], &str);
+            toks_push(result, &str);
+            i++;
+            continue;
+        }
+
+        if (tok_is(tok, "##") && i+1 < body->num) {
+            const cpp_token *next = &body->tok[++i];
+            const cpp_token *rhs = next;
+            size_t nrhs = 1;
+
+            if (next->param >= 0) {
+                rhs = args[next->param].tok;
+                nrhs = args[next->param].num;
+                /* GNU extension: , ## __VA_ARGS__ drops the comma if there
+                 * are no variable arguments.
+                 */
+                if (m->variadic && next->param == m->nparams-1 && nrhs == 0 &&
+                    result->num > 0 && tok_is(&result->tok[result->num-1], ",")) {
+                    result->num--;
+                    continue;
+                }
+            }
+            if (nrhs == 0)
+                continue;
+            if (result->num == 0 ||
+                result->tok[result->num-1].type == CPP_TOK_PLACEMARKER) {
+                if (result->num > 0)
+                    result->num--;
+                toks_push(result, &rhs[0]);
+            } else
+                cpp_paste(pp, result, &rhs[0]);
+            for (j=1; j<nrhs; j++)
+                toks_push(result, &rhs[j]);
+            continue;
+        }
+
+        if (tok->param >= 0) {
+            int n = tok->param;
+            if (i+1 < body->num && tok_is(&body->tok[i+1], "##")) {
+                if (args[n].num == 0) {
+                    cpp_token pm = *tok;
+                    pm.type = CPP_TOK_PLACEMARKER;
+                    pm.len = 0;
+                    toks_push(result, &pm);
+                } else
+                    toks_append(result, &args[n]);
+                continue;
+            }
+            if (!expanded[n].tok && args[n].num > 0) {
+                cpp_tokens in;
+                toks_init(&in);
+                toks_append(&in, &args[n]);
+                cpp_expand(pp, &in, &expanded[n], 0);
+                toks_free(&in);
+            }
+            toks_append(result, &expanded[n]);
+            continue;
+        }
+
+        toks_push(result, tok);
+        result->tok[result->num-1].param = -1;
+    }
+
+    /* Remove placemarkers */
+    for (i=0, j=0; i<result->num; i++) {
+        if (result->tok[i].type != CPP_TOK_PLACEMARKER)
+            result->tok[j++] = result->tok[i];
+    }
+    result->num = j;
+}
+
+/* Pop a token off the rescan stack, re-enabling macros whose replacement
+ * ends.  Returns NULL if the stack is empty.
+ */
+static /*@null@*/ cpp_token *
+cpp_pop(cpp_tokens *stk)
+{
+    while (stk->num > 0) {
+        cpp_token *tok = &stk->tok[--stk->num];
+        if (tok->type != CPP_TOK_MACRO_END)
+            return tok;
+        tok->macro->disabled = 0;
+    }
+    return NULL;
+}
+
+static void
+cpp_trim(cpp_tokens *toks)
+{
+    size_t start = 0;
+    while (toks->num > 0 && toks->tok[toks->num-1].type == CPP_TOK_SPACE)
+        toks->num--;
+    while (start < toks->num && toks->tok[start].type == CPP_TOK_SPACE)
+        start++;
+    if (start > 0) {
+        memmove(toks->tok, &toks->tok[start],
+                (toks->num-start)*sizeof(cpp_token));
+        toks->num -= start;
+    }
+}
+
+/* Collect the arguments of a function-like macro invocation from the rescan
+ * stack; the opening parenthesis has been popped.  Returns the number of
+ * arguments, or -1 if the closing parenthesis was not found.
+ */
+static int
+cpp_collect_args(cpp_tokens *stk, const cpp_macro *m, cpp_tokens **argsp)
+{
+    int nargs = 1, alloc = m->nparams > 0 ? m->nparams : 1;
+    int depth = 0, i;
+    cpp_tokens *args = yasm_xmalloc(alloc*sizeof(cpp_tokens));
+    cpp_token *tok;
+
+    toks_init(&args[0]);
+    for (;;) {
+        tok = cpp_pop(stk);
+        if (!tok) {
+            for (i=0; i<nargs; i++)
+                toks_free(&args[i]);
+            yasm_xfree(args);
+            return -1;
+        }
+        if (tok_is(tok, "("))
+            depth++;
+        else if (tok_is(tok, ")")) {
+            if (depth == 0)
+                break;
+            depth--;
+        } else if (tok_is(tok, ",") && depth == 0 &&
+                   !(m->variadic && nargs == m->nparams)) {
+            if (nargs == alloc) {
+                alloc *= 2;
+                args = yasm_xrealloc(args, alloc*sizeof(cpp_tokens));
+            }
+            toks_init(&args[nargs++]);
+            continue;
+        }
+        toks_push(&args[nargs-1], tok);
+    }
+
+    for (i=0; i<nargs; i++)
+        cpp_trim(&args[i]);
+    *argsp = args;
+    return nargs;
+}
+
+/* Expand the operand of `defined' in a #if expression. */
+static void
+cpp_expand_defined(cpp_pp *pp, cpp_tokens *stk, cpp_tokens *out)
+{
+    cpp_token *tok, result;
+    int paren = 0, value = 0;
+
+    while ((tok = cpp_pop(stk)) && tok->type == CPP_TOK_SPACE)
+        ;
+    if (tok && tok_is(tok, "(")) {
+        paren = 1;
+        while ((tok = cpp_pop(stk)) && tok->type == CPP_TOK_SPACE)
+            ;
+    }
+    if (!tok || tok->type != CPP_TOK_IDENT) {
+        yasm_error_set(YASM_ERROR_SYNTAX,
+                       N_("operator `defined' requires an identifier"));
+        cpp_error_propagate(pp);
+    } else
+        value = cpp_macro_find(pp, tok->text, tok->len) != NULL;
+    if (tok && paren) {
+        while ((tok = cpp_pop(stk)) && tok->type == CPP_TOK_SPACE)
+            ;
+        if (!tok || !tok_is(tok, ")")) {
+            yasm_error_set(YASM_ERROR_SYNTAX,
+                           N_("missing `)' after `defined'"));
+            cpp_error_propagate(pp);
+        }
+    }
+
+    result.type = CPP_TOK_NUMBER;
+    result.noexpand = 0;
+    result.param = -1;
+    result.text = value ? "1" : "0";
+    result.len = 1;
+    result.macro = NULL;
+    toks_push(out, &result);
+}
+
+/* Builtin macro value. */
+static void
+cpp_expand_builtin(cpp_pp *pp, const cpp_macro *m, cpp_tokens *out)
+{
+    cpp_token result;
+    char *s;
+
+    result.noexpand = 0;
+    result.param = -1;
+    result.macro = NULL;
+    if (m->builtin == CPP_BUILTIN_LINE) {
+        s = pool_alloc(pp, 24);
+        sprintf(s, "%lu", pp->cur_line);
+        result.type = CPP_TOK_NUMBER;
+    } else {
+        const char *name = pp->src ? pp->src->name : "";
+        size_t i, len = 0;
+        s = pool_alloc(pp, 2*strlen(name)+3);
+        s[len++] = '"';
+        for (i=0; name[i]; i++) {
+            if (name[i] == '"' || name[i] == '\\')
+                s[len++] = '\\';
+            s[len++] = name[i];
+        }
+        s[len++] = '"';
+        s[len] = '\0';
+        result.type = CPP_TOK_STRING;
+    }
+    result.text = s;
+    result.len = strlen(s);
+    toks_push(out, &result);
+}
+
+/* Fully macro-expand the tokens of in (which is consumed), appending the
+ * result to out.  Returns nonzero if a function-like macro invocation is
+ * not terminated within the tokens.
+ */
+static int
+cpp_expand(cpp_pp *pp, cpp_tokens *in, cpp_tokens *out, int in_if)
+{
+    cpp_tokens stk;
+    size_t i;
+    int unterminated = 0;
+
+    /* The rescan stack holds the remaining tokens in reverse order, so that
+     * macro replacements can be pushed in front of them.
+     */
+    toks_init(&stk);
+    for (i=in->num; i>0; i--)
+        toks_push(&stk, &in->tok[i-1]);
+    in->num = 0;
+
+    for (;;) {
+        cpp_token *tok = cpp_pop(&stk);
+        cpp_macro *m;
+        cpp_tokens *args = NULL, *expanded = NULL, repl;
+        int nargs = 0, k;
+
+        if (!tok)
+            break;
+
+        if (tok->type != CPP_TOK_IDENT || tok->noexpand) {
+            toks_push(out, tok);
+            continue;
+        }
+
+        if (in_if && tok->len == 7 && strncmp(tok->text, "defined", 7) == 0) {
+            cpp_expand_defined(pp, &stk, out);
+            continue;
+        }
+
+        m = cpp_macro_find(pp, tok->text, tok->len);
+        if (!m) {
+            toks_push(out, tok);
+            continue;
+        }
+        if (m->disabled) {
+            tok->noexpand = 1;
+            toks_push(out, tok);
+            continue;
+        }
+        if (m->builtin) {
+            cpp_expand_builtin(pp, m, out);
+            continue;
+        }
+
+        if (m->funclike) {
+            cpp_token name = *tok;
+
+            /* Only an invocation if followed by ( */
+            for (i=stk.num; i>0; i--) {
+                if (stk.tok[i-1].type != CPP_TOK_SPACE &&
+                    stk.tok[i-1].type != CPP_TOK_MACRO_END)
+                    break;
+            }
+            if (i == 0 || !tok_is(&stk.tok[i-1], "(")) {
+                toks_push(out, &name);
+                continue;
+            }
+            while ((tok = cpp_pop(&stk)) && !tok_is(tok, "("))
+                ;
+
+            nargs = cpp_collect_args(&stk, m, &args);
+            if (nargs < 0) {
+                unterminated = 1;
+                break;
+            }
+            if (m->nparams == 0 && nargs == 1 && args[0].num == 0)
+                nargs = 0;
+            if (nargs != m->nparams &&
+                !(m->variadic && nargs == m->nparams-1)) {
+                yasm_error_set(YASM_ERROR_SYNTAX,
+                    N_("macro `%s' passed %d arguments, but takes %d"),
+                    m->name, nargs, m->nparams);
+                cpp_error_propagate(pp);
+                toks_push(out, &name);
+                for (k=0; k<nargs; k++)
+                    toks_free(&args[k]);
+                yasm_xfree(args);
+                continue;
+            }
+            if (nargs < m->nparams) {
+                /* Empty variable arguments */
+                if (nargs == 0)
+                    args = yasm_xrealloc(args, sizeof(cpp_tokens));
+                toks_init(&args[nargs]);
+                nargs++;
+            }
+            expanded = yasm_xmalloc((nargs ? nargs : 1)*sizeof(cpp_tokens));
+            for (k=0; k<nargs; k++)
+                toks_init(&expanded[k]);
+        }
+
+        toks_init(&repl);
+        cpp_substitute(pp, m, args, expanded, &repl);
+        for (k=0; k<nargs; k++) {
+            toks_free(&args[k]);
+            toks_free(&expanded[k]);
+        }
+        if (args)
+            yasm_xfree(args);
+        if (expanded)
+            yasm_xfree(expanded);
+
+        /* Rescan the replacement together with the rest of the tokens, with
+         * the macro disabled until the end of its replacement.
+         */
+        {
+            cpp_token end;
+            end.type = CPP_TOK_MACRO_END;
+            end.noexpand = 0;
+            end.param = -1;
+            end.text = "";
+            end.len = 0;
+            end.macro = m;
+            toks_push(&stk, &end);
+        }
+        for (i=repl.num; i>0; i--)
+            toks_push(&stk, &repl.tok[i-1]);
+        toks_free(&repl);
+        m->disabled = 1;
+    }
+
+    /* Re-enable any macros still disabled (after an unterminated
+     * invocation)
+     */
+    while (cpp_pop(&stk))
+        ;
+    toks_free(&stk);
+    return unterminated;
+}
+
+/* Convert tokens back to text.  As with an external cpp, indentation is kept,
+ * whitespace between tokens becomes a single space, and trailing whitespace
+ * is dropped.
+ */
+static void
+cpp_tokens_to_buf(const cpp_tokens *toks, cpp_buf *b)
+{
+    size_t i;
+    int space = 0;
+
+    b->len = 0;
+    buf_reserve(b, 0);
+    b->s[0] = '\0';
+    for (i=0; i<toks->num; i++) {
+        const cpp_token *tok = &toks->tok[i];
+        if (tok->type == CPP_TOK_SPACE) {
+            space = 1;
+            continue;
+        }
+        if (tok->len == 0)
+            continue;
+        if (b->len == 0 && toks->tok[0].type == CPP_TOK_SPACE)
+            buf_append(b, toks->tok[0].text, toks->tok[0].len);
+        else if (space && b->len > 0)
+            buf_append(b, " ", 1);
+        buf_append(b, tok->text, tok->len);
+        space = 0;
+    }
+}
+
+/*******************************************************************************
+    #if expressions.
+*******************************************************************************/
+
+/* #if arithmetic is done in the widest integer types available, as
+ * intmax_t and uintmax_t are in C99.
+ */
+#ifdef UINTMAX_MAX
+typedef intmax_t cpp_int;
+typedef uintmax_t cpp_uint;
+#define CPP_INT_MAX     INTMAX_MAX
+#define CPP_UINT_MAX    UINTMAX_MAX
+#else
+typedef long cpp_int;
+typedef unsigned long cpp_uint;
+#define CPP_INT_MAX     LONG_MAX
+#define CPP_UINT_MAX    ULONG_MAX
+#endif
+
+/* Value of a #if expression.  The bits are kept unsigned; uns says whether
+ * the value has the unsigned type, which selects unsigned comparison,
+ * division and right shift under the usual arithmetic conversions.
+ */
+typedef struct cpp_value {
+    cpp_uint v;
+    int uns;
+} cpp_value;
+
+typedef struct cpp_expr {
+    cpp_pp *pp;
+    const cpp_tokens *toks;
+    size_t pos;
+    int error;
+} cpp_expr;
+
+static cpp_value
+expr_value(cpp_uint v, int uns)
+{
+    cpp_value val;
+    val.v = v;
+    val.uns = uns;
+    return val;
+}
+
+/* Reinterpret the bits of a signed value without relying on the
+ * implementation-defined unsigned to signed conversion.
+ */
+static cpp_int
+expr_signed(cpp_uint v)
+{
+    if (v <= (cpp_uint)CPP_INT_MAX)
+        return (cpp_int)v;
+    return -(cpp_int)(~v) - 1;
+}
+
+static /*@null@*/ const cpp_token *
+expr_peek(cpp_expr *e)
+{
+    while (e->pos < e->toks->num &&
+           e->toks->tok[e->pos].type == CPP_TOK_SPACE)
+        e->pos++;
+    if (e->pos < e->toks->num)
+        return &e->toks->tok[e->pos];
+    return NULL;
+}
+
+static int
+expr_accept(cpp_expr *e, const char *punct)
+{
+    const cpp_token *tok = expr_peek(e);
+    if (tok && tok_is(tok, punct)) {
+        e->pos++;
+        return 1;
+    }
+    return 0;
+}
+
+static cpp_value expr_cond(cpp_expr *e, int eval);
+
+/* Character constants have type int. */
+static long
+expr_char(const cpp_token *tok)
+{
+    const char *s = tok->text + 1;
+    if (*s != '\\')
+        return (long)(unsigned char)*s;
+    s++;
+    switch (*s) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'a': return '\a';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'x': return strtol(s+1, NULL, 16);
+        default:
+            if (*s >= '0' && *s <= '7')
+                return strtol(s, NULL, 8);
+            return (long)(unsigned char)*s;
+    }
+}
+
+static cpp_value
+expr_number(cpp_expr *e, const cpp_token *tok)
+{
+    cpp_uint val = 0, base = 10, digit;
+    const char *s, *digits;
+    int uns = 0, overflow = 0;
+
+    if (tok->text[0] == '\'')
+        return expr_value((cpp_uint)expr_char(tok), 0);
+
+    buf_set(&e->pp->key, tok->text, tok->len);
+    s = e->pp->key.s;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    } else if (s[0] == '0')
+        base = 8;
+    digits = s;
+    for (;; s++) {
+        if (*s >= '0' && *s <= '9')
+            digit = (cpp_uint)(*s - '0');
+        else if (*s >= 'a' && *s <= 'f')
+            digit = (cpp_uint)(*s - 'a' + 10);
+        else if (*s >= 'A' && *s <= 'F')
+            digit = (cpp_uint)(*s - 'A' + 10);
+        else
+            break;
+        if (digit >= base)
+            break;
+        if (val > (CPP_UINT_MAX - digit) / base)
+            overflow = 1;
+        val = val*base + digit;
+    }
+    if (s == digits && base == 16)
+        e->error = 1;
+    for (; *s == 'u' || *s == 'U' || *s == 'l' || *s == 'L'; s++) {
+        if (*s == 'u' || *s == 'U')
+            uns = 1;
+    }
+    if (*s != '\0')
+        e->error = 1;
+    if (overflow) {
+        yasm_warn_set(YASM_WARN_GENERAL,
+                      N_("integer constant is too large for its type"));
+        cpp_error_propagate(e->pp);
+    }
+    /* A constant too large for the signed type is unsigned */
+    if (val > (cpp_uint)CPP_INT_MAX)
+        uns = 1;
+    return expr_value(val, uns);
+}
+
+static cpp_value
+expr_unary(cpp_expr *e, int eval)
+{
+    const cpp_token *tok = expr_peek(e);
+    cpp_value val;
+
+    if (!tok) {
+        e->error = 1;
+        return expr_value(0, 0);
+    }
+    e->pos++;
+    switch (tok->type) {
+        case CPP_TOK_NUMBER:
+            return expr_number(e, tok);
+        case CPP_TOK_STRING:
+            if (tok->text[0] == '\'')
+                return expr_number(e, tok);
+            break;
+        case CPP_TOK_IDENT:
+            return expr_value(0, 0);    /* identifiers that are not macros */
+        case CPP_TOK_PUNCT:
+            if (tok_is(tok, "(")) {
+                val = expr_cond(e, eval);
+                if (!expr_accept(e, ")"))
+                    e->error = 1;
+                return val;
+            }
+            if (tok_is(tok, "+"))
+                return expr_unary(e, eval);
+            if (tok_is(tok, "-")) {
+                val = expr_unary(e, eval);
+                val.v = 0 - val.v;
+                return val;
+            }
+            if (tok_is(tok, "~")) {
+                val = expr_unary(e, eval);
+                val.v = ~val.v;
+                return val;
+            }
+            if (tok_is(tok, "!")) {
+                val = expr_unary(e, eval);
+                return expr_value(val.v == 0, 0);
+            }
+            break;
+        default:
+            break;
+    }
+    e->error = 1;
+    return expr_value(0, 0);
+}
+
+static int
+expr_prec(/*@null@*/ const cpp_token *tok)
+{
+    static const struct {
+        const char *op;
+        int prec;
+    } ops[] = {
+        {"||", 1}, {"&&", 2}, {"|", 3}, {"^", 4}, {"&", 5},
+        {"==", 6}, {"!=", 6}, {"<", 7}, {">", 7}, {"<=", 7}, {">=", 7},
+        {"<<", 8}, {">>", 8}, {"+", 9}, {"-", 9},
+        {"*", 10}, {"/", 10}, {"%", 10}
+    };
+    size_t i;
+
+    if (!tok || tok->type != CPP_TOK_PUNCT)
+        return 0;
+    for (i=0; i<NELEMS(ops); i++) {
+        if (tok_is(tok, ops[i].op))
+            return ops[i].prec;
+    }
+    return 0;
+}
+
+/* Compare two values after the usual arithmetic conversions: negative if
+ * lhs < rhs, zero if equal, positive if lhs > rhs.
+ */
+static int
+expr_compare(cpp_value lhs, cpp_value rhs)
+{
+    if (lhs.uns || rhs.uns)
+        return lhs.v < rhs.v ? -1 : lhs.v > rhs.v;
+    return expr_signed(lhs.v) < expr_signed(rhs.v) ? -1 :
+        expr_signed(lhs.v) > expr_signed(rhs.v);
+}
+
+static cpp_value
+expr_binary(cpp_expr *e, int minprec, int eval)
+{
+    cpp_value lhs = expr_unary(e, eval), rhs;
+    cpp_uint nbits = 8*sizeof(cpp_uint);
+
+    for (;;) {
+        const cpp_token *op = expr_peek(e);
+        int prec = expr_prec(op);
+        int uns;
+
+        if (prec == 0 || prec < minprec)
+            return lhs;
+        e->pos++;
+
+        if (tok_is(op, "||")) {
+            rhs = expr_binary(e, prec+1, eval && lhs.v == 0);
+            lhs = expr_value(lhs.v != 0 || rhs.v != 0, 0);
+            continue;
+        }
+        if (tok_is(op, "&&")) {
+            rhs = expr_binary(e, prec+1, eval && lhs.v != 0);
+            lhs = expr_value(lhs.v != 0 && rhs.v != 0, 0);
+            continue;
+        }
+
+        rhs = expr_binary(e, prec+1, eval);
+        uns = lhs.uns || rhs.uns;
+        switch (op->text[0]) {
+            case '|': lhs = expr_value(lhs.v | rhs.v, uns); break;
+            case '^': lhs = expr_value(lhs.v ^ rhs.v, uns); break;
+            case '&': lhs = expr_value(lhs.v & rhs.v, uns); break;
+            case '+': lhs = expr_value(lhs.v + rhs.v, uns); break;
+            case '-': lhs = expr_value(lhs.v - rhs.v, uns); break;
+            case '*': lhs = expr_value(lhs.v * rhs.v, uns); break;
+            case '/':
+            case '%':
+                if (rhs.v == 0) {
+                    if (eval) {
+                        yasm_error_set(YASM_ERROR_ZERO_DIVISION,
+                                       N_("division by zero in #if"));
+                        cpp_error_propagate(e->pp);
+                    }
+                    lhs = expr_value(0, uns);
+                } else if (uns) {
+                    if (op->text[0] == '/')
+                        lhs = expr_value(lhs.v / rhs.v, 1);
+                    else
+                        lhs = expr_value(lhs.v % rhs.v, 1);
+                } else if (expr_signed(rhs.v) == -1) {
+                    /* Avoid overflow on the most negative value */
+                    if (op->text[0] == '/')
+                        lhs = expr_value(0 - lhs.v, 0);
+                    else
+                        lhs = expr_value(0, 0);
+                } else {
+                    cpp_int a = expr_signed(lhs.v), b = expr_signed(rhs.v);
+                    lhs = expr_value((cpp_uint)(op->text[0] == '/' ? a / b
+                                                                : a % b), 0);
+                }
+                break;
+            case '=':
+                lhs = expr_value(lhs.v == rhs.v, 0);
+                break;
+            case '!':
+                lhs = expr_value(lhs.v != rhs.v, 0);
+                break;
+            case '<':
+                if (op->len == 1)
+                    lhs = expr_value(expr_compare(lhs, rhs) < 0, 0);
+                else if (op->text[1] == '=')
+                    lhs = expr_value(expr_compare(lhs, rhs) <= 0, 0);
+                else if ((!rhs.uns && expr_signed(rhs.v) < 0) ||
+                         rhs.v >= nbits)
+                    lhs.v = 0;
+                else
+                    lhs.v <<= rhs.v;
+                break;
+            case '>':
+                if (op->len == 1)
+                    lhs = expr_value(expr_compare(lhs, rhs) > 0, 0);
+                else if (op->text[1] == '=')
+                    lhs = expr_value(expr_compare(lhs, rhs) >= 0, 0);
+                else {
+                    /* Signed right shifts fill with the sign bit */
+                    int neg = !lhs.uns && expr_signed(lhs.v) < 0;
+                    if ((!rhs.uns && expr_signed(rhs.v) < 0) ||
+                        rhs.v >= nbits)
+                        lhs.v = neg ? ~(cpp_uint)0 : 0;
+                    else if (neg)
+                        lhs.v = ~(~lhs.v >> rhs.v);
+                    else
+                        lhs.v >>= rhs.v;
+                }
+                break;
+        }
+    }
+}
+
+static cpp_value
+expr_cond(cpp_expr *e, int eval)
+{
+    cpp_value cond = expr_binary(e, 1, eval), a, b;
+
+    if (!expr_accept(e, "?"))
+        return cond;
+    a = expr_cond(e, eval && cond.v != 0);
+    if (!expr_accept(e, ":"))
+        e->error = 1;
+    b = expr_cond(e, eval && cond.v == 0);
+    return expr_value(cond.v != 0 ? a.v : b.v, a.uns || b.uns);
+}
+
+/* Evaluate the condition of a #if or #elif. */
+static int
+cpp_eval_condition(cpp_pp *pp, const char *p, const char *dirname)
+{
+    cpp_tokens in, out;
+    cpp_expr e;
+    cpp_value val;
+
+    toks_init(&in);
+    toks_init(&out);
+    cpp_tokenize(p, strlen(p), &in);
+    pool_reset(pp);
+
+    e.pp = pp;
+    e.toks = &out;
+    e.pos = 0;
+    e.error = cpp_expand(pp, &in, &out, 1);
+    val = expr_value(0, 0);
+    if (!e.error) {
+        if (!expr_peek(&e)) {
+            yasm_error_set(YASM_ERROR_SYNTAX, N_("#%s with no expression"),
+                           dirname);
+            cpp_error_propagate(pp);
+            toks_free(&in);
+            toks_free(&out);
+            return 0;
+        }
+        val = expr_cond(&e, 1);
+        if (expr_peek(&e))
+            e.error = 1;
+    }
+    if (e.error) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("invalid expression in #%s"),
+                       dirname);
+        cpp_error_propagate(pp);
+        val.v = 0;
+    }
+
+    toks_free(&in);
+    toks_free(&out);
+    return val.v != 0;
+}
+
+/*******************************************************************************
+    Input.
+*******************************************************************************/
+
+static char *
+cpp_read_file(FILE *f, /*@out@*/ size_t *lenp)
+{
+    size_t bufsize = 4096, len = 0;
+    char *buf = yasm_xmalloc(bufsize);
+
+    for (;;) {
+        len += fread(buf+len, 1, bufsize-len-1, f);
+        if (len+1 < bufsize)
+            break;
+        bufsize *= 2;
+        buf = yasm_xrealloc(buf, bufsize);
+    }
+    buf[len] = '\0';
+    *lenp = len;
+    return buf;
+}
+
+static void
+cpp_add_dep(cpp_pp *pp, const char *name)
+{
+    cpp_dep *dep;
+
+    STAILQ_FOREACH(dep, &pp->deps, link) {
+        if (strcmp(dep->name, name) == 0)
+            return;
+    }
+    dep = yasm_xmalloc(sizeof(cpp_dep));
+    dep->name = yasm__xstrdup(name);
+    STAILQ_INSERT_TAIL(&pp->deps, dep, link);
+}
+
+/* Start reading a file (which is closed); takes ownership of path. */
+static void
+cpp_push_source(cpp_pp *pp, FILE *f, /*@only@*/ char *path, const char *name)
+{
+    cpp_source *src = yasm_xmalloc(sizeof(cpp_source));
+    size_t len;
+
+    src->buf = cpp_read_file(f, &len);
+    if (ferror(f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("error when reading from file"));
+        cpp_error_propagate(pp);
+    }
+    if (f != stdin)
+        fclose(f);
+
+    src->parent = pp->src;
+    src->path = path;
+    src->name = yasm__xstrdup(name);
+    src->pos = src->buf;
+    src->end = src->buf + len;
+    src->line = 0;
+    src->cond_depth = pp->num_conds;
+    pp->src = src;
+    pp->depth++;
+}
+
+static void
+cpp_pop_source(cpp_pp *pp)
+{
+    cpp_source *src = pp->src;
+
+    if (pp->num_conds > src->cond_depth) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("unterminated conditional"));
+        cpp_error_propagate(pp);
+        pp->num_conds = src->cond_depth;
+    }
+
+    pp->src = src->parent;
+    pp->depth--;
+    yasm_xfree(src->buf);
+    yasm_xfree(src->path);
+    yasm_xfree(src->name);
+    yasm_xfree(src);
+}
+
+/* Get the next physical line of a source, without the line ending. */
+static int
+cpp_next_physical(cpp_source *src, const char **linep, size_t *lenp)
+{
+    char *eol;
+
+    if (src->pos >= src->end)
+        return 0;
+    eol = memchr(src->pos, '\n', (size_t)(src->end - src->pos));
+    *linep = src->pos;
+    if (eol) {
+        *lenp = (size_t)(eol - src->pos);
+        src->pos = eol+1;
+    } else {
+        *lenp = (size_t)(src->end - src->pos);
+        src->pos = src->end;
+    }
+    if (*lenp > 0 && (*linep)[*lenp-1] == '\r')
+        (*lenp)--;
+    src->line++;
+    return 1;
+}
+
+/* Read a logical line into lbuf: continuation lines are joined, and comments
+ * are replaced with a space (block comments may span lines).  Returns the
+ * number of physical lines read, or 0 at end of the source.
+ */
+static unsigned long
+cpp_read_line(cpp_pp *pp, cpp_source *src)
+{
+    enum {
+        ST_NORMAL, ST_STRING, ST_CHAR, ST_COMMENT, ST_LINE_COMMENT
+    } state = ST_NORMAL;
+    cpp_buf *b = &pp->lbuf;
+    unsigned long n = 0;
+    const char *p;
+    size_t len, i;
+    char *d;
+
+    b->len = 0;
+    for (;;) {
+        int cont;
+
+        if (!cpp_next_physical(src, &p, &len))
+            break;
+        n++;
+        cont = len > 0 && p[len-1] == '\\';
+        if (cont)
+            len--;
+
+        buf_reserve(b, len);
+        d = b->s + b->len;
+        for (i=0; i<len; i++) {
+            char c = p[i];
+            switch (state) {
+                case ST_NORMAL:
+                    if (c == '/' && i+1 < len && p[i+1] == '*') {
+                        state = ST_COMMENT;
+                        *d++ = ' ';
+                        i++;
+                        continue;
+                    }
+                    if (c == '/' && i+1 < len && p[i+1] == '/') {
+                        state = ST_LINE_COMMENT;
+                        i = len;
+                        continue;
+                    }
+                    if (c == '"')
+                        state = ST_STRING;
+                    else if (c == '\'')
+                        state = ST_CHAR;
+                    *d++ = c;
+                    break;
+                case ST_STRING:
+                case ST_CHAR:
+                    *d++ = c;
+                    if (c == '\\' && i+1 < len)
+                        *d++ = p[++i];
+                    else if (c == (state == ST_STRING ? '"' : '\''))
+                        state = ST_NORMAL;
+                    break;
+                case ST_COMMENT:
+                    if (c == '*' && i+1 < len && p[i+1] == '/') {
+                        state = ST_NORMAL;
+                        i++;
+                    }
+                    break;
+                case ST_LINE_COMMENT:
+                    i = len;
+                    break;
+            }
+        }
+        b->len = (size_t)(d - b->s);
+
+        if (cont)
+            continue;
+        if (state == ST_COMMENT)
+            continue;
+        break;
+    }
+
+    if (state == ST_COMMENT) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("unterminated comment"));
+        cpp_error_propagate(pp);
+    }
+    buf_reserve(b, 0);
+    b->s[b->len] = '\0';
+    return n;
+}
+
+/*******************************************************************************
+    Output.
+*******************************************************************************/
+
+/* Put a line marker into the output line. */
+static void
+cpp_marker(cpp_pp *pp, cpp_buf *b, unsigned long line, const char *name,
+           /*@null@*/ const char *flag)
+{
+    char num[40];
+    size_t i;
+
+    sprintf(num, "# %lu \"", line);
+    buf_set(b, num, strlen(num));
+    for (i=0; name[i]; i++) {
+        if (name[i] == '"' || name[i] == '\\')
+            buf_append(b, "\\", 1);
+        buf_append(b, &name[i], 1);
+    }
+    buf_append(b, "\"", 1);
+    if (flag)
+        buf_append(b, flag, strlen(flag));
+    pp->pending_blank = 0;
+}
+
+static int
+cpp_has_macros(cpp_pp *pp, const cpp_tokens *toks)
+{
+    size_t i;
+    for (i=0; i<toks->num; i++) {
+        if (toks->tok[i].type == CPP_TOK_IDENT &&
+            cpp_macro_find(pp, toks->tok[i].text, toks->tok[i].len))
+            return 1;
+    }
+    return 0;
+}
+
+/* Expand the text line in lbuf into the output line.  A macro invocation
+ * whose arguments continue on following lines is completed by joining them;
+ * the number of extra physical lines read is added to *nlines.
+ */
+static void
+cpp_expand_text(cpp_pp *pp, unsigned long *nlines)
+{
+    cpp_tokens in, out;
+
+    toks_init(&in);
+    toks_init(&out);
+    for (;;) {
+        unsigned long n;
+
+        in.num = 0;
+        out.num = 0;
+        pool_reset(pp);
+        cpp_tokenize(pp->lbuf.s, pp->lbuf.len, &in);
+        if (!cpp_has_macros(pp, &in)) {
+            cpp_tokens_to_buf(&in, &pp->out);
+            break;
+        }
+        if (!cpp_expand(pp, &in, &out, 0)) {
+            cpp_tokens_to_buf(&out, &pp->out);
+            break;
+        }
+
+        /* Join the next line and try again */
+        buf_set(&pp->jbuf, pp->lbuf.s, pp->lbuf.len);
+        n = cpp_read_line(pp, pp->src);
+        if (n == 0) {
+            yasm_error_set(YASM_ERROR_SYNTAX,
+                N_("unterminated argument list invoking macro"));
+            cpp_error_propagate(pp);
+            buf_set(&pp->out, pp->jbuf.s, pp->jbuf.len);
+            break;
+        }
+        *nlines += n;
+        buf_append(&pp->jbuf, " ", 1);
+        buf_append(&pp->jbuf, pp->lbuf.s, pp->lbuf.len);
+        buf_set(&pp->lbuf, pp->jbuf.s, pp->jbuf.len);
+    }
+    toks_free(&in);
+    toks_free(&out);
+}
+
+/*******************************************************************************
+    Directives.
+*******************************************************************************/
+
+static int
+cpp_skipping(const cpp_pp *pp)
+{
+    return pp->num_conds > 0 &&
+        pp->conds[pp->num_conds-1].state != CPP_COND_TAKING;
+}
+
+static void
+cpp_push_cond(cpp_pp *pp, cpp_cond_state state)
+{
+    if (pp->num_conds >= pp->alloc_conds) {
+        pp->alloc_conds = pp->alloc_conds ? pp->alloc_conds*2 : 16;
+        pp->conds = yasm_xrealloc(pp->conds,
+                                  pp->alloc_conds*sizeof(cpp_cond));
+    }
+    pp->conds[pp->num_conds].state = state;
+    pp->conds[pp->num_conds].seen_else = 0;
+    pp->num_conds++;
+}
+
+/* Condition of #ifdef/#ifndef. */
+static int
+cpp_ifdef(cpp_pp *pp, const char *p, const char *dirname)
+{
+    size_t len = ident_len(p);
+
+    if (len == 0) {
+        yasm_error_set(YASM_ERROR_SYNTAX, N_("no macro name given in #%s"),
+                       dirname);
+        cpp_error_propagate(pp);
+        return 0;
+    }
+    return cpp_macro_find(pp, p, len) != NULL;
+}
+
+static cpp_line_kind
+cpp_include_directive(cpp_pp *pp, const char *p)
+{
+    cpp_buf name;
+    const char *start, *end;
+    char *path, *oname;
+    int quoted;
+    FILE *f;
+
+    buf_init(&name);
+
+    /* Computed includes are macro expanded first */
+    if (*p != '"' && *p != '<') {
+        cpp_tokens in, out;
+        toks_init(&in);
+        toks_init(&out);
+        cpp_tokenize(p, strlen(p), &in);
+        pool_reset(pp);
+        cpp_expand(pp, &in, &out, 0);
+        cpp_tokens_to_buf(&out, &name);
+        toks_free(&in);
+        toks_free(&out);
+        p = skip_space(name.s);
+    }
+
+    quoted = *p == '"';
+    start = p+1;
+    end = (*p == '"' || *p == '<') ? strchr(start, quoted ? '"' : '>') : NULL;
+    if (!end || end == start) {
+        yasm_error_set(YASM_ERROR_SYNTAX,
+                       N_("#include expects \"FILENAME\" or <FILENAME>"));
+        cpp_error_propagate(pp);
+        buf_free(&name);
+        return CPP_LINE_BLANK;
+    }
+    path = yasm__xstrndup(start, (size_t)(end-start));
+    buf_free(&name);
+
+    if (pp->depth >= CPP_MAX_INCLUDE_DEPTH) {
+        yasm_error_set(YASM_ERROR_GENERAL, N_("#include nested too deeply"));
+        cpp_error_propagate(pp);
+        yasm_xfree(path);
+        return CPP_LINE_BLANK;
+    }
+
+    f = yasm_fopen_include(path, quoted ? pp->src->path : NULL, "r", &oname);
+    if (!f) {
+        yasm_error_set(YASM_ERROR_IO, N_("unable to open include file `%s'"),
+                       path);
+        cpp_error_propagate(pp);
+        yasm_xfree(path);
+        return CPP_LINE_BLANK;
+    }
+    yasm_xfree(path);
+
+    cpp_add_dep(pp, oname);
+    cpp_push_source(pp, f, oname, oname);
+    cpp_marker(pp, &pp->out, 1, pp->src->name, " 1");
+    return CPP_LINE_OUTPUT;
+}
+
+static cpp_line_kind
+cpp_line_directive(cpp_pp *pp, const char *p)
+{
+    cpp_tokens in, out;
+    cpp_buf text;
+    unsigned long line;
+    char *end;
+
+    toks_init(&in);
+    toks_init(&out);
+    buf_init(&text);
+    cpp_tokenize(p, strlen(p), &in);
+    pool_reset(pp);
+    cpp_expand(pp, &in, &out, 0);
+    cpp_tokens_to_buf(&out, &text);
+    toks_free(&in);
+    toks_free(&out);
+
+    p = skip_space(text.s);
+    line = strtoul(p, &end, 10);
+    if (end == p) {
+        yasm_error_set(YASM_ERROR_SYNTAX,
+                       N_("#line directive requires a line number"));
+        cpp_error_propagate(pp);
+        buf_free(&text);
+        return CPP_LINE_BLANK;
+    }
+    p = skip_space(end);
+    if (*p == '"') {
+        const char *q = strchr(p+1, '"');
+        if (q) {
+            yasm_xfree(pp->src->name);
+            pp->src->name = yasm__xstrndup(p+1, (size_t)(q-p-1));
+        }
+    }
+    buf_free(&text);
+
+    pp->src->line = line > 0 ? line-1 : 0;
+    cpp_marker(pp, &pp->out, line, pp->src->name, NULL);
+    return CPP_LINE_OUTPUT;
+}
+
+/* Handle a line starting with # (p points after the #). */
+static cpp_line_kind
+cpp_directive(cpp_pp *pp, const char *p)
+{
+    size_t len;
+    cpp_cond *cond;
+    int skipping = cpp_skipping(pp);
+
+    p = skip_space(p);
+    len = ident_len(p);
+    if (len == 0)
+        return (*p == '\0' || skipping) ? CPP_LINE_BLANK : CPP_LINE_TEXT;
+
+#define DIRECTIVE(name) \
+    (len == sizeof(name)-1 && strncmp(p, name, len) == 0)
+
+    if (DIRECTIVE("if") || DIRECTIVE("ifdef") || DIRECTIVE("ifndef")) {
+        const char *args = skip_space(p+len);
+        int value;
+        if (skipping) {
+            cpp_push_cond(pp, CPP_COND_DONE);
+            return CPP_LINE_BLANK;
+        }
+        if (p[2] == 'd')
+            value = cpp_ifdef(pp, args, "ifdef");
+        else if (p[2] == 'n')
+            value = !cpp_ifdef(pp, args, "ifndef");
+        else
+            value = cpp_eval_condition(pp, args, "if");
+        cpp_push_cond(pp, value ? CPP_COND_TAKING : CPP_COND_SEEKING);
+        return CPP_LINE_BLANK;
+    }
+
+    if (DIRECTIVE("elif") || DIRECTIVE("else") || DIRECTIVE("endif")) {
+        const char *dirname = DIRECTIVE("elif") ? "elif" :
+            DIRECTIVE("else") ? "else" : "endif";
+        if (pp->num_conds == 0 ||
+            pp->num_conds <= (pp->src ? pp->src->cond_depth : 0)) {
+            yasm_error_set(YASM_ERROR_SYNTAX, N_("#%s without #if"), dirname);
+            cpp_error_propagate(pp);
+            return CPP_LINE_BLANK;
+        }
+        cond = &pp->conds[pp->num_conds-1];
+        if (dirname[1] == 'n') {
+            pp->num_conds--;
+            return CPP_LINE_BLANK;
+        }
+        if (cond->seen_else) {
+            yasm_error_set(YASM_ERROR_SYNTAX, N_("#%s after #else"), dirname);
+            cpp_error_propagate(pp);
+            return CPP_LINE_BLANK;
+        }
+        if (dirname[2] == 's')
+            cond->seen_else = 1;
+        if (cond->state == CPP_COND_TAKING)
+            cond->state = CPP_COND_DONE;
+        else if (cond->state == CPP_COND_SEEKING &&
+                 (dirname[2] == 's' ||
+                  cpp_eval_condition(pp, skip_space(p+len), "elif")))
+            cond->state = CPP_COND_TAKING;
+        return CPP_LINE_BLANK;
+    }
+
+    if (skipping)
+        return CPP_LINE_BLANK;
+
+    if (DIRECTIVE("define")) {
+        cpp_define(pp, p+len);
+        return CPP_LINE_BLANK;
+    }
+    if (DIRECTIVE("undef")) {
+        cpp_undef(pp, p+len);
+        return CPP_LINE_BLANK;
+    }
+    if (DIRECTIVE("include") || DIRECTIVE("include_next"))
+        return cpp_include_directive(pp, skip_space(p+len));
+    if (DIRECTIVE("line"))
+        return cpp_line_directive(pp, p+len);
+    if (DIRECTIVE("error")) {
+        yasm_error_set(YASM_ERROR_GENERAL, "#error %s", skip_space(p+len));
+        cpp_error_propagate(pp);
+        return CPP_LINE_BLANK;
+    }
+    if (DIRECTIVE("warning")) {
+        yasm_warn_set(YASM_WARN_PREPROC, "#warning %s", skip_space(p+len));
+        cpp_error_propagate(pp);
+        return CPP_LINE_BLANK;
+    }
+    if (DIRECTIVE("pragma") || DIRECTIVE("ident") || DIRECTIVE("sccs") ||
+        DIRECTIVE("assert") || DIRECTIVE("unassert"))
+        return CPP_LINE_BLANK;
+
+#undef DIRECTIVE
+
+    /* Not a directive (e.g. a GAS comment); pass it through */
+    return CPP_LINE_TEXT;
+}
+
+/*******************************************************************************
+    Interface.
+*******************************************************************************/
+
+cpp_pp *
+cpp_pp_create(const char *in_filename, yasm_linemap *lm,
+              yasm_errwarns *errwarns)
+{
+    cpp_pp *pp = yasm_xmalloc(sizeof(cpp_pp));
+    cpp_macro *m;
+
+    pp->in_filename = yasm__xstrdup(in_filename);
+    pp->cur_lm = lm;
+    pp->errwarns = errwarns;
+    pp->macros = HAMT_create(0, yasm_internal_error_);
+    pp->started = 0;
+    pp->done = 0;
+    pp->src = NULL;
+    pp->main_src = NULL;
+    pp->depth = 0;
+    STAILQ_INIT(&pp->includes);
+    pp->conds = NULL;
+    pp->num_conds = 0;
+    pp->alloc_conds = 0;
+    buf_init(&pp->lbuf);
+    buf_init(&pp->jbuf);
+    buf_init(&pp->out);
+    buf_init(&pp->key);
+    buf_init(&pp->mbuf);
+    pp->pending_blank = 0;
+    pp->held = 0;
+    pp->held_line = 0;
+    pp->held_extra = 0;
+    pp->cur_line = 0;
+    pp->pool = NULL;
+    STAILQ_INIT(&pp->deps);
+    pp->deps_started = 0;
+    pp->next_dep = NULL;
+
+    m = cpp_macro_get(pp, "__FILE__", 8);
+    m->defined = 1;
+    m->builtin = CPP_BUILTIN_FILE;
+    m = cpp_macro_get(pp, "__LINE__", 8);
+    m->defined = 1;
+    m->builtin = CPP_BUILTIN_LINE;
+    cpp_define(pp, "__ASSEMBLER__ 1");
+
+    return pp;
+}
+
+void
+cpp_pp_destroy(cpp_pp *pp)
+{
+    cpp_include *inc;
+    cpp_dep *dep;
+
+    while (pp->src)
+        cpp_pop_source(pp);
+    while (!STAILQ_EMPTY(&pp->includes)) {
+        inc = STAILQ_FIRST(&pp->includes);
+        STAILQ_REMOVE_HEAD(&pp->includes, link);
+        yasm_xfree(inc->name);
+        yasm_xfree(inc);
+    }
+    while (!STAILQ_EMPTY(&pp->deps)) {
+        dep = STAILQ_FIRST(&pp->deps);
+        STAILQ_REMOVE_HEAD(&pp->deps, link);
+        yasm_xfree(dep->name);
+        yasm_xfree(dep);
+    }
+    HAMT_destroy(pp->macros, cpp_macro_delete);
+    if (pp->conds)
+        yasm_xfree(pp->conds);
+    buf_free(&pp->lbuf);
+    buf_free(&pp->jbuf);
+    buf_free(&pp->out);
+    buf_free(&pp->key);
+    buf_free(&pp->mbuf);
+    pool_reset(pp);
+    if (pp->pool)
+        yasm_xfree(pp->pool);
+    yasm_xfree(pp->in_filename);
+    yasm_xfree(pp);
+}
+
+void
+cpp_pp_define(cpp_pp *pp, const char *macronameval)
+{
+    char *def = yasm_xmalloc(strlen(macronameval)+3);
+    char *eq;
+
+    strcpy(def, macronameval);
+    eq = strchr(def, '=');
+    if (eq)
+        *eq = ' ';
+    else
+        strcat(def, " 1");
+    cpp_define(pp, def);
+    yasm_xfree(def);
+}
+
+void
+cpp_pp_undefine(cpp_pp *pp, const char *macroname)
+{
+    cpp_undef(pp, macroname);
+}
+
+void
+cpp_pp_add_include_file(cpp_pp *pp, const char *filename)
+{
+    cpp_include *inc = yasm_xmalloc(sizeof(cpp_include));
+    inc->name = yasm__xstrdup(filename);
+    STAILQ_INSERT_TAIL(&pp->includes, inc, link);
+}
+
+static void
+cpp_start(cpp_pp *pp)
+{
+    FILE *f;
+    const char *name = pp->in_filename;
+
+    pp->started = 1;
+    if (strcmp(pp->in_filename, "-") != 0) {
+        f = fopen(pp->in_filename, "r");
+        if (!f)
+            yasm__fatal( N_("Could not open input file") );
+    } else {
+        f = stdin;
+        name = "<stdin>";
+    }
+    cpp_push_source(pp, f, yasm__xstrdup(pp->in_filename), name);
+    pp->main_src = pp->src;
+    cpp_marker(pp, &pp->out, 1, name, NULL);
+}
+
+/* Start the next -include file, which is processed before the first line of
+ * the main file.
+ */
+static int
+cpp_start_include(cpp_pp *pp)
+{
+    cpp_include *inc = STAILQ_FIRST(&pp->includes);
+    char *path = NULL;
+    FILE *f;
+
+    STAILQ_REMOVE_HEAD(&pp->includes, link);
+    f = fopen(inc->name, "r");
+    if (f)
+        path = yasm__xstrdup(inc->name);
+    else
+        f = yasm_fopen_include(inc->name, NULL, "r", &path);
+    if (!f) {
+        yasm_error_set(YASM_ERROR_IO, N_("unable to open include file `%s'"),
+                       inc->name);
+        cpp_error_propagate(pp);
+        yasm_xfree(inc->name);
+        yasm_xfree(inc);
+        return 0;
+    }
+    yasm_xfree(inc->name);
+    yasm_xfree(inc);
+
+    cpp_add_dep(pp, path);
+    cpp_push_source(pp, f, path, path);
+    cpp_marker(pp, &pp->out, 1, pp->src->name, " 1");
+    return 1;
+}
+
+static int
+cpp_return_buf(cpp_buf *b, yasm_preproc_line *line)
+{
+    buf_reserve(b, 0);
+    b->s[b->len] = '\0';
+    line->text = b->s;
+    line->len = b->len;
+    line->persistent = 0;
+    return 1;
+}
+
+int
+cpp_pp_get_line(cpp_pp *pp, yasm_preproc_line *line)
+{
+    if (pp->done)
+        return 0;
+    if (!pp->started) {
+        cpp_start(pp);
+        return cpp_return_buf(&pp->out, line);
+    }
+
+    for (;;) {
+        unsigned long n;
+        const char *p;
+        cpp_line_kind kind = CPP_LINE_TEXT;
+
+        /* Catch up on blank lines before the held line; too many are
+         * replaced by a line marker.
+         */
+        if (pp->held) {
+            if (pp->pending_blank >= CPP_MAX_BLANK_LINES) {
+                cpp_marker(pp, &pp->mbuf, pp->held_line, pp->src->name, NULL);
+                return cpp_return_buf(&pp->mbuf, line);
+            }
+            if (pp->pending_blank > 0) {
+                pp->pending_blank--;
+                pp->mbuf.len = 0;
+                return cpp_return_buf(&pp->mbuf, line);
+            }
+            pp->held = 0;
+            pp->pending_blank = pp->held_extra;
+            return cpp_return_buf(&pp->out, line);
+        }
+
+        if (!pp->src) {
+            pp->done = 1;
+            return 0;
+        }
+
+        if (pp->src == pp->main_src && pp->src->line == 0 &&
+            !STAILQ_EMPTY(&pp->includes)) {
+            if (cpp_start_include(pp))
+                return cpp_return_buf(&pp->out, line);
+            continue;
+        }
+
+        n = cpp_read_line(pp, pp->src);
+        if (n == 0) {
+            cpp_pop_source(pp);
+            if (!pp->src) {
+                pp->done = 1;
+                return 0;
+            }
+            cpp_marker(pp, &pp->out, pp->src->line+1, pp->src->name, " 2");
+            return cpp_return_buf(&pp->out, line);
+        }
+        pp->cur_line = pp->src->line - n + 1;
+
+        p = skip_space(pp->lbuf.s);
+        if (*p == '#') {
+            kind = cpp_directive(pp, p+1);
+            if (kind == CPP_LINE_OUTPUT)
+                return cpp_return_buf(&pp->out, line);
+        }
+        if (kind == CPP_LINE_BLANK || cpp_skipping(pp)) {
+            pp->pending_blank += n;
+            continue;
+        }
+
+        cpp_expand_text(pp, &n);
+        pp->held = 1;
+        pp->held_line = pp->cur_line;
+        pp->held_extra = n-1;
+    }
+}
+
+const char *
+cpp_pp_next_dep(cpp_pp *pp)
+{
+    if (!pp->deps_started) {
+        yasm_preproc_line line;
+        while (cpp_pp_get_line(pp, &line))
+            ;
+        pp->deps_started = 1;
+        pp->next_dep = STAILQ_FIRST(&pp->deps);
+    } else if (pp->next_dep)
+        pp->next_dep = STAILQ_NEXT(pp->next_dep, link);
+
+    return pp->next_dep ? pp->next_dep->name : NULL;
+}
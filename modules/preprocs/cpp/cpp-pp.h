@@ -0,0 +1,67 @@
+/*
+ * In-process C preprocessor header file
+ *
+ *  Copyright (C) 2026  Yasm Developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef YASM_CPP_PP_H
+#define YASM_CPP_PP_H
+
+/* A C preprocessor run in process, with the behavior of an external cpp
+ * invoked with "-x assembler-with-cpp": directives are processed, macros are
+ * expanded, comments are removed, and the output carries "# line "file""
+ * markers that the GAS parser understands.  Lines starting with '#' that are
+ * not directives are passed through, so GAS comments survive.
+ *
+ * Only the include paths set with yasm_add_include_path() are searched; there
+ * are no system include directories and no target predefines other than
+ * __ASSEMBLER__.
+ */
+typedef struct cpp_pp cpp_pp;
+
+/* Create a preprocessor for in_filename ("-" for stdin).  The input is not
+ * opened until the first line is requested.
+ */
+cpp_pp *cpp_pp_create(const char *in_filename, yasm_linemap *lm,
+                      yasm_errwarns *errwarns);
+void cpp_pp_destroy(cpp_pp *pp);
+
+/* Command line style definitions: "name", "name=value", or
+ * "name(args)=value".
+ */
+void cpp_pp_define(cpp_pp *pp, const char *macronameval);
+void cpp_pp_undefine(cpp_pp *pp, const char *macroname);
+
+/* Include a file before the main input, as with cpp -include. */
+void cpp_pp_add_include_file(cpp_pp *pp, const char *filename);
+
+/* Get the next line of output.  Returns zero at end of input. */
+int cpp_pp_get_line(cpp_pp *pp, /*@out@*/ yasm_preproc_line *line);
+
+/* Get the next file included (directly or indirectly) by the input, in the
+ * order first included; preprocesses the rest of the input if necessary.
+ * Returns NULL when there are no more.
+ */
+/*@null@*/ const char *cpp_pp_next_dep(cpp_pp *pp);
+
+#endif
@@ -1,5 +1,5 @@
 /*
- * Invoke an external C preprocessor
+ * C preprocessor: in process, or by invoking an external C preprocessor
  *
  *  Copyright (C) 2007       Paul Barker
  *  Copyright (C) 2001-2007  Peter Johnson
@@ -29,6 +29,8 @@
 #include <util.h>
 #include <libyasm.h>
 
+#include "cpp-pp.h"
+
 /* TODO: Use autoconf to get the limit on the command line length. */
 #define CMDLINE_SIZE 32770
 
@@ -61,11 +63,21 @@ typedef struct yasm_preproc_cpp {
     /* List of arguments to pass to cpp. */
     TAILQ_HEAD(cpp_arg_head, cpp_arg_entry) cpp_args;
 
+    /* In-process preprocessor; NULL if an external one is run. */
+    /*@null@*/ cpp_pp *engine;
+
+    /* External preprocessor command (from YASM_CPP, or CPP_PROG). */
+    /*@null@*/ const char *prog;
+
     char *filename;
     FILE *f, *f_deps;
     yasm_linemap *cur_lm;
     yasm_errwarns *errwarns;
 
+    /* Buffer holding the last line read, reused for each line. */
+    char *line;
+    size_t line_size;
+
     int flags;
 } yasm_preproc_cpp;
 
@@ -100,10 +112,10 @@ cpp_build_cmdline(yasm_preproc_cpp *pp, const char *extra)
     cpp_arg_entry *arg;
 
     /* Initialize command line. */
-    cmdline = p = yasm_xmalloc(strlen(CPP_PROG)+CMDLINE_SIZE);
+    cmdline = p = yasm_xmalloc(strlen(pp->prog)+CMDLINE_SIZE);
     limit = p + CMDLINE_SIZE;
-    strcpy(p, CPP_PROG);
-    p += strlen(CPP_PROG);
+    strcpy(p, pp->prog);
+    p += strlen(pp->prog);
 
     arg = TAILQ_FIRST(&pp->cpp_args);
 
@@ -192,11 +204,24 @@ cpp_preproc_create(const char *in, yasm_symtab *symtab, yasm_linemap *lm,
     const char * inc_dir;
 
     pp->preproc.module = &yasm_cpp_LTX_preproc;
+
+    /* Preprocess in process unless YASM_CPP names an external preprocessor
+     * (an empty value selects the configured one).
+     */
+    pp->prog = getenv("YASM_CPP");
+    if (pp->prog) {
+        if (pp->prog[0] == '\0')
+            pp->prog = CPP_PROG;
+        pp->engine = NULL;
+    } else
+        pp->engine = cpp_pp_create(in, lm, errwarns);
     pp->f = pp->f_deps = NULL;
     pp->cur_lm = lm;
     pp->errwarns = errwarns;
     pp->flags = 0;
     pp->filename = yasm__xstrdup(in);
+    pp->line = NULL;
+    pp->line_size = 0;
 
     TAILQ_INIT(&pp->cpp_args);
 
@@ -225,18 +250,24 @@ cpp_preproc_destroy(yasm_preproc *preproc)
 #endif
     }
 
+    if (pp->engine)
+        cpp_pp_destroy(pp->engine);
     cpp_destroy_args(pp);
 
+    if (pp->line)
+        yasm_xfree(pp->line);
     yasm_xfree(pp->filename);
     yasm_xfree(pp);
 }
 
-static char *
-cpp_preproc_get_line(yasm_preproc *preproc)
+static int
+cpp_preproc_get_line_ref(yasm_preproc *preproc, yasm_preproc_line *line)
 {
     yasm_preproc_cpp *pp = (yasm_preproc_cpp *)preproc;
-    int bufsize = BSIZE;
-    char *buf, *p;
+    char *p;
+
+    if (pp->engine)
+        return cpp_pp_get_line(pp->engine, line);
 
     if (! (pp->flags & CPP_HAS_BEEN_INVOKED) ) {
         pp->flags |= CPP_HAS_BEEN_INVOKED;
@@ -249,11 +280,15 @@ cpp_preproc_get_line(yasm_preproc *preproc)
         file.
     */
 
+    if (!pp->line) {
+        pp->line_size = BSIZE;
+        pp->line = yasm_xmalloc(pp->line_size);
+    }
+
     /* Loop to ensure entire line is read (don't want to limit line length). */
-    buf = yasm_xmalloc((size_t)bufsize);
-    p = buf;
+    p = pp->line;
     for (;;) {
-        if (!fgets(p, bufsize-(p-buf), pp->f)) {
+        if (!fgets(p, (int)(pp->line_size-(p-pp->line)), pp->f)) {
             if (ferror(pp->f)) {
                 yasm_error_set(YASM_ERROR_IO,
                                N_("error when reading from file"));
@@ -263,27 +298,39 @@ cpp_preproc_get_line(yasm_preproc *preproc)
             break;
         }
         p += strlen(p);
-        if (p > buf && p[-1] == '\n')
+        if (p > pp->line && p[-1] == '\n')
             break;
-        if ((p-buf) >= bufsize) {
+        if ((size_t)(p-pp->line)+1 >= pp->line_size) {
             /* Increase size of buffer */
-            char *oldbuf = buf;
-            bufsize *= 2;
-            buf = yasm_xrealloc(buf, (size_t)bufsize);
-            p = buf + (p-oldbuf);
+            char *oldbuf = pp->line;
+            pp->line_size *= 2;
+            pp->line = yasm_xrealloc(pp->line, pp->line_size);
+            p = pp->line + (p-oldbuf);
         }
     }
 
-    if (p == buf) {
+    if (p == pp->line) {
         /* No data; must be at EOF */
-        yasm_xfree(buf);
-        return NULL;
+        return 0;
     }
 
     /* Strip the line ending */
-    buf[strcspn(buf, "\r\n")] = '\0';
+    line->len = strcspn(pp->line, "\r\n");
+    pp->line[line->len] = '\0';
+
+    line->text = pp->line;
+    line->persistent = 0;
+    return 1;
+}
+
+static char *
+cpp_preproc_get_line(yasm_preproc *preproc)
+{
+    yasm_preproc_line line;
 
-    return buf;
+    if (!cpp_preproc_get_line_ref(preproc, &line))
+        return NULL;
+    return yasm__xstrdup(line.text);
 }
 
 static size_t
@@ -295,6 +342,15 @@ cpp_preproc_get_included_file(yasm_preproc *preproc, char *buf,
     size_t n = 0;
     yasm_preproc_cpp *pp = (yasm_preproc_cpp *)preproc;
 
+    if (pp->engine) {
+        const char *dep = cpp_pp_next_dep(pp->engine);
+        if (!dep || max_size == 0)
+            return 0;
+        strncpy(buf, dep, max_size);
+        buf[max_size-1] = '\0';
+        return strlen(buf);
+    }
+
     if (! (pp->flags & CPP_HAS_GENERATED_DEPS) ) {
         pp->flags |= CPP_HAS_GENERATED_DEPS;
 
@@ -338,8 +394,14 @@ static void
 cpp_preproc_add_include_file(yasm_preproc *preproc, const char *filename)
 {
     yasm_preproc_cpp *pp = (yasm_preproc_cpp *)preproc;
+    cpp_arg_entry *arg;
 
-    cpp_arg_entry *arg = yasm_xmalloc(sizeof(cpp_arg_entry));
+    if (pp->engine) {
+        cpp_pp_add_include_file(pp->engine, filename);
+        return;
+    }
+
+    arg = yasm_xmalloc(sizeof(cpp_arg_entry));
     arg->op = "-include";
     arg->param = yasm__xstrdup(filename);
 
@@ -350,8 +412,14 @@ static void
 cpp_preproc_predefine_macro(yasm_preproc *preproc, const char *macronameval)
 {
     yasm_preproc_cpp *pp = (yasm_preproc_cpp *)preproc;
+    cpp_arg_entry *arg;
+
+    if (pp->engine) {
+        cpp_pp_define(pp->engine, macronameval);
+        return;
+    }
 
-    cpp_arg_entry *arg = yasm_xmalloc(sizeof(cpp_arg_entry));
+    arg = yasm_xmalloc(sizeof(cpp_arg_entry));
     arg->op = "-D";
     arg->param = yasm__xstrdup(macronameval);
 
@@ -362,8 +430,14 @@ static void
 cpp_preproc_undefine_macro(yasm_preproc *preproc, const char *macroname)
 {
     yasm_preproc_cpp *pp = (yasm_preproc_cpp *)preproc;
+    cpp_arg_entry *arg;
+
+    if (pp->engine) {
+        cpp_pp_undefine(pp->engine, macroname);
+        return;
+    }
 
-    cpp_arg_entry *arg = yasm_xmalloc(sizeof(cpp_arg_entry));
+    arg = yasm_xmalloc(sizeof(cpp_arg_entry));
     arg->op = "-U";
     arg->param = yasm__xstrdup(macroname);
 
@@ -388,7 +462,7 @@ cpp_preproc_add_standard(yasm_preproc *preproc, const char **macros)
 *******************************************************************************/
 
 yasm_preproc_module yasm_cpp_LTX_preproc = {
-    "Run input through external C preprocessor",
+    "C preprocessor (in process, or external with YASM_CPP)",
     "cpp",
     cpp_preproc_create,
     cpp_preproc_destroy,
@@ -398,5 +472,8 @@ yasm_preproc_module yasm_cpp_LTX_preproc = {
     cpp_preproc_predefine_macro,
     cpp_preproc_undefine_macro,
     cpp_preproc_define_builtin,
-    cpp_preproc_add_standard
+    cpp_preproc_add_standard,
+    cpp_preproc_get_line_ref,
+    NULL,
+    NULL
 };
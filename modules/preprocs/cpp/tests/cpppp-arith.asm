@@ -0,0 +1,23 @@
+/* #if arithmetic uses intmax_t/uintmax_t and the usual conversions */
+#if 0xffffffffffffffff > 0
+	.byte 1
+#else
+	.byte 0xee
+#endif
+#if -1 < 0u
+	.byte 0xee
+#else
+	.byte 2
+#endif
+#if -1 < 0 && -1 > 0ul && (0 ? 1u : -1) > 0
+	.byte 3
+#endif
+#if (-1 >> 1) == -1 && (-1u >> 63) == 1 && -7 / 2 == -3 && -7 % 2 == -1
+	.byte 4
+#endif
+#if 18446744073709551615u == -1 && 9223372036854775807 > 0
+	.byte 5
+#endif
+#if -9223372036854775807 - 1 < 0 && 0x8000000000000000 > 0
+	.byte 6
+#endif
@@ -0,0 +1,25 @@
+#define VERSION 3
+#if defined(VERSION) && VERSION >= 2 && (VERSION * 2 == 6)
+	.byte 1
+#elif VERSION == 1
+	.byte 2
+#else
+	.byte 3
+#endif
+#ifdef UNDEFINED
+	.byte 4
+#else
+#if 0
+	.byte 5
+#elif 1 || (1 / 0)
+	.byte 6
+#endif
+#endif
+#undef VERSION
+#ifndef VERSION
+	.byte 7
+#endif
+#if 'a' == 97 && 010 == 8 && -1 < 0 && (1 << 4) == 16 && (7 % 3 ? 1 : 0)
+	.byte 8
+#endif
+# not a directive: a comment for the gas parser
@@ -0,0 +1,9 @@
+#define ADD(a, b) ((a) + (b))
+#define ADD(a, b) (a + b)
+	.long ADD(1, 2, 3)
+#if 1 +
+#endif
+#error stop here
+#include "nonexistent.h"
+#else
+#if 1
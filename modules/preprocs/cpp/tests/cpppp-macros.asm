@@ -0,0 +1,26 @@
+/* Object-like, function-like, and variadic macros */
+#define BASE	0x10
+#define REG	%eax
+#define LOAD(val, reg)	movl $(val), reg
+#define STR(x)	#x
+#define XSTR(x)	STR(x)
+#define CAT(a, b)	a ## b
+#define LIST(first, ...)	.byte first, ##__VA_ARGS__
+
+	LOAD(BASE + 1, REG)	// trailing comment
+	LOAD(
+	    BASE * 2,
+	    %ebx)
+	CAT(mov, l) $CAT(0x, 30), %ecx
+	.ascii XSTR(BASE)
+	LIST(1)
+	LIST(2, 3, 4)
+	.long __LINE__
+#define self self
+	self = 5
+	.long self
+#define hash_hash # ## #
+#define mkstr(a) # a
+#define in_between(a) mkstr(a)
+#define join(c, d) in_between(c hash_hash d)
+	.ascii join(x, y)
@@ -0,0 +1,3 @@
+#! /bin/sh
+${srcdir}/out_test.sh cpppp_test modules/preprocs/cpp/tests "cpp preproc" "-f bin -p gas -r cpp" ""
+exit $?
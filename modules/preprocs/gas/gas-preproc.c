@@ -99,6 +99,8 @@ typedef struct yasm_preproc_gas {
     yasm_errwarns *errwarns;
     int fatal_error;
     int detect_errors_only;
+
+    char *ref_line;     /* last line returned by get_line_ref */
 } yasm_preproc_gas;
 
 yasm_preproc_module yasm_gas_LTX_preproc;
@@ -896,6 +898,8 @@ static void expand_macro(yasm_preproc_gas *pp, macro_entry *macro, const char *a
     int i, j;
     buffered_line *prev_bline = NULL;
 
+    yasm_stats_inc(YASM_STATS_MACRO_EXPANSIONS);
+
     for (i = 0; i < macro->num_lines; i++) {
         buffered_line *bline = yasm_xmalloc(sizeof(buffered_line));
         struct tokenval tokval;
@@ -1288,6 +1292,7 @@ gas_preproc_create(const char *in_filename, yasm_symtab *symtab,
     pp->errwarns = errwarns;
     pp->fatal_error = 0;
     pp->detect_errors_only = 0;
+    pp->ref_line = NULL;
 
     return (yasm_preproc *) pp;
 }
@@ -1296,6 +1301,8 @@ static void
 gas_preproc_destroy(yasm_preproc *preproc)
 {
     yasm_preproc_gas *pp = (yasm_preproc_gas *) preproc;
+    if (pp->ref_line)
+        yasm_xfree(pp->ref_line);
     yasm_xfree(pp->in_filename);
     yasm_symtab_destroy(pp->defines);
     while (!SLIST_EMPTY(&pp->deferred_defines)) {
@@ -1367,6 +1374,23 @@ gas_preproc_get_line(yasm_preproc *preproc)
     return line;
 }
 
+static int
+gas_preproc_get_line_ref(yasm_preproc *preproc, yasm_preproc_line *line)
+{
+    yasm_preproc_gas *pp = (yasm_preproc_gas *)preproc;
+
+    if (pp->ref_line)
+        yasm_xfree(pp->ref_line);
+    pp->ref_line = gas_preproc_get_line(preproc);
+    if (!pp->ref_line)
+        return 0;
+
+    line->text = pp->ref_line;
+    line->len = strlen(pp->ref_line);
+    line->persistent = 0;
+    return 1;
+}
+
 static size_t
 gas_preproc_get_included_file(yasm_preproc *preproc, char *buf,
                               size_t max_size)
@@ -1433,5 +1457,8 @@ yasm_preproc_module yasm_gas_LTX_preproc = {
     gas_preproc_predefine_macro,
     gas_preproc_undefine_macro,
     gas_preproc_define_builtin,
-    gas_preproc_add_standard
+    gas_preproc_add_standard,
+    gas_preproc_get_line_ref,
+    NULL,
+    NULL
 };
@@ -39,10 +39,21 @@
 #include <libyasm/intnum.h>
 #include <libyasm/expr.h>
 #include <libyasm/file.h>
+#include <libyasm/stats.h>
+#include <libyasm/md5.h>
+#include <libyasm/phash.h>
+#include <libyasm/filecache.h>
 #include <stdarg.h>
 #include <ctype.h>
 #include <limits.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #include "nasm.h"
 #include "nasmlib.h"
 #include "nasm-pp.h"
@@ -305,6 +316,33 @@ enum
     PP_STRLEN, PP_SUBSTR, PP_UNDEF, PP_XDEFINE
 };
 
+/* Perfect hash from directive name (without the '%') to PP_* index. */
+struct pp_directive {
+    const char *name;
+    int index;
+};
+
+#include "nasm-ppdir.c"
+
+/* Look up a %-directive; returns its PP_* index, or -1 if unknown. */
+static int
+find_directive(const char *text)
+{
+    char lcasename[16];
+    const struct pp_directive *pd;
+    size_t i, len;
+
+    text++;                     /* skip the '%' */
+    len = strlen(text);
+    if (len >= sizeof(lcasename))
+        return -1;
+    for (i = 0; i < len; i++)
+        lcasename[i] = tolower((unsigned char)text[i]);
+    lcasename[len] = '\0';
+    pd = pp_directive_find(lcasename, len);
+    return pd ? pd->index : -1;
+}
+
 /* If this is a an IF, ELIF, ELSE or ENDIF keyword */
 static int is_condition(int arg)
 {
@@ -335,31 +373,33 @@ static const char *tasm_directives[] = {
     "ifndef", "include", "local"
 };
 
-static int StackSize = 4;
-static const char *StackPointer = "ebp";
-static int ArgOffset = 8;
-static int LocalOffset = 4;
-static int Level = 0;
+static YASM_THREAD_LOCAL int StackSize = 4;
+static YASM_THREAD_LOCAL const char *StackPointer = "ebp";
+static YASM_THREAD_LOCAL int ArgOffset = 8;
+static YASM_THREAD_LOCAL int LocalOffset = 4;
+static YASM_THREAD_LOCAL int Level = 0;
 
 
-static Context *cstk;
-static Include *istk;
+static YASM_THREAD_LOCAL Context *cstk;
+static YASM_THREAD_LOCAL Include *istk;
 
-static FILE *first_fp = NULL;
+static YASM_THREAD_LOCAL FILE *first_fp = NULL;
 
-static efunc _error;            /* Pointer to client-provided error reporting function */
-static evalfunc evaluate;
+/* Pointer to client-provided error reporting function */
+static YASM_THREAD_LOCAL efunc _error;
+static YASM_THREAD_LOCAL evalfunc evaluate;
 
-static int pass;                /* HACK: pass 0 = generate dependencies only */
+/* HACK: pass 0 = generate dependencies only */
+static YASM_THREAD_LOCAL int pass;
 
-static unsigned long unique;    /* unique identifier numbers */
+static YASM_THREAD_LOCAL unsigned long unique;  /* unique identifier numbers */
 
-static Line *builtindef = NULL;
-static Line *stddef = NULL;
-static Line *predef = NULL;
-static int first_line = 1;
+static YASM_THREAD_LOCAL Line *builtindef = NULL;
+static YASM_THREAD_LOCAL Line *stddef = NULL;
+static YASM_THREAD_LOCAL Line *predef = NULL;
+static YASM_THREAD_LOCAL int first_line = 1;
 
-static ListGen *list;
+static YASM_THREAD_LOCAL ListGen *list;
 
 /*
  * The number of hash values we use for the macro lookup tables.
@@ -371,18 +411,18 @@ static ListGen *list;
 /*
  * The current set of multi-line macros we have defined.
  */
-static MMacro *mmacros[NHASH];
+static YASM_THREAD_LOCAL MMacro *mmacros[NHASH];
 
 /*
  * The current set of single-line macros we have defined.
  */
-static SMacro *smacros[NHASH];
+static YASM_THREAD_LOCAL SMacro *smacros[NHASH];
 
 /*
  * The multi-line macro we are currently defining, or the %rep
  * block we are currently reading, if any.
  */
-static MMacro *defining;
+static YASM_THREAD_LOCAL MMacro *defining;
 
 /*
  * The number of macro parameters to allocate space for at a time.
@@ -447,19 +487,53 @@ static const char *tasm_compat_macros[] =
     NULL
 };
 
-static int nested_mac_count, nested_rep_count;
+static YASM_THREAD_LOCAL int nested_mac_count, nested_rep_count;
 
 /*
  * Tokens are allocated in blocks to improve speed
  */
 #define TOKEN_BLOCKSIZE 4096
-static Token *freeTokens = NULL;
+static YASM_THREAD_LOCAL Token *freeTokens = NULL;
 struct Blocks {
         Blocks *next;
         void *chunk;
 };
 
-static Blocks blocks = { NULL, NULL };
+static YASM_THREAD_LOCAL Blocks blocks = { NULL, NULL };
+
+/*
+ * State for saving and restoring preprocessor snapshots (see below).
+ */
+typedef struct SnapLine
+{
+    char *text;
+    char *fname;                /* NULL for the input file */
+    long linnum;
+} SnapLine;
+
+typedef struct SnapDep
+{
+    char *name;                 /* name as requested */
+    char *from;                 /* including file; NULL for the input file */
+    char *path;                 /* file found */
+} SnapDep;
+
+static YASM_THREAD_LOCAL char *snap_filename = NULL;
+/* name of the input file */
+static YASM_THREAD_LOCAL char *snap_input = NULL;
+/* recording a snapshot to be written */
+static YASM_THREAD_LOCAL int snap_recording;
+/* replaying the lines of a loaded one */
+static YASM_THREAD_LOCAL int snap_replaying;
+/* errors and warnings while recording */
+static YASM_THREAD_LOCAL int snap_diags;
+/* lines emitted, or to be replayed */
+static YASM_THREAD_LOCAL SnapLine *snap_lines;
+static YASM_THREAD_LOCAL int snap_nlines, snap_linepos;
+/* file and line at the end */
+static YASM_THREAD_LOCAL SnapLine snap_final;
+static YASM_THREAD_LOCAL SnapDep *snap_deps;
+static YASM_THREAD_LOCAL int snap_ndeps;
 
 /*
  * Forward declarations.
@@ -476,6 +550,7 @@ static Token *new_Token(Token * next, int type, const char *text,
                         size_t txtlen);
 static Token *delete_Token(Token * t);
 static Token *tokenise(char *line);
+static void snap_add_dep(const char *name, const char *path);
 
 /*
  * Macros for safe checking of token pointers, avoid *(NULL)
@@ -497,9 +572,9 @@ typedef struct TMEndItem {
     struct TMEndItem *next;
 } TMEndItem;
 
-static TMEndItem *EndmStack = NULL, *EndsStack = NULL;
+static YASM_THREAD_LOCAL TMEndItem *EndmStack = NULL, *EndsStack = NULL;
 
-char **TMParameters;
+YASM_THREAD_LOCAL char **TMParameters;
 
 struct TStrucField {
     char *name;
@@ -511,14 +586,14 @@ struct TStruc {
     struct TStrucField *fields, *lastField;
     struct TStruc *next;
 };
-static struct TStruc *TStrucs = NULL;
-static int inTstruc = 0;
+static YASM_THREAD_LOCAL struct TStruc *TStrucs = NULL;
+static YASM_THREAD_LOCAL int inTstruc = 0;
 
 struct TSegmentAssume {
     char *segreg;
     char *segment;
 };
-struct TSegmentAssume *TAssumes;
+YASM_THREAD_LOCAL struct TSegmentAssume *TAssumes;
 
 const char *tasm_get_segment_register(const char *segment)
 {
@@ -1543,7 +1618,7 @@ detoken(Token * tlist, int expand_locals)
     {
         if (t->type == TOK_PREPROC_ID && t->text[1] == '!')
         {
-            char *p2 = getenv(t->text + 2);
+            const char *p2 = yasm_getenv(t->text + 2);
             nasm_free(t->text);
             if (p2)
                 t->text = nasm_strdup(p2);
@@ -1795,7 +1870,7 @@ inc_fopen(char *file, char **newname)
     pb = file;
     p1 = pb;
     for (;;) {
-        char *env;
+        const char *env;
         while (*p1 != '\0' && *p1 != '%')
             p1++;
         if (*p1 == '\0')
@@ -1809,7 +1884,7 @@ inc_fopen(char *file, char **newname)
          * pointing to the second %.
          */
         *p2 = '\0';
-        env = getenv(p1+1);
+        env = yasm_getenv(p1+1);
         if (!env) {
             /* warn, restore %, and continue looking */
             error(ERR_WARNING, "environment variable `%s' does not exist",
@@ -1861,6 +1936,8 @@ inc_fopen(char *file, char **newname)
         error(ERR_FATAL, "unable to open include file `%s'",
               file2 ? file2 : file);
     nasm_preproc_add_dep(combine);
+    if (snap_recording)
+        snap_add_dep(file2 ? file2 : file, combine);
 
     if (file2)
         nasm_free(file2);
@@ -2333,6 +2410,7 @@ do_directive(Token * tline)
     int i, j, k, m, nparam, nolist;
     int offset;
     char *p, *mname, *newname;
+    const char *dirname;
     Include *inc;
     Context *ctx;
     Cond *cond;
@@ -2353,27 +2431,15 @@ do_directive(Token * tline)
                     || tline->text[1] == '!'))
         return NO_DIRECTIVE_FOUND;
 
-    i = -1;
-    j = elements(directives);
-    while (j - i > 1)
-    {
-        k = (j + i) / 2;
-        m = nasm_stricmp(tline->text, directives[k]);
-        if (m == 0) {
-                if (tasm_compatible_mode) {
-                i = k;
-                j = -2;
-                } else if (k != PP_ARG && k != PP_LOCAL && k != PP_STACKSIZE) {
-                    i = k;
-                j = -2;
-                }
-            break;
-        }
-        else if (m < 0) {
-            j = k;
-        }
+    dirname = tline->text;
+    j = -1;
+    i = find_directive(dirname);
+    if (i >= 0) {
+        if (tasm_compatible_mode ||
+            (i != PP_ARG && i != PP_LOCAL && i != PP_STACKSIZE))
+            j = -2;
         else
-            i = k;
+            i = -1;
     }
 
     /*
@@ -3790,7 +3856,7 @@ do_directive(Token * tline)
         default:
             error(ERR_FATAL,
                     "preprocessor directive `%s' not yet implemented",
-                    directives[i]);
+                    dirname);
             break;
     }
     return DIRECTIVE_FOUND;
@@ -4795,6 +4861,7 @@ expand_mmacro(Token * tline)
     }
 
     list->uplevel(m->nolist ? LIST_MACRO_NOLIST : LIST_MACRO);
+    yasm_stats_inc(YASM_STATS_MACRO_EXPANSIONS);
 
     return 1;
 }
@@ -4815,6 +4882,9 @@ error(int severity, const char *fmt, ...)
     if (istk && istk->conds && !emitting(istk->conds->state))
         return;
 
+    if (snap_recording)
+        snap_diags++;
+
     va_start(arg, fmt);
 #ifdef HAVE_VSNPRINTF
     vsnprintf(buff, sizeof(buff), fmt, arg);
@@ -4830,6 +4900,698 @@ error(int severity, const char *fmt, ...)
         _error(severity | ERR_PASS1, "%s", buff);
 }
 
+/*
+ * Preprocessor snapshots.
+ *
+ * Processing the builtin, standard and pre-included macro files can
+ * take far longer than a small source file, so the state they leave
+ * behind can be saved to a file and restored by later runs with the
+ * same macro options and unchanged included files.  The state consists
+ * of the macro tables, the counters used for %$ and ..@ names and
+ * %stacksize, and the lines emitted meanwhile together with their file
+ * names and line numbers.
+ *
+ * The file is a flat image of 32-bit little-endian words and strings
+ * (a length word, or SNAP_NULL for a NULL pointer, followed by the
+ * characters and a NUL), which is mapped into memory and converted
+ * without tokenising anything.  Included files are recorded with the
+ * name they were requested by, so that they can be searched for again
+ * and checked against the modification time, size and MD5 recorded.
+ */
+#define SNAP_MAGIC      "YASMNPP"       /* 8 bytes including the NUL */
+#define SNAP_VERSION    1
+#define SNAP_NULL       0xFFFFFFFFUL
+
+typedef struct SnapBuf
+{
+    unsigned char *data;
+    unsigned long len, size;
+} SnapBuf;
+
+typedef struct SnapReader
+{
+    unsigned char *p, *end;
+    int bad;
+} SnapReader;
+
+static void
+snap_put(SnapBuf *b, const void *p, unsigned long n)
+{
+    if (b->len + n > b->size)
+    {
+        while (b->len + n > b->size)
+            b->size = b->size ? b->size * 2 : 4096;
+        b->data = nasm_realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void
+snap_put_word(SnapBuf *b, unsigned long v)
+{
+    unsigned char w[4];
+    w[0] = (unsigned char)(v & 0xFF);
+    w[1] = (unsigned char)((v >> 8) & 0xFF);
+    w[2] = (unsigned char)((v >> 16) & 0xFF);
+    w[3] = (unsigned char)((v >> 24) & 0xFF);
+    snap_put(b, w, 4);
+}
+
+static void
+snap_put_str(SnapBuf *b, const char *s)
+{
+    if (!s)
+    {
+        snap_put_word(b, SNAP_NULL);
+        return;
+    }
+    snap_put_word(b, (unsigned long)strlen(s));
+    snap_put(b, s, (unsigned long)strlen(s) + 1);
+}
+
+static void
+snap_put_tokens(SnapBuf *b, Token * t)
+{
+    unsigned long n = 0;
+    Token *tt;
+
+    for (tt = t; tt; tt = tt->next)
+        n++;
+    snap_put_word(b, n);
+    for (; t; t = t->next)
+    {
+        snap_put_word(b, (unsigned long)t->type);
+        snap_put_str(b, t->text);
+    }
+}
+
+static unsigned long
+snap_get_word(SnapReader *r)
+{
+    unsigned long v;
+
+    if (r->end - r->p < 4)
+    {
+        r->bad = TRUE;
+        return 0;
+    }
+    v = (unsigned long)r->p[0] | ((unsigned long)r->p[1] << 8) |
+        ((unsigned long)r->p[2] << 16) | ((unsigned long)r->p[3] << 24);
+    r->p += 4;
+    return v;
+}
+
+static char *
+snap_get_str(SnapReader *r)
+{
+    unsigned long len = snap_get_word(r);
+    char *s;
+
+    if (r->bad || len == SNAP_NULL)
+        return NULL;
+    if ((unsigned long)(r->end - r->p) < len + 1 || r->p[len] != '\0')
+    {
+        r->bad = TRUE;
+        return NULL;
+    }
+    s = (char *)r->p;
+    r->p += len + 1;
+    return s;
+}
+
+/*
+ * Read a token list.  Parameter tokens may only refer to one of the
+ * nparam parameters of the single-line macro being read (none for
+ * other lists), as expand_smacro() indexes its parameters with them.
+ */
+static Token *
+snap_get_tokens(SnapReader *r, int nparam)
+{
+    unsigned long n = snap_get_word(r);
+    Token *head = NULL, **tail = &head;
+    int type;
+    char *text;
+
+    while (!r->bad && n-- > 0)
+    {
+        type = (int)snap_get_word(r);
+        text = snap_get_str(r);
+        if (type < TOK_WHITESPACE || type == TOK_SMAC_END ||
+            (type >= TOK_SMAC_PARAM && type - TOK_SMAC_PARAM >= nparam))
+            r->bad = TRUE;
+        if (r->bad)
+            break;
+        *tail = new_Token(NULL, type, text, 0);
+        tail = &(*tail)->next;
+    }
+    return head;
+}
+
+/*
+ * Get the modification time, size and MD5 of a file.  Returns FALSE
+ * if it can't be read.
+ */
+static int
+snap_file_info(yasm_filecache *cache, const char *path,
+               unsigned long *mtime, unsigned long *size,
+               unsigned char digest[16])
+{
+    const unsigned char *data;
+    unsigned long len;
+    yasm_md5_context ctx;
+#ifdef HAVE_SYS_STAT_H
+    struct stat st;
+#endif
+
+    *mtime = *size = 0;
+#ifdef HAVE_SYS_STAT_H
+    if (stat(path, &st) != 0)
+        return FALSE;
+    *mtime = (unsigned long)st.st_mtime & 0xFFFFFFFFUL;
+#endif
+    data = yasm_filecache_get_path(cache, path, &len);
+    if (!data)
+        return FALSE;
+    *size = len & 0xFFFFFFFFUL;
+    yasm_md5_init(&ctx);
+    yasm_md5_update(&ctx, data, len);
+    yasm_md5_final(digest, &ctx);
+    return TRUE;
+}
+
+/*
+ * The snapshot key: everything that is processed before the input
+ * file, and the mode it is processed in.
+ */
+static void
+snap_key(unsigned char digest[16])
+{
+    yasm_md5_context ctx;
+    Line *lists[3];
+    Line *l;
+    Token *t;
+    SnapBuf b = { NULL, 0, 0 };
+    int i;
+
+    lists[0] = builtindef;
+    lists[1] = stddef;
+    lists[2] = predef;
+    snap_put_word(&b, (unsigned long)tasm_compatible_mode);
+    for (i = 0; i < 3; i++)
+    {
+        for (l = lists[i]; l; l = l->next)
+        {
+            for (t = l->first; t; t = t->next)
+            {
+                snap_put_word(&b, (unsigned long)t->type);
+                snap_put_str(&b, t->text);
+            }
+            snap_put_word(&b, 0);
+        }
+        snap_put_word(&b, SNAP_NULL);
+    }
+
+    yasm_md5_init(&ctx);
+    yasm_md5_update(&ctx, b.data, b.len);
+    yasm_md5_final(digest, &ctx);
+    nasm_free(b.data);
+}
+
+static void
+snap_free_lines(void)
+{
+    int i;
+
+    for (i = 0; i < snap_nlines; i++)
+    {
+        nasm_free(snap_lines[i].text);
+        nasm_free(snap_lines[i].fname);
+    }
+    nasm_free(snap_lines);
+    snap_lines = NULL;
+    snap_nlines = snap_linepos = 0;
+    nasm_free(snap_final.fname);
+    snap_final.fname = NULL;
+}
+
+static void
+snap_free_deps(void)
+{
+    int i;
+
+    for (i = 0; i < snap_ndeps; i++)
+    {
+        nasm_free(snap_deps[i].name);
+        nasm_free(snap_deps[i].from);
+        nasm_free(snap_deps[i].path);
+    }
+    nasm_free(snap_deps);
+    snap_deps = NULL;
+    snap_ndeps = 0;
+}
+
+/*
+ * Record where the preprocessor is, as seen by the caller of
+ * pp_getline().
+ */
+static void
+snap_set_pos(SnapLine *sl, const char *text)
+{
+    const char *fname = nasm_src_get_fname();
+
+    sl->text = text ? nasm_strdup(text) : NULL;
+    sl->fname = fname && strcmp(fname, snap_input) != 0 ?
+        nasm_strdup(fname) : NULL;
+    sl->linnum = nasm_src_get_linnum();
+}
+
+static void
+snap_record_line(const char *line)
+{
+    if (snap_nlines % 64 == 0)
+        snap_lines = nasm_realloc(snap_lines,
+                                  sizeof(SnapLine) * (snap_nlines + 64));
+    snap_set_pos(&snap_lines[snap_nlines++], line);
+}
+
+static void
+snap_add_dep(const char *name, const char *path)
+{
+    const char *from = nasm_src_get_fname();
+    SnapDep *d;
+
+    if (snap_ndeps % 16 == 0)
+        snap_deps = nasm_realloc(snap_deps,
+                                 sizeof(SnapDep) * (snap_ndeps + 16));
+    d = &snap_deps[snap_ndeps++];
+    d->name = nasm_strdup(name);
+    d->from = from && strcmp(from, snap_input) != 0 ? nasm_strdup(from) :
+        NULL;
+    d->path = nasm_strdup(path);
+}
+
+static void
+snap_put_pos(SnapBuf *b, const SnapLine *sl)
+{
+    snap_put_str(b, sl->fname);
+    snap_put_word(b, (unsigned long)sl->linnum);
+    snap_put_str(b, sl->text);
+}
+
+/*
+ * Write the snapshot once everything before the input file has been
+ * processed.
+ */
+static void
+snap_write(void)
+{
+    SnapBuf b = { NULL, 0, 0 };
+    yasm_filecache *cache;
+    unsigned char digest[16];
+    unsigned long mtime, size, n;
+    char *tmp;
+    FILE *f;
+    MMacro *m;
+    SMacro *s;
+    Line *l;
+    int h, i, ok = TRUE;
+
+    snap_recording = FALSE;
+    if (snap_diags)
+        goto done;      /* don't lose the diagnostics on a later run */
+    if (defining || cstk || istk->conds || istk->mstk)
+    {
+        error(ERR_WARNING,
+              "macro state after pre-included files not saved to `%s'",
+              snap_filename);
+        goto done;
+    }
+
+    snap_put(&b, SNAP_MAGIC, 8);
+    snap_put_word(&b, SNAP_VERSION);
+    snap_key(digest);
+    snap_put(&b, digest, 16);
+
+    cache = yasm_filecache_create();
+    snap_put_word(&b, (unsigned long)snap_ndeps);
+    for (i = 0; i < snap_ndeps; i++)
+    {
+        snap_put_str(&b, snap_deps[i].name);
+        snap_put_str(&b, snap_deps[i].from);
+        snap_put_str(&b, snap_deps[i].path);
+        if (!snap_file_info(cache, snap_deps[i].path, &mtime, &size, digest))
+            ok = FALSE;
+        snap_put_word(&b, mtime);
+        snap_put_word(&b, size);
+        snap_put(&b, digest, 16);
+    }
+    yasm_filecache_destroy(cache);
+    if (!ok)
+        goto done;
+
+    snap_put_word(&b, unique);
+    snap_put_word(&b, (unsigned long)Level);
+    snap_put_word(&b, (unsigned long)StackSize);
+    snap_put_word(&b, (unsigned long)ArgOffset);
+    snap_put_word(&b, (unsigned long)LocalOffset);
+
+    n = 0;
+    for (h = 0; h < NHASH; h++)
+        for (s = smacros[h]; s; s = s->next)
+            n++;
+    snap_put_word(&b, n);
+    for (h = 0; h < NHASH; h++)
+    {
+        for (s = smacros[h]; s; s = s->next)
+        {
+            snap_put_str(&b, s->name);
+            snap_put_word(&b, (unsigned long)s->casesense);
+            snap_put_word(&b, (unsigned long)s->nparam);
+            snap_put_word(&b, (unsigned long)s->level);
+            snap_put_tokens(&b, s->expansion);
+        }
+    }
+
+    n = 0;
+    for (h = 0; h < NHASH; h++)
+        for (m = mmacros[h]; m; m = m->next)
+            n++;
+    snap_put_word(&b, n);
+    for (h = 0; h < NHASH; h++)
+    {
+        for (m = mmacros[h]; m; m = m->next)
+        {
+            snap_put_str(&b, m->name);
+            snap_put_word(&b, (unsigned long)m->casesense);
+            snap_put_word(&b, (unsigned long)m->nparam_min);
+            snap_put_word(&b, (unsigned long)m->nparam_max);
+            snap_put_word(&b, (unsigned long)m->plus);
+            snap_put_word(&b, (unsigned long)m->nolist);
+            snap_put_tokens(&b, m->dlist);
+            n = 0;
+            for (l = m->expansion; l; l = l->next)
+                n++;
+            snap_put_word(&b, n);
+            for (l = m->expansion; l; l = l->next)
+                snap_put_tokens(&b, l->first);
+        }
+    }
+
+    snap_put_word(&b, (unsigned long)snap_nlines);
+    for (i = 0; i < snap_nlines; i++)
+        snap_put_pos(&b, &snap_lines[i]);
+    snap_set_pos(&snap_final, NULL);
+    snap_put_pos(&b, &snap_final);
+
+    /* Write under a temporary name, so a partial file is never used */
+    tmp = nasm_malloc(strlen(snap_filename) + 32);
+#ifdef HAVE_UNISTD_H
+    sprintf(tmp, "%s.tmp%lu", snap_filename, (unsigned long)getpid());
+#else
+    sprintf(tmp, "%s.tmp", snap_filename);
+#endif
+    f = fopen(tmp, "wb");
+    if (f)
+    {
+        ok = fwrite(b.data, 1, b.len, f) == b.len;
+        if (fclose(f) != 0)
+            ok = FALSE;
+        if (ok && rename(tmp, snap_filename) != 0)
+        {
+            /* Windows rename() does not replace an existing file */
+            remove(snap_filename);
+            ok = rename(tmp, snap_filename) == 0;
+        }
+        if (!ok)
+            remove(tmp);
+    }
+    else
+        ok = FALSE;
+    if (ok)
+        yasm_stats_inc(YASM_STATS_SNAPSHOT_SAVES);
+    else
+        error(ERR_WARNING, "unable to write macro snapshot `%s'",
+              snap_filename);
+    nasm_free(tmp);
+
+done:
+    nasm_free(b.data);
+    snap_free_lines();
+    snap_free_deps();
+}
+
+static void
+free_macro_tables(void)
+{
+    int h;
+
+    for (h = 0; h < NHASH; h++)
+    {
+        while (mmacros[h])
+        {
+            MMacro *m = mmacros[h];
+            mmacros[h] = mmacros[h]->next;
+            free_mmacro(m);
+        }
+        while (smacros[h])
+        {
+            SMacro *s = smacros[h];
+            smacros[h] = smacros[h]->next;
+            nasm_free(s->name);
+            free_tlist(s->expansion);
+            nasm_free(s);
+        }
+    }
+}
+
+static void
+snap_get_pos(SnapReader *r, SnapLine *sl)
+{
+    char *fname = snap_get_str(r);
+    char *text;
+
+    sl->fname = fname ? nasm_strdup(fname) : NULL;
+    sl->linnum = (long)snap_get_word(r);
+    text = snap_get_str(r);
+    sl->text = text ? nasm_strdup(text) : NULL;
+}
+
+static void
+snap_restore_pos(const SnapLine *sl)
+{
+    nasm_free(nasm_src_set_fname(nasm_strdup(sl->fname ? sl->fname :
+                                             snap_input)));
+    nasm_src_set_linnum(sl->linnum);
+}
+
+/*
+ * Restore the state saved in the snapshot file, if the file exists and
+ * is up to date.  Returns FALSE, with nothing changed, otherwise.
+ */
+static int
+snap_load(void)
+{
+    yasm_filecache *cache = yasm_filecache_create();
+    SnapReader r;
+    unsigned char key[16], digest[16];
+    unsigned char *deps;
+    unsigned long len, n, i, j, mtime, size, cur_mtime, cur_size, sv_unique;
+    int sv_level, sv_stacksize, sv_argoffset, sv_localoffset, valid;
+    char *name, *from, *path, *found;
+    FILE *fp;
+    int ok = FALSE;
+
+    r.p = (unsigned char *)yasm_filecache_get_path(cache, snap_filename, &len);
+    if (!r.p || len < 8 + 4 + 16 || memcmp(r.p, SNAP_MAGIC, 8) != 0)
+        goto done;
+    r.end = r.p + len;
+    r.bad = FALSE;
+    r.p += 8;
+    if (snap_get_word(&r) != SNAP_VERSION)
+        goto done;
+    snap_key(key);
+    if (memcmp(r.p, key, 16) != 0)
+        goto done;
+    r.p += 16;
+
+    /* Every included file must still be found, and be unchanged */
+    deps = r.p;
+    n = snap_get_word(&r);
+    for (i = 0; i < n; i++)
+    {
+        name = snap_get_str(&r);
+        from = snap_get_str(&r);
+        path = snap_get_str(&r);
+        mtime = snap_get_word(&r);
+        size = snap_get_word(&r);
+        if (r.bad || !name || !path || r.end - r.p < 16)
+            goto done;
+        fp = yasm_fopen_include(name, from ? from : snap_input, "r", &found);
+        if (!fp)
+            goto done;
+        fclose(fp);
+        valid = strcmp(found, path) == 0 &&
+            snap_file_info(cache, path, &cur_mtime, &cur_size, digest) &&
+            cur_mtime == mtime && cur_size == size &&
+            memcmp(digest, r.p, 16) == 0;
+        yasm_xfree(found);
+        if (!valid)
+            goto done;
+        r.p += 16;
+    }
+
+    sv_unique = snap_get_word(&r);
+    sv_level = (int)snap_get_word(&r);
+    sv_stacksize = (int)snap_get_word(&r);
+    sv_argoffset = (int)snap_get_word(&r);
+    sv_localoffset = (int)snap_get_word(&r);
+
+    n = snap_get_word(&r);
+    for (i = 0; !r.bad && i < n; i++)
+    {
+        SMacro *s, **tail;
+
+        name = snap_get_str(&r);
+        if (!name)
+        {
+            r.bad = TRUE;
+            break;
+        }
+        s = nasm_malloc(sizeof(SMacro));
+        s->next = NULL;
+        s->name = nasm_strdup(name);
+        s->casesense = (int)snap_get_word(&r);
+        s->nparam = (int)snap_get_word(&r);
+        s->level = (int)snap_get_word(&r);
+        s->in_progress = FALSE;
+        if (s->nparam < 0)
+            r.bad = TRUE;
+        s->expansion = snap_get_tokens(&r, s->nparam);
+        for (tail = &smacros[hash(s->name)]; *tail; tail = &(*tail)->next)
+            ;
+        *tail = s;
+    }
+
+    n = snap_get_word(&r);
+    for (i = 0; !r.bad && i < n; i++)
+    {
+        MMacro *m, **tail;
+        Line *l, **ltail;
+
+        name = snap_get_str(&r);
+        if (!name)
+        {
+            r.bad = TRUE;
+            break;
+        }
+        m = nasm_malloc(sizeof(MMacro));
+        m->next = NULL;
+        m->name = nasm_strdup(name);
+        m->casesense = (int)snap_get_word(&r);
+        m->nparam_min = (long)snap_get_word(&r);
+        m->nparam_max = (long)snap_get_word(&r);
+        m->plus = (int)snap_get_word(&r);
+        m->nolist = (int)snap_get_word(&r);
+        m->in_progress = FALSE;
+        m->dlist = snap_get_tokens(&r, 0);
+        m->defaults = NULL;
+        m->ndefs = 0;
+        if (m->dlist)
+            count_mmac_params(m->dlist, &m->ndefs, &m->defaults);
+        m->expansion = NULL;
+        ltail = &m->expansion;
+        j = snap_get_word(&r);
+        while (!r.bad && j-- > 0)
+        {
+            l = nasm_malloc(sizeof(Line));
+            l->next = NULL;
+            l->finishes = NULL;
+            l->first = snap_get_tokens(&r, 0);
+            *ltail = l;
+            ltail = &l->next;
+        }
+        m->next_active = NULL;
+        m->rep_nest = NULL;
+        m->params = NULL;
+        m->iline = NULL;
+        m->nparam = 0;
+        m->rotate = 0;
+        m->paramlen = NULL;
+        m->unique = 0;
+        m->lineno = 0;
+        for (tail = &mmacros[hash(m->name)]; *tail; tail = &(*tail)->next)
+            ;
+        *tail = m;
+    }
+
+    n = snap_get_word(&r);
+    if (n > (unsigned long)(r.end - r.p))
+        r.bad = TRUE;
+    else
+        snap_lines = nasm_malloc(sizeof(SnapLine) * (n + 1));
+    for (i = 0; !r.bad && i < n; i++)
+    {
+        snap_get_pos(&r, &snap_lines[snap_nlines++]);
+        if (!snap_lines[i].text)
+            r.bad = TRUE;
+    }
+    if (!r.bad)
+        snap_get_pos(&r, &snap_final);
+
+    if (r.bad || r.p != r.end)
+    {
+        free_macro_tables();
+        snap_free_lines();
+        goto done;
+    }
+
+    /* Report the included files as dependencies, as if read again */
+    r.p = deps;
+    n = snap_get_word(&r);
+    for (i = 0; i < n; i++)
+    {
+        snap_get_str(&r);
+        snap_get_str(&r);
+        nasm_preproc_add_dep(snap_get_str(&r));
+        r.p += 4 + 4 + 16;
+    }
+
+    unique = sv_unique;
+    Level = sv_level;
+    StackSize = sv_stacksize;
+    StackPointer = StackSize == 2 ? "bp" : "ebp";
+    ArgOffset = sv_argoffset;
+    LocalOffset = sv_localoffset;
+    snap_replaying = TRUE;
+    yasm_stats_inc(YASM_STATS_SNAPSHOT_LOADS);
+    ok = TRUE;
+
+done:
+    yasm_filecache_destroy(cache);
+    return ok;
+}
+
+/*
+ * Called before anything is processed.  Returns TRUE if the state was
+ * restored from a snapshot, in which case the builtin, standard and
+ * pre-included macros need no processing.
+ */
+static int
+snap_begin(void)
+{
+    if (tasm_compatible_mode)
+    {
+        error(ERR_WARNING, "macro snapshots are not supported in TASM mode");
+        return FALSE;
+    }
+    if (snap_load())
+        return TRUE;
+    snap_recording = TRUE;
+    snap_diags = 0;
+    return FALSE;
+}
+
 static void
 pp_reset(FILE *f, const char *file, int apass, efunc errfunc, evalfunc eval,
         ListGen * listgen)
@@ -4848,6 +5610,10 @@ pp_reset(FILE *f, const char *file, int apass, efunc errfunc, evalfunc eval,
     istk->fname = NULL;
     nasm_free(nasm_src_set_fname(nasm_strdup(file)));
     nasm_src_set_linnum(0);
+    nasm_free(snap_input);
+    snap_input = nasm_strdup(file);
+    snap_recording = FALSE;
+    snap_replaying = FALSE;
     istk->lineinc = 1;
     defining = NULL;
     nested_mac_count = 0;
@@ -4912,13 +5678,29 @@ pp_getline(void)
 
         if (first_line)
         {
-            /* Reverse order */
-            poke_predef(predef);
-            poke_predef(stddef);
-            poke_predef(builtindef);
+            if (!snap_filename || !snap_begin())
+            {
+                /* Reverse order */
+                poke_predef(predef);
+                poke_predef(stddef);
+                poke_predef(builtindef);
+            }
             first_line = 0;
         }
 
+        if (snap_replaying)
+        {
+            if (snap_linepos < snap_nlines)
+            {
+                SnapLine *sl = &snap_lines[snap_linepos++];
+                snap_restore_pos(sl);
+                return nasm_strdup(sl->text);
+            }
+            snap_restore_pos(&snap_final);
+            snap_free_lines();
+            snap_replaying = FALSE;
+        }
+
         if (!istk)
             return NULL;
         while (istk->expansion && istk->expansion->finishes)
@@ -5026,6 +5808,12 @@ pp_getline(void)
                 nasm_free(p);
                 break;
             }
+            /*
+             * Everything before the input file proper has been
+             * processed once we get to read from it.
+             */
+            if (snap_recording && !istk->next)
+                snap_write();
             line = read_line();
             if (line)
             {                   /* from the current input file */
@@ -5139,14 +5927,14 @@ pp_getline(void)
         }
     }
 
+    if (snap_recording)
+        snap_record_line(line);
     return line;
 }
 
 static void
 pp_cleanup(int pass_)
 {
-    int h;
-
     if (pass_ == 1)
     {
         if (defining)
@@ -5159,23 +5947,7 @@ pp_cleanup(int pass_)
     }
     while (cstk)
         ctx_pop();
-    for (h = 0; h < NHASH; h++)
-    {
-        while (mmacros[h])
-        {
-            MMacro *m = mmacros[h];
-            mmacros[h] = mmacros[h]->next;
-            free_mmacro(m);
-        }
-        while (smacros[h])
-        {
-            SMacro *s = smacros[h];
-            smacros[h] = smacros[h]->next;
-            nasm_free(s->name);
-            free_tlist(s->expansion);
-            nasm_free(s);
-        }
-    }
+    free_macro_tables();
     while (istk)
     {
         Include *i = istk;
@@ -5195,6 +5967,14 @@ pp_cleanup(int pass_)
                 builtindef = NULL;
                 stddef = NULL;
                 predef = NULL;
+                snap_free_lines();
+                snap_free_deps();
+                snap_recording = FALSE;
+                snap_replaying = FALSE;
+                nasm_free(snap_filename);
+                nasm_free(snap_input);
+                snap_filename = NULL;
+                snap_input = NULL;
                 freeTokens = NULL;
                 delete_Blocks();
                 blocks.next = NULL;
@@ -5282,6 +6062,13 @@ pp_builtin_define(char *definition)
     builtindef = l;
 }
 
+void
+pp_snapshot(const char *filename)
+{
+    nasm_free(snap_filename);
+    snap_filename = nasm_strdup(filename);
+}
+
 void
 pp_extra_stdmac(const char **macros)
 {
@@ -38,16 +38,17 @@ typedef struct yasm_preproc_nasm {
 
     FILE *in;
     char *line;
+    char *ref_line;     /* last line returned by get_line_ref */
     char *file_name;
     long prior_linnum;
     int lineinc;
 } yasm_preproc_nasm;
-yasm_symtab *nasm_symtab;
-static yasm_linemap *cur_lm;
-static yasm_errwarns *cur_errwarns;
-int tasm_compatible_mode = 0;
-int tasm_locals;
-const char *tasm_segment;
+YASM_THREAD_LOCAL yasm_symtab *nasm_symtab;
+static YASM_THREAD_LOCAL yasm_linemap *cur_lm;
+static YASM_THREAD_LOCAL yasm_errwarns *cur_errwarns;
+YASM_THREAD_LOCAL int tasm_compatible_mode = 0;
+YASM_THREAD_LOCAL int tasm_locals;
+YASM_THREAD_LOCAL const char *tasm_segment;
 
 #include "nasm-version.c"
 
@@ -56,8 +57,9 @@ typedef struct preproc_dep {
     char *name;
 } preproc_dep;
 
-static STAILQ_HEAD(preproc_dep_head, preproc_dep) *preproc_deps;
-static int done_dep_preproc;
+static YASM_THREAD_LOCAL STAILQ_HEAD(preproc_dep_head, preproc_dep)
+    *preproc_deps;
+static YASM_THREAD_LOCAL int done_dep_preproc;
 
 yasm_preproc_module yasm_nasm_LTX_preproc;
 
@@ -131,29 +133,26 @@ nasm_efunc(int severity, const char *fmt, ...)
 }
 
 static yasm_preproc *
-nasm_preproc_create(const char *in_filename, yasm_symtab *symtab,
-                    yasm_linemap *lm, yasm_errwarns *errwarns)
+nasm_preproc_create_stream(FILE *f, const char *in_filename,
+                           yasm_symtab *symtab, yasm_linemap *lm,
+                           yasm_errwarns *errwarns)
 {
-    FILE *f;
     yasm_preproc_nasm *preproc_nasm = yasm_xmalloc(sizeof(yasm_preproc_nasm));
 
     preproc_nasm->preproc.module = &yasm_nasm_LTX_preproc;
 
-    if (strcmp(in_filename, "-") != 0) {
-        f = fopen(in_filename, "r");
-        if (!f)
-            yasm__fatal( N_("Could not open input file") );
-    }
-    else
-        f = stdin;
-
     preproc_nasm->in = f;
     nasm_symtab = symtab;
     cur_lm = lm;
     cur_errwarns = errwarns;
-    preproc_deps = NULL;
+    /* Dependencies are recorded as files are included, so they can also be
+     * retrieved after a normal pass over the input.
+     */
+    preproc_deps = yasm_xmalloc(sizeof(struct preproc_dep_head));
+    STAILQ_INIT(preproc_deps);
     done_dep_preproc = 0;
     preproc_nasm->line = NULL;
+    preproc_nasm->ref_line = NULL;
     preproc_nasm->file_name = NULL;
     preproc_nasm->prior_linnum = 0;
     preproc_nasm->lineinc = 0;
@@ -164,6 +163,23 @@ nasm_preproc_create(const char *in_filename, yasm_symtab *symtab,
     return (yasm_preproc *)preproc_nasm;
 }
 
+static yasm_preproc *
+nasm_preproc_create(const char *in_filename, yasm_symtab *symtab,
+                    yasm_linemap *lm, yasm_errwarns *errwarns)
+{
+    FILE *f;
+
+    if (strcmp(in_filename, "-") != 0) {
+        f = fopen(in_filename, "r");
+        if (!f)
+            yasm__fatal( N_("Could not open input file") );
+    }
+    else
+        f = stdin;
+
+    return nasm_preproc_create_stream(f, in_filename, symtab, lm, errwarns);
+}
+
 static void
 nasm_preproc_destroy(yasm_preproc *preproc)
 {
@@ -171,11 +187,19 @@ nasm_preproc_destroy(yasm_preproc *preproc)
     nasmpp.cleanup(0);
     if (preproc_nasm->line)
         yasm_xfree(preproc_nasm->line);
+    if (preproc_nasm->ref_line)
+        yasm_xfree(preproc_nasm->ref_line);
     if (preproc_nasm->file_name)
         yasm_xfree(preproc_nasm->file_name);
     yasm_xfree(preproc);
-    if (preproc_deps)
-        yasm_xfree(preproc_deps);
+    while (!STAILQ_EMPTY(preproc_deps)) {
+        preproc_dep *dep = STAILQ_FIRST(preproc_deps);
+        STAILQ_REMOVE_HEAD(preproc_deps, link);
+        yasm_xfree(dep->name);
+        yasm_xfree(dep);
+    }
+    yasm_xfree(preproc_deps);
+    preproc_deps = NULL;
 }
 
 static char *
@@ -192,10 +216,14 @@ nasm_preproc_get_line(yasm_preproc *preproc)
         return retval;
     }
 
+    if (done_dep_preproc)
+        return NULL;    /* already at EOF */
+
     line = nasmpp.getline();
     if (!line)
     {
         nasmpp.cleanup(1);
+        done_dep_preproc = 1;
         return NULL;    /* EOF */
     }
 
@@ -214,15 +242,31 @@ nasm_preproc_get_line(yasm_preproc *preproc)
     return line;
 }
 
+/* Lines are built up by the preprocessor proper, so they can't be referenced
+ * in place; instead keep ownership of each line until the next call.
+ */
+static int
+nasm_preproc_get_line_ref(yasm_preproc *preproc, yasm_preproc_line *line)
+{
+    yasm_preproc_nasm *preproc_nasm = (yasm_preproc_nasm *)preproc;
+
+    if (preproc_nasm->ref_line)
+        yasm_xfree(preproc_nasm->ref_line);
+    preproc_nasm->ref_line = nasm_preproc_get_line(preproc);
+    if (!preproc_nasm->ref_line)
+        return 0;
+
+    line->text = preproc_nasm->ref_line;
+    line->len = strlen(preproc_nasm->ref_line);
+    line->persistent = 0;
+    return 1;
+}
+
 void
 nasm_preproc_add_dep(char *name)
 {
     preproc_dep *dep;
 
-    /* If not processing dependencies, simply return */
-    if (!preproc_deps)
-        return;
-
     /* Save in preproc_deps */
     dep = yasm_xmalloc(sizeof(preproc_dep));
     dep->name = yasm__xstrdup(name);
@@ -233,11 +277,6 @@ static size_t
 nasm_preproc_get_included_file(yasm_preproc *preproc, /*@out@*/ char *buf,
                                size_t max_size)
 {
-    if (!preproc_deps) {
-        preproc_deps = yasm_xmalloc(sizeof(struct preproc_dep_head));
-        STAILQ_INIT(preproc_deps);
-    }
-
     for (;;) {
         char *line;
 
@@ -304,6 +343,12 @@ nasm_preproc_add_standard(yasm_preproc *preproc, const char **macros)
     pp_extra_stdmac(macros);
 }
 
+static void
+nasm_preproc_use_snapshot(yasm_preproc *preproc, const char *filename)
+{
+    pp_snapshot(filename);
+}
+
 /* Define preproc structure -- see preproc.h for details */
 yasm_preproc_module yasm_nasm_LTX_preproc = {
     "Real NASM Preprocessor",
@@ -316,7 +361,10 @@ yasm_preproc_module yasm_nasm_LTX_preproc = {
     nasm_preproc_predefine_macro,
     nasm_preproc_undefine_macro,
     nasm_preproc_define_builtin,
-    nasm_preproc_add_standard
+    nasm_preproc_add_standard,
+    nasm_preproc_get_line_ref,
+    nasm_preproc_use_snapshot,
+    nasm_preproc_create_stream
 };
 
 static yasm_preproc *
@@ -327,6 +375,15 @@ tasm_preproc_create(const char *in_filename, yasm_symtab *symtab,
     return nasm_preproc_create(in_filename, symtab, lm, errwarns);
 }
 
+static yasm_preproc *
+tasm_preproc_create_stream(FILE *f, const char *in_filename,
+                           yasm_symtab *symtab, yasm_linemap *lm,
+                           yasm_errwarns *errwarns)
+{
+    tasm_compatible_mode = 1;
+    return nasm_preproc_create_stream(f, in_filename, symtab, lm, errwarns);
+}
+
 yasm_preproc_module yasm_tasm_LTX_preproc = {
     "Real TASM Preprocessor",
     "tasm",
@@ -338,5 +395,8 @@ yasm_preproc_module yasm_tasm_LTX_preproc = {
     nasm_preproc_predefine_macro,
     nasm_preproc_undefine_macro,
     nasm_preproc_define_builtin,
-    nasm_preproc_add_standard
+    nasm_preproc_add_standard,
+    nasm_preproc_get_line_ref,
+    nasm_preproc_use_snapshot,
+    tasm_preproc_create_stream
 };
@@ -275,9 +275,9 @@ enum {
 
 #define elements(x)     ( sizeof(x) / sizeof(*(x)) )
 
-extern int tasm_compatible_mode;
-extern int tasm_locals;
-extern const char *tasm_segment;
+extern YASM_THREAD_LOCAL int tasm_compatible_mode;
+extern YASM_THREAD_LOCAL int tasm_locals;
+extern YASM_THREAD_LOCAL const char *tasm_segment;
 const char *tasm_get_segment_register(const char *segment);
 
 #endif
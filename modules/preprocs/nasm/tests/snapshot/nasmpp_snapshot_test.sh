@@ -0,0 +1,98 @@
+#! /bin/sh
+# Check that the first assembly writes a macro snapshot, that a later one
+# restores it (as counted by --stats) with the same output, and that a
+# snapshot with an out-of-range macro parameter token is rejected.
+
+YASM_TEST_SUITE=1
+export YASM_TEST_SUITE
+
+case `echo "testing\c"; echo 1,2,3`,`echo -n testing; echo 1,2,3` in
+  *c*,-n*) ECHO_N= ECHO_C='
+' ECHO_T='	' ;;
+  *c*,*  ) ECHO_N=-n ECHO_C= ECHO_T= ;;
+  *)       ECHO_N= ECHO_C='\c' ECHO_T= ;;
+esac
+
+mkdir results >/dev/null 2>&1
+
+passedct=0
+failedct=0
+
+pass() {
+    echo $ECHO_N ".$ECHO_C"
+    passedct=`expr $passedct + 1`
+}
+
+fail() {
+    echo $ECHO_N "F$ECHO_C"
+    eval "failed$failedct='$1'"
+    failedct=`expr $failedct + 1`
+}
+
+dir=${srcdir}/modules/preprocs/nasm/tests/snapshot
+snap=results/nasmpp-snapshot.snap
+
+# Assemble dir/$2.asm as $1 and check its output against $2.hex, and the
+# number of snapshots saved ($3) and loaded ($4).  The -P file is found
+# relative to the source, so this works for a relative $srcdir too.
+run() {
+    a=$1
+    # Run within a subshell to prevent signal messages from displaying.
+    sh -c "./yasm --stats -f bin -P snaphdr.inc --pp-snapshot=${snap} \
+        -o results/${a}.bin ${dir}/$2.asm 2>results/${a}.stats" \
+        >/dev/null 2>/dev/null
+    status=$?
+    if test $status -gt 128; then
+        fail "${a}: crashed!"
+        return
+    elif test $status -gt 0; then
+        fail "${a}: returned an error code!"
+        return
+    fi
+
+    ./test_hd results/${a}.bin > results/${a}.hx
+    if diff -w ${dir}/$2.hex results/${a}.hx >/dev/null; then
+        pass
+    else
+        fail "${a}: did not match result file!"
+    fi
+
+    if grep "^snapshot_saves  *$3\$" results/${a}.stats >/dev/null \
+        && grep "^snapshot_loads  *$4\$" results/${a}.stats >/dev/null; then
+        pass
+    else
+        fail "${a}: expected $3 snapshot saves and $4 loads"
+    fi
+}
+
+echo $ECHO_N "Test nasmpp_snapshot_test: $ECHO_C"
+
+rm -f ${snap}
+run snapshot-save snapshot-save 1 0
+run snapshot-use snapshot-use 0 1
+
+# Make the first parameter token of PAIR(a,b) (type TOK_SMAC_PARAM, text
+# "a") refer to a parameter the macro doesn't have.
+off=`./test_hd ${snap} | awk '{ s = s $1 " " } END {
+    i = index(s, "09 00 00 00 01 00 00 00 61 00 ");
+    if (i > 0) print (i - 1) / 3 }'`
+if test -n "$off"; then
+    pass
+    printf '\016' | dd of=${snap} bs=1 seek=$off conv=notrunc 2>/dev/null
+    run snapshot-bad snapshot-use 1 0
+else
+    fail "snapshot-bad: parameter token not found in snapshot"
+fi
+
+ct=`expr $failedct + $passedct`
+per=`expr 100 \* $passedct / $ct`
+
+echo " +$passedct-$failedct/$ct $per%"
+i=0
+while test $i -lt $failedct; do
+    eval "failure=\$failed$i"
+    echo " ** $failure"
+    i=`expr $i + 1`
+done
+
+exit $failedct
@@ -0,0 +1,4 @@
+[section .text]
+dw PAIR(HDRVAL, 0x34)
+counted 1
+counted 2, 3
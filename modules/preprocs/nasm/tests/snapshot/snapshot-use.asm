@@ -0,0 +1,6 @@
+[section .text]
+counted 4
+dw PAIR(5, 6)
+%ifdef HDRVAL
+db hdrcount
+%endif
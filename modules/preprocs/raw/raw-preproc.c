@@ -37,16 +37,40 @@ typedef struct yasm_preproc_raw {
     FILE *in;
     yasm_linemap *cur_lm;
     yasm_errwarns *errwarns;
+
+    /* Entire input (NUL-terminated), owned by cur_lm once read, and the
+     * position of the next line within it.
+     */
+    /*@null@*/ /*@dependent@*/ char *buf;
+    size_t len;
+    /*@dependent@*/ char *pos;
 } yasm_preproc_raw;
 
 yasm_preproc_module yasm_raw_LTX_preproc;
 
+static yasm_preproc *
+raw_preproc_create_stream(FILE *f, const char *in_filename,
+                          yasm_symtab *symtab, yasm_linemap *lm,
+                          yasm_errwarns *errwarns)
+{
+    yasm_preproc_raw *preproc_raw = yasm_xmalloc(sizeof(yasm_preproc_raw));
+
+    preproc_raw->preproc.module = &yasm_raw_LTX_preproc;
+    preproc_raw->in = f;
+    preproc_raw->cur_lm = lm;
+    preproc_raw->errwarns = errwarns;
+    preproc_raw->buf = NULL;
+    preproc_raw->len = 0;
+    preproc_raw->pos = NULL;
+
+    return (yasm_preproc *)preproc_raw;
+}
+
 static yasm_preproc *
 raw_preproc_create(const char *in_filename, yasm_symtab *symtab,
                    yasm_linemap *lm, yasm_errwarns *errwarns)
 {
     FILE *f;
-    yasm_preproc_raw *preproc_raw = yasm_xmalloc(sizeof(yasm_preproc_raw));
 
     if (strcmp(in_filename, "-") != 0) {
         f = fopen(in_filename, "r");
@@ -56,62 +80,92 @@ raw_preproc_create(const char *in_filename, yasm_symtab *symtab,
     else
         f = stdin;
 
-    preproc_raw->preproc.module = &yasm_raw_LTX_preproc;
-    preproc_raw->in = f;
-    preproc_raw->cur_lm = lm;
-    preproc_raw->errwarns = errwarns;
-
-    return (yasm_preproc *)preproc_raw;
+    return raw_preproc_create_stream(f, in_filename, symtab, lm, errwarns);
 }
 
 static void
 raw_preproc_destroy(yasm_preproc *preproc)
 {
+    yasm_preproc_raw *preproc_raw = (yasm_preproc_raw *)preproc;
+
+    if (preproc_raw->in && preproc_raw->in != stdin)
+        fclose(preproc_raw->in);
     yasm_xfree(preproc);
 }
 
-static char *
-raw_preproc_get_line(yasm_preproc *preproc)
+/* Read the entire input into a single buffer, which is handed to the line
+ * map so that the lines within it can be saved without copying.
+ */
+static void
+raw_preproc_read_input(yasm_preproc_raw *preproc_raw)
 {
-    yasm_preproc_raw *preproc_raw = (yasm_preproc_raw *)preproc;
-    int bufsize = BSIZE;
-    char *buf = yasm_xmalloc((size_t)bufsize);
-    char *p;
+    size_t bufsize = BSIZE*8;
+    size_t len = 0, n;
+    char *buf = yasm_xmalloc(bufsize);
 
-    /* Loop to ensure entire line is read (don't want to limit line length). */
-    p = buf;
     for (;;) {
-        if (!fgets(p, bufsize-(p-buf), preproc_raw->in)) {
-            if (ferror(preproc_raw->in)) {
-                yasm_error_set(YASM_ERROR_IO,
-                               N_("error when reading from file"));
-                yasm_errwarn_propagate(preproc_raw->errwarns,
-                    yasm_linemap_get_current(preproc_raw->cur_lm));
-            }
-            break;
-        }
-        p += strlen(p);
-        if (p > buf && p[-1] == '\n')
+        n = fread(buf+len, 1, bufsize-len-1, preproc_raw->in);
+        len += n;
+        if (len+1 < bufsize)
             break;
-        if ((p-buf)+1 >= bufsize) {
-            /* Increase size of buffer */
-            char *oldbuf = buf;
-            bufsize *= 2;
-            buf = yasm_xrealloc(buf, (size_t)bufsize);
-            p = buf + (p-oldbuf);
-        }
+        bufsize *= 2;
+        buf = yasm_xrealloc(buf, bufsize);
     }
-
-    if (p == buf) {
-        /* No data; must be at EOF */
-        yasm_xfree(buf);
-        return NULL;
+    if (ferror(preproc_raw->in)) {
+        yasm_error_set(YASM_ERROR_IO, N_("error when reading from file"));
+        yasm_errwarn_propagate(preproc_raw->errwarns,
+            yasm_linemap_get_current(preproc_raw->cur_lm));
     }
+    buf[len] = '\0';
+
+    if (preproc_raw->in != stdin)
+        fclose(preproc_raw->in);
+    preproc_raw->in = NULL;
+
+    yasm_linemap_keep_buffer(preproc_raw->cur_lm, buf);
+    preproc_raw->buf = buf;
+    preproc_raw->len = len;
+    preproc_raw->pos = buf;
+}
+
+static int
+raw_preproc_get_line_ref(yasm_preproc *preproc, yasm_preproc_line *line)
+{
+    yasm_preproc_raw *preproc_raw = (yasm_preproc_raw *)preproc;
+    char *p, *end, *eol;
+
+    if (!preproc_raw->buf)
+        raw_preproc_read_input(preproc_raw);
+
+    p = preproc_raw->pos;
+    end = preproc_raw->buf + preproc_raw->len;
+    if (p == end)
+        return 0;   /* EOF */
+
+    eol = memchr(p, '\n', (size_t)(end-p));
+    if (eol) {
+        *eol = '\0';
+        preproc_raw->pos = eol+1;
+    } else
+        preproc_raw->pos = end;
 
     /* Strip the line ending */
-    buf[strcspn(buf, "\r\n")] = '\0';
+    line->len = strcspn(p, "\r");
+    p[line->len] = '\0';
+
+    line->text = p;
+    line->persistent = 1;
+    return 1;
+}
 
-    return buf;
+static char *
+raw_preproc_get_line(yasm_preproc *preproc)
+{
+    yasm_preproc_line line;
+
+    if (!raw_preproc_get_line_ref(preproc, &line))
+        return NULL;
+    return yasm__xstrdup(line.text);
 }
 
 static size_t
@@ -165,5 +219,8 @@ yasm_preproc_module yasm_raw_LTX_preproc = {
     raw_preproc_predefine_macro,
     raw_preproc_undefine_macro,
     raw_preproc_define_builtin,
-    raw_preproc_add_standard
+    raw_preproc_add_standard,
+    raw_preproc_get_line_ref,
+    NULL,
+    raw_preproc_create_stream
 };
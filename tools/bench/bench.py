@@ -0,0 +1,437 @@
+#!/usr/bin/env python
+# Throughput benchmark for yasm using synthetic large inputs.
+#
+#  Copyright (C) 2026  Yasm Developers
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+# Each benchmark generator writes a synthetic source for a given parser
+# and returns the number of instructions/data items it emitted.  The
+# generated files are cached in the work directory, then every
+# (benchmark, parser, objfmt) combination is assembled and timed.  Sizes
+# default to the full stress sizes; use --scale to shrink them for quick
+# runs.
+#
+# Peak RSS is measured in the child by GNU time (-f %M) when it is found;
+# wait4() accounting from this script would also count the memory of the
+# forked Python process before it executed yasm.  Without GNU time the
+# column is left empty.
+#
+# Usage: bench.py [--yasm=path] [--workdir=dir] [--scale=factor]
+#                 [--runs=n] [--json] [--list] [benchmark...]
+
+from __future__ import print_function
+
+import json
+import os
+import random
+import subprocess
+import sys
+import time
+
+
+# Objfmts tried for each benchmark (filtered by what each supports).
+OBJFMTS = ["bin", "elf64", "win64", "macho64"]
+PARSERS = ["nasm", "gas"]
+
+AVX_OPS = ["vaddps", "vmulps", "vsubps", "vxorps", "vandps", "vmaxps"]
+GPRS = ["rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"]
+
+benchmarks = {}
+
+def benchmark(name, count, parsers=PARSERS, objfmts=OBJFMTS, args=()):
+    """Register a generator: gen(f, parser, n, workdir) -> insn count."""
+    def register(gen):
+        benchmarks[name] = dict(gen=gen, count=count, parsers=parsers,
+                                objfmts=objfmts, args=list(args))
+        return gen
+    return register
+
+def prologue(f, parser, section="text"):
+    if parser == "nasm":
+        f.write("bits 64\nsection .%s\n" % section)
+    else:
+        f.write(".code64\n.section .%s\n" % section)
+
+@benchmark("avx", 1000000)
+def gen_avx(f, parser, n, workdir):
+    prologue(f, parser)
+    for i in range(n):
+        op = AVX_OPS[i % len(AVX_OPS)]
+        a, b, c = i % 16, (i * 7) % 16, (i * 11) % 16
+        if i % 4 == 3:
+            base = GPRS[i % len(GPRS)]
+            disp = (i * 8) % 4096
+            if parser == "nasm":
+                f.write("%s ymm%d, ymm%d, [%s+%d]\n" % (op, a, b, base, disp))
+            else:
+                f.write("%s %d(%%%s), %%ymm%d, %%ymm%d\n"
+                        % (op, disp, base, b, a))
+        elif parser == "nasm":
+            f.write("%s ymm%d, ymm%d, ymm%d\n" % (op, a, b, c))
+        else:
+            f.write("%s %%ymm%d, %%ymm%d, %%ymm%d\n" % (op, c, b, a))
+    return n
+
+@benchmark("sections", 100000, objfmts=["elf64", "win64"])
+def gen_sections(f, parser, n, workdir):
+    for i in range(n):
+        if parser == "nasm":
+            f.write("section .text.s%d\nbits 64\nmov eax, %d\nret\n" % (i, i))
+        else:
+            f.write(".section .text.s%d\n.code64\nmovl $%d, %%eax\nret\n"
+                    % (i, i))
+    return 2 * n
+
+@benchmark("symbols", 50000)
+def gen_symbols(f, parser, n, workdir):
+    prologue(f, parser)
+    for i in range(n):
+        if parser == "nasm":
+            f.write("sym%d:\n  lea rax, [rel sym%d]\n" % (i, (i * 31) % n))
+        else:
+            f.write("sym%d:\n  lea sym%d(%%rip), %%rax\n" % (i, (i * 31) % n))
+    return n
+
+@benchmark("locallabels", 200000)
+def gen_locallabels(f, parser, n, workdir):
+    prologue(f, parser)
+    for i in range(n // 4):
+        if parser == "nasm":
+            f.write("func%d:\n.loop:\n  dec ecx\n  jnz .loop\n"
+                    ".done:\n  jmp .done\n" % i)
+        else:
+            f.write("func%d:\n1:\n  dec %%ecx\n  jnz 1b\n"
+                    "2:\n  jmp 2b\n" % i)
+    return 3 * (n // 4)
+
+@benchmark("macro", 200000, parsers=["nasm"])
+def gen_macro(f, parser, n, workdir):
+    # nasm-pp does not allow a macro to invoke itself, so build a deep chain
+    # of distinct macros, each expanding the next
+    depth = 200
+    f.write("bits 64\nsection .text\n")
+    for i in range(depth):
+        f.write("%%macro lvl%d 1\n  add eax, %%1\n" % i)
+        if i + 1 < depth:
+            f.write("  lvl%d %%1+1\n" % (i + 1))
+        f.write("%endmacro\n")
+    calls = max(1, n // depth)
+    for i in range(calls):
+        f.write("lvl0 %d\n" % i)
+    return calls * depth
+
+@benchmark("times", 64 * 1024 * 1024)
+def gen_times(f, parser, n, workdir):
+    blob = os.path.join(workdir, "blob.bin")
+    if not os.path.exists(blob) or os.path.getsize(blob) != 1024 * 1024:
+        with open(blob, "wb") as b:
+            rnd = random.Random(1)
+            b.write(bytearray(rnd.randint(0, 255)
+                              for i in range(1024 * 1024)))
+    prologue(f, parser, "data")
+    chunks = max(1, n // (2 * 1024 * 1024))
+    for i in range(chunks):
+        if parser == "nasm":
+            f.write("times %d db 0x%02x\n" % (1024 * 1024, i & 0xff))
+            f.write('incbin "%s"\n' % blob)
+        else:
+            f.write(".fill %d, 1, 0x%02x\n" % (1024 * 1024, i & 0xff))
+            f.write('.incbin "%s"\n' % blob)
+    return chunks * 2 * 1024 * 1024
+
+@benchmark("literals", 1000000)
+def gen_literals(f, parser, n, workdir):
+    prologue(f, parser, "data")
+    rnd = random.Random(2)
+    per = 8
+    directive = "dd" if parser == "nasm" else ".long"
+    for i in range(n // per):
+        vals = ["0x%08x" % rnd.getrandbits(32) for j in range(per // 2)]
+        vals += ["%d" % rnd.getrandbits(31) for j in range(per // 2)]
+        f.write("%s %s\n" % (directive, ", ".join(vals)))
+    return (n // per) * per
+
+@benchmark("numtable", 1000000)
+def gen_numtable(f, parser, n, workdir):
+    # 64-bit data table mixing every literal radix, as in generated lookup
+    # tables and test vectors
+    prologue(f, parser, "data")
+    rnd = random.Random(4)
+    per = 8
+    for i in range(n // per):
+        vals = []
+        for j in range(per):
+            v = rnd.getrandbits(64 if j % 2 else 24)
+            radix = j % 4
+            if radix == 0:
+                vals.append("%d" % v)
+            elif parser == "nasm":
+                vals.append(["%sb" % bin(v)[2:], "%oq" % v,
+                             "0x%x" % v][radix - 1])
+            else:
+                vals.append(["0b%s" % bin(v)[2:], "0%o" % v,
+                             "0x%x" % v][radix - 1])
+        f.write("%s %s\n" % ("dq" if parser == "nasm" else ".quad",
+                              ", ".join(vals)))
+    return (n // per) * per
+
+@benchmark("floats", 500000)
+def gen_floats(f, parser, n, workdir):
+    # filter coefficient style tables of single and double constants
+    prologue(f, parser, "data")
+    rnd = random.Random(5)
+    per = 8
+    for i in range(n // per):
+        vals = ["%.9g" % rnd.uniform(-2.0, 2.0) for j in range(per // 2)]
+        vals += ["%d.%016de%d" % (rnd.randint(1, 9), rnd.getrandbits(53),
+                                  rnd.randint(-30, 30))
+                 for j in range(per // 2)]
+        if parser == "nasm":
+            f.write("dd %s\ndq %s\n" % (", ".join(vals[:per // 2]),
+                                        ", ".join(vals[per // 2:])))
+        else:
+            f.write(".float %s\n.double %s\n" % (", ".join(vals[:per // 2]),
+                                                 ", ".join(vals[per // 2:])))
+    return (n // per) * per
+
+@benchmark("dwarf", 200000, parsers=["gas"], objfmts=["elf64"],
+           args=["-g", "dwarf2"])
+def gen_dwarf(f, parser, n, workdir):
+    f.write(".code64\n.text\n")
+    nfiles = 64
+    for i in range(nfiles):
+        f.write('.file %d "src%d.c"\n' % (i + 1, i))
+    for i in range(n):
+        if i % 50 == 0:
+            f.write(".globl fn%d\n.type fn%d, @function\nfn%d:\n" % (i, i, i))
+        f.write(".loc %d %d %d\n" % (i % nfiles + 1, i // nfiles + 1, i % 80))
+        f.write("addq $%d, %%rax\n" % (i & 0x7f))
+    return n
+
+@benchmark("jumps", 200000)
+def gen_jumps(f, parser, n, workdir):
+    prologue(f, parser)
+    rnd = random.Random(3)
+    for i in range(n):
+        # mix of short and near jumps in both directions so the optimizer
+        # has to iterate spans across the whole section
+        tgt = max(0, min(n - 1, i + rnd.randint(-200, 200)))
+        if parser == "nasm":
+            f.write("L%d:\n  jnz L%d\n" % (i, tgt))
+            if i % 7 == 0:
+                f.write("  times %d nop\n" % rnd.randint(1, 40))
+        else:
+            f.write("L%d:\n  jnz L%d\n" % (i, tgt))
+            if i % 7 == 0:
+                f.write("  .fill %d, 1, 0x90\n" % rnd.randint(1, 40))
+    return n
+
+def reg32(reg):
+    return reg + "d" if reg[1].isdigit() else "e" + reg[1:]
+
+@benchmark("memops", 1000000, objfmts=["bin", "elf64", "win64"])
+def gen_memops(f, parser, n, workdir):
+    prologue(f, parser)
+    f.write("tbl:\n")
+    for i in range(n):
+        # [base], [base+disp], [base+index*scale+disp] and a symbolic
+        # displacement; every fifth uses 32-bit address registers
+        base = GPRS[i % len(GPRS)]
+        index = GPRS[(i * 5 + 3) % len(GPRS)]
+        scale = (1, 2, 4, 8)[i % 4]
+        disp = (i * 24) % 2048
+        if i % 5 == 4:
+            base, index = reg32(base), reg32(index)
+        form = i % 4
+        if parser == "nasm":
+            if form == 0:
+                ea = "[%s]" % base
+            elif form == 1:
+                ea = "[%s+%d]" % (base, disp)
+            elif form == 2:
+                ea = "[%s+%s*%d+%d]" % (base, index, scale, disp)
+            else:
+                ea = "[%s+%s*%d+tbl+%d]" % (base, index, scale, disp)
+            f.write("mov rax, %s\n" % ea if i % 2 else
+                    "add %s, edx\n" % ea.replace("[", "dword ["))
+        else:
+            if form == 0:
+                ea = "(%%%s)" % base
+            elif form == 1:
+                ea = "%d(%%%s)" % (disp, base)
+            elif form == 2:
+                ea = "%d(%%%s,%%%s,%d)" % (disp, base, index, scale)
+            else:
+                ea = "tbl+%d(%%%s,%%%s,%d)" % (disp, base, index, scale)
+            f.write("movq %s, %%rax\n" % ea if i % 2 else
+                    "addl %%edx, %s\n" % ea)
+    return n
+
+def find_gnu_time():
+    """Return the path of a GNU time that supports -f %M, or None."""
+    for path in ["/usr/bin/time", "/usr/local/bin/time",
+                 "/usr/local/bin/gtime", "/opt/local/bin/gtime"]:
+        if not os.path.exists(path):
+            continue
+        try:
+            proc = subprocess.Popen([path, "-f", "%M", "true"],
+                                    stdout=subprocess.PIPE,
+                                    stderr=subprocess.PIPE)
+            out, err = proc.communicate()
+        except OSError:
+            continue
+        if proc.returncode == 0 and err.strip().isdigit():
+            return path
+    return None
+
+def run_yasm(cmd, gnu_time, rssfile):
+    """Run a command, returning (status, wall time, peak RSS in KiB or None,
+    stderr output)."""
+    if gnu_time:
+        cmd = [gnu_time, "-f", "%M", "-o", rssfile] + cmd
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE)
+    out, err = proc.communicate()
+    elapsed = time.time() - start
+    maxrss = None
+    if gnu_time:
+        try:
+            with open(rssfile) as f:
+                # GNU time prefixes a note if the command failed
+                maxrss = int(f.read().split()[-1])
+        except (IOError, ValueError, IndexError):
+            pass
+    return proc.returncode, elapsed, maxrss, err
+
+def main(argv):
+    yasm = "./yasm"
+    workdir = "bench-work"
+    scale = 1.0
+    runs = 1
+    as_json = False
+    only = []
+    for arg in argv:
+        if arg.startswith("--yasm="):
+            yasm = arg[7:]
+        elif arg.startswith("--workdir="):
+            workdir = arg[10:]
+        elif arg.startswith("--scale="):
+            scale = float(arg[8:])
+        elif arg.startswith("--runs="):
+            runs = int(arg[7:])
+        elif arg == "--json":
+            as_json = True
+        elif arg == "--list":
+            for name in sorted(benchmarks):
+                b = benchmarks[name]
+                print("%-12s %10d  parsers=%s objfmts=%s"
+                      % (name, b["count"], ",".join(b["parsers"]),
+                         ",".join(b["objfmts"])))
+            return 0
+        elif arg.startswith("-"):
+            print("unknown option `%s'" % arg, file=sys.stderr)
+            return 1
+        else:
+            only.append(arg)
+
+    for name in only:
+        if name not in benchmarks:
+            print("unknown benchmark `%s'" % name, file=sys.stderr)
+            return 1
+
+    if not os.path.isdir(workdir):
+        os.makedirs(workdir)
+    gnu_time = find_gnu_time()
+
+    results = []
+    failures = 0
+    if not as_json:
+        print("%-12s %-5s %-8s %10s %9s %9s %12s %10s"
+              % ("benchmark", "pars", "objfmt", "input MB", "time s",
+                 "MB/s", "insns/s", "peak KiB"))
+    for name in sorted(benchmarks):
+        if only and name not in only:
+            continue
+        b = benchmarks[name]
+        n = max(1, int(b["count"] * scale))
+        for parser in b["parsers"]:
+            src = os.path.join(workdir, "%s-%s-%d.asm" % (name, parser, n))
+            meta = src + ".count"
+            if not os.path.exists(src) or not os.path.exists(meta):
+                with open(src, "w") as f:
+                    count = b["gen"](f, parser, n, workdir)
+                with open(meta, "w") as f:
+                    f.write("%d\n" % count)
+            with open(meta) as f:
+                count = int(f.read())
+            size = os.path.getsize(src)
+
+            for objfmt in b["objfmts"]:
+                out = os.path.join(workdir, "out.o")
+                statsfile = os.path.join(workdir, "stats.json")
+                rssfile = os.path.join(workdir, "rss.txt")
+                cmd = [yasm, "-p", parser, "-f", objfmt, "-o", out,
+                       "--stats-json", "--stats-file=" + statsfile]
+                cmd += b["args"] + [src]
+                best = None
+                for r in range(runs):
+                    status, elapsed, maxrss, err = run_yasm(cmd, gnu_time,
+                                                            rssfile)
+                    if status != 0:
+                        break
+                    if best is None or elapsed < best[0]:
+                        best = (elapsed, maxrss)
+                if status != 0:
+                    failures += 1
+                    msg = err.decode("utf-8", "replace").strip()
+                    print("%-12s %-5s %-8s FAILED: %s"
+                          % (name, parser, objfmt, msg.split("\n")[0]),
+                          file=sys.stderr)
+                    continue
+                elapsed, maxrss = best
+                res = dict(benchmark=name, parser=parser, objfmt=objfmt,
+                           input_bytes=size, insns=count, time=elapsed,
+                           mb_per_s=size / 1048576.0 / max(elapsed, 1e-9),
+                           insns_per_s=count / max(elapsed, 1e-9),
+                           peak_rss_kib=maxrss)
+                try:
+                    with open(statsfile) as f:
+                        res["stats"] = json.load(f)
+                except (IOError, ValueError):
+                    pass
+                results.append(res)
+                if not as_json:
+                    print("%-12s %-5s %-8s %10.2f %9.3f %9.2f %12.0f %10s"
+                          % (name, parser, objfmt, size / 1048576.0, elapsed,
+                             res["mb_per_s"], res["insns_per_s"],
+                             maxrss is None and "-" or maxrss))
+                    sys.stdout.flush()
+
+    if as_json:
+        json.dump(results, sys.stdout, indent=2, sort_keys=True)
+        print()
+    return failures and 1 or 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
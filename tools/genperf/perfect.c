@@ -915,6 +915,11 @@ void findhash(
           tabq  = (qstuff *)yasm_xmalloc((size_t)(sizeof(qstuff)*(*blen+1)));
           --trysalt;               /* we know this salt got distinct (A,B) */
         }
+        else if (bad_perfect < RETRY_HEX)
+        {
+          /* Small key sets can need several salts at the largest tab[] */
+          continue;
+        }
         else
         {
           fprintf(stderr, "fatal error: Cannot perfect hash: cannot build tab[]\n");
@@ -0,0 +1,232 @@
+# Python bindings for Yasm: Pyrex input file for assemble.h
+#
+#  Copyright (C) 2026  Yasm Developers
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+cdef extern from "Python.h":
+    cdef enum:
+        PyBUF_WRITABLE
+        PyBUF_FORMAT
+        PyBUF_ND
+        PyBUF_STRIDES
+
+# Declared separately from _yasm.pxi so that it can be called without the
+# GIL.
+cdef extern from "libyasm/assemble.h":
+    cdef int _assemble_collect_nogil "yasm_assemble_collect" \
+        (yasm_assemble_options *opts, char *src, size_t len,
+         yasm_assembly *result) nogil
+
+cdef char _empty_buffer[1]
+
+cdef class _AssemblyBuffer:
+    """Read-only view of an array held by an Assembly, exported through the
+    buffer protocol without copying."""
+    cdef object owner
+    cdef char *buf
+    cdef Py_ssize_t shape[1]
+    cdef Py_ssize_t strides[1]
+    cdef char *format
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("assembly results are read-only")
+        buffer.buf = self.buf
+        buffer.obj = self
+        buffer.len = self.shape[0] * self.strides[0]
+        buffer.readonly = 1
+        buffer.itemsize = self.strides[0]
+        buffer.format = NULL
+        if flags & PyBUF_FORMAT:
+            buffer.format = self.format
+        buffer.ndim = 1
+        buffer.shape = NULL
+        if flags & PyBUF_ND:
+            buffer.shape = self.shape
+        buffer.strides = NULL
+        if flags & PyBUF_STRIDES:
+            buffer.strides = self.strides
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+cdef object _assembly_view(object owner, void *buf, Py_ssize_t count,
+                            Py_ssize_t itemsize, char *format):
+    cdef _AssemblyBuffer b
+    b = _AssemblyBuffer()
+    b.owner = owner
+    if buf == NULL or count == 0:
+        b.buf = _empty_buffer
+        count = 0
+    else:
+        b.buf = <char *>buf
+    b.shape[0] = count
+    b.strides[0] = itemsize
+    b.format = format
+    return memoryview(b)
+
+# Symbol kinds (the kind field of symbol_table entries)
+SYM_UNDEF = YASM_ASSEMBLY_SYM_UNDEF
+SYM_LABEL = YASM_ASSEMBLY_SYM_LABEL
+SYM_EQU = YASM_ASSEMBLY_SYM_EQU
+
+cdef class AssemblySection:
+    """A section of an Assembly.  data is a memoryview of the section
+    contents within the output (empty for BSS sections), and relocs a
+    memoryview of its relocations with format "Ll" (offset, index of the
+    symbol in Assembly.symbol_table or -1)."""
+    cdef readonly object name
+    cdef readonly object data
+    cdef readonly unsigned long size
+    cdef readonly object relocs
+
+cdef class Assembly:
+    """Results of assemble().  The output and the tables are exported as
+    read-only memoryviews into the assembler's own arrays:
+
+      output         object or flat binary (format "B")
+      section_table  name, offset, len, size, first_reloc, num_relocs
+                     (format "LLLLLL"; name is an offset into names)
+      symbol_table   name, value, section, visibility, kind
+                     (format "LLlLL")
+      reloc_table    offset, symbol (format "Ll")
+      names          NUL-terminated names (format "B")
+
+    Struct-formatted views can be decoded in bulk with struct.iter_unpack()
+    or numpy.frombuffer()."""
+    cdef yasm_assembly result
+    cdef readonly object output
+    cdef readonly object section_table
+    cdef readonly object symbol_table
+    cdef readonly object reloc_table
+    cdef readonly object names
+    cdef readonly object messages
+    cdef object _sections
+
+    def __cinit__(self):
+        yasm_assembly_init(&self.result)
+        self._sections = None
+
+    def __dealloc__(self):
+        yasm_assembly_free(&self.result)
+
+    cdef _finish(self):
+        self.output = _assembly_view(self, self.result.output.data,
+                                     self.result.output.len, 1, "B")
+        self.section_table = _assembly_view(self, self.result.sections,
+            self.result.num_sections, sizeof(yasm_assembly_section),
+            "LLLLLL")
+        self.symbol_table = _assembly_view(self, self.result.symbols,
+            self.result.num_symbols, sizeof(yasm_assembly_symbol), "LLlLL")
+        self.reloc_table = _assembly_view(self, self.result.relocs,
+            self.result.num_relocs, sizeof(yasm_assembly_reloc), "Ll")
+        self.names = _assembly_view(self, self.result.names,
+                                    self.result.names_len, 1, "B")
+        if self.result.messages_len:
+            self.messages = self.result.messages
+        else:
+            self.messages = ""
+
+    cdef object _name(self, unsigned long offset):
+        return <char *>(self.result.names + offset)
+
+    property sections:
+        """List of AssemblySection, in object order."""
+        def __get__(self):
+            cdef AssemblySection s
+            cdef yasm_assembly_section *sect
+            cdef unsigned long i
+            if self._sections is None:
+                sections = []
+                for i in range(self.result.num_sections):
+                    sect = &self.result.sections[i]
+                    s = AssemblySection()
+                    s.name = self._name(sect.name)
+                    s.data = self.output[sect.offset:sect.offset+sect.len]
+                    s.size = sect.size
+                    s.relocs = self.reloc_table[sect.first_reloc:
+                        sect.first_reloc+sect.num_relocs]
+                    sections.append(s)
+                self._sections = sections
+            return self._sections
+
+    property symbols:
+        """Dictionary mapping symbol names to (value, section index or -1,
+        visibility, kind) tuples."""
+        def __get__(self):
+            cdef yasm_assembly_symbol *sym
+            cdef unsigned long i
+            symbols = {}
+            for i in range(self.result.num_symbols):
+                sym = &self.result.symbols[i]
+                symbols[self._name(sym.name)] = (sym.value, sym.section,
+                                                  sym.visibility, sym.kind)
+            return symbols
+
+def assemble(source, objfmt="bin", arch="x86", machine=None, parser="nasm",
+             preproc=None, dbgfmt="null", filename="-", warning_error=False):
+    """Assemble source (a string) in memory and return an Assembly.  The GIL
+    is released while assembling, so several threads may assemble at once.
+    Assemblies with arch="lc3b" or a dbgfmt other than "null" still run one
+    at a time, as do all assemblies if yasm was built without thread
+    support; see yasm_assemble_buffer() in libyasm/assemble.h.
+    Raises YasmError with the error messages if assembly fails."""
+    cdef yasm_assemble_options opts
+    cdef Assembly assembly
+    cdef char *src
+    cdef size_t srclen
+    cdef int err
+
+    yasm_assemble_options_init(&opts)
+    # Keep the encoded strings referenced while the GIL is released
+    keywords = []
+    for value in (objfmt, arch, machine, parser, preproc, dbgfmt, filename):
+        if isinstance(value, unicode):
+            value = value.encode()
+        keywords.append(value)
+    objfmt, arch, machine, parser, preproc, dbgfmt, filename = keywords
+    opts.objfmt = objfmt
+    opts.arch = arch
+    if machine is not None:
+        opts.machine = machine
+    opts.parser = parser
+    if preproc is not None:
+        opts.preproc = preproc
+    opts.dbgfmt = dbgfmt
+    opts.src_filename = filename
+    opts.warning_error = bool(warning_error)
+
+    if isinstance(source, unicode):
+        source = source.encode()
+    src = source
+    srclen = len(source)
+
+    assembly = Assembly()
+    with nogil:
+        err = _assemble_collect_nogil(&opts, src, srclen, &assembly.result)
+    assembly._finish()
+    if err:
+        raise YasmError(assembly.messages)
+    return assembly
@@ -13,6 +13,7 @@ import test_intnum
 import test_symrec
 import test_bytecode
 import test_expr
+import test_assemble
 
 class Result(unittest.TestResult):
 
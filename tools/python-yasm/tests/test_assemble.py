@@ -0,0 +1,106 @@
+from tests import TestCase, add
+from yasm import assemble, YasmError, SYM_LABEL, SYM_EQU, SYM_UNDEF
+import struct
+import sys
+import threading
+
+# Names, messages and section contents are byte strings.
+def b(s):
+    return s.encode("ascii")
+
+SOURCE = """[bits 64]
+[extern ext]
+[global start]
+count equ 5
+[section .text]
+start:
+  call ext
+  jmp start
+[section .data]
+data1: dq start, count
+[section .bss]
+buf: resb 64
+"""
+
+class TAssemble(TestCase):
+    def test_bin(self):
+        result = assemble("[bits 32]\nmov eax, 1\nret\n", preproc="raw")
+        self.assertEquals(result.output.tobytes(),
+                          struct.pack("<BIB", 0xb8, 1, 0xc3))
+        self.assertEquals(len(result.sections), 1)
+        self.assertEquals(result.sections[0].data.tobytes(),
+                          result.output.tobytes())
+
+    def test_tables(self):
+        result = assemble(SOURCE, objfmt="elf64", preproc="raw")
+        names = [s.name for s in result.sections]
+        self.assertEquals(names, [b(".text"), b(".data"), b(".bss")])
+
+        text, data, bss = result.sections
+        self.assertEquals(text.data.tobytes()[:1], struct.pack("B", 0xe8))
+        self.assertEquals(text.size, 7)
+        self.assertEquals(len(data.data), 16)
+        self.assertEquals(len(bss.data), 0)
+        self.assertEquals(bss.size, 64)
+
+        symbols = result.symbols
+        self.assertEquals(symbols[b("start")][0:2], (0, 0))
+        self.assertEquals(symbols[b("start")][3], SYM_LABEL)
+        self.assertEquals(symbols[b("count")][0], 5)
+        self.assertEquals(symbols[b("count")][3], SYM_EQU)
+        self.assertEquals(symbols[b("ext")][1], -1)
+        self.assertEquals(symbols[b("ext")][3], SYM_UNDEF)
+        self.assertEquals(symbols[b("buf")][1], 2)
+
+        # call ext, then data1: dq start
+        self.assertEquals(len(text.relocs), 1)
+        self.assertEquals(len(data.relocs), 1)
+        table = result.symbol_table
+        self.assertEquals(len(table), len(symbols))
+        offset, sym = struct.unpack("Ll", text.relocs.tobytes())
+        self.assertEquals(offset, 1)
+        name = struct.unpack("LLlLL", table[sym:sym+1].tobytes())[0]
+        self.assertEquals(result.names.tobytes()[name:name+3], b("ext"))
+
+    def test_readonly(self):
+        result = assemble("db 1, 2, 3\n", preproc="raw")
+        self.assert_(result.output.readonly)
+        self.assertEquals(result.output.format, "B")
+        self.assertEquals(result.reloc_table.format, "Ll")
+        self.assertEquals(len(result.reloc_table), 0)
+
+    def test_error(self):
+        self.assertRaises(YasmError, assemble, "mov eax, undefined_sym\n",
+                          preproc="raw")
+        try:
+            assemble("mov eax, undefined_sym\n", preproc="raw")
+        except YasmError:
+            err = sys.exc_info()[1]
+            self.assert_(b("undefined symbol") in err.args[0])
+
+    def test_warning(self):
+        result = assemble("[bits 64]\nadd eax, 0x1ffffffff\n",
+                          preproc="raw")
+        self.assert_(b("warning:") in result.messages)
+        self.assertRaises(YasmError, assemble,
+                          "[bits 64]\nadd eax, 0x1ffffffff\n",
+                          preproc="raw", warning_error=True)
+
+    def test_threads(self):
+        expected = assemble(SOURCE, objfmt="macho64",
+                            preproc="raw").output.tobytes()
+        results = []
+        def worker():
+            for i in range(20):
+                results.append(assemble(SOURCE, objfmt="macho64",
+                                        preproc="raw").output.tobytes())
+        threads = [threading.Thread(target=worker) for i in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEquals(len(results), 80)
+        for output in results:
+            self.assertEquals(output, expected)
+
+add(TAssemble)
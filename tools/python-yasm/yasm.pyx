@@ -38,6 +38,10 @@ Section objects encapsulate an object file section, including the section
 name, any Bytecode objects contained within that section, and other
 information.
 
+The assemble() function assembles a complete source string in memory, and
+returns the output, sections, symbols and relocations as memoryviews of the
+assembler's own arrays.
+
 """
 
 cdef extern from "Python.h":
@@ -119,6 +123,8 @@ include "value.pxi"
 
 include "bytecode.pxi"
 
+include "assemble.pxi"
+
 cdef __initialize():
     BitVector_Boot()
     yasm_intnum_initialize()
@@ -119,6 +119,17 @@
 
 #include <libyasm/compat-queue.h>
 
+/* Parallel assembly needs threads, per-thread storage for the few pieces of
+ * global libyasm state used by section processing, and in-memory streams.
+ */
+#if defined(HAVE_PTHREAD) && defined(HAVE___THREAD) && \
+    defined(HAVE_OPEN_MEMSTREAM)
+# define YASM_THREADS
+# define YASM_THREAD_LOCAL              __thread
+#else
+# define YASM_THREAD_LOCAL
+#endif
+
 #ifdef WITH_DMALLOC
 # include <dmalloc.h>
 # define yasm__xstrdup(str)             xstrdup(str)